@@ -1,4 +1,4 @@
-QT += core gui network
+QT += core gui network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -31,7 +31,35 @@ SOURCES += \
     src/buyoutmanager.cpp \
     src/util.cpp \
     src/shop.cpp \
-    src/tabbuyoutsdialog.cpp
+    src/tabbuyoutsdialog.cpp \
+    src/ratelimiter.cpp \
+    src/itemsstore.cpp \
+    src/itemssnapshot.cpp \
+    src/stringpool.cpp \
+    src/bitmap.cpp \
+    src/itemsindex.cpp \
+    src/rangekernels.cpp \
+    src/trigramindex.cpp \
+    src/modtemplates.cpp \
+    src/searchrunner.cpp \
+    src/columnwidths.cpp \
+    src/hash128.cpp \
+    src/perfpanel.cpp \
+    src/perfstats.cpp \
+    src/pixmaplru.cpp \
+    src/itemicons.cpp \
+    src/icondelegate.cpp \
+    src/stashgrid.cpp \
+    src/stashscanner.cpp \
+    src/stashtransport.cpp \
+    src/asynclogdestination.cpp \
+    src/sessionmanager.cpp \
+    src/itemsdelta.cpp \
+    src/buyoutstore.cpp \
+    src/tabbuyoutsmodel.cpp \
+    src/itemarena.cpp \
+    src/queryserver.cpp \
+    src/headlesssession.cpp
 
 HEADERS += \
     src/item.h \
@@ -52,7 +80,37 @@ HEADERS += \
     src/util.h \
     src/shop.h \
     src/tabbuyoutsdialog.h \
-    src/version.h
+    src/version.h \
+    src/ratelimiter.h \
+    src/itemsstore.h \
+    src/itemssnapshot.h \
+    src/stringpool.h \
+    src/bitmap.h \
+    src/itemsindex.h \
+    src/rangekernels.h \
+    src/trigramindex.h \
+    src/modtemplates.h \
+    src/searchrunner.h \
+    src/columnwidths.h \
+    src/hash128.h \
+    src/hashkeymap.h \
+    src/perfpanel.h \
+    src/perfstats.h \
+    src/pixmaplru.h \
+    src/itemicons.h \
+    src/icondelegate.h \
+    src/stashgrid.h \
+    src/stashscanner.h \
+    src/stashtransport.h \
+    src/asynclogdestination.h \
+    src/sessionmanager.h \
+    src/itemsdelta.h \
+    src/buyoutstore.h \
+    src/tabbuyoutsmodel.h \
+    src/itemarena.h \
+    src/application.h \
+    src/queryserver.h \
+    src/headlesssession.h
 
 FORMS += \
     forms/mainwindow.ui \
@@ -0,0 +1,408 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Benchmarks of the hot paths of a refresh and a search. Run with e.g.
+ *   acquisition-bench -o results.xml,xml
+ * (or -csv) to get results that can be tracked over time. Every benchmark
+ * runs for 1k, 10k and 50k items, see fixtures.h for where they come from.
+ */
+
+#include <QDir>
+#include <QTemporaryDir>
+#include <QVBoxLayout>
+#include <QWidget>
+#include <QtTest/QtTest>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include "jsoncpp/json.h"
+
+#include "application.h"
+#include "buyoutmanager.h"
+#include "buyoutstore.h"
+#include "datamanager.h"
+#include "filters.h"
+#include "fixtures.h"
+#include "hash128.h"
+#include "item.h"
+#include "items_model.h"
+#include "itemsindex.h"
+#include "search.h"
+#include "shop.h"
+#include "stashscanner.h"
+#include "util.h"
+
+namespace {
+
+const int SIZES[] = { 1000, 10000, 50000 };
+
+struct Dataset {
+    std::vector<QByteArray> responses;
+    std::vector<Json::Value> json;
+    Items items;
+    std::shared_ptr<ItemsIndex> index;
+};
+
+// Just the managers Shop needs, with the database in a temporary directory
+class BenchApplication : public Application {
+public:
+    explicit BenchApplication(const std::string &directory):
+        league_("Bench"),
+        email_("bench")
+    {
+        data_manager_ = new DataManager(this, directory);
+        buyout_manager_ = new BuyoutManager(this);
+    }
+    ~BenchApplication() {
+        delete buyout_manager_;
+        delete data_manager_;
+    }
+    const std::string &league() const { return league_; }
+    const std::string &email() const { return email_; }
+    DataManager *data_manager() const { return data_manager_; }
+    BuyoutManager *buyout_manager() const { return buyout_manager_; }
+    // nothing is submitted
+    QNetworkAccessManager *logged_in_nm() const { return nullptr; }
+    const std::shared_ptr<const ItemsIndex> &items_index() const { return items_index_; }
+    const std::shared_ptr<Item> &current_item() const { return current_item_; }
+    void set_items_index(const std::shared_ptr<const ItemsIndex> &index) { items_index_ = index; }
+private:
+    std::string league_, email_;
+    DataManager *data_manager_;
+    BuyoutManager *buyout_manager_;
+    std::shared_ptr<const ItemsIndex> items_index_;
+    std::shared_ptr<Item> current_item_;
+};
+
+// Same work as ItemsManager does in its parse pool for a single response
+void ParseResponse(const QByteArray &bytes, int tab, Items *items) {
+    std::vector<std::pair<const char*, size_t>> slices;
+    StashScanner scanner(bytes.constData(), bytes.size());
+    scanner.Scan([&slices](const char *begin, size_t size) { slices.emplace_back(begin, size); });
+    auto arena = std::make_shared<ItemArena>();
+    Json::Reader reader;
+    for (auto &slice : slices) {
+        Json::Value item;
+        if (reader.parse(slice.first, slice.first + slice.second, item, false))
+            items->push_back(Item::Create(arena, item, std::string(slice.first, slice.second), tab, "Bench"));
+    }
+}
+
+}
+
+class Bench : public QObject {
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // not a benchmark, item hashes and shop keys are compared across both forms
+    void HashDigests();
+
+    void ParseResponses_data() { AddSizes(); }
+    void ParseResponses();
+    void ConstructItems_data() { AddSizes(); }
+    void ConstructItems();
+    void Md5_data() { AddSizes(); }
+    void Md5();
+    void ComputeHash_data() { AddSizes(); }
+    void ComputeHash();
+    void BuildIndex_data() { AddSizes(); }
+    void BuildIndex();
+    void FilterItems_data();
+    void FilterItems();
+    void ModelData_data() { AddSizes(); }
+    void ModelData();
+    void ShopUpdate_data();
+    void ShopUpdate();
+    void WriteBuyouts_data() { AddSizes(); }
+    void WriteBuyouts();
+    void LoadBuyouts_data() { AddSizes(); }
+    void LoadBuyouts();
+private:
+    void AddSizes();
+    const Dataset &Data(int size);
+    static Buyout BenchBuyout(int i);
+    std::vector<BuyoutRecord> Buyouts(int size);
+    // a database of its own per size, so that loads only see the rows of that size
+    std::string BuyoutsFile(int size);
+
+    std::map<int, Dataset> datasets_;
+    QTemporaryDir *db_dir_;
+    BenchApplication *app_;
+    QWidget *form_;
+    // same kinds of filters as the search form, setup fills in their data
+    std::vector<Filter*> filters_;
+    std::vector<std::pair<std::string, std::function<void(FilterData*)>>> setups_;
+};
+
+void Bench::initTestCase() {
+    db_dir_ = new QTemporaryDir;
+    app_ = new BenchApplication(db_dir_->path().toStdString());
+
+    form_ = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(form_);
+    auto add = [this](const std::string &name, Filter *filter, std::function<void(FilterData*)> setup) {
+        filters_.push_back(filter);
+        setups_.emplace_back(name, setup);
+    };
+    add("name", new NameSearchFilter(layout), [](FilterData *data) { data->text_query = "storm"; });
+    add("mods text", new NameSearchFilter(layout, TEXT_MODS), [](FilterData *data) { data->text_query = "resistance"; });
+    add("property", new SimplePropertyFilter(layout, "Armour"), [](FilterData *data) {
+        data->min_filled = true;
+        data->min = 500;
+    });
+    add("numeric attribute", new NumericAttributeFilter(layout, ATTRIBUTE_DPS, "DPS"), [](FilterData *data) {
+        data->min_filled = true;
+        data->min = 100;
+    });
+    add("requirement", new RequiredStatFilter(layout, "Level", "R. Level"), [](FilterData *data) {
+        data->max_filled = true;
+        data->max = 40;
+    });
+    add("sockets", new SocketsFilter(layout, "Sockets"), [](FilterData *data) {
+        data->min_filled = true;
+        data->min = 4;
+    });
+    add("links", new LinksFilter(layout, "Links"), [](FilterData *data) {
+        data->min_filled = true;
+        data->min = 3;
+    });
+    add("socket colors", new SocketsColorsFilter(layout), [](FilterData *data) {
+        data->r_filled = true;
+        data->r = 2;
+    });
+    add("link colors", new LinksColorsFilter(layout), [](FilterData *data) {
+        data->r_filled = data->g_filled = true;
+        data->r = data->g = 1;
+    });
+    add("mod", new ModFilter(layout), [](FilterData *data) {
+        data->text_query = "maximum life";
+        data->min_filled = true;
+        data->min = 50;
+    });
+}
+
+void Bench::cleanupTestCase() {
+    // filters are kept for the lifetime of the process, same as in MainWindow
+    delete form_;
+    delete app_;
+    delete db_dir_;
+}
+
+void Bench::AddSizes() {
+    QTest::addColumn<int>("size");
+    for (auto size : SIZES)
+        QTest::newRow(QByteArray::number(size).constData()) << size;
+}
+
+const Dataset &Bench::Data(int size) {
+    auto it = datasets_.find(size);
+    if (it != datasets_.end())
+        return it->second;
+    Dataset &data = datasets_[size];
+    data.responses = Fixtures::StashResponses(size);
+    for (size_t tab = 0; tab < data.responses.size(); ++tab)
+        ParseResponse(data.responses[tab], tab, &data.items);
+    for (auto &item : data.items)
+        data.json.push_back(*item->json());
+    data.index = std::make_shared<ItemsIndex>(data.items);
+    return data;
+}
+
+Buyout Bench::BenchBuyout(int i) {
+    Buyout bo;
+    bo.type = BUYOUT_TYPE_BUYOUT;
+    bo.currency = static_cast<Currency>(1 + i % (CurrencyAsTag.size() - 1));
+    bo.value = (i + 1) % 50 + 1;
+    return bo;
+}
+
+std::vector<BuyoutRecord> Bench::Buyouts(int size) {
+    std::vector<BuyoutRecord> buyouts;
+    int i = 0;
+    for (auto &item : Data(size).items) {
+        BuyoutRecord record = { item->hash(), BenchBuyout(i++), 0 };
+        buyouts.push_back(record);
+    }
+    return buyouts;
+}
+
+std::string Bench::BuyoutsFile(int size) {
+    return QDir(db_dir_->path()).filePath(QString("buyouts-%1").arg(size)).toStdString();
+}
+
+void Bench::HashDigests() {
+    for (auto text : { "", "a", "0123456789abcdef", "0123456789abcdef0", "Kaom's Heart" }) {
+        Hasher128 hasher, hex_hasher;
+        hasher.AddString(text);
+        hex_hasher.AddString(text);
+        HashKey key = hasher.Digest(), parsed;
+        std::string hex = hex_hasher.HexDigest();
+        QVERIFY(HashKey::FromHex(hex, &parsed));
+        QVERIFY(parsed == key);
+        QCOMPARE(key.ToHex(), hex);
+    }
+}
+
+void Bench::ParseResponses() {
+    QFETCH(int, size);
+    const Dataset &data = Data(size);
+    QBENCHMARK {
+        Items items;
+        for (size_t tab = 0; tab < data.responses.size(); ++tab)
+            ParseResponse(data.responses[tab], tab, &items);
+    }
+}
+
+void Bench::ConstructItems() {
+    QFETCH(int, size);
+    const Dataset &data = Data(size);
+    QBENCHMARK {
+        Items items;
+        for (auto &json : data.json)
+            items.push_back(std::make_shared<Item>(json, 0, "Bench"));
+    }
+}
+
+void Bench::Md5() {
+    QFETCH(int, size);
+    std::vector<std::string> payloads;
+    for (auto &item : Data(size).items)
+        payloads.push_back(item->raw_json());
+    QBENCHMARK {
+        for (auto &payload : payloads)
+            Util::Md5(payload);
+    }
+}
+
+void Bench::ComputeHash() {
+    QFETCH(int, size);
+    const Dataset &data = Data(size);
+    QBENCHMARK {
+        for (auto &json : data.json)
+            Item::ComputeHash(json);
+    }
+}
+
+void Bench::BuildIndex() {
+    QFETCH(int, size);
+    const Dataset &data = Data(size);
+    QBENCHMARK {
+        ItemsIndex index(data.items);
+    }
+}
+
+void Bench::FilterItems_data() {
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("filter");
+    for (auto size : SIZES)
+        for (size_t i = 0; i < setups_.size(); ++i)
+            QTest::newRow((std::to_string(size) + " " + setups_[i].first).c_str()) << size << static_cast<int>(i);
+}
+
+void Bench::FilterItems() {
+    QFETCH(int, size);
+    QFETCH(int, filter);
+    const Dataset &data = Data(size);
+    std::atomic<bool> cancel(false);
+    QBENCHMARK {
+        // a fresh search each time, otherwise the incremental caches turn it into a no-op
+        Search search("Bench", filters_);
+        std::vector<FilterData> filter_data = search.data();
+        setups_[filter].second(&filter_data[filter]);
+        SearchResult result;
+        search.Run(*data.index, filter_data, cancel, &result);
+        search.SetItems(std::move(result));
+    }
+}
+
+void Bench::ModelData() {
+    QFETCH(int, size);
+    const Dataset &data = Data(size);
+    QBENCHMARK {
+        // display strings are cached per row, so a new model measures the first paint
+        Search search("Bench", {});
+        SearchResult result;
+        result.items = data.items;
+        search.SetItems(std::move(result));
+        ItemsModel *model = search.model();
+        for (int row = 0; row < model->rowCount(); ++row)
+            for (int column = 0; column < model->columnCount(); ++column)
+                model->data(model->index(row, column, QModelIndex()));
+    }
+}
+
+void Bench::ShopUpdate_data() {
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("cached");
+    for (auto size : SIZES) {
+        QTest::newRow((std::to_string(size) + " render").c_str()) << size << false;
+        QTest::newRow((std::to_string(size) + " cached").c_str()) << size << true;
+    }
+}
+
+void Bench::ShopUpdate() {
+    QFETCH(int, size);
+    QFETCH(bool, cached);
+    const Dataset &data = Data(size);
+    int i = 0;
+    for (auto &item : data.items)
+        app_->buyout_manager()->Set(*item, BenchBuyout(i++));
+    app_->set_items_index(data.index);
+    // cached: fragments of the last Update are reused, as after a single price edit
+    Shop shop(app_);
+    shop.Update();
+    QBENCHMARK {
+        if (cached) {
+            shop.Update();
+        } else {
+            Shop fresh(app_);
+            fresh.Update();
+        }
+    }
+}
+
+void Bench::WriteBuyouts() {
+    QFETCH(int, size);
+    std::vector<BuyoutRecord> buyouts = Buyouts(size);
+    BuyoutStore store(BuyoutsFile(size));
+    QBENCHMARK {
+        // one transaction, as after a refresh or a tab price edit
+        store.Put(BUYOUT_KIND_ITEM, buyouts);
+        store.Flush();
+    }
+}
+
+void Bench::LoadBuyouts() {
+    QFETCH(int, size);
+    BuyoutStore store(BuyoutsFile(size));
+    store.Put(BUYOUT_KIND_ITEM, Buyouts(size));
+    store.Flush();
+    QBENCHMARK {
+        std::vector<BuyoutRecord> items, tabs;
+        store.Load(&items, &tabs);
+    }
+}
+
+QTEST_MAIN(Bench)
+#include "bench.moc"
@@ -0,0 +1,54 @@
+QT += core gui network concurrent testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = acquisition-bench
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+unix {
+    LIBS += -ldl
+}
+
+include(../deps/QsLog/QsLog.pri)
+
+INCLUDEPATH += ../src ../deps
+
+SOURCES += \
+    bench.cpp \
+    fixtures.cpp \
+    ../deps/jsoncpp/jsoncpp.cpp \
+    ../deps/sqlite/sqlite3.c \
+    ../src/bitmap.cpp \
+    ../src/buyoutmanager.cpp \
+    ../src/buyoutstore.cpp \
+    ../src/column.cpp \
+    ../src/datamanager.cpp \
+    ../src/filters.cpp \
+    ../src/hash128.cpp \
+    ../src/item.cpp \
+    ../src/itemarena.cpp \
+    ../src/items_model.cpp \
+    ../src/itemsindex.cpp \
+    ../src/modtemplates.cpp \
+    ../src/perfstats.cpp \
+    ../src/rangekernels.cpp \
+    ../src/search.cpp \
+    ../src/shop.cpp \
+    ../src/stashscanner.cpp \
+    ../src/stringpool.cpp \
+    ../src/trigramindex.cpp \
+    ../src/util.cpp
+
+HEADERS += \
+    fixtures.h \
+    ../src/buyoutstore.h \
+    ../src/items_model.h \
+    ../src/shop.h
+
+# filters.h pulls in the main window form
+FORMS += \
+    ../forms/mainwindow.ui
+
+DEPENDPATH *= $${INCLUDEPATH}
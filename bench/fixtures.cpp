@@ -0,0 +1,170 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fixtures.h"
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <cstdio>
+#include <random>
+#include <string>
+#include "jsoncpp/json.h"
+
+namespace {
+
+const int ITEMS_PER_TAB = 100;
+
+const char *BASES[] = {
+    "Vaal Regalia", "Glorious Plate", "Imperial Bow", "Siege Axe", "Jewelled Foil",
+    "Titanium Spirit Shield", "Sorcerer Boots", "Hubris Circlet", "Onyx Amulet", "Two-Stone Ring",
+};
+
+const char *MODS[] = {
+    "+%d to maximum Life", "+%d%% to Fire Resistance", "+%d%% to Cold Resistance",
+    "+%d%% to Lightning Resistance", "%d%% increased Physical Damage", "+%d to Strength",
+    "+%d to Dexterity", "+%d to Intelligence", "%d%% increased Attack Speed",
+    "+%d to maximum Energy Shield", "%d%% increased Critical Strike Chance",
+};
+
+const char *NAME_PARTS[] = { "Doom", "Storm", "Gale", "Blood", "Dusk", "Corruption", "Soul", "Rune" };
+
+const char SOCKET_ATTRS[] = "SDIG";
+
+std::string Format(const char *format, int value) {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), format, value);
+    return buffer;
+}
+
+Json::Value Property(const std::string &name, const std::string &value) {
+    Json::Value property;
+    property["name"] = name;
+    property["values"][0][0] = value;
+    property["values"][0][1] = 0;
+    property["displayMode"] = 0;
+    return property;
+}
+
+Json::Value GenerateItem(std::mt19937 *rng, int index) {
+    auto pick = [rng](int n) { return static_cast<int>((*rng)() % n); };
+    Json::Value item;
+    int frame_type = pick(4);
+    item["frameType"] = frame_type;
+    item["name"] = frame_type >= 2 ? std::string(NAME_PARTS[pick(8)]) + " " + NAME_PARTS[pick(8)] : "";
+    item["typeLine"] = BASES[pick(10)];
+    item["icon"] = "http://webcdn.pathofexile.com/image/Art/2DItems/bench" + std::to_string(pick(200)) + ".png";
+    item["w"] = 1 + pick(2);
+    item["h"] = 1 + pick(4);
+    item["x"] = index % 12;
+    item["y"] = (index / 12) % 12;
+    item["corrupted"] = pick(10) == 0;
+    item["identified"] = true;
+    item["league"] = "Standard";
+
+    Json::Value &properties = item["properties"];
+    properties.append(Property("Quality", "+" + std::to_string(pick(21)) + "%"));
+    if (pick(2)) {
+        int low = 10 + pick(50);
+        properties.append(Property("Physical Damage", std::to_string(low) + "-" + std::to_string(low + pick(100))));
+        properties.append(Property("Attacks per Second", "1." + std::to_string(10 + pick(80))));
+        properties.append(Property("Critical Strike Chance", std::to_string(5 + pick(3)) + ".00%"));
+    } else {
+        properties.append(Property("Armour", std::to_string(pick(1500))));
+        properties.append(Property("Energy Shield", std::to_string(pick(400))));
+    }
+
+    Json::Value &requirements = item["requirements"];
+    requirements.append(Property("Level", std::to_string(1 + pick(80))));
+    requirements.append(Property("Str", std::to_string(pick(200))));
+
+    int mods = frame_type == 0 ? 0 : 1 + pick(6);
+    for (int i = 0; i < mods; ++i)
+        item["explicitMods"].append(Format(MODS[pick(11)], 1 + pick(100)));
+    if (pick(3) == 0)
+        item["implicitMods"].append(Format(MODS[pick(11)], 1 + pick(30)));
+
+    int sockets = pick(7);
+    int group = 0;
+    for (int i = 0; i < sockets; ++i) {
+        if (i > 0 && pick(3) == 0)
+            ++group;
+        Json::Value socket;
+        socket["group"] = group;
+        socket["attr"] = std::string(1, SOCKET_ATTRS[pick(4)]);
+        item["sockets"].append(socket);
+    }
+    return item;
+}
+
+std::vector<QByteArray> RecordedResponses(const QString &directory) {
+    std::vector<QByteArray> responses;
+    QDir dir(directory);
+    for (auto &file_name : dir.entryList(QStringList("*.json"), QDir::Files, QDir::Name)) {
+        QFile file(dir.filePath(file_name));
+        if (file.open(QIODevice::ReadOnly))
+            responses.push_back(file.readAll());
+    }
+    return responses;
+}
+
+// Rebuilds a recorded response with only the first count items
+QByteArray Truncate(const QByteArray &response, int count, int *taken) {
+    Json::Value root;
+    Json::Reader().parse(response.constData(), response.constData() + response.size(), root);
+    Json::Value items = root["items"];
+    root["items"] = Json::Value(Json::arrayValue);
+    for (int i = 0; i < count && i < static_cast<int>(items.size()); ++i)
+        root["items"].append(items[i]);
+    *taken = root["items"].size();
+    return QByteArray(Json::FastWriter().write(root).c_str());
+}
+
+}
+
+std::vector<QByteArray> Fixtures::StashResponses(int item_count) {
+    std::vector<QByteArray> responses;
+    QByteArray directory = qgetenv("ACQUISITION_BENCH_FIXTURES");
+    if (!directory.isEmpty()) {
+        std::vector<QByteArray> recorded = RecordedResponses(QString(directory));
+        int total = 0;
+        for (size_t i = 0; !recorded.empty() && total < item_count; i = (i + 1) % recorded.size()) {
+            int taken;
+            responses.push_back(Truncate(recorded[i], item_count - total, &taken));
+            // a file without items would loop forever
+            if (taken == 0)
+                break;
+            total += taken;
+        }
+        return responses;
+    }
+
+    std::mt19937 rng(42);
+    for (int begin = 0, tab = 0; begin < item_count; begin += ITEMS_PER_TAB, ++tab) {
+        Json::Value root;
+        root["numTabs"] = (item_count + ITEMS_PER_TAB - 1) / ITEMS_PER_TAB;
+        root["items"] = Json::Value(Json::arrayValue);
+        for (int i = begin; i < item_count && i < begin + ITEMS_PER_TAB; ++i)
+            root["items"].append(GenerateItem(&rng, i - begin));
+        if (tab == 0)
+            root["tabs"][0]["n"] = "Bench";
+        responses.push_back(QByteArray(Json::FastWriter().write(root).c_str()));
+    }
+    return responses;
+}
@@ -0,0 +1,37 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <vector>
+
+/*
+ * Stash tab responses for the benchmarks. If ACQUISITION_BENCH_FIXTURES
+ * points to a directory, the recorded responses in it (one *.json file per
+ * tab, as returned by get-stash-items) are cycled until there are enough
+ * items. Otherwise responses are generated from a fixed seed so that runs
+ * stay comparable.
+ */
+namespace Fixtures {
+
+// Responses with item_count items in total
+std::vector<QByteArray> StashResponses(int item_count);
+
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+class BuyoutManager;
+class DataManager;
+class Item;
+class ItemsIndex;
+class QNetworkAccessManager;
+
+/*
+ * What ItemsManager, BuyoutManager, DataManager and price filters need from
+ * the session that owns them. Implemented by MainWindow and by
+ * HeadlessSession, which runs the same managers without any widgets.
+ */
+class Application {
+public:
+    virtual ~Application() {}
+    virtual const std::string &league() const = 0;
+    virtual const std::string &email() const = 0;
+    virtual DataManager *data_manager() const = 0;
+    virtual BuyoutManager *buyout_manager() const = 0;
+    virtual QNetworkAccessManager *logged_in_nm() const = 0;
+    // index of the items from the last ItemsRefreshed
+    virtual const std::shared_ptr<const ItemsIndex> &items_index() const = 0;
+    // item the user is looking at, null if there's none; its tab is fetched first
+    virtual const std::shared_ptr<Item> &current_item() const = 0;
+};
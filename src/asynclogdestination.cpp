@@ -0,0 +1,155 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "asynclogdestination.h"
+
+#include <QMutexLocker>
+#include <QStringList>
+#include <algorithm>
+
+AsyncLogDestination::AsyncLogDestination(const QsLogging::DestinationPtr &inner):
+    inner_(inner),
+    cells_(new Cell[ASYNC_LOG_CAPACITY]),
+    enqueue_(0),
+    dequeue_(0),
+    dropped_(0),
+    stopping_(false),
+    stopped_(false),
+    producers_(0),
+    writer_(this)
+{
+    for (size_t i = 0; i < ASYNC_LOG_CAPACITY; ++i)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    writer_.start(QThread::LowPriority);
+}
+
+AsyncLogDestination::~AsyncLogDestination() {
+    Stop();
+}
+
+bool AsyncLogDestination::isValid() {
+    return inner_->isValid();
+}
+
+void AsyncLogDestination::write(const QString &message, QsLogging::Level level) {
+    // seq_cst pairs with Stop: either this sees stopped_ or Stop sees this producer and waits for it
+    producers_.fetch_add(1);
+    if (stopped_.load()) {
+        producers_.fetch_sub(1);
+        QMutexLocker locker(&stop_mutex_);
+        inner_->write(message, level);
+        return;
+    }
+    if (Push(message, level)) {
+        // the writer wakes up by itself eventually, only hurry it up when the ring fills up
+        size_t queued = enqueue_.load(std::memory_order_relaxed) - dequeue_.load(std::memory_order_relaxed);
+        if (queued >= ASYNC_LOG_CAPACITY / 2 || level >= QsLogging::ErrorLevel)
+            wake_.wakeOne();
+    } else {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    producers_.fetch_sub(1, std::memory_order_release);
+}
+
+void AsyncLogDestination::Stop() {
+    if (stopped_.load())
+        return;
+    stopping_.store(true, std::memory_order_release);
+    {
+        QMutexLocker locker(&wake_mutex_);
+        wake_.wakeOne();
+    }
+    writer_.wait();
+    QMutexLocker locker(&stop_mutex_);
+    stopped_.store(true);
+    // producers that didn't see stopped_ finish their push, it's short
+    while (producers_.load() > 0)
+        QThread::yieldCurrentThread();
+    // whatever was pushed while the writer was finishing
+    while (WriteBatch()) {}
+}
+
+// Bounded MPMC queue by Dmitry Vyukov, here with a single consumer
+bool AsyncLogDestination::Push(const QString &message, QsLogging::Level level) {
+    Cell *cell;
+    size_t pos = enqueue_.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &cells_[pos & (ASYNC_LOG_CAPACITY - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // full
+            return false;
+        } else {
+            pos = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->message = message;
+    cell->level = level;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLogDestination::Pop(QString *message, QsLogging::Level *level) {
+    size_t pos = dequeue_.load(std::memory_order_relaxed);
+    Cell &cell = cells_[pos & (ASYNC_LOG_CAPACITY - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0)
+        return false;
+    *message = cell.message;
+    *level = cell.level;
+    cell.message = QString();
+    cell.sequence.store(pos + ASYNC_LOG_CAPACITY, std::memory_order_release);
+    dequeue_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void AsyncLogDestination::Run() {
+    while (!stopping_.load(std::memory_order_acquire)) {
+        if (!WriteBatch()) {
+            QMutexLocker locker(&wake_mutex_);
+            wake_.wait(&wake_mutex_, ASYNC_LOG_FLUSH_INTERVAL);
+        }
+    }
+    while (WriteBatch()) {}
+}
+
+bool AsyncLogDestination::WriteBatch() {
+    QStringList batch;
+    QsLogging::Level batch_level = QsLogging::TraceLevel;
+    QString message;
+    QsLogging::Level level;
+    while (batch.size() < static_cast<int>(ASYNC_LOG_CAPACITY) && Pop(&message, &level)) {
+        batch << message;
+        batch_level = std::max(batch_level, level);
+    }
+    size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        batch << QString("%1 log messages were dropped because the log could not keep up").arg(static_cast<qint64>(dropped));
+        batch_level = std::max(batch_level, QsLogging::WarnLevel);
+    }
+    if (batch.isEmpty())
+        return false;
+    // the inner destination writes a newline after the message, so a batch is a single write
+    inner_->write(batch.join("\n"), batch_level);
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
+#include "QsLogDest.h"
+
+// must be a power of two
+const size_t ASYNC_LOG_CAPACITY = 4096;
+// the writer wakes up at least this often (ms) to write out what was queued
+const int ASYNC_LOG_FLUSH_INTERVAL = 200;
+
+/*
+ * Wraps a (slow) destination such as the log file so that logging threads
+ * never wait for the disk. Messages go into a lock-free bounded MPSC ring
+ * and a writer thread hands them to the inner destination in batches, one
+ * write (and one flush) per batch. When the ring is full messages are
+ * dropped and counted instead of blocking, the count is logged later.
+ */
+class AsyncLogDestination : public QsLogging::Destination {
+public:
+    explicit AsyncLogDestination(const QsLogging::DestinationPtr &inner);
+    ~AsyncLogDestination();
+    void write(const QString &message, QsLogging::Level level);
+    bool isValid();
+    // Writes out everything queued and stops the writer, later messages are written synchronously
+    void Stop();
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        QString message;
+        QsLogging::Level level;
+    };
+    class Writer : public QThread {
+    public:
+        explicit Writer(AsyncLogDestination *destination): destination_(destination) {}
+    protected:
+        void run() { destination_->Run(); }
+    private:
+        AsyncLogDestination *destination_;
+    };
+
+    bool Push(const QString &message, QsLogging::Level level);
+    // consumer side, only called from the writer (or after it has stopped)
+    bool Pop(QString *message, QsLogging::Level *level);
+    void Run();
+    // returns false if there was nothing to write
+    bool WriteBatch();
+
+    QsLogging::DestinationPtr inner_;
+    std::unique_ptr<Cell[]> cells_;
+    std::atomic<size_t> enqueue_, dequeue_;
+    std::atomic<size_t> dropped_;
+    std::atomic<bool> stopping_, stopped_;
+    // write() calls that may still push, Stop drains the ring once there are none
+    std::atomic<int> producers_;
+    // held by Stop while it drains and by synchronous writes after it, so that
+    // the inner destination has a single writer and queued messages come first
+    QMutex stop_mutex_;
+    QMutex wake_mutex_;
+    QWaitCondition wake_;
+    Writer writer_;
+};
@@ -0,0 +1,71 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitmap.h"
+
+#include <algorithm>
+
+Bitmap::Bitmap():
+    size_(0)
+{}
+
+Bitmap::Bitmap(size_t size, bool value):
+    size_(size),
+    words_((size + 63) / 64)
+{
+    Fill(value);
+}
+
+void Bitmap::Fill(bool value) {
+    std::fill(words_.begin(), words_.end(), value ? ~0ULL : 0ULL);
+    ClearTail();
+}
+
+void Bitmap::Invert() {
+    for (auto &word : words_)
+        word = ~word;
+    ClearTail();
+}
+
+void Bitmap::ClearTail() {
+    if (size_ % 64)
+        words_.back() &= (1ULL << (size_ % 64)) - 1;
+}
+
+void Bitmap::And(const Bitmap &other) {
+    for (size_t i = 0; i < words_.size(); ++i)
+        words_[i] &= other.words_[i];
+}
+
+void Bitmap::Or(const Bitmap &other) {
+    for (size_t i = 0; i < words_.size(); ++i)
+        words_[i] |= other.words_[i];
+}
+
+size_t Bitmap::Count() const {
+    size_t count = 0;
+    for (uint64_t word : words_) {
+        // portable popcount
+        word = word - ((word >> 1) & 0x5555555555555555ULL);
+        word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+        word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        count += (word * 0x0101010101010101ULL) >> 56;
+    }
+    return count;
+}
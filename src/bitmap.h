@@ -0,0 +1,67 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size set of bits, one per item of an ItemsIndex
+class Bitmap {
+public:
+    Bitmap();
+    explicit Bitmap(size_t size, bool value = false);
+    size_t size() const { return size_; }
+    bool Test(size_t i) const { return (words_[i >> 6] >> (i & 63)) & 1; }
+    void Set(size_t i) { words_[i >> 6] |= 1ULL << (i & 63); }
+    void Fill(bool value);
+    void And(const Bitmap &other);
+    void Or(const Bitmap &other);
+    void Invert();
+    size_t Count() const;
+    bool operator==(const Bitmap &other) const { return size_ == other.size_ && words_ == other.words_; }
+    // bits past size() are always zero
+    uint64_t *words() { return words_.data(); }
+    const uint64_t *words() const { return words_.data(); }
+    size_t word_count() const { return words_.size(); }
+    // call after writing whole words directly
+    void ClearTail();
+    // Calls f(i) for every set bit in increasing order
+    template<typename F>
+    void ForEach(F f) const {
+        for (size_t w = 0; w < words_.size(); ++w)
+            for (uint64_t word = words_[w]; word; word &= word - 1)
+                f(w * 64 + LowestBit(word));
+    }
+    // index of the lowest set bit, word must not be 0
+    static size_t LowestBit(uint64_t word) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(word);
+#else
+        size_t bit = 0;
+        while (!((word >> bit) & 1))
+            ++bit;
+        return bit;
+#endif
+    }
+private:
+    size_t size_;
+    std::vector<uint64_t> words_;
+};
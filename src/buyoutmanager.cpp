@@ -20,42 +20,99 @@
 #include "buyoutmanager.h"
 
 #include <cassert>
+#include <ctime>
 #include <sstream>
 #include "QsLog.h"
 
-#include "mainwindow.h"
+#include "application.h"
+#include "buyoutstore.h"
 #include "datamanager.h"
+#include "itemsdelta.h"
+#include "itemsindex.h"
+#include "perfstats.h"
 #include "util.h"
 
-BuyoutManager::BuyoutManager(MainWindow *app):
+// version of Item::hash() that buyouts_ is keyed by
+const char *BUYOUTS_HASH_VERSION = "2";
+
+BuyoutManager::BuyoutManager(Application *app):
     app_(app),
-    save_needed_(false)
+    store_(new BuyoutStore(app->data_manager()->filename())),
+    migration_needed_(false),
+    resolved_index_(0),
+    grace_period_(BUYOUT_GRACE_PERIOD),
+    reconciled_index_(0),
+    rates_(CurrencyAsTag.size(), 0.0)
 {
     Load();
 }
 
+BuyoutManager::~BuyoutManager() {
+    delete store_;
+}
+
+void BuyoutManager::Changed() {
+    resolved_index_ = 0;
+    prices_.reset();
+}
+
+void BuyoutManager::WriteItem(const HashKey &key) {
+    const Buyout *buyout = buyouts_.Find(key);
+    if (!buyout) {
+        store_->Erase(BUYOUT_KIND_ITEM, key.ToHex());
+        return;
+    }
+    const long long *since = missing_since_.Find(key);
+    store_->Put(BUYOUT_KIND_ITEM, key.ToHex(), *buyout, since ? *since : 0);
+}
+
 void BuyoutManager::Set(const Item &item, const Buyout &buyout) {
-    save_needed_ = true;
-    buyouts_[ItemHash(item)] = buyout;
+    Changed();
+    buyouts_.Set(item.hash_key(), buyout);
+    missing_since_.Erase(item.hash_key());
+    WriteItem(item.hash_key());
 }
 
 Buyout BuyoutManager::Get(const Item &item) {
-    if (!Exists(item))
+    const Buyout *buyout = buyouts_.Find(item.hash_key());
+    if (!buyout)
         throw std::runtime_error("Asked to get inexistant buyout.");
-    return buyouts_[ItemHash(item)];
+    return *buyout;
 }
 
 void BuyoutManager::Delete(const Item &item) {
-    save_needed_ = true;
-    buyouts_.erase(ItemHash(item));
+    Changed();
+    buyouts_.Erase(item.hash_key());
+    missing_since_.Erase(item.hash_key());
+    WriteItem(item.hash_key());
 }
 
 bool BuyoutManager::Exists(const Item &item) {
-    return buyouts_.count(ItemHash(item)) > 0;
+    return buyouts_.Contains(item.hash_key());
 }
 
-std::string BuyoutManager::ItemHash(const Item &item) {
-    return item.hash();
+void BuyoutManager::SetMany(const Items &items, const Buyout &buyout) {
+    Changed();
+    bool erase = buyout.type == BUYOUT_TYPE_NONE;
+    std::vector<BuyoutRecord> records;
+    std::vector<std::string> keys;
+    for (auto &item : items) {
+        const HashKey &key = item->hash_key();
+        missing_since_.Erase(key);
+        if (erase) {
+            if (buyouts_.Erase(key))
+                keys.push_back(key.ToHex());
+            continue;
+        }
+        buyouts_.Set(key, buyout);
+        BuyoutRecord record = { key.ToHex(), buyout, 0 };
+        records.push_back(record);
+    }
+    if (erase)
+        store_->Erase(BUYOUT_KIND_ITEM, keys);
+    else
+        store_->Put(BUYOUT_KIND_ITEM, records);
+    QLOG_INFO() << "Changed buyouts of" << (erase ? keys.size() : records.size()) << "items at once.";
 }
 
 Buyout BuyoutManager::GetTab(const std::string &tab) {
@@ -63,8 +120,9 @@ Buyout BuyoutManager::GetTab(const std::string &tab) {
 }
 
 void BuyoutManager::SetTab(const std::string &tab, const Buyout &buyout) {
-    save_needed_ = true;
+    Changed();
     tab_buyouts_[tab] = buyout;
+    store_->Put(BUYOUT_KIND_TAB, tab, buyout);
 }
 
 bool BuyoutManager::ExistsTab(const std::string &tab) {
@@ -72,30 +130,118 @@ bool BuyoutManager::ExistsTab(const std::string &tab) {
 }
 
 void BuyoutManager::DeleteTab(const std::string &tab) {
-    save_needed_ = true;
+    Changed();
     tab_buyouts_.erase(tab);
+    store_->Erase(BUYOUT_KIND_TAB, tab);
 }
 
-std::string BuyoutManager::Serialize(const std::map<std::string, Buyout> &buyouts) {
-    Json::Value root;
+static Buyout NoBuyout() {
+    Buyout none;
+    none.type = BUYOUT_TYPE_NONE;
+    none.currency = CURRENCY_NONE;
+    none.value = 0;
+    return none;
+}
+
+Buyout BuyoutManager::ResolveTab(const std::string &tab) const {
+    auto it = tab_buyouts_.find(tab);
+    if (it != tab_buyouts_.end())
+        return it->second;
+    return NoBuyout();
+}
 
-    for (auto &bo : buyouts) {
-        if (bo.second.currency == CURRENCY_NONE || bo.second.type == BUYOUT_TYPE_NONE)
+Buyout BuyoutManager::Resolve(const Item &item) const {
+    if (const Buyout *buyout = buyouts_.Find(item.hash_key()))
+        return *buyout;
+    if (item.in_character())
+        return NoBuyout();
+    return ResolveTab(item.tab_caption());
+}
+
+const std::vector<Buyout> &BuyoutManager::ResolveAll(const ItemsIndex &index) {
+    if (resolved_index_ == index.id())
+        return resolved_;
+    resolved_.clear();
+    resolved_.reserve(index.size());
+    // captions are pooled strings, so items of one tab share the same pointer
+    const std::string *tab = nullptr;
+    Buyout tab_buyout;
+    for (size_t i = 0; i < index.size(); ++i) {
+        const Item &item = *index.item(i);
+        if (const Buyout *buyout = buyouts_.Find(item.hash_key())) {
+            resolved_.push_back(*buyout);
             continue;
-        if (bo.second.type >= BuyoutTypeAsTag.size() || bo.second.currency >= CurrencyAsTag.size()) {
-            QLOG_WARN() << "Ignoring invalid buyout, type:" << bo.second.type
-                << "currency:" << bo.second.currency;
+        }
+        if (item.in_character()) {
+            // tab buyouts only apply to the stash
+            resolved_.push_back(NoBuyout());
             continue;
         }
-        Json::Value item;
-        item["value"] = bo.second.value;
-        item["type"] = BuyoutTypeAsTag[bo.second.type];
-        item["currency"] = CurrencyAsTag[bo.second.currency];
-        root[bo.first] = item;
+        if (&item.tab_caption() != tab) {
+            tab = &item.tab_caption();
+            tab_buyout = ResolveTab(*tab);
+        }
+        resolved_.push_back(tab_buyout);
+    }
+    resolved_index_ = index.id();
+    return resolved_;
+}
+
+double BuyoutManager::rate(Currency currency) const {
+    if (currency >= rates_.size())
+        return 0.0;
+    // chaos is the unit, it doesn't need a rate of its own unless the user gave it another one
+    if (currency == CURRENCY_CHAOS_ORB && rates_[currency] <= 0)
+        return 1.0;
+    return rates_[currency];
+}
+
+void BuyoutManager::SetRates(const std::vector<double> &rates) {
+    rates_.assign(CurrencyAsTag.size(), 0.0);
+    Json::Value root(Json::objectValue);
+    // CURRENCY_NONE never has a rate
+    for (size_t currency = CURRENCY_NONE + 1; currency < rates.size() && currency < rates_.size(); ++currency) {
+        if (rates[currency] <= 0)
+            continue;
+        rates_[currency] = rates[currency];
+        root[CurrencyAsTag[currency]] = rates[currency];
     }
+    app_->data_manager()->Set("currency_rates", Json::FastWriter().write(root));
+    prices_.reset();
+}
+
+bool BuyoutManager::Normalize(const Buyout &buyout, double *price) const {
+    if (buyout.type == BUYOUT_TYPE_NONE)
+        return false;
+    double chaos = rate(buyout.currency);
+    if (chaos <= 0)
+        return false;
+    *price = buyout.value * chaos;
+    return true;
+}
 
-    Json::FastWriter writer;
-    return writer.write(root);
+bool BuyoutManager::NormalizedPrice(const Item &item, double *price) const {
+    return Normalize(Resolve(item), price);
+}
+
+std::shared_ptr<const NormalizedPrices> BuyoutManager::Prices(const ItemsIndex &index) {
+    if (prices_ && prices_->index_id == index.id())
+        return prices_;
+    PerfTimer timer("BuyoutManager::Prices");
+    const std::vector<Buyout> &buyouts = ResolveAll(index);
+    auto prices = std::make_shared<NormalizedPrices>();
+    prices->index_id = index.id();
+    prices->values.assign(index.size(), 0.0f);
+    prices->present = Bitmap(index.size());
+    for (size_t i = 0; i < buyouts.size(); ++i) {
+        double price;
+        if (Normalize(buyouts[i], &price)) {
+            prices->values[i] = static_cast<float>(price);
+            prices->present.Set(i);
+        }
+    }
+    prices_ = prices;
+    return prices_;
 }
 
 void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, Buyout> *buyouts) {
@@ -120,15 +266,181 @@ void BuyoutManager::Deserialize(const std::string &data, std::map<std::string, B
 }
 
 void BuyoutManager::Save() {
-    if (!save_needed_)
+    store_->Flush();
+}
+
+void BuyoutManager::Load() {
+    std::vector<BuyoutRecord> items, tabs;
+    store_->Load(&items, &tabs);
+    if (items.empty() && tabs.empty())
+        ImportBlobs(&items, &tabs);
+
+    buyouts_.Clear();
+    missing_since_.Clear();
+    for (auto &record : items) {
+        HashKey key;
+        if (!HashKey::FromHex(record.key, &key)) {
+            QLOG_WARN() << "Ignoring buyout with invalid item hash" << record.key.c_str();
+            continue;
+        }
+        buyouts_.Set(key, record.buyout);
+        if (record.missing_since != 0)
+            missing_since_.Set(key, record.missing_since);
+    }
+    tab_buyouts_.clear();
+    for (auto &record : tabs)
+        tab_buyouts_[record.key] = record.buyout;
+
+    std::string grace_period = app_->data_manager()->Get("buyout_grace_period");
+    if (grace_period.size() != 0)
+        grace_period_ = std::stoi(grace_period);
+    rates_.assign(CurrencyAsTag.size(), 0.0);
+    Json::Value rates;
+    std::string rates_data = app_->data_manager()->Get("currency_rates");
+    if (rates_data.size() != 0 && Json::Reader().parse(rates_data, rates) && rates.isObject()) {
+        for (auto &tag : rates.getMemberNames()) {
+            // unknown tags come back as CurrencyAsTag.size()
+            size_t currency = Util::TagAsCurrency(tag);
+            if (currency != CURRENCY_NONE && currency < rates_.size())
+                rates_[currency] = rates[tag].asDouble();
+        }
+    }
+    prices_.reset();
+    migration_needed_ = app_->data_manager()->Get("buyouts_hash_version") != BUYOUTS_HASH_VERSION;
+    // nothing to migrate
+    if (migration_needed_ && buyouts_.empty()) {
+        migration_needed_ = false;
+        app_->data_manager()->Set("buyouts_hash_version", BUYOUTS_HASH_VERSION);
+    }
+}
+
+void BuyoutManager::ImportBlobs(std::vector<BuyoutRecord> *items, std::vector<BuyoutRecord> *tabs) {
+    std::string buyouts_data = app_->data_manager()->Get("buyouts");
+    std::string tabs_data = app_->data_manager()->Get("tab_buyouts");
+    if (buyouts_data.empty() && tabs_data.empty())
         return;
-    save_needed_ = false;
 
-    app_->data_manager()->Set("buyouts", Serialize(buyouts_));
-    app_->data_manager()->Set("tab_buyouts", Serialize(tab_buyouts_));
+    std::map<std::string, Buyout> buyouts, tab_buyouts;
+    if (!buyouts_data.empty())
+        Deserialize(buyouts_data, &buyouts);
+    if (!tabs_data.empty())
+        Deserialize(tabs_data, &tab_buyouts);
+    Json::Value missing;
+    std::string missing_data = app_->data_manager()->Get("buyouts_missing");
+    if (!missing_data.empty())
+        Json::Reader().parse(missing_data, missing);
+
+    for (auto &buyout : buyouts) {
+        long long since = missing.isObject() ? missing.get(buyout.first, 0).asInt64() : 0;
+        BuyoutRecord record = { buyout.first, buyout.second, since };
+        items->push_back(record);
+        store_->Put(BUYOUT_KIND_ITEM, record.key, record.buyout, record.missing_since);
+    }
+    for (auto &buyout : tab_buyouts) {
+        BuyoutRecord record = { buyout.first, buyout.second, 0 };
+        tabs->push_back(record);
+        store_->Put(BUYOUT_KIND_TAB, record.key, record.buyout);
+    }
+    // the blobs are only dropped once the rows are in
+    store_->Flush();
+    app_->data_manager()->BeginBatch();
+    app_->data_manager()->Set("buyouts", "");
+    app_->data_manager()->Set("tab_buyouts", "");
+    app_->data_manager()->Set("buyouts_missing", "");
+    app_->data_manager()->Commit();
+    QLOG_INFO() << "Moved" << items->size() << "item and" << tabs->size() << "tab buyouts to the buyouts table.";
 }
 
-void BuyoutManager::Load() {
-    Deserialize(app_->data_manager()->Get("buyouts"), &buyouts_);
-    Deserialize(app_->data_manager()->Get("tab_buyouts"), &tab_buyouts_);
+void BuyoutManager::MigrateItemHashes(const Items &items) {
+    if (!migration_needed_)
+        return;
+    migration_needed_ = false;
+
+    // the first refresh has every item that was saved, so this covers all buyouts that still can be matched
+    int migrated = 0;
+    for (auto &item : items) {
+        HashKey legacy;
+        if (!HashKey::FromHex(item->LegacyHash(), &legacy))
+            continue;
+        const Buyout *found = buyouts_.Find(legacy);
+        if (!found)
+            continue;
+        Buyout buyout = *found;
+        buyouts_.Erase(legacy);
+        buyouts_.Set(item->hash_key(), buyout);
+        WriteItem(legacy);
+        WriteItem(item->hash_key());
+        ++migrated;
+    }
+    QLOG_INFO() << "Migrated" << migrated << "buyouts to new item hashes.";
+
+    Changed();
+    // the new keys have to be written before the version says so
+    Save();
+    app_->data_manager()->Set("buyouts_hash_version", BUYOUTS_HASH_VERSION);
+}
+
+void BuyoutManager::Reconcile(const ItemsIndex &index, const ItemsDelta &delta) {
+    long long now = std::time(nullptr);
+    // buyouts that were marked missing or aren't anymore
+    std::vector<HashKey> changed;
+    if (reconciled_index_ != 0 && reconciled_index_ == delta.previous_index_id) {
+        for (auto &hash : delta.removed) {
+            HashKey key;
+            if (HashKey::FromHex(hash, &key) && buyouts_.Contains(key) && !missing_since_.Contains(key)) {
+                missing_since_.Set(key, now);
+                changed.push_back(key);
+            }
+        }
+        for (auto &hash : delta.added) {
+            HashKey key;
+            if (HashKey::FromHex(hash, &key) && missing_since_.Erase(key))
+                changed.push_back(key);
+        }
+    } else {
+        HashKeyMap<bool> present;
+        for (size_t i = 0; i < index.size(); ++i)
+            present.Set(index.item(i)->hash_key(), true);
+        HashKeyMap<long long> missing;
+        buyouts_.ForEach([&](const HashKey &key, const Buyout &) {
+            if (present.Contains(key))
+                return;
+            const long long *since = missing_since_.Find(key);
+            missing.Set(key, since ? *since : now);
+            if (!since)
+                changed.push_back(key);
+        });
+        missing_since_.ForEach([&](const HashKey &key, long long) {
+            if (!missing.Contains(key))
+                changed.push_back(key);
+        });
+        missing_since_ = std::move(missing);
+    }
+    reconciled_index_ = index.id();
+
+    // the item may just be on its way between two tabs or in a character that wasn't fetched
+    long long cutoff = now - grace_period_ * 24LL * 60 * 60;
+    std::vector<HashKey> expired;
+    missing_since_.ForEach([&](const HashKey &key, long long since) {
+        if (since <= cutoff)
+            expired.push_back(key);
+    });
+    for (auto &key : expired) {
+        buyouts_.Erase(key);
+        missing_since_.Erase(key);
+    }
+    for (auto &key : changed)
+        WriteItem(key);
+    for (auto &key : expired)
+        WriteItem(key);
+    if (!expired.empty()) {
+        QLOG_INFO() << "Dropped" << expired.size() << "buyouts of items missing for more than"
+                    << grace_period_ << "days," << buyouts_.size() << "left.";
+        Changed();
+    }
+}
+
+void BuyoutManager::SetGracePeriod(int days) {
+    grace_period_ = days;
+    app_->data_manager()->Set("buyout_grace_period", std::to_string(days));
 }
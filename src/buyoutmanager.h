@@ -19,6 +19,13 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "hashkeymap.h"
 #include "item.h"
 
 enum Currency {
@@ -90,37 +97,113 @@ const std::vector<std::string> BuyoutTypeAsTag({
     "price"
 });
 
+const std::vector<std::string> BuyoutTypeAsString({
+    "No price",
+    "Buyout",
+    "Fixed price"
+});
+
 struct Buyout {
     double value;
     BuyoutType type;
     Currency currency;
+    bool operator==(const Buyout &other) const {
+        return value == other.value && type == other.type && currency == other.currency;
+    }
 };
 
-class MainWindow;
+// Resolved buyouts of every row of an index in chaos orbs, see BuyoutManager::Prices.
+// Rows without a buyout or without a rate for its currency aren't present.
+struct NormalizedPrices {
+    unsigned long long index_id;
+    std::vector<float> values;
+    Bitmap present;
+};
+
+// days that buyouts of items which can't be found anymore are kept by default
+const int BUYOUT_GRACE_PERIOD = 7;
+
+class BuyoutStore;
+class ItemsIndex;
+class Application;
+struct BuyoutRecord;
+struct ItemsDelta;
 
 class BuyoutManager {
 public:
-    explicit BuyoutManager(MainWindow *app);
+    explicit BuyoutManager(Application *app);
+    ~BuyoutManager();
+    BuyoutManager(const BuyoutManager&) = delete;
+    BuyoutManager& operator=(const BuyoutManager&) = delete;
     void Set(const Item &item, const Buyout &buyout);
     Buyout Get(const Item &item);
     void Delete(const Item &item);
     bool Exists(const Item &item);
+    // Set (or Delete for BUYOUT_TYPE_NONE) for all items as a single change
+    void SetMany(const Items &items, const Buyout &buyout);
 
     void SetTab(const std::string &tab, const Buyout &buyout);
     Buyout GetTab(const std::string &tab);
     void DeleteTab(const std::string &tab);
     bool ExistsTab(const std::string &tab);
 
+    // The item's own buyout if it has one, otherwise that of its tab,
+    // BUYOUT_TYPE_NONE if neither is set
+    Buyout Resolve(const Item &item) const;
+    // Resolve() for every row of index, kept until a buyout changes or another index is passed
+    const std::vector<Buyout> &ResolveAll(const ItemsIndex &index);
+
+    // Chaos orbs per one of currency, 0 if it wasn't set (1 for chaos itself)
+    double rate(Currency currency) const;
+    // indexed by Currency, 0 leaves a currency without a rate
+    void SetRates(const std::vector<double> &rates);
+    // Resolve() in chaos orbs, false if there's no buyout or no rate for its currency
+    bool NormalizedPrice(const Item &item, double *price) const;
+    // NormalizedPrice() for every row of index. The result is immutable and can be
+    // read from any thread, a new one is made after a buyout or rate changes.
+    std::shared_ptr<const NormalizedPrices> Prices(const ItemsIndex &index);
+
+    // Edits are written in the background shortly after they're made, this writes what's pending now
     void Save();
     void Load();
+    // Buyouts saved by older versions are keyed by Item::LegacyHash, this
+    // re-keys them for the given items. Does nothing once it has run.
+    void MigrateItemHashes(const Items &items);
+    // Notes buyouts whose item is no longer in index and drops those that
+    // have been missing for more than grace_period() days. After a pass over
+    // delta.previous_index_id only the hashes listed in delta are looked at.
+    void Reconcile(const ItemsIndex &index, const ItemsDelta &delta);
+    void SetGracePeriod(int days);
+    int grace_period() const { return grace_period_; }
 private:
-    std::string ItemHash(const Item &item);
-    std::string Serialize(const std::map<std::string, Buyout> &buyouts);
-    void Deserialize(const std::string &data, std::map<std::string, Buyout> *buyouts);
-
-    MainWindow *app_;
-    std::map<std::string, Buyout> buyouts_;
+    // a buyout was set or deleted
+    void Changed();
+    // queues the current state of the buyout of key for store_
+    void WriteItem(const HashKey &key);
+    // Moves buyouts saved as JSON by older versions into store_
+    void ImportBlobs(std::vector<BuyoutRecord> *items, std::vector<BuyoutRecord> *tabs);
+    // buyouts by item hash or tab caption as older versions stored them in DataManager
+    static void Deserialize(const std::string &data, std::map<std::string, Buyout> *buyouts);
+    Buyout ResolveTab(const std::string &tab) const;
+    // value of buyout in chaos orbs, false if it can't be converted
+    bool Normalize(const Buyout &buyout, double *price) const;
+
+    Application *app_;
+    HashKeyMap<Buyout> buyouts_;
     std::map<std::string, Buyout> tab_buyouts_;
-    bool save_needed_;
+    BuyoutStore *store_;
+    bool migration_needed_;
+    // ResolveAll result and the index it's for, 0 if it's outdated
+    unsigned long long resolved_index_;
+    std::vector<Buyout> resolved_;
+    // std::time() when the items of these buyouts were found missing
+    HashKeyMap<long long> missing_since_;
+    int grace_period_;
+    // index of the last Reconcile
+    unsigned long long reconciled_index_;
+    // by Currency, saved as a JSON object of CurrencyAsTag -> rate
+    std::vector<double> rates_;
+    // last Prices result, null if it's outdated
+    std::shared_ptr<const NormalizedPrices> prices_;
 };
 
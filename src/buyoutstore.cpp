@@ -0,0 +1,185 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "buyoutstore.h"
+
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrentRun>
+#include <stdexcept>
+#include "QsLog.h"
+
+#include "perfstats.h"
+#include "util.h"
+
+// ms to wait for the main connection to finish its transaction
+const int BUYOUT_BUSY_TIMEOUT = 5000;
+
+BuyoutStore::BuyoutStore(const std::string &filename) {
+    if (sqlite3_open(filename.c_str(), &db_) != SQLITE_OK)
+        throw std::runtime_error("Failed to open sqlite3 database.");
+    sqlite3_busy_timeout(db_, BUYOUT_BUSY_TIMEOUT);
+    Exec("CREATE TABLE IF NOT EXISTS buyouts(kind INTEGER, key TEXT, type TEXT, currency TEXT, value REAL, "
+         "missing_since INTEGER, PRIMARY KEY (kind, key))");
+    upsert_ = Prepare("INSERT OR REPLACE INTO buyouts (kind, key, type, currency, value, missing_since) "
+                      "VALUES (?, ?, ?, ?, ?, ?)");
+    erase_ = Prepare("DELETE FROM buyouts WHERE kind = ? AND key = ?");
+
+    write_pool_.setMaxThreadCount(1);
+    write_timer_.setSingleShot(true);
+    write_timer_.setInterval(BUYOUT_WRITE_DELAY);
+    connect(&write_timer_, SIGNAL(timeout()), this, SLOT(OnWriteTimer()));
+    // queued when it comes from the write thread, the timer belongs to this one
+    connect(this, SIGNAL(WriteFailed()), &write_timer_, SLOT(start()));
+}
+
+BuyoutStore::~BuyoutStore() {
+    Flush();
+    sqlite3_finalize(upsert_);
+    sqlite3_finalize(erase_);
+    sqlite3_close(db_);
+}
+
+void BuyoutStore::Exec(const std::string &query) {
+    if (sqlite3_exec(db_, query.c_str(), 0, 0, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to execute '" + query + "': " + sqlite3_errmsg(db_));
+}
+
+sqlite3_stmt *BuyoutStore::Prepare(const std::string &query) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to prepare '" + query + "': " + sqlite3_errmsg(db_));
+    return stmt;
+}
+
+static std::string ColumnText(sqlite3_stmt *stmt, int column) {
+    const unsigned char *text = sqlite3_column_text(stmt, column);
+    return text ? reinterpret_cast<const char*>(text) : "";
+}
+
+void BuyoutStore::Load(std::vector<BuyoutRecord> *items, std::vector<BuyoutRecord> *tabs) {
+    sqlite3_stmt *select = Prepare("SELECT kind, key, type, currency, value, missing_since FROM buyouts");
+    while (sqlite3_step(select) == SQLITE_ROW) {
+        BuyoutRecord record;
+        record.key = ColumnText(select, 1);
+        record.buyout.type = static_cast<BuyoutType>(Util::TagAsBuyoutType(ColumnText(select, 2)));
+        record.buyout.currency = static_cast<Currency>(Util::TagAsCurrency(ColumnText(select, 3)));
+        record.buyout.value = sqlite3_column_double(select, 4);
+        record.missing_since = sqlite3_column_int64(select, 5);
+        if (sqlite3_column_int(select, 0) == BUYOUT_KIND_TAB)
+            tabs->push_back(record);
+        else
+            items->push_back(record);
+    }
+    sqlite3_finalize(select);
+}
+
+void BuyoutStore::Schedule(const RowKey &key, const Change &change) {
+    {
+        QMutexLocker locker(&mutex_);
+        pending_[key] = change;
+    }
+    // restarted by every change, a burst of edits is written once
+    write_timer_.start();
+}
+
+void BuyoutStore::Put(BuyoutKind kind, const std::string &key, const Buyout &buyout, long long missing_since) {
+    Change change = { false, buyout, missing_since };
+    Schedule(std::make_pair(kind, key), change);
+}
+
+void BuyoutStore::Erase(BuyoutKind kind, const std::string &key) {
+    Change change = { true, Buyout(), 0 };
+    Schedule(std::make_pair(kind, key), change);
+}
+
+void BuyoutStore::Put(BuyoutKind kind, const std::vector<BuyoutRecord> &records) {
+    {
+        QMutexLocker locker(&mutex_);
+        for (auto &record : records) {
+            Change change = { false, record.buyout, record.missing_since };
+            pending_[std::make_pair(kind, record.key)] = change;
+        }
+    }
+    write_timer_.start();
+}
+
+void BuyoutStore::Erase(BuyoutKind kind, const std::vector<std::string> &keys) {
+    {
+        QMutexLocker locker(&mutex_);
+        for (auto &key : keys) {
+            Change change = { true, Buyout(), 0 };
+            pending_[std::make_pair(kind, key)] = change;
+        }
+    }
+    write_timer_.start();
+}
+
+void BuyoutStore::OnWriteTimer() {
+    QtConcurrent::run(&write_pool_, [this]() { WritePending(); });
+}
+
+void BuyoutStore::Flush() {
+    write_timer_.stop();
+    write_pool_.waitForDone();
+    WritePending();
+}
+
+void BuyoutStore::WritePending() {
+    std::map<RowKey, Change> changes;
+    {
+        QMutexLocker locker(&mutex_);
+        changes.swap(pending_);
+    }
+    if (changes.empty())
+        return;
+    PerfTimer timer("BuyoutStore::WritePending");
+    // errors are only logged, this can run on the write thread
+    bool ok = sqlite3_exec(db_, "BEGIN", 0, 0, 0) == SQLITE_OK;
+    for (auto it = changes.begin(); ok && it != changes.end(); ++it) {
+        auto &change = *it;
+        const Buyout &bo = change.second.buyout;
+        // same as what older versions skipped when saving buyouts
+        bool erase = change.second.erase || bo.type == BUYOUT_TYPE_NONE || bo.currency == CURRENCY_NONE
+            || bo.type >= BuyoutTypeAsTag.size() || bo.currency >= CurrencyAsTag.size();
+        sqlite3_stmt *stmt = erase ? erase_ : upsert_;
+        sqlite3_bind_int(stmt, 1, change.first.first);
+        sqlite3_bind_text(stmt, 2, change.first.second.c_str(), -1, SQLITE_STATIC);
+        if (!erase) {
+            sqlite3_bind_text(stmt, 3, BuyoutTypeAsTag[bo.type].c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, CurrencyAsTag[bo.currency].c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_double(stmt, 5, bo.value);
+            sqlite3_bind_int64(stmt, 6, change.second.missing_since);
+        }
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    if (!ok || sqlite3_exec(db_, "COMMIT", 0, 0, 0) != SQLITE_OK) {
+        // e.g. the main connection held the database for longer than BUYOUT_BUSY_TIMEOUT
+        QLOG_ERROR() << "Failed to write buyouts:" << sqlite3_errmsg(db_);
+        sqlite3_exec(db_, "ROLLBACK", 0, 0, 0);
+        // written with the next change or Flush, changes made since then win
+        QMutexLocker locker(&mutex_);
+        for (auto &change : changes)
+            pending_.insert(change);
+        emit WriteFailed();
+        return;
+    }
+    QLOG_DEBUG() << "Wrote" << changes.size() << "buyout changes.";
+}
@@ -0,0 +1,100 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "sqlite/sqlite3.h"
+
+#include "buyoutmanager.h"
+
+// ms between the last change and writing it out
+const int BUYOUT_WRITE_DELAY = 1000;
+
+enum BuyoutKind {
+    BUYOUT_KIND_ITEM,
+    BUYOUT_KIND_TAB
+};
+
+struct BuyoutRecord {
+    // item hash in hex or tab caption
+    std::string key;
+    Buyout buyout;
+    // see BuyoutManager::Reconcile, 0 if the item is there
+    long long missing_since;
+};
+
+/*
+ * Keeps buyouts as rows of the buyouts table, one per item or tab. Changes
+ * are collected per row and written together BUYOUT_WRITE_DELAY after the
+ * last one, in a transaction on a worker thread with its own connection to
+ * the database. Only the last change of every row is written. Failed writes
+ * are retried BUYOUT_WRITE_DELAY later.
+ */
+class BuyoutStore : public QObject {
+    Q_OBJECT
+public:
+    explicit BuyoutStore(const std::string &filename);
+    // writes the pending changes
+    ~BuyoutStore();
+    BuyoutStore(const BuyoutStore&) = delete;
+    BuyoutStore& operator=(const BuyoutStore&) = delete;
+    // GUI thread only, before anything is written
+    void Load(std::vector<BuyoutRecord> *items, std::vector<BuyoutRecord> *tabs);
+    void Put(BuyoutKind kind, const std::string &key, const Buyout &buyout, long long missing_since = 0);
+    void Erase(BuyoutKind kind, const std::string &key);
+    // many rows at once, the write timer is restarted only once
+    void Put(BuyoutKind kind, const std::vector<BuyoutRecord> &records);
+    void Erase(BuyoutKind kind, const std::vector<std::string> &keys);
+    // Writes the pending changes right away, waiting for a write in flight
+    void Flush();
+signals:
+    // emitted by WritePending after it put back changes it couldn't write
+    void WriteFailed();
+private slots:
+    void OnWriteTimer();
+private:
+    struct Change {
+        bool erase;
+        Buyout buyout;
+        long long missing_since;
+    };
+    typedef std::pair<int, std::string> RowKey;
+    void Schedule(const RowKey &key, const Change &change);
+    // runs in write_pool_, or on the calling thread of Flush once that is idle
+    void WritePending();
+    void Exec(const std::string &query);
+    sqlite3_stmt *Prepare(const std::string &query);
+
+    sqlite3 *db_;
+    sqlite3_stmt *upsert_, *erase_;
+    // guards pending_, which is handed over to the writer as a whole
+    QMutex mutex_;
+    std::map<RowKey, Change> pending_;
+    QTimer write_timer_;
+    // a single thread, so writes happen in the order they were scheduled
+    QThreadPool write_pool_;
+};
@@ -20,13 +20,47 @@
 #include "column.h"
 
 #include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "buyoutmanager.h"
+#include "util.h"
 
 const double EPS = 1e-6;
+const double NO_VALUE = -std::numeric_limits<double>::infinity();
+
+namespace {
+
+// "+20%" -> 20, "10-20" -> 15
+double SortNumber(const std::string &s) {
+    if (s.empty())
+        return NO_VALUE;
+    if (s.find('-', 1) != std::string::npos)
+        return Util::AverageDamage(s);
+    char *end;
+    double value = strtod(s.c_str(), &end);
+    return end == s.c_str() ? NO_VALUE : value;
+}
+
+// same as the "" shown for zero
+double DPSSortValue(double dps) {
+    return fabs(dps) < EPS ? NO_VALUE : dps;
+}
+
+}
 
 QColor Column::color(const Item & /* item */) {
     return QColor();
 }
 
+std::string IconColumn::name() {
+    return "";
+}
+
+std::string IconColumn::value(const Item & /* item */) {
+    return "";
+}
+
 std::string NameColumn::name() {
     return "Name";
 }
@@ -63,14 +97,18 @@ std::string CorruptedColumn::value(const Item &item) {
     return "";
 }
 
+double CorruptedColumn::sort_value(const Item &item) {
+    return item.corrupted() ? 1 : 0;
+}
+
 PropertyColumn::PropertyColumn(const std::string &name):
     name_(name),
-    property_(name)
+    property_(IString(name))
 {}
 
 PropertyColumn::PropertyColumn(const std::string &name, const std::string &property):
     name_(name),
-    property_(property)
+    property_(IString(property))
 {}
 
 std::string PropertyColumn::name() {
@@ -78,11 +116,17 @@ std::string PropertyColumn::name() {
 }
 
 std::string PropertyColumn::value(const Item &item) {
-    if (item.properties().count(property_))
-        return item.properties().find(property_)->second;
+    const IString *value = item.property(property_);
+    if (value)
+        return *value;
     return "";
 }
 
+double PropertyColumn::sort_value(const Item &item) {
+    const IString *value = item.property(property_);
+    return value ? SortNumber(*value) : NO_VALUE;
+}
+
 std::string DPSColumn::name() {
     return "DPS";
 }
@@ -94,6 +138,10 @@ std::string DPSColumn::value(const Item &item) {
     return QString::number(dps).toUtf8().constData();
 }
 
+double DPSColumn::sort_value(const Item &item) {
+    return DPSSortValue(item.DPS());
+}
+
 std::string pDPSColumn::name() {
     return "pDPS";
 }
@@ -105,6 +153,10 @@ std::string pDPSColumn::value(const Item &item) {
     return QString::number(pdps).toUtf8().constData();
 }
 
+double pDPSColumn::sort_value(const Item &item) {
+    return DPSSortValue(item.pDPS());
+}
+
 std::string eDPSColumn::name() {
     return "eDPS";
 }
@@ -116,6 +168,10 @@ std::string eDPSColumn::value(const Item &item) {
     return QString::number(edps).toUtf8().constData();
 }
 
+double eDPSColumn::sort_value(const Item &item) {
+    return DPSSortValue(item.eDPS());
+}
+
 ElementalDamageColumn::ElementalDamageColumn(int index):
     index_(index)
 {}
@@ -134,6 +190,12 @@ std::string ElementalDamageColumn::value(const Item &item) {
     return "";
 }
 
+double ElementalDamageColumn::sort_value(const Item &item) {
+    if (item.elemental_damage().size() > index_)
+        return SortNumber(item.elemental_damage().at(index_).first);
+    return NO_VALUE;
+}
+
 QColor ElementalDamageColumn::color(const Item &item) {
     if (item.elemental_damage().size() > index_) {
         auto &ed = item.elemental_damage().at(index_);
@@ -148,3 +210,23 @@ QColor ElementalDamageColumn::color(const Item &item) {
     }
     return QColor();
 }
+
+PriceColumn::PriceColumn(BuyoutManager *buyout_manager):
+    buyout_manager_(buyout_manager)
+{}
+
+std::string PriceColumn::name() {
+    return "Price";
+}
+
+std::string PriceColumn::value(const Item &item) {
+    double price;
+    if (!buyout_manager_->NormalizedPrice(item, &price))
+        return "";
+    return QString::number(price).toUtf8().constData();
+}
+
+double PriceColumn::sort_value(const Item &item) {
+    double price;
+    return buyout_manager_->NormalizedPrice(item, &price) ? price : NO_VALUE;
+}
@@ -24,14 +24,29 @@
 
 #include "item.h"
 
+class BuyoutManager;
+
 class Column {
 public:
     virtual std::string name() = 0;
     virtual std::string value(const Item &item) = 0;
     virtual QColor color(const Item &item);
+    // Numeric columns are sorted by sort_value() instead of value() text,
+    // items without a value get -infinity
+    virtual bool numeric() { return false; }
+    virtual double sort_value(const Item & /* item */) { return 0; }
+    // Cells of icon columns are drawn by IconDelegate, the text is left empty
+    virtual bool icon() { return false; }
     virtual ~Column() {}
 };
 
+class IconColumn : public Column {
+public:
+    std::string name();
+    std::string value(const Item &item);
+    bool icon() { return true; }
+};
+
 class NameColumn : public Column {
 public:
     std::string name();
@@ -43,6 +58,8 @@ class CorruptedColumn : public Column {
 public:
     std::string name();
     std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 };
 
 // Returns values from item -> properties
@@ -52,27 +69,35 @@ public:
     PropertyColumn(const std::string &name, const std::string &property);
     std::string name();
     std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 private:
     std::string name_;
-    std::string property_;
+    IString property_;
 };
 
 class DPSColumn : public Column {
 public:
     std::string name();
     std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 };
 
 class pDPSColumn : public Column {
 public:
     std::string name();
     std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 };
 
 class eDPSColumn : public Column {
 public:
     std::string name();
     std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 };
 
 class ElementalDamageColumn : public Column {
@@ -81,6 +106,20 @@ public:
     std::string name();
     std::string value(const Item &item);
     QColor color(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
 private:
     size_t index_;
 };
+
+// Resolved buyout in chaos orbs, see BuyoutManager::NormalizedPrice
+class PriceColumn : public Column {
+public:
+    explicit PriceColumn(BuyoutManager *buyout_manager);
+    std::string name();
+    std::string value(const Item &item);
+    bool numeric() { return true; }
+    double sort_value(const Item &item);
+private:
+    BuyoutManager *buyout_manager_;
+};
@@ -0,0 +1,96 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "columnwidths.h"
+
+#include <QHeaderView>
+#include <QTreeView>
+#include <algorithm>
+
+// rows looked at per update, half around the top of the viewport, half spread over the rest
+const int COLUMN_SAMPLE_ROWS = 256;
+// space around the text taken by the item delegate
+const int COLUMN_PADDING = 12;
+// cached widths per column, the cache is dropped when it grows past this
+const int COLUMN_TEXT_CACHE_SIZE = 4096;
+
+ColumnWidths::ColumnWidths(QTreeView *view):
+    view_(view),
+    metrics_(view->font())
+{}
+
+int ColumnWidths::TextWidth(int column, const QString &text) {
+    QHash<QString, int> &cache = text_widths_[column];
+    auto it = cache.find(text);
+    if (it != cache.end())
+        return it.value();
+    if (cache.size() >= COLUMN_TEXT_CACHE_SIZE)
+        cache.clear();
+    int width = metrics_.width(text);
+    cache.insert(text, width);
+    return width;
+}
+
+void ColumnWidths::SetMinimumWidth(int column, int width) {
+    if (static_cast<int>(min_widths_.size()) <= column)
+        min_widths_.resize(column + 1, 0);
+    min_widths_[column] = width;
+}
+
+void ColumnWidths::Update() {
+    QAbstractItemModel *model = view_->model();
+    if (!model)
+        return;
+    int columns = model->columnCount();
+    int rows = model->rowCount();
+    if (static_cast<int>(widths_.size()) < columns) {
+        widths_.resize(columns, 0);
+        text_widths_.resize(columns);
+    }
+
+    std::vector<int> sample;
+    if (rows <= COLUMN_SAMPLE_ROWS) {
+        for (int row = 0; row < rows; ++row)
+            sample.push_back(row);
+    } else {
+        QModelIndex top = view_->indexAt(QPoint(0, 0));
+        int first = top.isValid() ? top.row() : 0;
+        for (int row = first; row < rows && row < first + COLUMN_SAMPLE_ROWS / 2; ++row)
+            sample.push_back(row);
+        int step = rows / (COLUMN_SAMPLE_ROWS / 2);
+        for (int row = 0; row < rows; row += step)
+            sample.push_back(row);
+    }
+
+    for (int column = 0; column < columns; ++column) {
+        int width = TextWidth(column, model->headerData(column, Qt::Horizontal, Qt::DisplayRole).toString());
+        for (auto row : sample)
+            width = std::max(width, TextWidth(column, model->data(model->index(row, column)).toString()));
+        width += COLUMN_PADDING;
+        // the first column also has the tree indentation
+        if (column == 0)
+            width += view_->indentation();
+        if (column < static_cast<int>(min_widths_.size()))
+            width = std::max(width, min_widths_[column]);
+        if (width > widths_[column]) {
+            widths_[column] = width;
+            view_->header()->resizeSection(column, width);
+        }
+    }
+}
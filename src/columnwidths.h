@@ -0,0 +1,52 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QFontMetrics>
+#include <QHash>
+#include <QString>
+#include <vector>
+
+class QTreeView;
+
+/*
+ * Sizes the columns of a view from a bounded sample of rows instead of
+ * measuring every row like resizeColumnToContents does. Columns only ever
+ * get wider, so they don't jump around as results change, and text widths
+ * are cached per column since the same values show up over and over.
+ */
+class ColumnWidths {
+public:
+    explicit ColumnWidths(QTreeView *view);
+    // Measures up to COLUMN_SAMPLE_ROWS rows of the current model and widens
+    // columns whose widest sampled value doesn't fit
+    void Update();
+    // Column is never made narrower than width, e.g. for cells drawn by a delegate
+    void SetMinimumWidth(int column, int width);
+private:
+    int TextWidth(int column, const QString &text);
+
+    QTreeView *view_;
+    QFontMetrics metrics_;
+    // by column
+    std::vector<int> widths_;
+    std::vector<int> min_widths_;
+    std::vector<QHash<QString, int>> text_widths_;
+};
@@ -24,11 +24,14 @@
 #include <QFile>
 #include <QString>
 #include <stdexcept>
+#include "QsLog.h"
 
-#include "mainwindow.h"
+#include "application.h"
+#include "perfstats.h"
 
-DataManager::DataManager(MainWindow *app, const std::string &directory):
-    app_(app)
+DataManager::DataManager(Application *app, const std::string &directory):
+    app_(app),
+    batch_depth_(0)
 {
     if (!QDir(directory.c_str()).exists())
         QDir().mkdir(directory.c_str());
@@ -38,34 +41,74 @@ DataManager::DataManager(MainWindow *app, const std::string &directory):
     if (sqlite3_open(filename_.c_str(), &db_) != SQLITE_OK) {
         throw std::runtime_error("Failed to open sqlite3 database.");
     }
-    std::string query = "CREATE TABLE IF NOT EXISTS data(key TEXT PRIMARY KEY, value BLOB)";
+    // With WAL and synchronous=NORMAL commits don't wait for fsync, the database
+    // can lose the last few transactions on power loss but never gets corrupted.
+    Exec("PRAGMA journal_mode=WAL");
+    Exec("PRAGMA synchronous=NORMAL");
+    // in KiB when negative
+    Exec("PRAGMA cache_size=-16384");
+    // BuyoutStore writes to the same database from its own connection
+    sqlite3_busy_timeout(db_, 5000);
+    if (!Exec("CREATE TABLE IF NOT EXISTS data(key TEXT PRIMARY KEY, value BLOB)"))
+        throw std::runtime_error("Failed to create the data table.");
+
+    if (sqlite3_prepare_v2(db_, "SELECT value FROM data WHERE key = ?", -1, &get_stmt_, 0) != SQLITE_OK
+            || sqlite3_prepare_v2(db_, "INSERT OR REPLACE INTO data (key, value) VALUES (?, ?)", -1, &set_stmt_, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to prepare statements.");
+}
+
+bool DataManager::Exec(const std::string &query) {
     if (sqlite3_exec(db_, query.c_str(), 0, 0, 0) != SQLITE_OK) {
-        throw std::runtime_error("Failed to execute creation statement.");
+        QLOG_ERROR() << "Failed to execute" << query.c_str() << ":" << sqlite3_errmsg(db_);
+        return false;
     }
+    return true;
 }
 
 std::string DataManager::Get(const std::string &key) {
-    std::string query = "SELECT value FROM data WHERE key = ?";
-    sqlite3_stmt *stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(get_stmt_, 1, key.c_str(), -1, SQLITE_STATIC);
     std::string result;
-    if (sqlite3_step(stmt) == SQLITE_ROW)
-        result = std::string(static_cast<const char*>(sqlite3_column_blob(stmt, 0)), sqlite3_column_bytes(stmt, 0));
-    sqlite3_finalize(stmt);
+    if (sqlite3_step(get_stmt_) == SQLITE_ROW && sqlite3_column_bytes(get_stmt_, 0) > 0)
+        result = std::string(static_cast<const char*>(sqlite3_column_blob(get_stmt_, 0)), sqlite3_column_bytes(get_stmt_, 0));
+    sqlite3_reset(get_stmt_);
+    sqlite3_clear_bindings(get_stmt_);
     return result;
 }
 
 void DataManager::Set(const std::string &key, const std::string &value) {
-    std::string query = "INSERT OR REPLACE INTO data (key, value) VALUES (?, ?)";
-    sqlite3_stmt *stmt;
-    sqlite3_prepare(db_, query.c_str(), -1, &stmt, 0);
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 2, value.c_str(), value.size(), SQLITE_STATIC);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    PerfTimer timer("DataManager::Set");
+    sqlite3_bind_text(set_stmt_, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_blob(set_stmt_, 2, value.c_str(), value.size(), SQLITE_STATIC);
+    if (sqlite3_step(set_stmt_) != SQLITE_DONE)
+        QLOG_ERROR() << "Failed to set" << key.c_str() << ":" << sqlite3_errmsg(db_);
+    sqlite3_reset(set_stmt_);
+    sqlite3_clear_bindings(set_stmt_);
+}
+
+void DataManager::BeginBatch() {
+    if (batch_depth_++ == 0)
+        Exec("BEGIN");
+}
+
+bool DataManager::Commit() {
+    if (batch_depth_ == 0) {
+        QLOG_WARN() << "DataManager::Commit called without BeginBatch";
+        return false;
+    }
+    if (--batch_depth_ > 0 || Exec("COMMIT"))
+        return true;
+    // otherwise the transaction stays open and every later BEGIN fails
+    sqlite3_exec(db_, "ROLLBACK", 0, 0, 0);
+    return false;
 }
 
 DataManager::~DataManager() {
+    // whatever wasn't committed is incomplete
+    if (batch_depth_ > 0) {
+        QLOG_WARN() << "DataManager destroyed in the middle of a batch, rolling it back";
+        sqlite3_exec(db_, "ROLLBACK", 0, 0, 0);
+    }
+    sqlite3_finalize(get_stmt_);
+    sqlite3_finalize(set_stmt_);
     sqlite3_close(db_);
 }
@@ -22,18 +22,33 @@
 #include "sqlite/sqlite3.h"
 #include <string>
 
-class MainWindow;
+class Application;
 
 class DataManager {
 public:
-    DataManager(MainWindow *app, const std::string &directory_);
+    DataManager(Application *app, const std::string &directory_);
     ~DataManager();
+    DataManager(const DataManager&) = delete;
+    DataManager& operator=(const DataManager&) = delete;
     void Set(const std::string &key, const std::string &value);
     std::string Get(const std::string &key);
+    /*
+     * Everything written between BeginBatch and Commit goes into a single
+     * transaction. Batches can be nested, only the outermost Commit
+     * actually commits. A failed commit is rolled back and returns false.
+     */
+    void BeginBatch();
+    bool Commit();
+    sqlite3 *db() const { return db_; }
+    const std::string &filename() const { return filename_; }
 private:
-    MainWindow *app_;
+    // logs errors, false if the query failed
+    bool Exec(const std::string &query);
+    Application *app_;
     std::string email_;
     std::string league_;
     std::string filename_;
     sqlite3 *db_;
+    sqlite3_stmt *get_stmt_, *set_stmt_;
+    int batch_depth_;
 };
@@ -22,12 +22,34 @@
 
 #include "filters.h"
 
+#include <algorithm>
+#include <limits>
+
+#include "bitmap.h"
+#include "buyoutmanager.h"
+#include "itemsindex.h"
+#include "modtemplates.h"
+#include "rangekernels.h"
+
 const int FILTER_LABEL_WIDTH = 40;
 
 FilterData* Filter::CreateData() {
     return new FilterData(this);
 }
 
+void Filter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    for (size_t i = 0; i < index.size(); ++i)
+        if (Matches(index.item(i), data))
+            result->Set(i);
+}
+
+void Filter::EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result) {
+    candidates.ForEach([&](size_t i) {
+        if (Matches(index.item(i), data))
+            result->Set(i);
+    });
+}
+
 FilterData::FilterData(Filter *filter):
     filter_(filter),
     text_query(""),
@@ -42,6 +64,34 @@ bool FilterData::Matches(const std::shared_ptr<Item> item) {
     return filter_->Matches(item, this);
 }
 
+void FilterData::Evaluate(const ItemsIndex &index, Bitmap *result) {
+    filter_->Evaluate(index, this, result);
+}
+
+bool FilterData::IsActive() {
+    return filter_->IsActive(this);
+}
+
+bool FilterData::ToRangeQuery(const ItemsIndex &index, RangeQuery *query) {
+    return filter_->ToRangeQuery(index, this, query);
+}
+
+void FilterData::EvaluateSubset(const ItemsIndex &index, const Bitmap &candidates, Bitmap *result) {
+    filter_->EvaluateSubset(index, this, candidates, result);
+}
+
+bool FilterData::Narrows(const FilterData &previous) const {
+    return filter_->Narrows(previous, *this);
+}
+
+bool FilterData::SameAs(const FilterData &other) const {
+    return filter_ == other.filter_ && text_query == other.text_query && prices == other.prices
+        && min_filled == other.min_filled && max_filled == other.max_filled
+        && (!min_filled || min == other.min) && (!max_filled || max == other.max)
+        && r_filled == other.r_filled && g_filled == other.g_filled && b_filled == other.b_filled
+        && (!r_filled || r == other.r) && (!g_filled || g == other.g) && (!b_filled || b == other.b);
+}
+
 void FilterData::FromForm() {
     filter_->FromForm(this);
 }
@@ -50,8 +100,15 @@ void FilterData::ToForm() {
     filter_->ToForm(this);
 }
 
-NameSearchFilter::NameSearchFilter(QLayout *parent) {
-    Initialize(parent);
+void FilterData::Refresh() {
+    filter_->Refresh(this);
+}
+
+NameSearchFilter::NameSearchFilter(QLayout *parent, TextField field, const std::string &placeholder):
+    field_(field)
+{
+    if (parent)
+        Initialize(parent, placeholder);
 }
 
 void NameSearchFilter::FromForm(FilterData *data) {
@@ -68,31 +125,77 @@ void NameSearchFilter::ResetForm() {
 
 bool NameSearchFilter::Matches(const std::shared_ptr<Item> &item, FilterData *data) {
     std::string query = data->text_query;
-    std::string name = item->PrettyName();
     std::transform(query.begin(), query.end(), query.begin(), ::tolower);
-    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-    return name.find(query) != std::string::npos;
+    return ItemsIndex::ItemText(*item, field_).find(query) != std::string::npos;
+}
+
+void NameSearchFilter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    std::string query = data->text_query;
+    std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+    auto &text = index.text(field_);
+    Bitmap candidates(index.size());
+    if (!index.trigrams(field_).Candidates(query, &candidates)) {
+        for (size_t i = 0; i < text.size(); ++i)
+            if (text[i].find(query) != std::string::npos)
+                result->Set(i);
+        return;
+    }
+    candidates.ForEach([&](size_t i) {
+        if (text[i].find(query) != std::string::npos)
+            result->Set(i);
+    });
+}
+
+void NameSearchFilter::EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result) {
+    std::string query = data->text_query;
+    std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+    auto &text = index.text(field_);
+    Bitmap rows(index.size());
+    if (index.trigrams(field_).Candidates(query, &rows))
+        rows.And(candidates);
+    else
+        rows = candidates;
+    rows.ForEach([&](size_t i) {
+        if (text[i].find(query) != std::string::npos)
+            result->Set(i);
+    });
+}
+
+bool NameSearchFilter::IsActive(FilterData *data) {
+    return !data->text_query.empty();
 }
 
-void NameSearchFilter::Initialize(QLayout *parent) {
+bool NameSearchFilter::Narrows(const FilterData &previous, const FilterData &current) {
+    // anything containing the new query also contains the old one
+    std::string before = previous.text_query, after = current.text_query;
+    std::transform(before.begin(), before.end(), before.begin(), ::tolower);
+    std::transform(after.begin(), after.end(), after.begin(), ::tolower);
+    return after.find(before) != std::string::npos;
+}
+
+void NameSearchFilter::Initialize(QLayout *parent, const std::string &placeholder) {
     textbox_ = new QLineEdit;
+    if (!placeholder.empty())
+        textbox_->setPlaceholderText(placeholder.c_str());
     parent->addWidget(textbox_);
     QObject::connect(textbox_, SIGNAL(textEdited(const QString&)),
                      parent->parentWidget()->window(), SLOT(OnSearchFormChange()));
 }
 
 MinMaxFilter::MinMaxFilter(QLayout *parent, std::string property):
-    property_(property),
+    property_(IString(property)),
     caption_(property)
 {
-    Initialize(parent);
+    if (parent)
+        Initialize(parent);
 }
 
 MinMaxFilter::MinMaxFilter(QLayout *parent, std::string property, std::string caption):
-    property_(property),
+    property_(IString(property)),
     caption_(caption)
 {
-    Initialize(parent);
+    if (parent)
+        Initialize(parent);
 }
 
 void MinMaxFilter::Initialize(QLayout *parent) {
@@ -155,40 +258,270 @@ bool MinMaxFilter::Matches(const std::shared_ptr<Item> &item, FilterData *data)
     }
 }
 
+SimplePropertyFilter::SimplePropertyFilter(QLayout *parent, std::string property):
+    MinMaxFilter(parent, property),
+    attribute_(Item::NumericAttributeForProperty(property))
+{}
+
+SimplePropertyFilter::SimplePropertyFilter(QLayout *parent, std::string property, std::string caption):
+    MinMaxFilter(parent, property, caption),
+    attribute_(Item::NumericAttributeForProperty(property))
+{}
+
+void MinMaxFilter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    RangeQuery query;
+    if (!ToRangeQuery(index, data, &query)) {
+        Filter::Evaluate(index, data, result);
+        return;
+    }
+    if (!IsActive(data)) {
+        result->Fill(true);
+        return;
+    }
+    EvaluateRanges({ query }, index.size(), result);
+}
+
+bool MinMaxFilter::ToRangeQuery(const ItemsIndex &index, FilterData *data, RangeQuery *query) {
+    int column = index_column();
+    if (column < 0)
+        return false;
+    query->values = index.column(column);
+    query->min = data->min_filled ? static_cast<float>(data->min) : -std::numeric_limits<float>::infinity();
+    query->max = data->max_filled ? static_cast<float>(data->max) : std::numeric_limits<float>::infinity();
+    query->present = column < ATTRIBUTE_COUNT ? &index.present(column) : nullptr;
+    query->column = column;
+    return true;
+}
+
+void MinMaxFilter::EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result) {
+    RangeQuery query;
+    if (!ToRangeQuery(index, data, &query)) {
+        Filter::EvaluateSubset(index, data, candidates, result);
+        return;
+    }
+    candidates.ForEach([&](size_t i) {
+        if (query.values[i] >= query.min && query.values[i] <= query.max && (!query.present || query.present->Test(i)))
+            result->Set(i);
+    });
+}
+
+bool MinMaxFilter::IsActive(FilterData *data) {
+    return data->min_filled || data->max_filled;
+}
+
+bool MinMaxFilter::Narrows(const FilterData &previous, const FilterData &current) {
+    // items without the value only match when nothing is filled, so those are covered as well
+    bool min_ok = !previous.min_filled || (current.min_filled && current.min >= previous.min);
+    bool max_ok = !previous.max_filled || (current.max_filled && current.max <= previous.max);
+    return min_ok && max_ok;
+}
+
 bool SimplePropertyFilter::IsValuePresent(const std::shared_ptr<Item> &item) {
-    return item->properties().count(property_);
+    if (attribute_ != ATTRIBUTE_COUNT)
+        return item->has_numeric(attribute_);
+    return item->property(property_) != nullptr;
 }
 
 double SimplePropertyFilter::GetValue(const std::shared_ptr<Item> &item) {
-    return std::stod(item->properties().at(property_));
+    if (attribute_ != ATTRIBUTE_COUNT)
+        return item->numeric(attribute_);
+    return std::stod(*item->property(property_));
 }
 
 double RequiredStatFilter::GetValue(const std::shared_ptr<Item> &item) {
-    auto &requirements = item->requirements();
-    if (requirements.count(property_))
-        return requirements.at(property_);
-    return 0;
+    return item->requirement(property_);
+}
+
+int RequiredStatFilter::index_column() {
+    return ItemsIndex::RequirementColumn(property_);
 }
 
-ItemMethodFilter::ItemMethodFilter(QLayout *parent, std::function<double (Item *)> func, std::string caption):
+NumericAttributeFilter::NumericAttributeFilter(QLayout *parent, NumericAttribute attribute, std::string caption):
     MinMaxFilter(parent, caption, caption),
-    func_(func)
+    attribute_(attribute)
 {}
 
-double ItemMethodFilter::GetValue(const std::shared_ptr<Item> &item) {
-    return func_(&*item);
+double NumericAttributeFilter::GetValue(const std::shared_ptr<Item> &item) {
+    return item->numeric(attribute_);
 }
 
 double SocketsFilter::GetValue(const std::shared_ptr<Item> &item) {
     return item->sockets();
 }
 
+int SocketsFilter::index_column() {
+    return INDEX_SOCKETS;
+}
+
 double LinksFilter::GetValue(const std::shared_ptr<Item> &item) {
     return item->links();
 }
 
+int LinksFilter::index_column() {
+    return INDEX_LINKS;
+}
+
+PriceFilter::PriceFilter(QLayout *parent, Application *app):
+    MinMaxFilter(parent, "Price"),
+    app_(app)
+{}
+
+void PriceFilter::FromForm(FilterData *data) {
+    MinMaxFilter::FromForm(data);
+    Refresh(data);
+}
+
+void PriceFilter::Refresh(FilterData *data) {
+    // inactive filters don't hold on to prices, so buyout edits don't count as a change of the search
+    if (IsActive(data) && app_->items_index())
+        data->prices = app_->buyout_manager()->Prices(*app_->items_index());
+    else
+        data->prices.reset();
+}
+
+// Only used when data->prices were made for another index. MainWindow refreshes filter data
+// before scheduling a search over a new index, so this doesn't race with buyout edits.
+bool PriceFilter::IsValuePresent(const std::shared_ptr<Item> &item) {
+    double price;
+    return app_->buyout_manager()->NormalizedPrice(*item, &price);
+}
+
+double PriceFilter::GetValue(const std::shared_ptr<Item> &item) {
+    double price = 0;
+    app_->buyout_manager()->NormalizedPrice(*item, &price);
+    return price;
+}
+
+bool PriceFilter::ToRangeQuery(const ItemsIndex &index, FilterData *data, RangeQuery *query) {
+    if (!data->prices || data->prices->index_id != index.id())
+        return false;
+    query->values = data->prices->values.data();
+    query->min = data->min_filled ? static_cast<float>(data->min) : -std::numeric_limits<float>::infinity();
+    query->max = data->max_filled ? static_cast<float>(data->max) : std::numeric_limits<float>::infinity();
+    query->present = &data->prices->present;
+    query->column = -1;
+    return true;
+}
+
+bool PriceFilter::Narrows(const FilterData &previous, const FilterData &current) {
+    return previous.prices == current.prices && MinMaxFilter::Narrows(previous, current);
+}
+
+ModFilter::ModFilter(QLayout *parent) {
+    if (parent)
+        Initialize(parent);
+}
+
+void ModFilter::Initialize(QLayout *parent) {
+    QWidget *group = new QWidget;
+    QHBoxLayout *layout = new QHBoxLayout;
+    layout->setMargin(0);
+    textbox_mod_ = new QLineEdit;
+    textbox_min_ = new QLineEdit;
+    textbox_max_ = new QLineEdit;
+    layout->addWidget(textbox_mod_);
+    layout->addWidget(textbox_min_);
+    layout->addWidget(textbox_max_);
+    group->setLayout(layout);
+    parent->addWidget(group);
+    textbox_mod_->setPlaceholderText("+# to maximum Life");
+    textbox_min_->setPlaceholderText("min");
+    textbox_max_->setPlaceholderText("max");
+    textbox_mod_->setFixedWidth(180);
+    textbox_min_->setFixedWidth(30);
+    textbox_max_->setFixedWidth(30);
+    QObject::connect(textbox_mod_, SIGNAL(textEdited(const QString&)),
+                     parent->parentWidget()->window(), SLOT(OnSearchFormChange()));
+    QObject::connect(textbox_min_, SIGNAL(textEdited(const QString&)),
+                     parent->parentWidget()->window(), SLOT(OnSearchFormChange()));
+    QObject::connect(textbox_max_, SIGNAL(textEdited(const QString&)),
+                     parent->parentWidget()->window(), SLOT(OnSearchFormChange()));
+}
+
+void ModFilter::FromForm(FilterData *data) {
+    data->text_query = textbox_mod_->text().toUtf8().constData();
+    data->min_filled = textbox_min_->text().size() > 0;
+    data->min = textbox_min_->text().toDouble();
+    data->max_filled = textbox_max_->text().size() > 0;
+    data->max = textbox_max_->text().toDouble();
+}
+
+void ModFilter::ToForm(FilterData *data) {
+    textbox_mod_->setText(data->text_query.c_str());
+    if (data->min_filled)
+        textbox_min_->setText(QString::number(data->min));
+    else
+        textbox_min_->setText("");
+    if (data->max_filled)
+        textbox_max_->setText(QString::number(data->max));
+    else
+        textbox_max_->setText("");
+}
+
+void ModFilter::ResetForm() {
+    textbox_mod_->setText("");
+    textbox_min_->setText("");
+    textbox_max_->setText("");
+}
+
+bool ModFilter::Matches(const std::shared_ptr<Item> &item, FilterData *data) {
+    std::string query = data->text_query;
+    std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+    // same semantics as Evaluate: values of a template are summed per item
+    std::vector<std::pair<IString, float>> values;
+    auto add = [&](const IString &mod) {
+        const ParsedMod &parsed = ModTemplates::Parse(mod);
+        for (auto &value : values) {
+            if (value.first == parsed.mod_template) {
+                value.second += parsed.value;
+                return;
+            }
+        }
+        values.push_back(std::make_pair(parsed.mod_template, parsed.value));
+    };
+    for (auto &mod : item->explicitMods())
+        add(mod);
+    for (auto &mod : item->implicitMods())
+        add(mod);
+    for (auto &value : values) {
+        std::string text = value.first;
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        if (text.find(query) == std::string::npos)
+            continue;
+        if ((!data->min_filled || value.second >= data->min) && (!data->max_filled || value.second <= data->max))
+            return true;
+    }
+    return false;
+}
+
+void ModFilter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    float min = data->min_filled ? static_cast<float>(data->min) : -std::numeric_limits<float>::infinity();
+    float max = data->max_filled ? static_cast<float>(data->max) : std::numeric_limits<float>::infinity();
+    for (uint32_t id : index.mods().MatchTemplates(data->text_query)) {
+        const ModsIndex::Postings &postings = index.mods().postings(id);
+        for (size_t i = 0; i < postings.rows.size(); ++i)
+            if (postings.values[i] >= min && postings.values[i] <= max)
+                result->Set(postings.rows[i]);
+    }
+}
+
+bool ModFilter::IsActive(FilterData *data) {
+    return !data->text_query.empty();
+}
+
+bool ModFilter::Narrows(const FilterData &previous, const FilterData &current) {
+    // a longer pattern matches fewer templates and a tighter range fewer values
+    std::string before = previous.text_query, after = current.text_query;
+    std::transform(before.begin(), before.end(), before.begin(), ::tolower);
+    std::transform(after.begin(), after.end(), after.begin(), ::tolower);
+    bool min_ok = !previous.min_filled || (current.min_filled && current.min >= previous.min);
+    bool max_ok = !previous.max_filled || (current.max_filled && current.max <= previous.max);
+    return after.find(before) != std::string::npos && min_ok && max_ok;
+}
+
 SocketsColorsFilter::SocketsColorsFilter(QLayout *parent) {
-    Initialize(parent, "Colors");
+    if (parent)
+        Initialize(parent, "Colors");
 }
 
 // TODO(xyz): ugh, a lot of copypasta below, perhaps this could be done
@@ -267,42 +600,84 @@ bool SocketsColorsFilter::Matches(const std::shared_ptr<Item> &item, FilterData
         item->sockets_w());
 }
 
+void SocketsColorsFilter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    if (!IsActive(data)) {
+        result->Fill(true);
+        return;
+    }
+    float need_r = data->r_filled ? data->r : 0;
+    float need_g = data->g_filled ? data->g : 0;
+    float need_b = data->b_filled ? data->b : 0;
+    const float *r = index.column(INDEX_SOCKETS_R);
+    const float *g = index.column(INDEX_SOCKETS_G);
+    const float *b = index.column(INDEX_SOCKETS_B);
+    const float *w = index.column(INDEX_SOCKETS_W);
+    for (size_t i = 0; i < index.size(); ++i) {
+        float diff = std::max(0.0f, need_r - r[i]) + std::max(0.0f, need_g - g[i]) + std::max(0.0f, need_b - b[i]);
+        if (diff <= w[i])
+            result->Set(i);
+    }
+}
+
+bool SocketsColorsFilter::IsActive(FilterData *data) {
+    return data->r_filled || data->g_filled || data->b_filled;
+}
+
+bool SocketsColorsFilter::Narrows(const FilterData &previous, const FilterData &current) {
+    // needing more sockets of any color can only drop items
+    auto need = [](bool filled, int value) { return filled ? value : 0; };
+    return need(current.r_filled, current.r) >= need(previous.r_filled, previous.r)
+        && need(current.g_filled, current.g) >= need(previous.g_filled, previous.g)
+        && need(current.b_filled, current.b) >= need(previous.b_filled, previous.b);
+}
+
 LinksColorsFilter::LinksColorsFilter(QLayout *parent) {
-    Initialize(parent, "Linked");
+    if (parent)
+        Initialize(parent, "Linked");
+}
+
+bool LinksColorsFilter::AnyGroupMatches(const LinkGroup *groups, int need_r, int need_g, int need_b) {
+    for (int i = 0; i < MAX_LINK_GROUPS && groups[i]; ++i) {
+        int group = groups[i];
+        int diff = std::max(0, need_r - (group & 15)) + std::max(0, need_g - ((group >> 4) & 15))
+            + std::max(0, need_b - ((group >> 8) & 15));
+        if (diff <= (group >> 12))
+            return true;
+    }
+    // an item without sockets still matches a filter that needs none
+    return need_r + need_g + need_b == 0;
 }
 
 bool LinksColorsFilter::Matches(const std::shared_ptr<Item> &item, FilterData *data) {
     if (!data->r_filled && !data->g_filled && !data->b_filled)
         return true;
-    int need_r = 0, need_g = 0, need_b = 0;
-    if (data->r_filled)
-        need_r = data->r;
-    if (data->g_filled)
-        need_g = data->g;
-    if (data->b_filled)
-        need_b = data->b;
-    int current = 0, got_r = 0, got_g = 0, got_b = 0, got_w = 0;
-    for (auto &socket : item->json()["sockets"]) {
-        if (current != socket["group"].asInt()) {
-            if (Check(need_r, need_g, need_b, got_r, got_g, got_b, got_w))
-                return true;
-            got_r = got_g = got_b = 0;
-        }
-        current = socket["group"].asInt();
-        switch (socket["attr"].asString()[0]) {
-        case 'S':
-            ++got_r;
-            break;
-        case 'D':
-            ++got_g;
-            break;
-        case 'I':
-            ++got_b;
-            break;
-        case 'G':
-            ++got_w;
-            break;
-        }
+    return AnyGroupMatches(item->link_groups(), data->r_filled ? data->r : 0,
+        data->g_filled ? data->g : 0, data->b_filled ? data->b : 0);
+}
+
+void LinksColorsFilter::Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result) {
+    if (!IsActive(data)) {
+        result->Fill(true);
+        return;
+    }
+    int need_r = data->r_filled ? data->r : 0;
+    int need_g = data->g_filled ? data->g : 0;
+    int need_b = data->b_filled ? data->b : 0;
+    for (size_t i = 0; i < index.size(); ++i)
+        if (AnyGroupMatches(index.link_groups(i), need_r, need_g, need_b))
+            result->Set(i);
+}
+
+void LinksColorsFilter::EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result) {
+    if (!IsActive(data)) {
+        *result = candidates;
+        return;
     }
-    return Check(need_r, need_g, need_b, got_r, got_g, got_b, got_w);
+    int need_r = data->r_filled ? data->r : 0;
+    int need_g = data->g_filled ? data->g : 0;
+    int need_b = data->b_filled ? data->b : 0;
+    candidates.ForEach([&](size_t i) {
+        if (AnyGroupMatches(index.link_groups(i), need_r, need_g, need_b))
+            result->Set(i);
+    });
 }
@@ -19,22 +19,33 @@
 
 #pragma once
 
-#include <functional>
-
 #include "item.h"
+#include "itemsindex.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
 class QLineEdit;
+class Bitmap;
 class FilterData;
+class ItemsIndex;
+struct NormalizedPrices;
+struct RangeQuery;
 
 /*
  * Objects of subclasses of this class do the following:
  * 1) FromForm: provided with a FilterData fill it with data from form
  * 2) ToForm: provided with a FilterData fill form with data from it
  * 3) Matches: check if an item matches the filter provided with FilterData
+ * 4) Evaluate: same as Matches but for all items of an ItemsIndex at once,
+ *    filters that can work on index columns override it
+ * 5) Narrows: tells Search that new filter data can only match a subset of
+ *    what the old data matched, so it can re-check just the previous results
+ * 6) Refresh: updates the parts of FilterData that don't come from the form
+ *    (e.g. buyouts) for the current items, on the GUI thread
  * Objects here should not store any data (except pointers to
  * widgets that were created in Initialize)
+ * Filters made with a null layout have no widgets, code fills in their
+ * FilterData (see QueryServer) and the form methods must not be called.
  */
 class Filter {
 public:
@@ -42,6 +53,20 @@ public:
     virtual void ToForm(FilterData *data) = 0;
     virtual void ResetForm() = 0;
     virtual bool Matches(const std::shared_ptr<Item> &item, FilterData *data) = 0;
+    // Sets bits of matching items in result which initially has all bits cleared
+    virtual void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    // Inactive filters match every item and can be skipped
+    virtual bool IsActive(FilterData * /* data */) { return true; }
+    // Filters that are a plain range check over an index column describe it here,
+    // so Search can evaluate all of them in a single pass
+    virtual bool ToRangeQuery(const ItemsIndex & /* index */, FilterData * /* data */, RangeQuery * /* query */) { return false; }
+    // Like Evaluate but only looks at rows set in candidates
+    virtual void EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result);
+    virtual bool Narrows(const FilterData & /* previous */, const FilterData & /* current */) { return false; }
+    // Filters that look up matches in an inverted index cost about the same with or
+    // without candidates, Search evaluates them over all rows and keeps the result
+    virtual bool IndexDriven() { return false; }
+    virtual void Refresh(FilterData * /* data */) {}
     FilterData *CreateData();
 };
 
@@ -54,8 +79,17 @@ public:
     FilterData(Filter *filter);
     Filter *filter () { return filter_; }
     bool Matches(const std::shared_ptr<Item> item);
+    void Evaluate(const ItemsIndex &index, Bitmap *result);
+    bool IsActive();
+    bool ToRangeQuery(const ItemsIndex &index, RangeQuery *query);
+    void EvaluateSubset(const ItemsIndex &index, const Bitmap &candidates, Bitmap *result);
+    bool IndexDriven() { return filter_->IndexDriven(); }
+    // true if this can only match a subset of what previous matched
+    bool Narrows(const FilterData &previous) const;
+    bool SameAs(const FilterData &other) const;
     void FromForm();
     void ToForm();
+    void Refresh();
     // Various types of data for various filters
     // It's probably not a very elegant solution but it works.
     std::string text_query;
@@ -63,20 +97,29 @@ public:
     bool min_filled, max_filled;
     int r, g, b;
     bool r_filled, g_filled, b_filled;
+    // snapshot of BuyoutManager::Prices for price filters
+    std::shared_ptr<const NormalizedPrices> prices;
 private:
     Filter *filter_;
 };
 
+// Case-insensitive substring search on one of the indexed text fields
 class NameSearchFilter : public Filter {
 public:
-    explicit NameSearchFilter(QLayout *parent);
+    explicit NameSearchFilter(QLayout *parent, TextField field = TEXT_NAME, const std::string &placeholder = "");
     void FromForm(FilterData *data);
     void ToForm(FilterData *data);
     void ResetForm();
     bool Matches(const std::shared_ptr<Item> &item, FilterData *data);
-    void Initialize(QLayout *parent);
+    void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    void EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result);
+    bool IsActive(FilterData *data);
+    bool Narrows(const FilterData &previous, const FilterData &current);
+    bool IndexDriven() { return true; }
+    void Initialize(QLayout *parent, const std::string &placeholder);
 private:
     QLineEdit *textbox_;
+    TextField field_;
 };
 
 class MinMaxFilter : public Filter {
@@ -87,21 +130,33 @@ public:
     void ToForm(FilterData *data);
     void ResetForm();
     bool Matches(const std::shared_ptr<Item> &item, FilterData *data);
+    void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    bool IsActive(FilterData *data);
+    bool ToRangeQuery(const ItemsIndex &index, FilterData *data, RangeQuery *query);
+    void EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result);
+    bool Narrows(const FilterData &previous, const FilterData &current);
     void Initialize(QLayout *parent);
 private:
     virtual double GetValue(const std::shared_ptr<Item> &item) = 0;
     virtual bool IsValuePresent(const std::shared_ptr<Item> &item) = 0;
+    // IndexColumn holding the same values as GetValue, -1 if there's none
+    virtual int index_column() { return -1; }
     QLineEdit *textbox_min_, *textbox_max_;
 protected:
-    std::string property_, caption_;
+    IString property_;
+    std::string caption_;
 };
 
+// Uses precomputed Item::numeric() when the property has one, parses the property text otherwise
 class SimplePropertyFilter : public MinMaxFilter {
 public:
-    using MinMaxFilter::MinMaxFilter;
+    SimplePropertyFilter(QLayout *parent, std::string property);
+    SimplePropertyFilter(QLayout *parent, std::string property, std::string caption);
 private:
     bool IsValuePresent(const std::shared_ptr<Item> &item);
     double GetValue(const std::shared_ptr<Item> &item);
+    int index_column() { return attribute_ == ATTRIBUTE_COUNT ? -1 : attribute_; }
+    NumericAttribute attribute_;
 };
 
 class RequiredStatFilter : public MinMaxFilter {
@@ -110,15 +165,18 @@ public:
 private:
     bool IsValuePresent(const std::shared_ptr<Item> & /* item */) { return true; }
     double GetValue(const std::shared_ptr<Item> &item);
+    int index_column();
 };
 
-class ItemMethodFilter : public MinMaxFilter {
+// Filters on one of Item::numeric(), missing values count as 0
+class NumericAttributeFilter : public MinMaxFilter {
 public:
-    ItemMethodFilter(QLayout *parent, std::function<double(Item*)> func, std::string caption);
+    NumericAttributeFilter(QLayout *parent, NumericAttribute attribute, std::string caption);
 private:
     bool IsValuePresent(const std::shared_ptr<Item> & /* item */) { return true; }
     double GetValue(const std::shared_ptr<Item> &item);
-    std::function<double(Item*)> func_;
+    int index_column() { return attribute_; }
+    NumericAttribute attribute_;
 };
 
 class SocketsFilter : public MinMaxFilter {
@@ -126,6 +184,7 @@ public:
     using MinMaxFilter::MinMaxFilter;
     bool IsValuePresent(const std::shared_ptr<Item> & /* item */) { return true; }
     double GetValue(const std::shared_ptr<Item> &item);
+    int index_column();
 };
 
 class LinksFilter : public MinMaxFilter {
@@ -133,6 +192,41 @@ public:
     using MinMaxFilter::MinMaxFilter;
     bool IsValuePresent(const std::shared_ptr<Item> & /* item */) { return true; }
     double GetValue(const std::shared_ptr<Item> &item);
+    int index_column();
+};
+
+// Filters on buyouts in chaos orbs, items without a price (or a rate for its currency) don't match
+class PriceFilter : public MinMaxFilter {
+public:
+    PriceFilter(QLayout *parent, Application *app);
+    void FromForm(FilterData *data);
+    // a range over data->prices as long as they were made for index, otherwise
+    // Matches resolves the price of every item through BuyoutManager::NormalizedPrice
+    bool ToRangeQuery(const ItemsIndex &index, FilterData *data, RangeQuery *query);
+    bool Narrows(const FilterData &previous, const FilterData &current);
+    void Refresh(FilterData *data);
+private:
+    bool IsValuePresent(const std::shared_ptr<Item> &item);
+    double GetValue(const std::shared_ptr<Item> &item);
+    Application *app_;
+};
+
+// Matches a mod template such as "+# to maximum Life" with the value
+// (average of the numbers in the mod) between min and max
+class ModFilter : public Filter {
+public:
+    explicit ModFilter(QLayout *parent);
+    void FromForm(FilterData *data);
+    void ToForm(FilterData *data);
+    void ResetForm();
+    bool Matches(const std::shared_ptr<Item> &item, FilterData *data);
+    void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    bool IsActive(FilterData *data);
+    bool Narrows(const FilterData &previous, const FilterData &current);
+    bool IndexDriven() { return true; }
+    void Initialize(QLayout *parent);
+private:
+    QLineEdit *textbox_mod_, *textbox_min_, *textbox_max_;
 };
 
 class SocketsColorsFilter : public Filter {
@@ -143,6 +237,9 @@ public:
     void ToForm(FilterData *data);
     void ResetForm();
     bool Matches(const std::shared_ptr<Item> &item, FilterData *data);
+    void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    bool IsActive(FilterData *data);
+    bool Narrows(const FilterData &previous, const FilterData &current);
     void Initialize(QLayout *parent, const char* caption);
 protected:
     bool Check(int need_r, int need_g, int need_b, int got_r, int got_g, int got_b, int got_w);
@@ -153,4 +250,10 @@ class LinksColorsFilter : public SocketsColorsFilter {
 public:
     explicit LinksColorsFilter(QLayout *parent);
     bool Matches(const std::shared_ptr<Item> &item, FilterData *data);
+    // scans ItemsIndex::link_groups()
+    void Evaluate(const ItemsIndex &index, FilterData *data, Bitmap *result);
+    void EvaluateSubset(const ItemsIndex &index, FilterData *data, const Bitmap &candidates, Bitmap *result);
+private:
+    // true if one of the MAX_LINK_GROUPS groups has the needed colors, white sockets fill in for any color
+    static bool AnyGroupMatches(const LinkGroup *groups, int need_r, int need_g, int need_b);
 };
@@ -0,0 +1,172 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash128.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint64_t C1 = 0x87c37b91114253d5ULL;
+const uint64_t C2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// little-endian load regardless of alignment
+inline uint64_t Load(const uint8_t *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+inline uint64_t ByteSwap(uint64_t x) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i, x >>= 8)
+        value = (value << 8) | (x & 0xff);
+    return value;
+}
+
+}
+
+bool HashKey::FromHex(const std::string &hex, HashKey *key) {
+    if (hex.size() != 32)
+        return false;
+    uint64_t parts[2] = { 0, 0 };
+    for (size_t i = 0; i < 32; ++i) {
+        char c = hex[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        parts[i / 16] = (parts[i / 16] << 4) | digit;
+    }
+    key->hi = parts[0];
+    key->lo = parts[1];
+    return true;
+}
+
+std::string HashKey::ToHex() const {
+    static const char HEX[] = "0123456789abcdef";
+    std::string result(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        result[15 - i] = HEX[(hi >> (4 * i)) & 15];
+        result[31 - i] = HEX[(lo >> (4 * i)) & 15];
+    }
+    return result;
+}
+
+Hasher128::Hasher128(uint64_t seed):
+    h1_(seed),
+    h2_(seed),
+    buffered_(0),
+    length_(0)
+{}
+
+void Hasher128::Block(const uint8_t *block) {
+    uint64_t k1 = Load(block), k2 = Load(block + 8);
+
+    k1 *= C1; k1 = Rotl(k1, 31); k1 *= C2; h1_ ^= k1;
+    h1_ = Rotl(h1_, 27); h1_ += h2_; h1_ = h1_ * 5 + 0x52dce729;
+
+    k2 *= C2; k2 = Rotl(k2, 33); k2 *= C1; h2_ ^= k2;
+    h2_ = Rotl(h2_, 31); h2_ += h1_; h2_ = h2_ * 5 + 0x38495ab5;
+}
+
+void Hasher128::Update(const void *data, size_t size) {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    length_ += size;
+    if (buffered_) {
+        size_t take = std::min(size, sizeof(buffer_) - buffered_);
+        memcpy(buffer_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        size -= take;
+        if (buffered_ < sizeof(buffer_))
+            return;
+        Block(buffer_);
+        buffered_ = 0;
+    }
+    for (; size >= 16; p += 16, size -= 16)
+        Block(p);
+    memcpy(buffer_, p, size);
+    buffered_ = size;
+}
+
+void Hasher128::AddString(const char *s, size_t size) {
+    AddInt(size);
+    Update(s, size);
+}
+
+void Hasher128::AddInt(int64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i));
+    Update(bytes, sizeof(bytes));
+}
+
+void Hasher128::Finalize() {
+    // tail, same as MurmurHash3_x64_128
+    uint8_t tail[16] = {};
+    memcpy(tail, buffer_, buffered_);
+    uint64_t k1 = Load(tail), k2 = Load(tail + 8);
+    if (buffered_ > 8) {
+        k2 *= C2; k2 = Rotl(k2, 33); k2 *= C1; h2_ ^= k2;
+    }
+    if (buffered_ > 0) {
+        k1 *= C1; k1 = Rotl(k1, 31); k1 *= C2; h1_ ^= k1;
+    }
+
+    h1_ ^= length_;
+    h2_ ^= length_;
+    h1_ += h2_;
+    h2_ += h1_;
+    h1_ = Fmix(h1_);
+    h2_ = Fmix(h2_);
+    h1_ += h2_;
+    h2_ += h1_;
+}
+
+HashKey Hasher128::Digest() {
+    Finalize();
+    // the hex digest lists the bytes of both halves little-endian first, as the reference
+    // implementation writes them, and HashKey reads hex big-endian
+    return { ByteSwap(h1_), ByteSwap(h2_) };
+}
+
+std::string Hasher128::HexDigest() {
+    return Digest().ToHex();
+}
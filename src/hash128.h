@@ -0,0 +1,63 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Binary form of a 32 hex digit hash, cheap to compare and to hash again
+struct HashKey {
+    uint64_t hi, lo;
+    bool operator==(const HashKey &other) const { return hi == other.hi && lo == other.lo; }
+    bool operator!=(const HashKey &other) const { return !(*this == other); }
+    // false if hex isn't 32 hex digits
+    static bool FromHex(const std::string &hex, HashKey *key);
+    std::string ToHex() const;
+};
+
+/*
+ * Streaming 128-bit MurmurHash3 (x64 variant). Not cryptographic, only used
+ * to tell items apart, but much cheaper than MD5 and can be fed field by
+ * field without building a temporary string first.
+ */
+class Hasher128 {
+public:
+    explicit Hasher128(uint64_t seed = 0);
+    void Update(const void *data, size_t size);
+    // Length-prefixed so that ("ab", "c") and ("a", "bc") hash differently
+    void AddString(const char *s, size_t size);
+    void AddString(const char *s) { AddString(s, strlen(s)); }
+    void AddString(const std::string &s) { AddString(s.c_str(), s.size()); }
+    void AddInt(int64_t value);
+    // 32 lowercase hex digits, the hasher can't be updated afterwards
+    std::string HexDigest();
+    // Same hash in binary, equal to HashKey::FromHex(HexDigest())
+    HashKey Digest();
+private:
+    void Block(const uint8_t *block);
+    void Finalize();
+
+    uint64_t h1_, h2_;
+    uint8_t buffer_[16];
+    size_t buffered_;
+    uint64_t length_;
+};
@@ -0,0 +1,121 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "hash128.h"
+
+/*
+ * Open-addressing hash map from HashKey to V with linear probing. Keys are
+ * already well mixed hashes, so the low bits are used as the slot directly.
+ * Erased slots become tombstones that are dropped on the next grow.
+ */
+template<class V>
+class HashKeyMap {
+public:
+    HashKeyMap(): size_(0), used_(0) {}
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // nullptr if key isn't there
+    const V *Find(const HashKey &key) const {
+        size_t i = Lookup(key);
+        return i == NOT_FOUND ? nullptr : &slots_[i].value;
+    }
+    V *Find(const HashKey &key) {
+        size_t i = Lookup(key);
+        return i == NOT_FOUND ? nullptr : &slots_[i].value;
+    }
+    bool Contains(const HashKey &key) const { return Find(key) != nullptr; }
+    void Set(const HashKey &key, const V &value) {
+        if (V *existing = Find(key)) {
+            *existing = value;
+            return;
+        }
+        // keep at most 3/4 of the slots in use, tombstones included
+        if ((used_ + 1) * 4 > slots_.size() * 3)
+            Rehash(std::max<size_t>(16, size_ * 4 >= slots_.size() ? slots_.size() * 2 : slots_.size()));
+        size_t i = Slot(key);
+        while (slots_[i].state == FULL)
+            i = (i + 1) & (slots_.size() - 1);
+        if (slots_[i].state == EMPTY)
+            ++used_;
+        slots_[i].state = FULL;
+        slots_[i].key = key;
+        slots_[i].value = value;
+        ++size_;
+    }
+    bool Erase(const HashKey &key) {
+        size_t i = Lookup(key);
+        if (i == NOT_FOUND)
+            return false;
+        slots_[i].state = ERASED;
+        slots_[i].value = V();
+        --size_;
+        return true;
+    }
+    void Clear() {
+        slots_.clear();
+        size_ = used_ = 0;
+    }
+    template<class F>
+    void ForEach(F f) const {
+        for (auto &entry : slots_)
+            if (entry.state == FULL)
+                f(entry.key, entry.value);
+    }
+private:
+    enum State { EMPTY, FULL, ERASED };
+    struct Entry {
+        Entry(): state(EMPTY), key({ 0, 0 }), value() {}
+        State state;
+        HashKey key;
+        V value;
+    };
+    static const size_t NOT_FOUND = static_cast<size_t>(-1);
+    size_t Slot(const HashKey &key) const { return key.lo & (slots_.size() - 1); }
+    size_t Lookup(const HashKey &key) const {
+        if (slots_.empty())
+            return NOT_FOUND;
+        for (size_t i = Slot(key);; i = (i + 1) & (slots_.size() - 1)) {
+            const Entry &entry = slots_[i];
+            if (entry.state == EMPTY)
+                return NOT_FOUND;
+            if (entry.state == FULL && entry.key == key)
+                return i;
+        }
+    }
+    // capacity must be a power of two
+    void Rehash(size_t capacity) {
+        std::vector<Entry> old(capacity);
+        old.swap(slots_);
+        size_ = used_ = 0;
+        for (auto &entry : old)
+            if (entry.state == FULL)
+                Set(entry.key, entry.value);
+    }
+
+    std::vector<Entry> slots_;
+    size_t size_;
+    // FULL and ERASED slots
+    size_t used_;
+};
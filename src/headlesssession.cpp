@@ -0,0 +1,163 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "headlesssession.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSettings>
+#include <QStringList>
+#include <QUrl>
+#include "QsLog.h"
+
+#include "buyoutmanager.h"
+#include "datamanager.h"
+#include "filters.h"
+#include "itemsdelta.h"
+#include "itemsindex.h"
+#include "itemsmanager.h"
+#include "logindialog.h"
+
+HeadlessSession::HeadlessSession(const std::string &root_dir, const HeadlessOptions &options):
+    options_(options),
+    league_(options.league),
+    email_(options.session_id),
+    logged_in_nm_(new QNetworkAccessManager)
+{
+    data_manager_ = new DataManager(this, root_dir + "/data");
+    buyout_manager_ = new BuyoutManager(this);
+    InitializeFilters();
+    query_server_ = new QueryServer(this, filters_);
+
+    items_manager_ = new ItemsManager(this);
+    connect(items_manager_, SIGNAL(ItemsRefreshed(Items,std::vector<std::string>,ItemsDelta)),
+            this, SLOT(OnItemsRefreshed(Items,std::vector<std::string>,ItemsDelta)));
+    items_manager_->Init();
+    if (options_.refresh_interval > 0)
+        items_manager_->SetAutoUpdateInterval(options_.refresh_interval);
+    // postponed by the items manager until OnLoggedIn
+    items_manager_->Update();
+}
+
+HeadlessSession::~HeadlessSession() {
+    delete query_server_;
+    delete items_manager_;
+    buyout_manager_->Save();
+    delete buyout_manager_;
+    delete data_manager_;
+    delete logged_in_nm_;
+}
+
+bool HeadlessSession::ParseOptions(const QStringList &arguments, HeadlessOptions *options) {
+    QSettings settings(LOGIN_SETTINGS_FILE, QSettings::IniFormat);
+    options->league = settings.value("league", "").toString().toStdString();
+    options->session_id = settings.value("sessionID", "").toString().toStdString();
+    for (int i = 1; i + 1 < arguments.size(); ++i) {
+        const QString &name = arguments[i], &value = arguments[i + 1];
+        if (name == "--league")
+            options->league = value.toStdString();
+        else if (name == "--session-id")
+            options->session_id = value.toStdString();
+        else if (name == "--port")
+            options->port = value.toInt();
+        else if (name == "--refresh")
+            options->refresh_interval = value.toInt();
+        else
+            continue;
+        ++i;
+    }
+    if (options->league.empty() || options->session_id.empty()) {
+        QLOG_ERROR() << "Headless mode needs --league and --session-id unless they were saved by the login dialog";
+        return false;
+    }
+    if (options->port <= 0 || options->port > 65535) {
+        QLOG_ERROR() << "Bad --port";
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessSession::Start() {
+    if (!query_server_->Listen(options_.port))
+        return false;
+    QNetworkCookie cookie("PHPSESSID", QByteArray(options_.session_id.c_str()));
+    cookie.setPath("/");
+    cookie.setDomain("www.pathofexile.com");
+    logged_in_nm_->cookieJar()->insertCookie(cookie);
+    QNetworkReply *login_page = logged_in_nm_->get(QNetworkRequest(QUrl(POE_LOGIN_URL)));
+    connect(login_page, SIGNAL(finished()), this, SLOT(OnLoggedIn()));
+    QLOG_INFO() << "Headless session for" << league_.c_str() << "is logging in, serving saved items meanwhile";
+    return true;
+}
+
+void HeadlessSession::OnLoggedIn() {
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
+    reply->deleteLater();
+    // same as LoginDialog, a bad session id only shows when the stash requests fail
+    if (reply->error() != QNetworkReply::NoError)
+        QLOG_WARN() << "Login page request failed:" << reply->errorString();
+    items_manager_->SetOnline();
+}
+
+void HeadlessSession::OnItemsRefreshed(const Items &items, const std::vector<std::string> & /* tabs */,
+                                       const ItemsDelta &delta) {
+    if (items_index_ && delta.index_id == items_index_->id())
+        return;
+    items_index_ = items_manager_->items_index();
+
+    Items changed;
+    delta.dirty.ForEach([&](size_t row) { changed.push_back(items[row]); });
+    buyout_manager_->MigrateItemHashes(changed);
+    buyout_manager_->Reconcile(*items_index_, delta);
+    QLOG_INFO() << "Serving" << items_index_->size() << "items";
+}
+
+void HeadlessSession::InitializeFilters() {
+    // the filters of MainWindow::InitializeSearchForm in the same order
+    filters_ = {
+        { "name", new NameSearchFilter(nullptr), QUERY_TEXT },
+        { "mods", new NameSearchFilter(nullptr, TEXT_MODS), QUERY_TEXT },
+        { "crit", new SimplePropertyFilter(nullptr, "Critical Strike Chance", "Crit."), QUERY_RANGE },
+        { "dps", new NumericAttributeFilter(nullptr, ATTRIBUTE_DPS, "DPS"), QUERY_RANGE },
+        { "pdps", new NumericAttributeFilter(nullptr, ATTRIBUTE_PDPS, "pDPS"), QUERY_RANGE },
+        { "edps", new NumericAttributeFilter(nullptr, ATTRIBUTE_EDPS, "eDPS"), QUERY_RANGE },
+        { "aps", new SimplePropertyFilter(nullptr, "Attacks per Second", "APS"), QUERY_RANGE },
+        { "armour", new SimplePropertyFilter(nullptr, "Armour"), QUERY_RANGE },
+        { "evasion", new SimplePropertyFilter(nullptr, "Evasion"), QUERY_RANGE },
+        { "shield", new SimplePropertyFilter(nullptr, "Energy Shield", "Shield"), QUERY_RANGE },
+        { "block", new SimplePropertyFilter(nullptr, "Chance to Block", "Block"), QUERY_RANGE },
+        { "sockets", new SocketsFilter(nullptr, "Sockets"), QUERY_RANGE },
+        { "links", new LinksFilter(nullptr, "Links"), QUERY_RANGE },
+        { "colors", new SocketsColorsFilter(nullptr), QUERY_COLORS },
+        { "linked", new LinksColorsFilter(nullptr), QUERY_COLORS },
+        { "req_level", new RequiredStatFilter(nullptr, "Level", "R. Level"), QUERY_RANGE },
+        { "req_str", new RequiredStatFilter(nullptr, "Str", "R. Str"), QUERY_RANGE },
+        { "req_dex", new RequiredStatFilter(nullptr, "Dex", "R. Dex"), QUERY_RANGE },
+        { "req_int", new RequiredStatFilter(nullptr, "Int", "R. Int"), QUERY_RANGE },
+        { "quality", new SimplePropertyFilter(nullptr, "Quality"), QUERY_RANGE },
+        { "level", new SimplePropertyFilter(nullptr, "Level"), QUERY_RANGE },
+        { "price", new PriceFilter(nullptr, this), QUERY_RANGE },
+        { "mod1", new ModFilter(nullptr), QUERY_TEXT_RANGE },
+        { "mod2", new ModFilter(nullptr), QUERY_TEXT_RANGE },
+        { "mod3", new ModFilter(nullptr), QUERY_TEXT_RANGE },
+    };
+}
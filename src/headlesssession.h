@@ -0,0 +1,90 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QObject>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "application.h"
+#include "item.h"
+#include "queryserver.h"
+
+class QStringList;
+class ItemsManager;
+struct ItemsDelta;
+
+const int DEFAULT_QUERY_PORT = 8351;
+
+struct HeadlessOptions {
+    std::string league;
+    std::string session_id;
+    int port = DEFAULT_QUERY_PORT;
+    // minutes between full refreshes, 0 keeps what ItemsManager uses
+    int refresh_interval = 0;
+};
+
+/*
+ * Session for --headless runs: the same DataManager, BuyoutManager and
+ * ItemsManager (with its refresh timers) as a MainWindow, but no widgets.
+ * The items are only served to local tools through QueryServer.
+ */
+class HeadlessSession : public QObject, public Application {
+    Q_OBJECT
+public:
+    HeadlessSession(const std::string &root_dir, const HeadlessOptions &options);
+    ~HeadlessSession();
+    HeadlessSession(const HeadlessSession&) = delete;
+    HeadlessSession& operator=(const HeadlessSession&) = delete;
+    // --league, --session-id, --port and --refresh, the login saved by LoginDialog
+    // fills in what's missing. False if there's still no league or session id.
+    static bool ParseOptions(const QStringList &arguments, HeadlessOptions *options);
+    // Starts the query server and logs in, refreshing starts once that's done
+    bool Start();
+    const std::string &league() const { return league_; }
+    const std::string &email() const { return email_; }
+    DataManager *data_manager() const { return data_manager_; }
+    BuyoutManager *buyout_manager() const { return buyout_manager_; }
+    QNetworkAccessManager *logged_in_nm() const { return logged_in_nm_; }
+    const std::shared_ptr<const ItemsIndex> &items_index() const { return items_index_; }
+    const std::shared_ptr<Item> &current_item() const { return current_item_; }
+public slots:
+    void OnLoggedIn();
+    void OnItemsRefreshed(const Items &items, const std::vector<std::string> &tabs, const ItemsDelta &delta);
+private:
+    // Filters of the search form without widgets, see QueryFilter
+    void InitializeFilters();
+
+    HeadlessOptions options_;
+    std::string league_;
+    // LoginDialog keys sessions by the session id as well
+    std::string email_;
+    QNetworkAccessManager *logged_in_nm_;
+    DataManager *data_manager_;
+    BuyoutManager *buyout_manager_;
+    ItemsManager *items_manager_;
+    std::shared_ptr<const ItemsIndex> items_index_;
+    // always null, there's nobody looking at an item
+    std::shared_ptr<Item> current_item_;
+    // kept for the lifetime of the process, same as in MainWindow
+    std::vector<QueryFilter> filters_;
+    QueryServer *query_server_;
+};
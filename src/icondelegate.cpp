@@ -0,0 +1,79 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "icondelegate.h"
+
+#include <QPainter>
+#include <QTreeView>
+#include <algorithm>
+#include <string>
+
+#include "imagecache.h"
+#include "itemicons.h"
+#include "items_model.h"
+
+// space around the thumbnail
+const int THUMBNAIL_MARGIN = 1;
+
+IconDelegate::IconDelegate(ImageCache *image_cache, ItemIcons *item_icons, QTreeView *view):
+    QStyledItemDelegate(view),
+    image_cache_(image_cache),
+    item_icons_(item_icons),
+    view_(view)
+{
+    connect(image_cache_, SIGNAL(ImageReady(QString)), this, SLOT(OnImageReady(QString)));
+}
+
+void IconDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    // background and selection like every other cell
+    QStyledItemDelegate::paint(painter, option, index);
+    const ItemsModel *model = qobject_cast<const ItemsModel*>(index.model());
+    if (!model)
+        return;
+    const Item &item = *model->item(index.row());
+    if (item.icon().empty())
+        return;
+    QPixmap icon;
+    if (!image_cache_->Get(item.icon(), &icon)) {
+        image_cache_->Fetch(item.icon());
+        return;
+    }
+    QPixmap thumbnail = item_icons_->Thumbnail(item, icon, THUMBNAIL_SIZE);
+    painter->drawPixmap(option.rect.x() + (option.rect.width() - thumbnail.width()) / 2,
+                        option.rect.y() + (option.rect.height() - thumbnail.height()) / 2, thumbnail);
+}
+
+QSize IconDelegate::sizeHint(const QStyleOptionViewItem & /* option */, const QModelIndex & /* index */) const {
+    return QSize(THUMBNAIL_SIZE + 2 * THUMBNAIL_MARGIN, THUMBNAIL_SIZE + 2 * THUMBNAIL_MARGIN);
+}
+
+void IconDelegate::OnImageReady(const QString &qurl) {
+    ItemsModel *model = qobject_cast<ItemsModel*>(view_->model());
+    if (!model || model->rowCount() == 0 || model->icon_column() < 0)
+        return;
+    QModelIndex top = view_->indexAt(QPoint(0, 0));
+    if (!top.isValid())
+        return;
+    QModelIndex bottom = view_->indexAt(QPoint(0, view_->viewport()->height() - 1));
+    int last = bottom.isValid() ? bottom.row() : model->rowCount() - 1;
+    std::string url = qurl.toUtf8().constData();
+    for (int row = top.row(); row <= last; ++row)
+        if (model->item(row)->icon() == url)
+            view_->update(model->index(row, model->icon_column(), QModelIndex()));
+}
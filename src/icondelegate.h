@@ -0,0 +1,49 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QStyledItemDelegate>
+
+class ImageCache;
+class ItemIcons;
+class QTreeView;
+
+// side of the square thumbnails are scaled into
+const int THUMBNAIL_SIZE = 32;
+
+/*
+ * Draws item thumbnails in the icon column of an ItemsModel view.
+ * Only rows that are painted ask for their icons, missing ones are fetched
+ * through ImageCache and just the visible cells showing that icon are
+ * repainted once it's ready.
+ */
+class IconDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    IconDelegate(ImageCache *image_cache, ItemIcons *item_icons, QTreeView *view);
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+private slots:
+    void OnImageReady(const QString &url);
+private:
+    ImageCache *image_cache_;
+    ItemIcons *item_icons_;
+    QTreeView *view_;
+};
@@ -20,33 +20,221 @@
 #include "imagecache.h"
 
 #include <QDir>
-#include <QFile>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSaveFile>
 #include <QString>
-#include <QCryptographicHash>
+#include <QStringList>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+#include "QsLog.h"
 
-#include "mainwindow.h"
+#include "perfstats.h"
 #include "util.h"
 
-ImageCache::ImageCache(MainWindow *app, const std::string &directory):
-    app_(app),
-    directory_(directory)
+// memory taken by decoded pixmaps
+const size_t IMAGE_CACHE_BUDGET = 64 * 1024 * 1024;
+// images requested by a single Prefetch, the rest is left for later
+const size_t IMAGE_PREFETCH_MAX = 64;
+// concurrent downloads from the CDN
+const int IMAGE_MAX_DOWNLOADS = 4;
+// first wait before a failed url is tried again, doubled with every failure up to IMAGE_RETRY_MAX_MS
+const qint64 IMAGE_RETRY_MS = 30 * 1000;
+const qint64 IMAGE_RETRY_MAX_MS = 60 * 60 * 1000;
+
+ImageCache::ImageCache(const std::string &directory):
+    directory_(directory),
+    pixmaps_(IMAGE_CACHE_BUDGET),
+    io_pool_(new QThreadPool),
+    network_manager_(new QNetworkAccessManager(this)),
+    downloads_in_flight_(0)
 {
     if (!QDir(directory_.c_str()).exists())
         QDir().mkdir(directory_.c_str());
+    for (auto &file : QDir(directory_.c_str()).entryList(QStringList("*.png"), QDir::Files))
+        on_disk_.insert(file.toUtf8().constData());
+
+    // disk is the bottleneck, more threads won't help
+    io_pool_->setMaxThreadCount(2);
+    connect(this, SIGNAL(DiskImageLoaded(QString, QImage)), this, SLOT(OnDiskImageLoaded(QString, QImage)),
+            Qt::QueuedConnection);
+    connect(this, SIGNAL(DiskImageSaved(QString, bool)), this, SLOT(OnDiskImageSaved(QString, bool)),
+            Qt::QueuedConnection);
+    connect(network_manager_, SIGNAL(finished(QNetworkReply*)), this, SLOT(OnDownloadFinished(QNetworkReply*)));
+    clock_.start();
+}
+
+ImageCache::~ImageCache() {
+    io_pool_->waitForDone();
+    delete io_pool_;
 }
 
 bool ImageCache::Exists(const std::string &url) {
-    std::string path = GetPath(url);
-    QFile file(QString(path.c_str()));
-    return file.exists();
+    return pixmaps_.Contains(url) || on_disk_.count(Util::Md5(url) + ".png");
+}
+
+bool ImageCache::Get(const std::string &url, QPixmap *pixmap) {
+    bool hit = pixmaps_.Get(url, pixmap);
+    PerfStats::Count(hit ? "image cache hit" : "image cache miss");
+    return hit;
+}
+
+void ImageCache::Request(const std::string &url) {
+    if (pixmaps_.Contains(url) || loading_.count(url))
+        return;
+    loading_.insert(url);
+    QString path(GetPath(url).c_str());
+    QString qurl(url.c_str());
+    QtConcurrent::run(io_pool_, [=]() {
+        // QImage can be used outside of the GUI thread, QPixmap can't
+        emit DiskImageLoaded(qurl, QImage(path));
+    });
+}
+
+void ImageCache::Prefetch(const std::vector<std::string> &urls) {
+    size_t requested = 0;
+    for (auto &url : urls) {
+        if (requested >= IMAGE_PREFETCH_MAX)
+            break;
+        if (pixmaps_.Contains(url) || loading_.count(url) || !Exists(url))
+            continue;
+        Request(url);
+        ++requested;
+    }
+}
+
+void ImageCache::OnDiskImageLoaded(const QString &qurl, const QImage &image) {
+    std::string url = qurl.toUtf8().constData();
+    loading_.erase(url);
+    if (image.isNull()) {
+        QLOG_WARN() << "Failed to load cached image for" << qurl;
+        on_disk_.erase(Util::Md5(url) + ".png");
+        MarkFailed(url);
+        return;
+    }
+    failed_.erase(url);
+    pixmaps_.Put(url, QPixmap::fromImage(image));
+    emit ImageReady(qurl);
+}
+
+void ImageCache::Fetch(const std::string &url) {
+    if (url.empty() || Failing(url))
+        return;
+    if (Exists(url)) {
+        Request(url);
+        return;
+    }
+    if (downloading_.count(url)) {
+        // already queued or being saved, but it's wanted right now
+        warming_.erase(url);
+        auto it = std::find(download_queue_.begin(), download_queue_.end(), url);
+        if (it != download_queue_.end()) {
+            download_queue_.erase(it);
+            download_queue_.push_front(url);
+        }
+        return;
+    }
+    downloading_.insert(url);
+    download_queue_.push_front(url);
+    StartDownloads();
+}
+
+void ImageCache::Warm(const std::vector<std::string> &urls) {
+    size_t queued = 0;
+    for (auto &url : urls) {
+        if (url.empty() || downloading_.count(url) || Exists(url) || Failing(url))
+            continue;
+        downloading_.insert(url);
+        warming_.insert(url);
+        download_queue_.push_back(url);
+        ++queued;
+    }
+    if (queued)
+        QLOG_INFO() << "Downloading" << queued << "icons into the image cache.";
+    StartDownloads();
+}
+
+void ImageCache::StartDownloads() {
+    while (downloads_in_flight_ < IMAGE_MAX_DOWNLOADS && !download_queue_.empty()) {
+        std::string url = download_queue_.front();
+        download_queue_.pop_front();
+        QNetworkRequest request(QUrl(url.c_str()));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+        // icons come from a single CDN host, HTTP/2 fetches them over one connection
+        request.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif
+        network_manager_->get(request);
+        ++downloads_in_flight_;
+    }
+}
+
+void ImageCache::OnDownloadFinished(QNetworkReply *reply) {
+    reply->deleteLater();
+    --downloads_in_flight_;
+    std::string url = reply->request().url().toString().toUtf8().constData();
+    StartDownloads();
+    if (reply->error()) {
+        QLOG_WARN() << "Failed to download" << url.c_str() << ":" << reply->errorString();
+        downloading_.erase(url);
+        warming_.erase(url);
+        MarkFailed(url);
+        return;
+    }
+
+    QByteArray bytes = reply->readAll();
+    QString path(GetPath(url).c_str());
+    QString qurl(url.c_str());
+    if (warming_.count(url)) {
+        // stays in downloading_ until the file is there, so a Fetch meanwhile doesn't download it again
+        QtConcurrent::run(io_pool_, [=]() {
+            QSaveFile file(path);
+            bool ok = file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit();
+            emit DiskImageSaved(qurl, ok);
+        });
+        return;
+    }
+
+    downloading_.erase(url);
+    on_disk_.insert(Util::Md5(url) + ".png");
+    // the image is decoded from the same bytes, Request won't start a concurrent read of the file
+    loading_.insert(url);
+    QtConcurrent::run(io_pool_, [=]() {
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size() || !file.commit())
+            QLOG_WARN() << "Failed to save" << path;
+        QImage image;
+        image.loadFromData(bytes);
+        emit DiskImageLoaded(qurl, image);
+    });
+}
+
+void ImageCache::OnDiskImageSaved(const QString &qurl, bool ok) {
+    std::string url = qurl.toUtf8().constData();
+    downloading_.erase(url);
+    // Fetch took it out of warming_ if it's wanted now
+    bool wanted = !warming_.erase(url);
+    if (!ok) {
+        QLOG_WARN() << "Failed to save" << qurl;
+        MarkFailed(url);
+        return;
+    }
+    on_disk_.insert(Util::Md5(url) + ".png");
+    if (wanted)
+        Request(url);
 }
 
-QImage ImageCache::Get(const std::string &url) {
-    return QImage(QString(GetPath(url).c_str()));
+bool ImageCache::Failing(const std::string &url) {
+    auto it = failed_.find(url);
+    return it != failed_.end() && clock_.elapsed() < it->second.retry_at;
 }
 
-void ImageCache::Set(const std::string &url, const QImage &image) {
-    image.save(QString(GetPath(url).c_str()));
+void ImageCache::MarkFailed(const std::string &url) {
+    Failure &failure = failed_[url];
+    qint64 delay = IMAGE_RETRY_MS << std::min(failure.attempts, 10);
+    ++failure.attempts;
+    failure.retry_at = clock_.elapsed() + std::min(delay, IMAGE_RETRY_MAX_MS);
 }
 
 std::string ImageCache::GetPath(const std::string &url) {
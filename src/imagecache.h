@@ -1,18 +1,104 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
 #pragma once
 
+#include <QElapsedTimer>
 #include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QString>
+#include <deque>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
+
+#include "pixmaplru.h"
 
-class MainWindow;
+class QNetworkAccessManager;
+class QNetworkReply;
+class QThreadPool;
 
-class ImageCache {
+/*
+ * Icons downloaded from the CDN, stored as PNG files in directory_.
+ * Decoded pixmaps are kept in an LRU limited to IMAGE_CACHE_BUDGET bytes.
+ * Everything that touches the disk (reading, decoding, encoding, writing)
+ * happens in io_pool_, results are delivered through ImageReady.
+ * Missing images are downloaded at most IMAGE_MAX_DOWNLOADS at a time and
+ * only once per url, the downloaded bytes are stored as they are. Urls that
+ * failed to download or decode aren't tried again until a backoff passes.
+ * Shared by all sessions, see SessionManager.
+ */
+class ImageCache : public QObject {
+    Q_OBJECT
 public:
-    ImageCache(MainWindow *app, const std::string &directory);
+    explicit ImageCache(const std::string &directory);
+    ~ImageCache();
+    // Is the image in memory or on disk, doesn't touch the filesystem
     bool Exists(const std::string &url);
-    QImage Get(const std::string &url);
-    void Set(const std::string &url, const QImage &image);
+    // Only looks into memory, returns false if the image has to be Request'ed first
+    bool Get(const std::string &url, QPixmap *pixmap);
+    // Starts loading an image from disk, ImageReady is emitted once it's in memory
+    void Request(const std::string &url);
+    // Requests images that are on disk but not in memory, most important first
+    void Prefetch(const std::vector<std::string> &urls);
+    // Like Request, but downloads the image first if it's not on disk yet
+    void Fetch(const std::string &url);
+    // Queues downloads of all urls that aren't on disk, behind the ones that were Fetch'ed.
+    // They're only written to disk, decoding waits until the image is Request'ed.
+    void Warm(const std::vector<std::string> &urls);
+signals:
+    void ImageReady(const QString &url);
+    // emitted from io_pool_ threads
+    void DiskImageLoaded(const QString &url, const QImage &image);
+    // emitted from io_pool_ threads for downloads that are only stored
+    void DiskImageSaved(const QString &url, bool ok);
+private slots:
+    void OnDiskImageLoaded(const QString &url, const QImage &image);
+    void OnDiskImageSaved(const QString &url, bool ok);
+    void OnDownloadFinished(QNetworkReply *reply);
 private:
+    struct Failure {
+        int attempts = 0;
+        // clock_ time before which the url isn't tried again
+        qint64 retry_at = 0;
+    };
     std::string GetPath(const std::string &url);
-    MainWindow *app_;
+    void StartDownloads();
+    bool Failing(const std::string &url);
+    void MarkFailed(const std::string &url);
     std::string directory_;
+    // basenames of the files in directory_, read once on startup
+    std::set<std::string> on_disk_;
+    // urls being loaded in io_pool_
+    std::set<std::string> loading_;
+    PixmapLru pixmaps_;
+    QThreadPool *io_pool_;
+    QNetworkAccessManager *network_manager_;
+    // urls waiting for a download slot, Fetch'ed ones go to the front
+    std::deque<std::string> download_queue_;
+    // queued or being downloaded right now
+    std::set<std::string> downloading_;
+    // downloads that were only queued by Warm, nobody is waiting for them to be decoded
+    std::set<std::string> warming_;
+    std::map<std::string, Failure> failed_;
+    QElapsedTimer clock_;
+    int downloads_in_flight_;
 };
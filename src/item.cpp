@@ -19,34 +19,161 @@
 
 #include "item.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
 #include <utility>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QString>
 #include "jsoncpp/json.h"
 
+#include "hash128.h"
 #include "util.h"
 
+namespace {
+
+// how many decoded items are kept around
+const size_t JSON_CACHE_SIZE = 64;
+
+std::atomic<unsigned long long> next_serial(1);
+
+const IString PHYSICAL_DAMAGE("Physical Damage");
+const IString ATTACKS_PER_SECOND("Attacks per Second");
+
+struct PropertyAttribute {
+    NumericAttribute attribute;
+    IString property;
+};
+
+const PropertyAttribute PROPERTY_ATTRIBUTES[] = {
+    { ATTRIBUTE_QUALITY, IString("Quality") },
+    { ATTRIBUTE_ARMOUR, IString("Armour") },
+    { ATTRIBUTE_EVASION, IString("Evasion") },
+    { ATTRIBUTE_ENERGY_SHIELD, IString("Energy Shield") },
+    { ATTRIBUTE_BLOCK, IString("Chance to Block") },
+    { ATTRIBUTE_CRIT, IString("Critical Strike Chance") },
+    { ATTRIBUTE_APS, ATTACKS_PER_SECOND },
+    { ATTRIBUTE_LEVEL, IString("Level") },
+};
+
+// Text of a string value without copying it, "" for anything else
+inline const char *JsonText(const Json::Value &value) {
+    return value.isString() ? value.asCString() : "";
+}
+
+// Parses values like "+20%" or "1.50", returns false if there's no number at the start
+bool ParseNumber(const std::string &s, double *value) {
+    const char *begin = s.c_str();
+    char *end;
+    *value = strtod(begin, &end);
+    return end != begin;
+}
+
+// Small LRU of decoded item JSON. It is shared by all items and may be used
+// from worker threads, so everything goes through mutex_.
+class JsonCache {
+public:
+    QMutex *mutex() { return &mutex_; }
+    // mutex_ must be held
+    std::shared_ptr<const Json::Value> Get(unsigned long long serial) {
+        auto it = index_.find(serial);
+        if (it == index_.end())
+            return nullptr;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+    // mutex_ must be held
+    void Put(unsigned long long serial, const std::shared_ptr<const Json::Value> &json) {
+        lru_.emplace_front(serial, json);
+        index_[serial] = lru_.begin();
+        if (lru_.size() > JSON_CACHE_SIZE) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+private:
+    typedef std::list<std::pair<unsigned long long, std::shared_ptr<const Json::Value>>> List;
+    QMutex mutex_;
+    List lru_;
+    std::unordered_map<unsigned long long, List::iterator> index_;
+};
+
+JsonCache &json_cache() {
+    static JsonCache cache;
+    return cache;
+}
+
+}
+
+Item::Item() :
+    serial_(next_serial++),
+    json_source_(nullptr),
+    json_id_(0),
+    corrupted_(false),
+    w_(0), h_(0),
+    x_(0), y_(0),
+    frameType_(0),
+    tab_(0),
+    sockets_(0),
+    links_(0),
+    sockets_r_(0),
+    sockets_g_(0),
+    sockets_b_(0),
+    sockets_w_(0),
+    numeric_present_(0)
+{
+    hash_key_ = { 0, 0 };
+    std::fill(numeric_, numeric_ + ATTRIBUTE_COUNT, 0.0);
+    std::fill(link_groups_, link_groups_ + MAX_LINK_GROUPS, 0);
+}
+
 Item::Item(const Json::Value &json, int tab, std::string tab_caption) :
-    json_(json),
-    name_(json["name"].asString()),
-    typeLine_(json["typeLine"].asString()),
+    Item(json, Json::FastWriter().write(json), tab, tab_caption)
+{}
+
+Item::Item(const Json::Value &json, std::string raw_json, int tab, std::string tab_caption, ItemArena *arena) :
+    serial_(next_serial++),
+    payload_(std::move(raw_json)),
+    json_source_(nullptr),
+    json_id_(0),
+    name_(IString(json["name"].asString())),
+    typeLine_(IString(json["typeLine"].asString())),
     corrupted_(json["corrupted"].asBool()),
     w_(json["w"].asInt()),
     h_(json["h"].asInt()),
     x_(json["x"].asInt()),
     y_(json["y"].asInt()),
     frameType_(json["frameType"].asInt()),
-    icon_(json["icon"].asString()),
+    icon_(IString(json["icon"].asString())),
+    explicitMods_(ArenaAllocator<IString>(arena)),
+    implicitMods_(ArenaAllocator<IString>(arena)),
     tab_(tab),
-    tab_caption_(tab_caption),
+    tab_caption_(IString(tab_caption)),
+    properties_(ArenaAllocator<std::pair<IString, IString>>(arena)),
+    elemental_damage_(ArenaAllocator<std::pair<IString, int>>(arena)),
     sockets_(0),
     links_(0),
     sockets_r_(0),
     sockets_g_(0),
     sockets_b_(0),
-    sockets_w_(0)
+    sockets_w_(0),
+    text_sockets_(ArenaAllocator<ItemSocket>(arena)),
+    numeric_present_(0),
+    requirements_(ArenaAllocator<std::pair<IString, int>>(arena))
 {
+    // arena memory isn't reused, so vectors shouldn't grow in steps
+    explicitMods_.reserve(json["explicitMods"].size());
+    implicitMods_.reserve(json["implicitMods"].size());
+    properties_.reserve(json["properties"].size());
+    requirements_.reserve(json["requirements"].size());
+    text_sockets_.reserve(json["sockets"].size());
     for (auto mod : json["explicitMods"])
-        explicitMods_.push_back(mod.asString());
+        explicitMods_.push_back(IString(mod.asString()));
+    for (auto mod : json["implicitMods"])
+        implicitMods_.push_back(IString(mod.asString()));
 
     for (auto &property : json["properties"]) {
         std::string name = property["name"].asString();
@@ -54,21 +181,34 @@ Item::Item(const Json::Value &json, int tab, std::string tab_caption) :
             name = "Level";
         if (name == "Elemental Damage") {
             for (auto &value : property["values"])
-                elemental_damage_.push_back(std::make_pair(value[0].asString(), value[1].asInt()));
+                elemental_damage_.push_back(std::make_pair(IString(value[0].asString()), value[1].asInt()));
         } else {
-            properties_[name] = property["values"][0][0].asString();
+            IString key(name), value(property["values"][0][0].asString());
+            auto it = std::find_if(properties_.begin(), properties_.end(),
+                [&key](const std::pair<IString, IString> &p) { return p.first == key; });
+            if (it != properties_.end())
+                it->second = value;
+            else
+                properties_.push_back(std::make_pair(key, value));
         }
     }
 
     for (auto &requirement : json["requirements"]) {
         int value = QString(requirement["values"][0][0].asString().c_str()).toInt();
-        requirements_[requirement["name"].asString()] = value;
+        IString key(requirement["name"].asString());
+        auto it = std::find_if(requirements_.begin(), requirements_.end(),
+            [&key](const std::pair<IString, int> &p) { return p.first == key; });
+        if (it != requirements_.end())
+            it->second = value;
+        else
+            requirements_.push_back(std::make_pair(key, value));
     }
 
     sockets_ = json["sockets"].size();
     int counter = 0, prev = -1;
     for (auto &socket : json["sockets"]) {
         int cur = socket["group"].asInt();
+        text_sockets_.push_back({ cur, socket["attr"].asString()[0] });
         if (prev != cur)
             counter = 0;
         prev = cur;
@@ -90,24 +230,140 @@ Item::Item(const Json::Value &json, int tab, std::string tab_caption) :
         }
     }
 
+    SetHash(ComputeHash(json));
+
+    ComputeNumericAttributes();
+    ComputeLinkGroups();
+}
+
+std::shared_ptr<Item> Item::Create(const std::shared_ptr<ItemArena> &arena, const Json::Value &json,
+                                   std::string raw_json, int tab, std::string tab_caption) {
+    return std::allocate_shared<Item>(ArenaOwner<Item>(arena), json, std::move(raw_json), tab,
+                                      std::move(tab_caption), arena.get());
+}
+
+void Item::SetHash(const std::string &hash) {
+    hash_ = hash;
+    if (!HashKey::FromHex(hash, &hash_key_))
+        hash_key_ = { 0, 0 };
+}
+
+std::string Item::ComputeHash(const Json::Value &json) {
+    // same fields as LegacyHash, fed straight from the JSON
+    Hasher128 hasher;
+    hasher.AddString(JsonText(json["name"]));
+    hasher.AddString(JsonText(json["typeLine"]));
+    for (auto &key : { "explicitMods", "implicitMods" }) {
+        const Json::Value &mods = json[key];
+        hasher.AddInt(mods.size());
+        for (auto &mod : mods)
+            hasher.AddString(JsonText(mod));
+    }
+    for (auto &key : { "properties", "additionalProperties" }) {
+        const Json::Value &properties = json[key];
+        hasher.AddInt(properties.size());
+        for (auto &property : properties) {
+            hasher.AddString(JsonText(property["name"]));
+            const Json::Value &values = property["values"];
+            hasher.AddInt(values.size());
+            for (auto &value : values)
+                hasher.AddString(JsonText(value[0]));
+        }
+    }
+    const Json::Value &sockets = json["sockets"];
+    hasher.AddInt(sockets.size());
+    for (auto &socket : sockets) {
+        hasher.AddInt(socket["group"].asInt());
+        hasher.AddString(JsonText(socket["attr"]));
+    }
+    return hasher.HexDigest();
+}
+
+std::string Item::LegacyHash() const {
+    std::shared_ptr<const Json::Value> item_json = json();
+    const Json::Value &json = *item_json;
     std::string unique;
     unique += json["name"].asString() + "~" + json["typeLine"].asString() + "~";
     for (auto &mod : json["explicitMods"])
         unique += mod.asString() + "~";
     for (auto &mod : json["implicitMods"])
         unique += mod.asString() + "~";
-    unique += UniqueProperties("properties") + "~";
-    unique += UniqueProperties("additionalProperties") + "~";
+    unique += UniqueProperties(json, "properties") + "~";
+    unique += UniqueProperties(json, "additionalProperties") + "~";
 
     for (auto &socket : json["sockets"])
         unique += std::to_string(socket["group"].asInt()) + "~" + socket["attr"].asString() + "~";
 
-    hash_ = Util::Md5(unique);
+    return Util::Md5(unique);
+}
+
+void Item::ComputeLinkGroups() {
+    std::fill(link_groups_, link_groups_ + MAX_LINK_GROUPS, 0);
+    int group = -1, current = -1;
+    for (auto &socket : text_sockets_) {
+        if (group < 0 || socket.group != current) {
+            current = socket.group;
+            // an item can't have more groups than sockets
+            if (++group == MAX_LINK_GROUPS)
+                break;
+        }
+        switch (socket.attr) {
+        case 'S':
+            link_groups_[group] += 1;
+            break;
+        case 'D':
+            link_groups_[group] += 1 << 4;
+            break;
+        case 'I':
+            link_groups_[group] += 1 << 8;
+            break;
+        case 'G':
+            link_groups_[group] += 1 << 12;
+            break;
+        }
+    }
 }
 
-std::string Item::UniqueProperties(const std::string &name) {
+void Item::ComputeNumericAttributes() {
+    std::fill(numeric_, numeric_ + ATTRIBUTE_COUNT, 0.0);
+    numeric_present_ = 0;
+    for (auto &entry : PROPERTY_ATTRIBUTES) {
+        const IString *value = property(entry.property);
+        if (value && ParseNumber(*value, &numeric_[entry.attribute]))
+            numeric_present_ |= 1u << entry.attribute;
+    }
+
+    if (!has_numeric(ATTRIBUTE_APS))
+        return;
+    double aps = numeric_[ATTRIBUTE_APS];
+    const IString *pd = property(PHYSICAL_DAMAGE);
+    if (pd) {
+        numeric_[ATTRIBUTE_PDPS] = aps * Util::AverageDamage(*pd);
+        numeric_present_ |= 1u << ATTRIBUTE_PDPS;
+    }
+    if (!elemental_damage_.empty()) {
+        double damage = 0;
+        for (auto &x : elemental_damage_)
+            damage += Util::AverageDamage(x.first);
+        numeric_[ATTRIBUTE_EDPS] = aps * damage;
+        numeric_present_ |= 1u << ATTRIBUTE_EDPS;
+    }
+    numeric_[ATTRIBUTE_DPS] = numeric_[ATTRIBUTE_PDPS] + numeric_[ATTRIBUTE_EDPS];
+    if (has_numeric(ATTRIBUTE_PDPS) || has_numeric(ATTRIBUTE_EDPS))
+        numeric_present_ |= 1u << ATTRIBUTE_DPS;
+}
+
+NumericAttribute Item::NumericAttributeForProperty(const std::string &property) {
+    IString name(property);
+    for (auto &entry : PROPERTY_ATTRIBUTES)
+        if (entry.property == name)
+            return entry.attribute;
+    return ATTRIBUTE_COUNT;
+}
+
+std::string Item::UniqueProperties(const Json::Value &json, const std::string &name) {
     std::string result;
-    for (auto &property : json_[name]) {
+    for (auto &property : json[name]) {
         result += property["name"].asString() + "~";
         for (auto value : property["values"])
             result += value[0].asString() + "~";
@@ -115,31 +371,51 @@ std::string Item::UniqueProperties(const std::string &name) {
     return result;
 }
 
-std::string Item::PrettyName() const {
-    if (!name_.empty())
-        return name_ + " " + typeLine_;
-    return typeLine_;
+std::shared_ptr<const Json::Value> Item::json() const {
+    JsonCache &cache = json_cache();
+    QMutexLocker locker(cache.mutex());
+    std::shared_ptr<const Json::Value> result = cache.Get(serial_);
+    if (result)
+        return result;
+
+    std::shared_ptr<Json::Value> json = std::make_shared<Json::Value>();
+    Json::Reader reader;
+    if (!reader.parse(payload_.empty() && json_source_ ? json_source_->LoadItemJson(json_id_) : payload_, *json))
+        *json = Json::Value();
+    cache.Put(serial_, json);
+    return json;
+}
+
+std::string Item::raw_json() const {
+    QMutexLocker locker(json_cache().mutex());
+    if (payload_.empty() && json_source_)
+        return json_source_->LoadItemJson(json_id_);
+    return payload_;
 }
 
-double Item::DPS() const {
-    return pDPS() + eDPS();
+void Item::SetJsonSource(ItemJsonSource *source, long long id) {
+    QMutexLocker locker(json_cache().mutex());
+    json_source_ = source;
+    json_id_ = id;
+    std::string().swap(payload_);
 }
 
-double Item::pDPS() const {
-    if (!properties_.count("Physical Damage") || !properties_.count("Attacks per Second"))
-        return 0;
-    double aps = std::stod(properties_.at("Attacks per Second"));
-    std::string pd = properties_.at("Physical Damage");
+std::string Item::PrettyName() const {
+    if (!name_.empty())
+        return name_.str() + " " + typeLine_.str();
+    return typeLine_;
+}
 
-    return aps * Util::AverageDamage(pd);
+const IString *Item::property(const IString &name) const {
+    for (auto &property : properties_)
+        if (property.first == name)
+            return &property.second;
+    return nullptr;
 }
 
-double Item::eDPS() const {
-    if (elemental_damage_.empty() || !properties_.count("Attacks per Second"))
-        return 0;
-    double damage = 0;
-    for (auto &x : elemental_damage_)
-        damage += Util::AverageDamage(x.first);
-    double aps = std::stod(properties_.at("Attacks per Second"));
-    return aps * damage;
+int Item::requirement(const IString &name) const {
+    for (auto &requirement : requirements_)
+        if (requirement.first == name)
+            return requirement.second;
+    return 0;
 }
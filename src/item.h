@@ -19,14 +19,21 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <map>
 #include <string>
 #include <vector>
 #include "jsoncpp/json.h"
 
+#include "hash128.h"
+#include "itemarena.h"
+#include "stringpool.h"
+
 const int PIXELS_PER_SLOT = 47;
 const int INVENTORY_SLOTS = 12;
+// Item::tab() of items carried by characters, the n-th character gets CHARACTER_TAB_BASE + n
+const int CHARACTER_TAB_BASE = 1 << 16;
 
 enum FRAME_TYPES {
     FRAME_TYPE_NORMAL = 0,
@@ -43,13 +50,61 @@ enum ELEMENTAL_DAMAGE_TYPES {
     ED_LIGHTNING = 6,
 };
 
+struct ItemSocket {
+    int group;
+    char attr;
+};
+
+// Socket counts of one group of linked sockets, 4 bits per color: R | G << 4 | B << 8 | W << 12
+typedef uint16_t LinkGroup;
+const int MAX_LINK_GROUPS = 6;
+
+// Provides raw JSON for items that were restored from storage without it
+class ItemJsonSource {
+public:
+    virtual ~ItemJsonSource() {}
+    virtual std::string LoadItemJson(long long id) = 0;
+};
+
+// Numbers derived from item properties, computed once when the item is created
+enum NumericAttribute {
+    ATTRIBUTE_QUALITY,
+    ATTRIBUTE_ARMOUR,
+    ATTRIBUTE_EVASION,
+    ATTRIBUTE_ENERGY_SHIELD,
+    ATTRIBUTE_BLOCK,
+    ATTRIBUTE_CRIT,
+    ATTRIBUTE_APS,
+    ATTRIBUTE_LEVEL,
+    ATTRIBUTE_PDPS,
+    ATTRIBUTE_EDPS,
+    ATTRIBUTE_DPS,
+    ATTRIBUTE_COUNT
+};
+
+// containers of derived item data, in the arena of the tab response the item was parsed from
+template<class T>
+using ItemVector = std::vector<T, ArenaAllocator<T>>;
+// [name, value] pairs in the order they appear on the item
+typedef ItemVector<std::pair<IString, IString>> ItemProperties;
+typedef ItemVector<std::pair<IString, int>> ItemRequirements;
+
 class Item {
+    friend class ItemsStore;
+    friend class ItemsSnapshot;
 public:
     Item(const Json::Value &json, int tab, std::string tab_caption);
-    std::string name() const { return name_; }
-    std::string typeLine() const { return typeLine_; }
+    // raw_json is the same item as json, kept as is instead of writing json out again
+    Item(const Json::Value &json, std::string raw_json, int tab, std::string tab_caption, ItemArena *arena = nullptr);
+    // Allocates the item and its derived data from arena, see ItemArena
+    static std::shared_ptr<Item> Create(const std::shared_ptr<ItemArena> &arena, const Json::Value &json,
+                                        std::string raw_json, int tab, std::string tab_caption);
+    const std::string &name() const { return name_; }
+    const std::string &typeLine() const { return typeLine_; }
     std::string PrettyName() const;
-    const Json::Value &json() const { return json_; }
+    // Parsed on demand from the compact raw JSON, recently used items are cached
+    std::shared_ptr<const Json::Value> json() const;
+    std::string raw_json() const;
     bool corrupted() const { return corrupted_; }
     int w() const { return w_; }
     int h() const { return h_; }
@@ -57,43 +112,83 @@ public:
     int y() const { return y_; }
     int frameType() const { return frameType_; }
     const std::string &icon() const { return icon_; }
-    const std::vector<std::string>& explicitMods() const { return explicitMods_; }
+    const ItemVector<IString>& explicitMods() const { return explicitMods_; }
+    const ItemVector<IString>& implicitMods() const { return implicitMods_; }
     int tab() const { return tab_; }
+    // for items of characters this is the character name
     const std::string &tab_caption() const { return tab_caption_; }
-    const std::map<std::string, std::string> &properties() const { return properties_; }
+    // equipped by or in the inventory of a character rather than in the stash
+    bool in_character() const { return tab_ >= CHARACTER_TAB_BASE; }
+    const ItemProperties &properties() const { return properties_; }
+    // nullptr if the item doesn't have this property
+    const IString *property(const IString &name) const;
+    // identifies the item for buyouts, see ComputeHash
     const std::string &hash() const { return hash_; }
-    const std::vector<std::pair<std::string, int>> &elemental_damage() const { return elemental_damage_; }
-    const std::map<std::string, int> &requirements() const { return requirements_; }
-    double DPS() const;
-    double pDPS() const;
-    double eDPS() const;
+    // hash() in binary
+    const HashKey &hash_key() const { return hash_key_; }
+    // MD5 based hash used by older versions, only needed to migrate buyouts
+    std::string LegacyHash() const;
+    static std::string ComputeHash(const Json::Value &json);
+    const ItemVector<std::pair<IString, int>> &elemental_damage() const { return elemental_damage_; }
+    const ItemRequirements &requirements() const { return requirements_; }
+    // 0 if there's no such requirement
+    int requirement(const IString &name) const;
+    double DPS() const { return numeric_[ATTRIBUTE_DPS]; }
+    double pDPS() const { return numeric_[ATTRIBUTE_PDPS]; }
+    double eDPS() const { return numeric_[ATTRIBUTE_EDPS]; }
+    double numeric(NumericAttribute attribute) const { return numeric_[attribute]; }
+    bool has_numeric(NumericAttribute attribute) const { return (numeric_present_ >> attribute) & 1; }
+    // Attribute that is parsed from the given property, ATTRIBUTE_COUNT if there's none
+    static NumericAttribute NumericAttributeForProperty(const std::string &property);
     int sockets() const { return sockets_; }
     int links() const { return links_; }
     int sockets_r() const { return sockets_r_; }
     int sockets_g() const { return sockets_g_; }
     int sockets_b() const { return sockets_b_; }
     int sockets_w() const { return sockets_w_; }
+    const ItemVector<ItemSocket> &text_sockets() const { return text_sockets_; }
+    // MAX_LINK_GROUPS groups in socket order, unused ones are 0
+    const LinkGroup *link_groups() const { return link_groups_; }
 private:
-    std::string UniqueProperties(const std::string &name);
+    Item();
+    static std::string UniqueProperties(const Json::Value &json, const std::string &name);
+    // Fills numeric_ from properties_ and elemental_damage_
+    void ComputeNumericAttributes();
+    // Fills link_groups_ from text_sockets_
+    void ComputeLinkGroups();
+    void SetHash(const std::string &hash);
+    // Drops the in-memory raw JSON, from now on it is read from source
+    void SetJsonSource(ItemJsonSource *source, long long id);
 
-    Json::Value json_;
-    std::string name_;
-    std::string typeLine_;
+    // identifies the item in the decoded JSON cache
+    unsigned long long serial_;
+    // compact raw JSON, empty once the item is backed by json_source_
+    std::string payload_;
+    ItemJsonSource *json_source_;
+    long long json_id_;
+    IString name_;
+    IString typeLine_;
     bool corrupted_;
     int w_, h_;
     int x_, y_;
     int frameType_;
-    std::string icon_;
-    std::vector<std::string> explicitMods_;
+    IString icon_;
+    ItemVector<IString> explicitMods_;
+    ItemVector<IString> implicitMods_;
     int tab_;
-    std::string tab_caption_;
-    std::map<std::string, std::string> properties_;
+    IString tab_caption_;
+    ItemProperties properties_;
     std::string hash_;
+    HashKey hash_key_;
     // vector of pairs [damage, type]
-    std::vector<std::pair<std::string, int>> elemental_damage_;
+    ItemVector<std::pair<IString, int>> elemental_damage_;
     int sockets_, links_;
     int sockets_r_, sockets_g_, sockets_b_, sockets_w_;
-    std::map<std::string, int> requirements_;
+    ItemVector<ItemSocket> text_sockets_;
+    LinkGroup link_groups_[MAX_LINK_GROUPS];
+    double numeric_[ATTRIBUTE_COUNT];
+    unsigned numeric_present_;
+    ItemRequirements requirements_;
 };
 
 typedef std::vector<std::shared_ptr<Item>> Items;
@@ -0,0 +1,54 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemarena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// a tab with a few dozen items fits in one chunk
+const size_t ARENA_CHUNK_SIZE = 64 * 1024;
+
+ItemArena::ItemArena():
+    current_(nullptr),
+    left_(0),
+    allocated_(0)
+{}
+
+ItemArena::~ItemArena() {
+    for (auto chunk : chunks_)
+        delete[] chunk;
+}
+
+void *ItemArena::Allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - reinterpret_cast<uintptr_t>(current_) % alignment) % alignment;
+    if (!current_ || padding + size > left_) {
+        // anything bigger than a chunk gets one of its own
+        size_t chunk_size = std::max(ARENA_CHUNK_SIZE, size + alignment);
+        current_ = new char[chunk_size];
+        chunks_.push_back(current_);
+        left_ = chunk_size;
+        padding = (alignment - reinterpret_cast<uintptr_t>(current_) % alignment) % alignment;
+    }
+    void *result = current_ + padding;
+    current_ += padding + size;
+    left_ -= padding + size;
+    allocated_ += size;
+    return result;
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Monotonic memory for the items parsed from one tab response: the Item objects
+ * with their shared_ptr control blocks and the vectors inside them.
+ * Nothing is freed on its own, all chunks go at once when the arena is
+ * destroyed, which is when the last item allocated from it is released by
+ * ItemsManager, searches and models (see ArenaOwner).
+ * Not thread-safe, an arena is only allocated from by the parse job that made it.
+ */
+class ItemArena {
+public:
+    ItemArena();
+    ~ItemArena();
+    ItemArena(const ItemArena&) = delete;
+    ItemArena& operator=(const ItemArena&) = delete;
+    void *Allocate(size_t size, size_t alignment);
+    // bytes handed out so far
+    size_t allocated() const { return allocated_; }
+private:
+    std::vector<char*> chunks_;
+    char *current_;
+    size_t left_;
+    size_t allocated_;
+};
+
+// Allocator of the containers in Item, items made without an arena use the heap
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    ArenaAllocator(): arena_(nullptr) {}
+    explicit ArenaAllocator(ItemArena *arena): arena_(arena) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other): arena_(other.arena()) {}
+    T *allocate(size_t n) {
+        if (!arena_)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, size_t) {
+        if (!arena_)
+            ::operator delete(p);
+    }
+    // copies may be made outside of the parse job, they can't use its arena
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+    ItemArena *arena() const { return arena_; }
+private:
+    ItemArena *arena_;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() == b.arena(); }
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() != b.arena(); }
+
+// For std::allocate_shared: every control block keeps the arena alive
+template<class T>
+class ArenaOwner {
+public:
+    typedef T value_type;
+    explicit ArenaOwner(std::shared_ptr<ItemArena> arena): arena_(std::move(arena)) {}
+    template<class U>
+    ArenaOwner(const ArenaOwner<U> &other): arena_(other.arena()) {}
+    T *allocate(size_t n) { return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+    const std::shared_ptr<ItemArena> &arena() const { return arena_; }
+private:
+    std::shared_ptr<ItemArena> arena_;
+};
+
+template<class T, class U>
+bool operator==(const ArenaOwner<T> &a, const ArenaOwner<U> &b) { return a.arena() == b.arena(); }
+
+template<class T, class U>
+bool operator!=(const ArenaOwner<T> &a, const ArenaOwner<U> &b) { return a.arena() != b.arena(); }
@@ -0,0 +1,147 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemicons.h"
+
+#include <QImage>
+#include <QPainter>
+#include "QsLog.h"
+
+#include "item.h"
+
+const int LINKH_HEIGHT = 16;
+const int LINKH_WIDTH = 38;
+const int LINKV_HEIGHT = LINKH_WIDTH;
+const int LINKV_WIDTH = LINKH_HEIGHT;
+const char SOCKET_ATTRS[] = "SDIG";
+// memory taken by composited icons
+const size_t ITEM_ICONS_BUDGET = 32 * 1024 * 1024;
+const size_t ITEM_THUMBNAILS_BUDGET = 8 * 1024 * 1024;
+
+ItemIcons::ItemIcons():
+    atlas_loaded_(false),
+    composites_(ITEM_ICONS_BUDGET),
+    thumbnails_(ITEM_THUMBNAILS_BUDGET)
+{}
+
+void ItemIcons::LoadAtlas() {
+    // all sprites side by side: four sockets, then the horizontal and vertical links
+    for (int i = 0; i < 4; ++i)
+        sockets_[i] = QRect(PIXELS_PER_SLOT * i, 0, PIXELS_PER_SLOT, PIXELS_PER_SLOT);
+    link_h_ = QRect(PIXELS_PER_SLOT * 4, 0, LINKH_WIDTH, LINKH_HEIGHT);
+    link_v_ = QRect(link_h_.right() + 1, 0, LINKV_WIDTH, LINKV_HEIGHT);
+
+    atlas_ = QPixmap(link_v_.right() + 1, PIXELS_PER_SLOT);
+    atlas_.fill(Qt::transparent);
+    QPainter painter(&atlas_);
+    for (int i = 0; i < 4; ++i)
+        painter.drawImage(sockets_[i].topLeft(), QImage(":/sockets/" + QString(QChar(SOCKET_ATTRS[i])) + ".png"));
+    painter.drawImage(link_h_.topLeft(), QImage(":/sockets/linkH.png"));
+    painter.drawImage(link_v_.topLeft(), QImage(":/sockets/linkV.png"));
+    atlas_loaded_ = true;
+}
+
+const QRect *ItemIcons::SocketRect(char attr) const {
+    for (int i = 0; i < 4; ++i)
+        if (SOCKET_ATTRS[i] == attr)
+            return &sockets_[i];
+    return nullptr;
+}
+
+std::string ItemIcons::SocketSignature(const Item &item) {
+    std::string signature = std::to_string(item.w());
+    auto &sockets = item.text_sockets();
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        // '-' if linked to the previous socket
+        signature += (i > 0 && sockets[i].group == sockets[i - 1].group) ? '-' : ' ';
+        signature += sockets[i].attr;
+    }
+    return signature;
+}
+
+QPixmap ItemIcons::Composite(const Item &item, const QPixmap &icon) {
+    if (item.text_sockets().empty())
+        return icon;
+    std::string key = item.icon() + "#" + SocketSignature(item);
+    QPixmap pixmap;
+    if (composites_.Get(key, &pixmap))
+        return pixmap;
+
+    if (!atlas_loaded_)
+        LoadAtlas();
+    pixmap = icon;
+    QPainter painter(&pixmap);
+    PaintSockets(&painter, item);
+    painter.end();
+    composites_.Put(key, pixmap);
+    return pixmap;
+}
+
+QPixmap ItemIcons::Thumbnail(const Item &item, const QPixmap &icon, int size) {
+    std::string key = item.icon() + "#" + SocketSignature(item) + "@" + std::to_string(size);
+    QPixmap thumbnail;
+    if (thumbnails_.Get(key, &thumbnail))
+        return thumbnail;
+    thumbnail = Composite(item, icon).scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    thumbnails_.Put(key, thumbnail);
+    return thumbnail;
+}
+
+void ItemIcons::PaintSockets(QPainter *painter, const Item &item) {
+    auto &sockets = item.text_sockets();
+    for (int i = 0; i < static_cast<int>(sockets.size()); ++i) {
+        auto &socket = sockets[i];
+        bool link = (i > 0) && (socket.group == sockets[i - 1].group);
+        const QRect *socket_rect = SocketRect(socket.attr);
+        if (item.w() == 1) {
+            if (socket_rect)
+                painter->drawPixmap(QPoint(0, PIXELS_PER_SLOT * i), atlas_, *socket_rect);
+            if (link)
+                painter->drawPixmap(QPoint(16, PIXELS_PER_SLOT * i - 19), atlas_, link_v_);
+        } else /* w == 2 */ {
+            int row = i / 2;
+            int column = i % 2;
+            if (row % 2 == 1)
+                column = 1 - column;
+            if (socket_rect)
+                painter->drawPixmap(QPoint(PIXELS_PER_SLOT * column, PIXELS_PER_SLOT * row), atlas_, *socket_rect);
+            if (link) {
+                if (i == 1 || i == 3 || i == 5) {
+                    // horizontal link
+                    painter->drawPixmap(QPoint(
+                        PIXELS_PER_SLOT - LINKH_WIDTH / 2,
+                        row * PIXELS_PER_SLOT + PIXELS_PER_SLOT / 2 - LINKH_HEIGHT / 2
+                    ), atlas_, link_h_);
+                } else if (i == 2) {
+                    painter->drawPixmap(QPoint(
+                        PIXELS_PER_SLOT * 1.5 - LINKV_WIDTH / 2,
+                        row * PIXELS_PER_SLOT - LINKV_HEIGHT / 2
+                    ), atlas_, link_v_);
+                } else if (i == 4) {
+                    painter->drawPixmap(QPoint(
+                        PIXELS_PER_SLOT / 2 - LINKV_WIDTH / 2,
+                        row * PIXELS_PER_SLOT - LINKV_HEIGHT / 2
+                    ), atlas_, link_v_);
+                } else {
+                    QLOG_ERROR() << "No idea how to draw link for" << item.PrettyName().c_str();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QPixmap>
+#include <QRect>
+#include <string>
+
+#include "pixmaplru.h"
+
+class Item;
+class QPainter;
+
+/*
+ * Item icons with sockets and links painted over them.
+ * Socket and link sprites are loaded once into atlas_, composites are
+ * memoized by icon url and socket layout, so most items of the same base
+ * type share a single pixmap. GUI thread only.
+ */
+class ItemIcons {
+public:
+    ItemIcons();
+    // icon is the plain image from the CDN for item.icon()
+    QPixmap Composite(const Item &item, const QPixmap &icon);
+    // Composite scaled down to fit into a size x size square
+    QPixmap Thumbnail(const Item &item, const QPixmap &icon, int size);
+    // Width, colors and links of the sockets, same signature means same overlay
+    static std::string SocketSignature(const Item &item);
+private:
+    void LoadAtlas();
+    void PaintSockets(QPainter *painter, const Item &item);
+    // sprite for socket attribute, nullptr for unknown ones
+    const QRect *SocketRect(char attr) const;
+    QPixmap atlas_;
+    // S, D, I, G sockets
+    QRect sockets_[4];
+    QRect link_h_, link_v_;
+    bool atlas_loaded_;
+    PixmapLru composites_, thumbnails_;
+};
@@ -18,18 +18,26 @@
 */
 
 #include "items_model.h"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+#include "perfstats.h"
 #include "search.h"
 
 ItemsModel::ItemsModel(QObject *parent, Search *search) :
     QAbstractItemModel(parent),
-    search_(search)
+    search_(search),
+    sort_column_(-1),
+    sort_order_(Qt::AscendingOrder)
 {
 }
 
 int ItemsModel::rowCount(const QModelIndex &parent) const {
     if (parent.isValid())
         return 0;
-    return search_->items().size();
+    return rows_.size();
 }
 
 int ItemsModel::columnCount(const QModelIndex &parent) const {
@@ -38,6 +46,14 @@ int ItemsModel::columnCount(const QModelIndex &parent) const {
     return search_->columns().size();
 }
 
+int ItemsModel::icon_column() const {
+    auto &columns = search_->columns();
+    for (size_t i = 0; i < columns.size(); ++i)
+        if (columns[i]->icon())
+            return i;
+    return -1;
+}
+
 QVariant ItemsModel::headerData(int section, Qt::Orientation /* orientation */, int role) const {
     if (role == Qt::DisplayRole)
         return QString(search_->columns()[section]->name().c_str());
@@ -45,13 +61,14 @@ QVariant ItemsModel::headerData(int section, Qt::Orientation /* orientation */,
 }
 
 QVariant ItemsModel::data(const QModelIndex &index, int role) const {
-    Column *column = search_->columns()[index.column()];
-    const Item &item = *search_->items()[index.row()];
+    if (role != Qt::DisplayRole && role != Qt::ForegroundRole)
+        return QVariant();
+    const Cells &row = cells(rows_[index.row()]);
     if (role == Qt::DisplayRole)
-        return QString(column->value(item).c_str());
-    else if (role == Qt::ForegroundRole)
-        return column->color(item);
-    return QVariant();
+        return row.text[index.column()];
+    if (!row.color[index.column()].isValid())
+        return QVariant();
+    return row.color[index.column()];
 }
 
 QModelIndex ItemsModel::parent(const QModelIndex & /* index */) const {
@@ -61,3 +78,154 @@ QModelIndex ItemsModel::parent(const QModelIndex & /* index */) const {
 QModelIndex ItemsModel::index(int row, int column, const QModelIndex & /* parent */) const {
     return createIndex(row, column);
 }
+
+const ItemsModel::Cells &ItemsModel::cells(const Row &row) const {
+    if (!row.cells) {
+        row.cells.reset(new Cells);
+        for (auto column : search_->columns()) {
+            row.cells->text.push_back(QString::fromStdString(column->value(*row.item)));
+            row.cells->color.push_back(column->color(*row.item));
+        }
+    }
+    return *row.cells;
+}
+
+void ItemsModel::SetItems(const Items &items) {
+    PerfTimer timer("ItemsModel::SetItems");
+    std::unordered_map<const Item*, int> source;
+    for (size_t i = 0; i < items.size(); ++i)
+        source[items[i].get()] = i;
+
+    // drop rows that are gone in a single pass, as one layout change however scattered they are
+    std::vector<int> position(rows_.size(), -1);
+    size_t kept = 0;
+    for (size_t i = 0; i < rows_.size(); ++i)
+        if (source.count(rows_[i].item.get()))
+            position[i] = kept++;
+    if (kept < rows_.size()) {
+        emit layoutAboutToBeChanged();
+        // selection and current index follow their items, the ones of dropped rows go away
+        QModelIndexList before = persistentIndexList(), after;
+        for (auto &index : before) {
+            int row = position[index.row()];
+            after.push_back(row < 0 ? QModelIndex() : createIndex(row, index.column()));
+        }
+        changePersistentIndexList(before, after);
+        for (size_t i = 0; i < rows_.size(); ++i)
+            if (position[i] >= 0 && position[i] != static_cast<int>(i))
+                rows_[position[i]] = std::move(rows_[i]);
+        rows_.resize(kept);
+        emit layoutChanged();
+    }
+
+    // the rest are kept, update where they are in the new set
+    std::vector<bool> shown(items.size(), false);
+    for (auto &row : rows_) {
+        row.source = source[row.item.get()];
+        shown[row.source] = true;
+    }
+
+    size_t added = std::count(shown.begin(), shown.end(), false);
+    if (added > 0) {
+        beginInsertRows(QModelIndex(), rows_.size(), rows_.size() + added - 1);
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (shown[i])
+                continue;
+            Row row;
+            row.item = items[i];
+            row.source = i;
+            rows_.push_back(std::move(row));
+        }
+        endInsertRows();
+    }
+
+    Reorder();
+}
+
+void ItemsModel::sort(int column, Qt::SortOrder order) {
+    sort_column_ = column;
+    sort_order_ = order;
+    Reorder();
+}
+
+void ItemsModel::InvalidateColumn(int column, const std::unordered_set<const Item*> *items) {
+    if (column < 0 || column >= columnCount())
+        return;
+    Column *source = search_->columns()[column];
+    int first = rows_.size(), last = -1;
+    for (size_t i = 0; i < rows_.size(); ++i) {
+        Row &row = rows_[i];
+        if (items && !items->count(row.item.get()))
+            continue;
+        // rows that were never painted or sorted have nothing to update
+        if (row.cells) {
+            row.cells->text[column] = QString::fromStdString(source->value(*row.item));
+            row.cells->color[column] = source->color(*row.item);
+        }
+        if (!row.keys.empty())
+            row.keys[column] = source->sort_value(*row.item);
+        first = std::min(first, static_cast<int>(i));
+        last = i;
+    }
+    if (last < 0)
+        return;
+    emit dataChanged(index(first, column, QModelIndex()), index(last, column, QModelIndex()));
+    if (sort_column_ == column)
+        Reorder();
+}
+
+void ItemsModel::Reorder() {
+    std::vector<int> order(rows_.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto by_source = [&](int a, int b) { return rows_[a].source < rows_[b].source; };
+    if (sort_column_ < 0 || sort_column_ >= columnCount()) {
+        std::sort(order.begin(), order.end(), by_source);
+    } else if (search_->columns()[sort_column_]->numeric()) {
+        for (auto &row : rows_) {
+            if (!row.keys.empty())
+                continue;
+            for (auto column : search_->columns())
+                row.keys.push_back(column->sort_value(*row.item));
+        }
+        int column = sort_column_;
+        bool descending = sort_order_ == Qt::DescendingOrder;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            double x = rows_[a].keys[column], y = rows_[b].keys[column];
+            if (x != y)
+                return descending ? x > y : x < y;
+            return by_source(a, b);
+        });
+    } else {
+        int column = sort_column_;
+        bool descending = sort_order_ == Qt::DescendingOrder;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            int cmp = cells(rows_[a]).text[column].compare(cells(rows_[b]).text[column], Qt::CaseInsensitive);
+            if (cmp != 0)
+                return descending ? cmp > 0 : cmp < 0;
+            return by_source(a, b);
+        });
+    }
+
+    bool unchanged = true;
+    for (size_t i = 0; i < order.size() && unchanged; ++i)
+        unchanged = order[i] == static_cast<int>(i);
+    if (unchanged)
+        return;
+
+    emit layoutAboutToBeChanged();
+    std::vector<int> position(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        position[order[i]] = i;
+    // selection and current index follow their items
+    QModelIndexList before = persistentIndexList(), after;
+    for (auto &index : before)
+        after.push_back(createIndex(position[index.row()], index.column()));
+    changePersistentIndexList(before, after);
+
+    std::vector<Row> sorted;
+    sorted.reserve(rows_.size());
+    for (auto i : order)
+        sorted.push_back(std::move(rows_[i]));
+    rows_.swap(sorted);
+    emit layoutChanged();
+}
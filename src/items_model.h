@@ -20,12 +20,25 @@
 #pragma once
 
 #include <QAbstractItemModel>
+#include <QColor>
+#include <QString>
+#include <memory>
+#include <unordered_set>
+#include <vector>
 
 #include "column.h"
 #include "item.h"
 
 class Search;
 
+/*
+ * Shows the items of a Search with its columns. Display strings and colors
+ * are materialized per row the first time the row is painted, sort keys the
+ * first time the model is sorted; both stay with the row until it's removed.
+ * New results are merged in as a layout change that drops the rows that are
+ * gone, an insertion of the new rows and a layout change to the new order,
+ * so the view keeps its scroll position and selection.
+ */
 class ItemsModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -37,10 +50,42 @@ public:
     QModelIndex parent(const QModelIndex &index) const;
     QModelIndex index(int row, int column, const QModelIndex &parent) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+    // Item shown in the given row, i.e. with the sort applied
+    const std::shared_ptr<Item> &item(int row) const { return rows_[row].item; }
+    // First column that shows item icons, -1 if there's none
+    int icon_column() const;
+    // Replaces the shown items, rows of items that are in both sets are kept
+    void SetItems(const Items &items);
+    // Recomputes one column of the given items (of every row if items is null), for columns
+    // whose values change without the items changing (e.g. prices). Sorts again if sorted by it.
+    void InvalidateColumn(int column, const std::unordered_set<const Item*> *items = nullptr);
 signals:
 
 public slots:
 
 private:
+    struct Cells {
+        std::vector<QString> text;
+        std::vector<QColor> color;
+    };
+    struct Row {
+        std::shared_ptr<Item> item;
+        // position in the items given to SetItems, the order when not sorted
+        int source;
+        // null until painted
+        mutable std::unique_ptr<Cells> cells;
+        // Column::sort_value() for every column, empty until sorted
+        std::vector<double> keys;
+    };
+    const Cells &cells(const Row &row) const;
+    // Moves rows to where the sort (or lack of it) wants them
+    void Reorder();
+
     Search *search_;
+    // in display order
+    std::vector<Row> rows_;
+    // -1 before the view asks for sorting
+    int sort_column_;
+    Qt::SortOrder sort_order_;
 };
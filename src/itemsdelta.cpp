@@ -0,0 +1,111 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemsdelta.h"
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+// Items with the same hash can still differ in what is shown around them
+static bool SameListing(const Item &a, const Item &b) {
+    if (a.tab() != b.tab() || a.x() != b.x() || a.y() != b.y() || a.tab_caption() != b.tab_caption()
+            || a.corrupted() != b.corrupted() || a.links() != b.links()
+            || a.text_sockets().size() != b.text_sockets().size())
+        return false;
+    for (size_t i = 0; i < a.text_sockets().size(); ++i)
+        if (a.text_sockets()[i].group != b.text_sockets()[i].group
+                || a.text_sockets()[i].attr != b.text_sockets()[i].attr)
+            return false;
+    return true;
+}
+
+bool ItemsDelta::identity() const {
+    if (!empty())
+        return false;
+    for (size_t i = 0; i < previous_rows.size(); ++i)
+        if (previous_rows[i] != static_cast<int>(i))
+            return false;
+    return true;
+}
+
+ItemsDelta ItemsDelta::Compute(const Items &previous, const Items &current) {
+    ItemsDelta delta;
+    delta.previous_rows.assign(current.size(), -1);
+    delta.dirty = Bitmap(current.size());
+
+    // tabs that weren't parsed again keep their Item objects
+    std::unordered_map<const Item*, size_t> previous_row_of;
+    previous_row_of.reserve(previous.size());
+    for (size_t i = 0; i < previous.size(); ++i)
+        previous_row_of[previous[i].get()] = i;
+    std::vector<bool> used(previous.size(), false);
+    size_t unmatched = 0;
+    for (size_t i = 0; i < current.size(); ++i) {
+        auto it = previous_row_of.find(current[i].get());
+        if (it == previous_row_of.end()) {
+            ++unmatched;
+            continue;
+        }
+        delta.previous_rows[i] = it->second;
+        used[it->second] = true;
+    }
+    if (unmatched == 0 && previous.size() == current.size())
+        return delta;
+
+    // the rest is matched by hash, a parsed again tab mostly has the same items
+    std::unordered_multimap<std::string, size_t> previous_by_hash;
+    std::unordered_set<std::string> previous_hashes, current_hashes;
+    for (size_t i = 0; i < previous.size(); ++i) {
+        previous_hashes.insert(previous[i]->hash());
+        if (!used[i])
+            previous_by_hash.insert(std::make_pair(previous[i]->hash(), i));
+    }
+    std::set<std::string> added, modified;
+    for (size_t i = 0; i < current.size(); ++i) {
+        const Item &item = *current[i];
+        current_hashes.insert(item.hash());
+        if (delta.previous_rows[i] >= 0)
+            continue;
+        auto range = previous_by_hash.equal_range(item.hash());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (SameListing(item, *previous[it->second])) {
+                delta.previous_rows[i] = it->second;
+                previous_by_hash.erase(it);
+                break;
+            }
+        }
+        if (delta.previous_rows[i] >= 0)
+            continue;
+        delta.dirty.Set(i);
+        if (previous_hashes.count(item.hash()))
+            modified.insert(item.hash());
+        else
+            added.insert(item.hash());
+    }
+    std::set<std::string> removed;
+    for (auto &item : previous)
+        if (!current_hashes.count(item->hash()))
+            removed.insert(item->hash());
+
+    delta.added.assign(added.begin(), added.end());
+    delta.modified.assign(modified.begin(), modified.end());
+    delta.removed.assign(removed.begin(), removed.end());
+    return delta;
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "item.h"
+
+/*
+ * What changed between two consecutive ItemsRefreshed. Items are told apart
+ * by Item::hash(); an item is modified when its hash is still there but it
+ * moved, got relinked or its tab was renamed. previous_rows lets consumers
+ * carry per-row state of the previous index over to the new one.
+ */
+struct ItemsDelta {
+    unsigned long long previous_index_id = 0;
+    unsigned long long index_id = 0;
+    // hashes, each listed once
+    std::vector<std::string> added, removed, modified;
+    // for every row of the new index its row in the previous one, -1 for dirty rows
+    std::vector<int> previous_rows;
+    // rows of the new index that hold added or modified items
+    Bitmap dirty;
+    bool empty() const { return added.empty() && removed.empty() && modified.empty(); }
+    // rows were neither changed nor moved, the previous index can be kept
+    bool identity() const;
+    static ItemsDelta Compute(const Items &previous, const Items &current);
+};
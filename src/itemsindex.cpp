@@ -0,0 +1,165 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemsindex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <limits>
+
+namespace {
+
+const char *REQUIREMENT_NAMES[] = { "Level", "Str", "Dex", "Int" };
+
+std::atomic<unsigned long long> next_id(1);
+
+}
+
+ItemsIndex::ItemsIndex():
+    id_(next_id++)
+{}
+
+ItemsIndex::ItemsIndex(const Items &items):
+    id_(next_id++),
+    items_(items)
+{
+    size_t n = items.size();
+    for (int c = 0; c < INDEX_COLUMN_COUNT; ++c) {
+        columns_[c].resize(n);
+        present_[c] = Bitmap(n, c >= ATTRIBUTE_COUNT);
+    }
+    frame_types_.resize(n);
+    link_groups_.resize(n * MAX_LINK_GROUPS);
+
+    IString requirements[INDEX_REQUIRED_INT - INDEX_REQUIRED_LEVEL + 1];
+    for (int r = 0; r <= INDEX_REQUIRED_INT - INDEX_REQUIRED_LEVEL; ++r)
+        requirements[r] = IString(REQUIREMENT_NAMES[r]);
+
+    for (size_t i = 0; i < n; ++i) {
+        const Item &item = *items[i];
+        for (int a = 0; a < ATTRIBUTE_COUNT; ++a) {
+            NumericAttribute attribute = static_cast<NumericAttribute>(a);
+            if (item.has_numeric(attribute)) {
+                columns_[a][i] = static_cast<float>(item.numeric(attribute));
+                present_[a].Set(i);
+            }
+        }
+        columns_[INDEX_SOCKETS][i] = item.sockets();
+        columns_[INDEX_LINKS][i] = item.links();
+        columns_[INDEX_SOCKETS_R][i] = item.sockets_r();
+        columns_[INDEX_SOCKETS_G][i] = item.sockets_g();
+        columns_[INDEX_SOCKETS_B][i] = item.sockets_b();
+        columns_[INDEX_SOCKETS_W][i] = item.sockets_w();
+        for (int r = 0; r <= INDEX_REQUIRED_INT - INDEX_REQUIRED_LEVEL; ++r)
+            columns_[INDEX_REQUIRED_LEVEL + r][i] = item.requirement(requirements[r]);
+        frame_types_[i] = item.frameType();
+        std::copy(item.link_groups(), item.link_groups() + MAX_LINK_GROUPS, &link_groups_[i * MAX_LINK_GROUPS]);
+        for (int f = 0; f < TEXT_FIELD_COUNT; ++f)
+            text_[f].push_back(ItemText(item, static_cast<TextField>(f)));
+    }
+    for (int f = 0; f < TEXT_FIELD_COUNT; ++f)
+        trigrams_[f].Build(text_[f]);
+    mods_.Build(items);
+    BuildHistograms();
+}
+
+void ItemsIndex::BuildHistograms() {
+    for (int c = 0; c < INDEX_COLUMN_COUNT; ++c) {
+        Histogram &histogram = histograms_[c];
+        const std::vector<float> &values = columns_[c];
+        histogram.min = std::numeric_limits<float>::infinity();
+        histogram.max = -std::numeric_limits<float>::infinity();
+        histogram.count = 0;
+        present_[c].ForEach([&](size_t i) {
+            histogram.min = std::min(histogram.min, values[i]);
+            histogram.max = std::max(histogram.max, values[i]);
+            ++histogram.count;
+        });
+        histogram.buckets.assign(INDEX_HISTOGRAM_BUCKETS, 0);
+        if (histogram.count == 0 || histogram.max == histogram.min)
+            continue;
+        float scale = INDEX_HISTOGRAM_BUCKETS / (histogram.max - histogram.min);
+        present_[c].ForEach([&](size_t i) {
+            int bucket = static_cast<int>((values[i] - histogram.min) * scale);
+            ++histogram.buckets[std::min(bucket, INDEX_HISTOGRAM_BUCKETS - 1)];
+        });
+    }
+}
+
+bool ItemsIndex::MatchesAll(int column, float min, float max) const {
+    const Histogram &histogram = histograms_[column];
+    return histogram.count == size() && min <= histogram.min && max >= histogram.max;
+}
+
+double ItemsIndex::Selectivity(int column, float min, float max) const {
+    const Histogram &histogram = histograms_[column];
+    if (size() == 0)
+        return 1.0;
+    float low = std::max(min, histogram.min), high = std::min(max, histogram.max);
+    if (histogram.count == 0 || low > high)
+        return 0.0;
+    if (histogram.max == histogram.min || (low == histogram.min && high == histogram.max))
+        return static_cast<double>(histogram.count) / size();
+    // buckets partially inside the range count in proportion to the overlap
+    double width = (histogram.max - histogram.min) / INDEX_HISTOGRAM_BUCKETS;
+    double rows = 0;
+    for (int b = 0; b < INDEX_HISTOGRAM_BUCKETS; ++b) {
+        double begin = histogram.min + b * width, end = begin + width;
+        double overlap = std::min<double>(end, high) - std::max<double>(begin, low);
+        if (overlap > 0)
+            rows += histogram.buckets[b] * overlap / width;
+        else if (overlap == 0 && low == high && low >= begin && low <= end)
+            rows += histogram.buckets[b] / 2.0;
+    }
+    return std::min(1.0, rows / size());
+}
+
+std::string ItemsIndex::ItemText(const Item &item, TextField field) {
+    std::string text;
+    switch (field) {
+    case TEXT_NAME:
+        text = item.PrettyName();
+        break;
+    case TEXT_MODS:
+        for (auto &mod : item.explicitMods())
+            text += mod.str() + "\n";
+        for (auto &mod : item.implicitMods())
+            text += mod.str() + "\n";
+        break;
+    case TEXT_FIELD_COUNT:
+        break;
+    }
+    std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+    return text;
+}
+
+int ItemsIndex::RequirementColumn(const std::string &requirement) {
+    for (int r = 0; r <= INDEX_REQUIRED_INT - INDEX_REQUIRED_LEVEL; ++r)
+        if (requirement == REQUIREMENT_NAMES[r])
+            return INDEX_REQUIRED_LEVEL + r;
+    return -1;
+}
+
+Items ItemsIndex::Select(const Bitmap &selection) const {
+    Items result;
+    result.reserve(selection.Count());
+    selection.ForEach([&](size_t i) { result.push_back(items_[i]); });
+    return result;
+}
@@ -0,0 +1,108 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "item.h"
+#include "modtemplates.h"
+#include "trigramindex.h"
+
+// Columns of ItemsIndex, the first ATTRIBUTE_COUNT mirror Item::numeric()
+enum IndexColumn {
+    INDEX_SOCKETS = ATTRIBUTE_COUNT,
+    INDEX_LINKS,
+    INDEX_SOCKETS_R,
+    INDEX_SOCKETS_G,
+    INDEX_SOCKETS_B,
+    INDEX_SOCKETS_W,
+    INDEX_REQUIRED_LEVEL,
+    INDEX_REQUIRED_STR,
+    INDEX_REQUIRED_DEX,
+    INDEX_REQUIRED_INT,
+    INDEX_COLUMN_COUNT
+};
+
+// buckets of the per column histograms used to estimate filter selectivity
+const int INDEX_HISTOGRAM_BUCKETS = 64;
+
+// Lower-cased searchable text of an item
+enum TextField {
+    // Item::PrettyName(), i.e. name and type line
+    TEXT_NAME,
+    // explicit and implicit mods, one per line
+    TEXT_MODS,
+    TEXT_FIELD_COUNT
+};
+
+/*
+ * Struct-of-arrays copy of the data that filters look at, one row per item.
+ * Filters evaluate against the dense columns and produce a Bitmap of
+ * matching rows, so searching doesn't touch Item objects at all.
+ * An index is immutable once built and is rebuilt whenever the items change.
+ */
+class ItemsIndex {
+public:
+    ItemsIndex();
+    explicit ItemsIndex(const Items &items);
+    // unique for every index built during this run, lets searches tell indexes apart
+    unsigned long long id() const { return id_; }
+    size_t size() const { return items_.size(); }
+    const Items &items() const { return items_; }
+    const std::shared_ptr<Item> &item(size_t i) const { return items_[i]; }
+    const float *column(int column) const { return columns_[column].data(); }
+    // rows that have a value in the column, only numeric attributes can be missing
+    const Bitmap &present(int column) const { return present_[column]; }
+    const std::vector<uint8_t> &frame_types() const { return frame_types_; }
+    // Item::link_groups() of every row, MAX_LINK_GROUPS per row
+    const LinkGroup *link_groups(size_t row) const { return &link_groups_[row * MAX_LINK_GROUPS]; }
+    const std::vector<std::string> &text(TextField field) const { return text_[field]; }
+    const TrigramIndex &trigrams(TextField field) const { return trigrams_[field]; }
+    static std::string ItemText(const Item &item, TextField field);
+    const ModsIndex &mods() const { return mods_; }
+    // Column that holds the given requirement, -1 if not indexed
+    static int RequirementColumn(const std::string &requirement);
+    // Estimated share of rows with a value in [min, max] in column
+    double Selectivity(int column, float min, float max) const;
+    // true if every row has a value in [min, max], i.e. such a range filter does nothing
+    bool MatchesAll(int column, float min, float max) const;
+    Items Select(const Bitmap &selection) const;
+private:
+    // equi-width histogram over the present values of a column
+    struct Histogram {
+        float min, max;
+        size_t count;
+        std::vector<uint32_t> buckets;
+    };
+    void BuildHistograms();
+
+    unsigned long long id_;
+    Items items_;
+    std::vector<float> columns_[INDEX_COLUMN_COUNT];
+    Bitmap present_[INDEX_COLUMN_COUNT];
+    std::vector<uint8_t> frame_types_;
+    std::vector<LinkGroup> link_groups_;
+    std::vector<std::string> text_[TEXT_FIELD_COUNT];
+    TrigramIndex trigrams_[TEXT_FIELD_COUNT];
+    ModsIndex mods_;
+    Histogram histograms_[INDEX_COLUMN_COUNT];
+};
@@ -19,149 +19,652 @@
 
 #include "itemsmanager.h"
 
+#include <QCryptographicHash>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QSignalMapper>
+#include <QThreadPool>
 #include <QTimer>
 #include <QUrlQuery>
-#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+#include <climits>
 #include <iostream>
 #include <stdexcept>
+#include <utility>
 #include "jsoncpp/json.h"
 #include "QsLog.h"
 
-#include "mainwindow.h"
+#include "application.h"
 #include "datamanager.h"
-
-const char *POE_STASH_URL = "http://www.pathofexile.com/character-window/get-stash-items";
+#include "itemsindex.h"
+#include "itemssnapshot.h"
+#include "perfstats.h"
+#include "itemsstore.h"
+#include "buyoutmanager.h"
+#include "ratelimiter.h"
+#include "stashscanner.h"
+#include "stashtransport.h"
+#include "util.h"
+
+// https so Qt can use HTTP/2 and keep all requests on one connection
+const char *POE_STASH_URL = "https://www.pathofexile.com/character-window/get-stash-items";
+const char *POE_CHARACTERS_URL = "https://www.pathofexile.com/character-window/get-characters";
+const char *POE_CHARACTER_ITEMS_URL = "https://www.pathofexile.com/character-window/get-items";
+const int HTTP_NOT_MODIFIED = 304;
 const int DEFAULT_AUTO_UPDATE_INTERVAL = 30;
-
-ItemsManager::ItemsManager(MainWindow *app):
+const int DEFAULT_HOT_UPDATE_INTERVAL = 5;
+const int REQUESTS_BURST = 5;
+const int DEFAULT_MAX_IN_FLIGHT = 4;
+const int PRIORITY_CURRENT_TAB = 4;
+const int PRIORITY_TAB_BUYOUT = 2;
+const int PRIORITY_PRICED_ITEMS = 1;
+
+ItemsManager::ItemsManager(Application *app):
     app_(app),
-    signal_mapper_(new QSignalMapper),
+    characters_as_json_(Json::arrayValue),
+    characters_reply_(nullptr),
+    tabs_received_(0),
+    tabs_needed_(0),
+    lists_pending_(0),
+    in_flight_(0),
+    max_in_flight_(DEFAULT_MAX_IN_FLIGHT),
+    rate_limiter_(new RateLimiter(static_cast<double>(THROTTLE_REQUESTS) / THROTTLE_SLEEP, REQUESTS_BURST)),
+    transport_(nullptr),
+    signal_mapper_(nullptr),
+    items_store_(nullptr),
     auto_update_(true),
     auto_update_timer_(new QTimer),
-    updating_(false)
+    hot_update_interval_(DEFAULT_HOT_UPDATE_INTERVAL),
+    hot_update_timer_(new QTimer),
+    updating_(false),
+    online_(false),
+    saved_data_loaded_(false),
+    update_pending_(false),
+    generation_(0),
+    parse_pool_(new QThreadPool)
 {
+    qRegisterMetaType<ParsedTab>("ParsedTab");
+    connect(this, SIGNAL(TabParsed(ParsedTab)), this, SLOT(OnTabParsed(ParsedTab)), Qt::QueuedConnection);
+    qRegisterMetaType<SavedItems>("SavedItems");
+    connect(this, SIGNAL(SavedItemsDecoded(SavedItems)), this, SLOT(OnSavedItemsDecoded(SavedItems)),
+            Qt::QueuedConnection);
 }
 
 ItemsManager::~ItemsManager() {
+    // parse jobs emit signals on this object
+    parse_pool_->waitForDone();
+    delete parse_pool_;
     delete auto_update_timer_;
+    delete hot_update_timer_;
+    delete signal_mapper_;
+    delete rate_limiter_;
+    delete transport_;
+    delete items_store_;
 }
 
 void ItemsManager::Init() {
+    items_store_ = new ItemsStore(app_->data_manager());
+    transport_ = StashTransport::Create(app_->logged_in_nm());
     SetAutoUpdateInterval(DEFAULT_AUTO_UPDATE_INTERVAL);
     LoadSavedData();
     connect(auto_update_timer_, SIGNAL(timeout()), this, SLOT(OnAutoRefreshTimer()));
+    connect(hot_update_timer_, SIGNAL(timeout()), this, SLOT(OnHotRefreshTimer()));
+    connect(rate_limiter_, SIGNAL(Ready()), this, SLOT(FetchNextTab()));
+    StartHotUpdateTimer();
+}
+
+// Accept-Encoding and decompression are handled by QNetworkAccessManager, as long as we don't set the header
+static QNetworkRequest StashRequest(const QUrl &url) {
+    QNetworkRequest request(url);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    request.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif
+    return request;
 }
 
 QNetworkRequest ItemsManager::MakeRequest(int tab_index, bool tabs) {
     QUrlQuery query;
+    if (tab_index >= CHARACTER_TAB_BASE) {
+        query.addQueryItem("character", characters_[tab_index - CHARACTER_TAB_BASE].c_str());
+        QUrl url(POE_CHARACTER_ITEMS_URL);
+        url.setQuery(query);
+        return StashRequest(url);
+    }
     query.addQueryItem("league", app_->league().c_str());
     query.addQueryItem("tabs", tabs ? "1" : "0");
     query.addQueryItem("tabIndex", QString::number(tab_index));
 
     QUrl url(POE_STASH_URL);
     url.setQuery(query);
-    return QNetworkRequest(url);
+    return StashRequest(url);
 }
 
-void ItemsManager::Update() {
-    if (updating_) {
-        QLOG_WARN() << "ItemsManager::Update called while updating";
+QNetworkRequest ItemsManager::MakeCharactersRequest() {
+    return StashRequest(QUrl(POE_CHARACTERS_URL));
+}
+
+void ItemsManager::AddValidators(int index, QNetworkRequest *request) {
+    auto it = validators_.find(index);
+    if (it == validators_.end() || !tab_items_.count(index) || it->second.metadata != SourceMetadataString(index))
         return;
-    }
-    updating_ = true;
+    if (!it->second.etag.isEmpty())
+        request->setRawHeader("If-None-Match", it->second.etag);
+    if (!it->second.last_modified.isEmpty())
+        request->setRawHeader("If-Modified-Since", it->second.last_modified);
+}
+
+const Json::Value &ItemsManager::SourceMetadata(int index) {
+    if (index >= CHARACTER_TAB_BASE)
+        return characters_as_json_[index - CHARACTER_TAB_BASE];
+    return tabs_as_json_[index];
+}
+
+std::string ItemsManager::SourceMetadataString(int index) {
+    return Json::FastWriter().write(SourceMetadata(index));
+}
+
+std::string ItemsManager::SourceCaption(int index) {
+    if (index >= CHARACTER_TAB_BASE)
+        return characters_[index - CHARACTER_TAB_BASE];
+    return tabs_[index];
+}
+
+void ItemsManager::ResetRequests() {
     // remove all mappings (from previous requests)
     delete signal_mapper_;
     signal_mapper_ = new QSignalMapper;
+    connect(signal_mapper_, SIGNAL(mapped(int)), this, SLOT(OnTabReceived(int)));
     // remove all pending requests
-    tabs_queue_ = std::queue<int>();
+    rate_limiter_->Stop();
+    tabs_queue_ = std::priority_queue<TabRequest>();
     for (auto &reply : replies_)
         delete reply.second;
     replies_.clear();
-    items_as_json_.clear();
-    items_.clear();
+    delete characters_reply_;
+    characters_reply_ = nullptr;
+    request_started_.clear();
+    tabs_received_ = 0;
+    tabs_needed_ = 0;
+    lists_pending_ = 0;
+    // results of parse jobs that are still running will be ignored
+    ++generation_;
+    priority_tabs_pending_.clear();
+    in_flight_ = 0;
+}
+
+int ItemsManager::TabPriority(int index) {
+    int priority = 0;
+    const std::shared_ptr<Item> &current = app_->current_item();
+    if (current && current->tab() == index)
+        priority += PRIORITY_CURRENT_TAB;
+    if (index < CHARACTER_TAB_BASE && app_->buyout_manager()->ExistsTab(tabs_[index]))
+        priority += PRIORITY_TAB_BUYOUT;
+    if (tab_items_.count(index)) {
+        for (auto &item : tab_items_[index])
+            if (app_->buyout_manager()->Exists(*item)) {
+                priority += PRIORITY_PRICED_ITEMS;
+                break;
+            }
+    }
+    return priority;
+}
+
+void ItemsManager::QueueTab(int index) {
+    TabRequest request;
+    request.index = index;
+    request.priority = TabPriority(index);
+    if (request.priority > 0)
+        priority_tabs_pending_.insert(index);
+    tabs_queue_.push(request);
+}
+
+void ItemsManager::SetOnline() {
+    online_ = true;
+    StartPendingUpdate();
+}
+
+void ItemsManager::StartPendingUpdate() {
+    if (update_pending_ && online_ && saved_data_loaded_) {
+        update_pending_ = false;
+        Update();
+    }
+}
+
+void ItemsManager::Update() {
+    if (!online_ || !saved_data_loaded_) {
+        QLOG_INFO() << "Refresh postponed until saved items are loaded and the login is done.";
+        update_pending_ = true;
+        return;
+    }
+    if (updating_) {
+        QLOG_WARN() << "ItemsManager::Update called while updating";
+        return;
+    }
+    updating_ = true;
+    refresh_clock_.start();
+    ResetRequests();
 
-    // first step, fetch first tab and get list of all tabs
-    QNetworkReply *first_tab = app_->logged_in_nm()->get(MakeRequest(0, true));
+    // first step, fetch first tab and get list of all tabs, and the list of characters
+    lists_pending_ = 2;
+    request_started_[0] = PerfStats::Now();
+    QNetworkReply *first_tab = transport_->Fetch(MakeRequest(0, true));
     connect(first_tab, SIGNAL(finished()), this, SLOT(OnFirstTabReceived()));
+    characters_reply_ = transport_->Fetch(MakeCharactersRequest());
+    connect(characters_reply_, SIGNAL(finished()), this, SLOT(OnCharactersReceived()));
 }
 
-void ItemsManager::FetchSomeTabs(int limit) {
-    int count = std::min(limit, static_cast<int>(tabs_queue_.size()));
-    for (int i = 0; i < count; ++i) {
-        int index = tabs_queue_.front();
-        tabs_queue_.pop();
+void ItemsManager::OnCharactersReceived() {
+    QNetworkReply *reply = characters_reply_;
+    characters_reply_ = nullptr;
+    QByteArray bytes = reply->readAll();
+    reply->deleteLater();
+    --lists_pending_;
+
+    Json::Value root;
+    if (!Json::Reader().parse(bytes.constData(), bytes.constData() + bytes.size(), root, false) || !root.isArray()) {
+        // items of the characters we already know about are kept as they are
+        QLOG_WARN() << "Failed to get the list of characters, only stash tabs are refreshed.";
+        CheckRefreshDone();
+        return;
+    }
+
+    std::vector<std::string> characters;
+    Json::Value characters_json(Json::arrayValue);
+    for (auto &character : root) {
+        if (character["league"].asString() != app_->league())
+            continue;
+        characters.push_back(character["name"].asString());
+        Json::Value metadata = character;
+        metadata["n"] = characters.back();
+        characters_json.append(metadata);
+    }
+    characters_ = characters;
+    characters_as_json_ = characters_json;
+    // forget about characters that no longer exist
+    int end = CHARACTER_TAB_BASE + characters_.size();
+    tab_items_.erase(tab_items_.lower_bound(end), tab_items_.end());
+    tab_fingerprints_.erase(tab_fingerprints_.lower_bound(end), tab_fingerprints_.end());
+
+    tabs_needed_ += characters_.size();
+    for (size_t i = 0; i < characters_.size(); ++i)
+        QueueTab(CHARACTER_TAB_BASE + i);
+    if (!characters_.empty())
+        rate_limiter_->Start();
+    emit StatusUpdate(tabs_received_, tabs_needed_, rate_limiter_->backing_off());
+    CheckRefreshDone();
+}
 
-        QNetworkReply *tab_fetched = app_->logged_in_nm()->get(MakeRequest(index, false));
-        signal_mapper_->setMapping(tab_fetched, index);
-        connect(tab_fetched, SIGNAL(finished()), signal_mapper_, SLOT(map()));
-        replies_[index] = tab_fetched;
+void ItemsManager::UpdateHotTabs() {
+    if (!online_ || !saved_data_loaded_)
+        return;
+    if (updating_) {
+        QLOG_INFO() << "Skipping hot tabs refresh because a refresh is already running.";
+        return;
+    }
+    std::vector<int> hot;
+    for (size_t i = 0; i < tabs_.size(); ++i)
+        if (hot_tabs_.count(tabs_[i]))
+            hot.push_back(i);
+    if (hot.empty())
+        return;
+
+    updating_ = true;
+    refresh_clock_.start();
+    ResetRequests();
+    for (auto index : hot)
+        QueueTab(index);
+    tabs_needed_ = hot.size();
+    rate_limiter_->Start();
+}
+
+void ItemsManager::FetchNextTab() {
+    if (tabs_queue_.empty() || in_flight_ >= max_in_flight_) {
+        // will be started again when a reply arrives or some tab has to be re-requested
+        rate_limiter_->Stop();
+        return;
     }
-    requests_needed_ = count;
-    requests_completed_ = 0;
+    int index = tabs_queue_.top().index;
+    tabs_queue_.pop();
+
+    // a tab might be re-requested after an error, get rid of the old reply
+    if (replies_.count(index))
+        replies_[index]->deleteLater();
+    request_started_[index] = PerfStats::Now();
+    QNetworkRequest request = MakeRequest(index, false);
+    AddValidators(index, &request);
+    QNetworkReply *tab_fetched = transport_->Fetch(request);
+    signal_mapper_->setMapping(tab_fetched, index);
+    connect(tab_fetched, SIGNAL(finished()), signal_mapper_, SLOT(map()));
+    replies_[index] = tab_fetched;
+    if (++in_flight_ >= max_in_flight_)
+        rate_limiter_->Stop();
 }
 
 void ItemsManager::OnFirstTabReceived() {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
-    QByteArray bytes = reply->readAll();
+    RecordRequestLatency(0);
+    ParseTabAsync(0, reply, true);
+}
 
-    std::string json(bytes.constData(), bytes.size());
-    Json::Value root;
+void ItemsManager::RecordRequestLatency(int index) {
+    auto it = request_started_.find(index);
+    if (it == request_started_.end())
+        return;
+    PerfStats::Record("stash request", it->second, PerfStats::Now() - it->second);
+    request_started_.erase(it);
+}
+
+/*
+ * Runs in parse_pool_, must not touch any ItemsManager state.
+ */
+static ParsedTab ParseTab(int generation, int index, const QByteArray &bytes, bool first,
+                          const std::string &metadata, const std::string &label,
+                          const std::string &previous_fingerprint) {
+    PerfTimer timer("parse tab");
+    ParsedTab result;
+    result.generation = generation;
+    result.index = index;
+    result.first = first;
+    result.error = false;
+    result.unchanged = false;
+
+    // the first response contains all tab metadata so its hash covers that too
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(bytes);
+    hash.addData(metadata.c_str(), metadata.size());
+    result.fingerprint = hash.result().toHex().constData();
+    if (result.fingerprint == previous_fingerprint) {
+        // same response as last time, no need to even parse it
+        result.unchanged = true;
+        return result;
+    }
+
+    // items are only located here, they're decoded once the caption is known
+    std::vector<std::pair<const char*, size_t>> slices;
+    StashScanner scanner(bytes.constData(), bytes.size());
+    if (!scanner.Scan([&slices](const char *begin, size_t size) { slices.emplace_back(begin, size); })) {
+        result.error = true;
+        return result;
+    }
+
+    std::string caption = label;
+    if (first) {
+        result.tabs = scanner.tabs();
+        caption = result.tabs[0]["n"].asString();
+    }
+    PerfTimer construct_timer("construct items");
+    PerfStats::Count("items parsed", slices.size());
+    // freed in one go once no one holds on to items of this response
+    auto arena = std::make_shared<ItemArena>();
     Json::Reader reader;
-    reader.parse(json, root);
+    for (auto &slice : slices) {
+        Json::Value item;
+        if (!reader.parse(slice.first, slice.first + slice.second, item, false) || !item.isObject()) {
+            QLOG_WARN() << "Skipping malformed item in tab" << index;
+            continue;
+        }
+        result.items.push_back(Item::Create(arena, item, std::string(slice.first, slice.second), index, caption));
+    }
+    PerfStats::Count("item arena bytes", arena->allocated());
+    return result;
+}
 
-    int index = 0;
-    if (!root.isObject())
-        throw std::runtime_error("First response is not an object.");
-    tabs_.clear();
-    tabs_as_json_ = root["tabs"];
-    for (auto tab : root["tabs"]) {
-        tabs_.push_back(tab["n"].asString());
-        if (index > 0)
-            tabs_queue_.push(index);
-        ++index;
+void ItemsManager::ParseTabAsync(int index, QNetworkReply *reply, bool first) {
+    std::string metadata, label, previous;
+    if (!first) {
+        metadata = SourceMetadataString(index);
+        label = SourceCaption(index);
     }
-    ParseItems(root, 0);
-    tabs_needed_ = tabs_.size();
-    tabs_received_ = 1;
-    FetchSomeTabs(THROTTLE_REQUESTS - 1);
+    if (tab_items_.count(index) && tab_fingerprints_.count(index))
+        previous = tab_fingerprints_[index];
+    TabValidator validator;
+    validator.etag = reply->rawHeader("ETag");
+    validator.last_modified = reply->rawHeader("Last-Modified");
+    validator.metadata = metadata;
+    QByteArray bytes = reply->readAll();
+    int generation = generation_;
+    QtConcurrent::run(parse_pool_, [=]() {
+        ParsedTab tab = ParseTab(generation, index, bytes, first, metadata, label, previous);
+        tab.validator = validator;
+        emit TabParsed(tab);
+    });
+}
 
-    connect(signal_mapper_, SIGNAL(mapped(int)), this, SLOT(OnTabReceived(int)));
+void ItemsManager::OnTabParsed(const ParsedTab &tab) {
+    if (tab.generation != generation_) {
+        QLOG_INFO() << "Dropping tab" << tab.index << "parsed for a previous refresh.";
+        return;
+    }
+    if (tab.first)
+        OnFirstTabParsed(tab);
+    else
+        OnOtherTabParsed(tab);
 }
 
-void ItemsManager::ParseItems(const Json::Value &root, int tab) {
-    for (auto item : root["items"]) {
-        item["_tab"] = tab;
-        item["_tab_label"] = tabs_[tab];
-        items_as_json_.append(item);
-        items_.push_back(std::make_shared<Item>(item, tab, tabs_[tab]));
+void ItemsManager::OnFirstTabParsed(const ParsedTab &tab) {
+    if (tab.error) {
+        QLOG_WARN() << "Got 'error' instead of the list of tabs, refresh aborted.";
+        rate_limiter_->OnThrottled();
+        ResetRequests();
+        updating_ = false;
+        return;
     }
+
+    if (!tab.unchanged) {
+        tabs_.clear();
+        tabs_as_json_ = tab.tabs;
+        for (auto &tab_json : tabs_as_json_)
+            tabs_.push_back(tab_json["n"].asString());
+        StoreTab(tab);
+    }
+    // forget about tabs that no longer exist
+    int tabs_count = tabs_.size();
+    tab_items_.erase(tab_items_.lower_bound(tabs_count), tab_items_.lower_bound(CHARACTER_TAB_BASE));
+    tab_fingerprints_.erase(tab_fingerprints_.lower_bound(tabs_count), tab_fingerprints_.lower_bound(CHARACTER_TAB_BASE));
+
+    --lists_pending_;
+    tabs_needed_ += tabs_count;
+    for (int i = 1; i < tabs_count; ++i)
+        QueueTab(i);
+    rate_limiter_->OnSuccess();
+    rate_limiter_->Start();
+    OnTabProcessed(0);
+}
+
+void ItemsManager::OnOtherTabParsed(const ParsedTab &tab) {
+    if (tab.error) {
+        QLOG_WARN() << tab.index << "got 'error' instead of stash tab contents, we're probably going too fast.";
+        rate_limiter_->OnThrottled();
+        TabRequest request;
+        request.index = tab.index;
+        request.priority = TabPriority(tab.index);
+        tabs_queue_.push(request);
+        rate_limiter_->Start();
+        emit StatusUpdate(tabs_received_ + 1, tabs_needed_, true);
+        return;
+    }
+
+    rate_limiter_->OnSuccess();
+    if (!tab.unchanged)
+        StoreTab(tab);
+    if (!tab.validator.etag.isEmpty() || !tab.validator.last_modified.isEmpty())
+        validators_[tab.index] = tab.validator;
+    OnTabProcessed(tab.index);
+}
+
+void ItemsManager::StoreTab(const ParsedTab &tab) {
+    tab_items_[tab.index] = tab.items;
+    dirty_tabs_.insert(tab.index);
+    tab_fingerprints_[tab.index] = tab.fingerprint;
+}
+
+void ItemsManager::RebuildItems() {
+    PerfTimer timer("ItemsManager::RebuildItems");
+    Items items;
+    for (auto &tab : tab_items_)
+        items.insert(items.end(), tab.second.begin(), tab.second.end());
+    delta_ = ItemsDelta::Compute(items_, items);
+    delta_.previous_index_id = items_index_ ? items_index_->id() : 0;
+    if (items_index_ && delta_.identity()) {
+        // nothing changed, consumers see the same index and skip all work
+        delta_.index_id = items_index_->id();
+        return;
+    }
+    items_ = std::move(items);
+    items_index_ = std::make_shared<ItemsIndex>(items_);
+    delta_.index_id = items_index_->id();
+    QLOG_DEBUG() << "Items rebuilt:" << delta_.added.size() << "added," << delta_.removed.size() << "removed,"
+                 << delta_.modified.size() << "modified.";
+}
+
+void ItemsManager::LoadLegacyData(const std::string &items) {
+    // items used to be saved as one big JSON array under the "items" key
+    Json::Value root;
+    Json::Reader reader;
+    reader.parse(items, root);
+    for (auto &item : root) {
+        int tab = item["_tab"].asInt();
+        tab_items_[tab].push_back(std::make_shared<Item>(item, tab, item["_tab_label"].asString()));
+    }
+
+    std::string tabs = app_->data_manager()->Get("tabs");
+    if (tabs.size() != 0)
+        reader.parse(tabs, tabs_as_json_);
+
+    std::string fingerprints = app_->data_manager()->Get("tab_fingerprints");
+    if (fingerprints.size() != 0) {
+        Json::Value fingerprints_root;
+        reader.parse(fingerprints, fingerprints_root);
+        for (auto &key : fingerprints_root.getMemberNames())
+            tab_fingerprints_[std::stoi(key)] = fingerprints_root[key].asString();
+    }
+
+    QLOG_INFO() << "Moving saved items to the new storage format.";
+    for (size_t i = 0; i < tabs_as_json_.size(); ++i)
+        dirty_tabs_.insert(i);
+    app_->data_manager()->BeginBatch();
+    SaveData();
+    for (auto key : { "items", "tabs", "tab_fingerprints" })
+        app_->data_manager()->Set(key, "");
+    app_->data_manager()->Commit();
 }
 
 void ItemsManager::LoadSavedData() {
     items_.clear();
-    std::string items = app_->data_manager()->Get("items");
-    if (items.size() != 0) {
+    tab_items_.clear();
+    tab_fingerprints_.clear();
+    tabs_as_json_ = Json::Value(Json::arrayValue);
+
+    characters_.clear();
+    characters_as_json_ = Json::Value(Json::arrayValue);
+    std::string characters = app_->data_manager()->Get("characters");
+    if (characters.size() != 0)
+        Json::Reader().parse(characters, characters_as_json_);
+    for (auto &character : characters_as_json_)
+        characters_.push_back(character["n"].asString());
+
+    hot_tabs_.clear();
+    std::string hot_tabs = app_->data_manager()->Get("hot_tabs");
+    if (hot_tabs.size() != 0) {
         Json::Value root;
         Json::Reader reader;
-        reader.parse(items, root);
-        for (auto &item : root) {
-            items_.push_back(std::make_shared<Item>(item, item["_tab"].asInt(), item["_tab_label"].asString()));
-        }
+        reader.parse(hot_tabs, root);
+        for (auto &tab : root)
+            hot_tabs_.insert(tab.asString());
+    }
+    std::string hot_interval = app_->data_manager()->Get("hot_update_interval");
+    if (hot_interval.size() != 0)
+        hot_update_interval_ = std::stoi(hot_interval);
+    std::string max_in_flight = app_->data_manager()->Get("max_in_flight");
+    if (max_in_flight.size() != 0)
+        max_in_flight_ = std::stoi(max_in_flight);
+
+    std::string legacy_items = app_->data_manager()->Get("items");
+    if (items_store_->empty() && legacy_items.size() != 0) {
+        LoadLegacyData(legacy_items);
+        OnSavedItemsLoaded();
+        return;
+    }
+
+    // runs while the login is still in progress, items only keep the store pointer for later
+    std::string path = SnapshotPath();
+    uint64_t generation = SnapshotGeneration();
+    ItemsStore *store = items_store_;
+    QtConcurrent::run(parse_pool_, [=]() {
+        PerfTimer timer("decode snapshot");
+        SavedItems saved;
+        saved.loaded = ItemsSnapshot::Load(path, generation, store, &saved.tabs, &saved.fingerprints,
+                                           &saved.tab_items);
+        emit SavedItemsDecoded(saved);
+    });
+}
+
+void ItemsManager::OnSavedItemsDecoded(const SavedItems &saved) {
+    if (saved.loaded) {
+        tabs_as_json_ = saved.tabs;
+        tab_fingerprints_ = saved.fingerprints;
+        tab_items_ = saved.tab_items;
+    } else {
+        items_store_->Load(&tab_items_, &tabs_as_json_, &tab_fingerprints_);
     }
+    OnSavedItemsLoaded();
+}
 
+void ItemsManager::OnSavedItemsLoaded() {
+    RebuildItems();
     tabs_.clear();
-    std::string tabs = app_->data_manager()->Get("tabs");
-    if (tabs.size() != 0) {
-        Json::Value root;
-        Json::Reader reader;
-        reader.parse(tabs, root);
-        for (auto &tab : root)
-            tabs_.push_back(tab["n"].asString());
+    for (auto &tab : tabs_as_json_)
+        tabs_.push_back(tab["n"].asString());
+    saved_data_loaded_ = true;
+
+    emit ItemsRefreshed(items_, tabs_, delta_);
+    StartPendingUpdate();
+}
+
+std::string ItemsManager::SnapshotPath() {
+    return app_->data_manager()->filename() + ".snapshot";
+}
+
+uint64_t ItemsManager::SnapshotGeneration() {
+    std::string generation = app_->data_manager()->Get("snapshot_generation");
+    if (generation.empty())
+        return 0;
+    return std::stoull(generation);
+}
+
+void ItemsManager::SaveData() {
+    // only tabs that were parsed during this refresh are written
+    app_->data_manager()->BeginBatch();
+    // tabs that failed to save are tried again with the next save
+    std::set<int> failed_tabs;
+    std::map<int, std::vector<long long>> saved_ids;
+    for (auto tab : dirty_tabs_) {
+        std::vector<long long> ids;
+        if (items_store_->SaveTab(tab, SourceMetadata(tab), tab_fingerprints_[tab], tab_items_[tab], &ids))
+            saved_ids[tab].swap(ids);
+        else
+            failed_tabs.insert(tab);
+    }
+    bool deleted = items_store_->DeleteTabs(tabs_as_json_.size(), CHARACTER_TAB_BASE);
+    deleted = items_store_->DeleteTabs(CHARACTER_TAB_BASE + characters_.size(), INT_MAX) && deleted;
+    app_->data_manager()->Set("characters", Json::FastWriter().write(characters_as_json_));
+    // the snapshot is only trusted if it was written after this commit
+    uint64_t generation = SnapshotGeneration() + 1;
+    app_->data_manager()->Set("snapshot_generation", std::to_string(generation));
+    bool committed = app_->data_manager()->Commit();
+    // until the rows are committed items keep reading their old ones
+    for (auto &saved : saved_ids) {
+        if (committed)
+            items_store_->Attach(tab_items_[saved.first], saved.second);
+        else
+            failed_tabs.insert(saved.first);
     }
-    emit ItemsRefreshed(items_, tabs_);
+    dirty_tabs_.swap(failed_tabs);
+
+    // items of unsaved tabs have no rows to point at and tabs that weren't deleted would
+    // come back from the database, the outdated snapshot isn't trusted either
+    if (dirty_tabs_.empty() && deleted && committed)
+        ItemsSnapshot::Save(SnapshotPath(), generation, tabs_as_json_, tab_fingerprints_, tab_items_);
 }
 
 void ItemsManager::OnTabReceived(int index) {
@@ -169,51 +672,60 @@ void ItemsManager::OnTabReceived(int index) {
         QLOG_WARN() << "Received a tab" << index << "that was not requested.";
         return;
     }
-    ++requests_completed_;
-    if (requests_completed_ == requests_needed_ && tabs_queue_.size() > 0) {
-        emit StatusUpdate(tabs_received_ + 1, tabs_needed_, true);
-        QLOG_INFO() << "Sleeping one minute to prevent throttling.";
-        QTimer::singleShot(THROTTLE_SLEEP * 1000, this, SLOT(FetchSomeTabs()));
-    } else {
-        emit StatusUpdate(tabs_received_ + 1, tabs_needed_, false);
-    }
-
     QNetworkReply *reply = replies_[index];
-    QByteArray bytes = reply->readAll();
-    std::string json(bytes.constData(), bytes.size());
-    Json::Value root;
-    Json::Reader reader;
-    reader.parse(json, root);
-
-    if (root.isMember("error")) {
-        QLOG_WARN() << index << "got 'error' instead of stash tab contents, this shouldn't normally happen.";
-        // but it just happened
-        tabs_queue_.push(index);
+    RecordRequestLatency(index);
+    --in_flight_;
+    if (!tabs_queue_.empty())
+        rate_limiter_->Start();
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == HTTP_NOT_MODIFIED) {
+        // only asked for with validators of items we still have, nothing to download or parse
+        PerfStats::Count("tabs not modified");
+        ParsedTab tab;
+        tab.generation = generation_;
+        tab.index = index;
+        tab.first = false;
+        tab.error = false;
+        tab.unchanged = true;
+        tab.validator = validators_[index];
+        OnTabParsed(tab);
         return;
     }
+    ParseTabAsync(index, reply, false);
+}
 
-    ParseItems(root, index);
-
+void ItemsManager::OnTabProcessed(int index) {
     ++tabs_received_;
-    if (tabs_received_ == tabs_needed_) {
-        // all tabs were received
-        emit ItemsRefreshed(items_, tabs_);
+    emit StatusUpdate(tabs_received_, tabs_needed_, rate_limiter_->backing_off());
+    if (priority_tabs_pending_.erase(index) && priority_tabs_pending_.empty() && tabs_received_ < tabs_needed_) {
+        QLOG_INFO() << "Prioritized tabs received, showing partial results.";
+        RebuildItems();
+        emit ItemsRefreshed(items_, tabs_, delta_);
+    }
+    CheckRefreshDone();
+}
 
-        Json::FastWriter writer;
-        app_->data_manager()->Set("items", writer.write(items_as_json_));
-        app_->data_manager()->Set("tabs", writer.write(tabs_as_json_));
+void ItemsManager::CheckRefreshDone() {
+    if (!updating_ || lists_pending_ > 0 || tabs_received_ < tabs_needed_)
+        return;
+    // all tabs and characters were received
+    RebuildItems();
+    emit ItemsRefreshed(items_, tabs_, delta_);
+    SaveData();
 
-        updating_ = false;
-    }
+    QLOG_INFO() << "Refreshed" << tabs_needed_ << "tabs and characters in" << refresh_clock_.elapsed() << "ms";
+    updating_ = false;
 }
 
 void ItemsManager::SetAutoUpdate(bool update) {
     auto_update_ = update;
-    if (!auto_update_)
+    if (!auto_update_) {
         auto_update_timer_->stop();
-    else
+        hot_update_timer_->stop();
+    } else {
         // to start timer
         SetAutoUpdateInterval(auto_update_interval_);
+        StartHotUpdateTimer();
+    }
 }
 
 void ItemsManager::SetAutoUpdateInterval(int minutes) {
@@ -222,6 +734,40 @@ void ItemsManager::SetAutoUpdateInterval(int minutes) {
         auto_update_timer_->start(auto_update_interval_ * 60 * 1000);
 }
 
+void ItemsManager::SetHotTabs(const std::set<std::string> &hot_tabs) {
+    hot_tabs_ = hot_tabs;
+    Json::Value root(Json::arrayValue);
+    for (auto &tab : hot_tabs_)
+        root.append(tab);
+    Json::FastWriter writer;
+    app_->data_manager()->Set("hot_tabs", writer.write(root));
+    StartHotUpdateTimer();
+}
+
+void ItemsManager::SetHotUpdateInterval(int minutes) {
+    hot_update_interval_ = minutes;
+    app_->data_manager()->Set("hot_update_interval", std::to_string(minutes));
+    StartHotUpdateTimer();
+}
+
+void ItemsManager::SetMaxInFlight(int max_in_flight) {
+    max_in_flight_ = max_in_flight;
+    app_->data_manager()->Set("max_in_flight", std::to_string(max_in_flight));
+    if (!tabs_queue_.empty())
+        rate_limiter_->Start();
+}
+
+void ItemsManager::StartHotUpdateTimer() {
+    if (auto_update_ && !hot_tabs_.empty())
+        hot_update_timer_->start(hot_update_interval_ * 60 * 1000);
+    else
+        hot_update_timer_->stop();
+}
+
 void ItemsManager::OnAutoRefreshTimer() {
     Update();
 }
+
+void ItemsManager::OnHotRefreshTimer() {
+    UpdateHotTabs();
+}
@@ -19,69 +19,229 @@
 
 #pragma once
 
+#include <QByteArray>
+#include <QElapsedTimer>
 #include <QNetworkRequest>
 #include <QObject>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <queue>
 #include "jsoncpp/json.h"
 
 #include "item.h"
+#include "itemsdelta.h"
 
+/*
+ * GGG throttles requests, these values were approximated based on some
+ * quick testing and are only used as the starting rate of rate_limiter_.
+ */
 const int THROTTLE_REQUESTS = 45;
 const int THROTTLE_SLEEP = 60;
 
 class QNetworkReply;
 class QSignalMapper;
+class QThreadPool;
 class QTimer;
-class MainWindow;
+class Application;
+class ItemsIndex;
+class ItemsStore;
+class RateLimiter;
+class StashTransport;
+
+// Validators of the last good response of a tab, sent with the next request for it
+struct TabValidator {
+    QByteArray etag;
+    QByteArray last_modified;
+    // a renamed or moved tab can be "not modified" while its items need a new caption
+    std::string metadata;
+};
+
+// Result of parsing a single stash tab response in a worker thread
+struct ParsedTab {
+    // ItemsManager ignores results from previous refreshes
+    int generation;
+    int index;
+    // this is the response that also has the list of tabs
+    bool first;
+    // got "error" or garbage instead of tab contents
+    bool error;
+    // same response as last time, nothing was parsed
+    bool unchanged;
+    std::string fingerprint;
+    TabValidator validator;
+    // only filled for the first tab
+    Json::Value tabs;
+    Items items;
+};
+
+Q_DECLARE_METATYPE(ParsedTab)
+
+// Items decoded from the snapshot in parse_pool_ at startup
+struct SavedItems {
+    // false if the snapshot is missing or stale and items have to come from ItemsStore
+    bool loaded;
+    Json::Value tabs;
+    std::map<int, std::string> fingerprints;
+    std::map<int, Items> tab_items;
+};
+
+Q_DECLARE_METATYPE(SavedItems)
+
+struct TabRequest {
+    int priority;
+    // stash tab, or CHARACTER_TAB_BASE + character
+    int index;
+    // higher priority first, then in tab order
+    bool operator<(const TabRequest &other) const {
+        if (priority != other.priority)
+            return priority < other.priority;
+        return index > other.index;
+    }
+};
 
 class ItemsManager : public QObject {
     Q_OBJECT
 public:
-    explicit ItemsManager(MainWindow *app);
+    explicit ItemsManager(Application *app);
     ~ItemsManager();
     ItemsManager(const ItemsManager&) = delete;
     ItemsManager& operator=(const ItemsManager&) = delete;
     void Init();
+    // Requests are only sent once the account is logged in, until then saved items are shown.
+    // Refreshes asked for before that, or before saved items are decoded, start afterwards.
+    void SetOnline();
+    bool online() const { return online_; }
+    // Full sweep: fetches the lists of tabs and characters and then every tab and character.
     void Update();
+    // Fetches only tabs from the "hot tabs" set, the rest are kept as is.
+    void UpdateHotTabs();
     void SetAutoUpdateInterval(int minutes);
     void SetAutoUpdate(bool update);
     int auto_update_interval() const { return auto_update_interval_; }
+    void SetHotTabs(const std::set<std::string> &hot_tabs);
+    const std::set<std::string> &hot_tabs() const { return hot_tabs_; }
+    // characters in this league, their items are fetched like another tab
+    const std::vector<std::string> &characters() const { return characters_; }
+    void SetHotUpdateInterval(int minutes);
+    int hot_update_interval() const { return hot_update_interval_; }
+    void SetMaxInFlight(int max_in_flight);
+    int max_in_flight() const { return max_in_flight_; }
+    // Columnar index of the items from the last ItemsRefreshed
+    const std::shared_ptr<const ItemsIndex> &items_index() const { return items_index_; }
 public slots:
     void OnFirstTabReceived();
+    void OnCharactersReceived();
     void OnTabReceived(int index);
-    /*
-     * Fetches 45 tabs at once, should be called every minute.
-     * These values are approximated (GGG throttles requests)
-     * based on some quick testing.
-     */
-    void FetchSomeTabs(int limit = THROTTLE_REQUESTS);
+    void OnTabParsed(const ParsedTab &tab);
+    void OnSavedItemsDecoded(const SavedItems &saved);
+    // Sends a request for the next queued tab, called by rate_limiter_
+    void FetchNextTab();
     // called by auto_update_timer_
     void OnAutoRefreshTimer();
+    // called by hot_update_timer_
+    void OnHotRefreshTimer();
 signals:
-    void ItemsRefreshed(const Items &items, const std::vector<std::string> &tabs);
+    // delta is relative to the items of the previous ItemsRefreshed
+    void ItemsRefreshed(const Items &items, const std::vector<std::string> &tabs, const ItemsDelta &delta);
     void StatusUpdate(int fetched, int total, bool throttled);
+    // emitted from parse_pool_ threads
+    void TabParsed(const ParsedTab &tab);
+    // emitted from a parse_pool_ thread
+    void SavedItemsDecoded(const SavedItems &saved);
 private:
-    void ParseItems(const Json::Value &root, int tab);
+    // Hands tab response over to parse_pool_, the result comes back through TabParsed
+    void ParseTabAsync(int index, QNetworkReply *reply, bool first);
+    void OnFirstTabParsed(const ParsedTab &tab);
+    void OnOtherTabParsed(const ParsedTab &tab);
+    void StoreTab(const ParsedTab &tab);
+    void OnTabProcessed(int index);
+    // Emits the final ItemsRefreshed once every tab and character was processed
+    void CheckRefreshDone();
+    // metadata and caption of a stash tab or character
+    const Json::Value &SourceMetadata(int index);
+    std::string SourceCaption(int index);
+    void RecordRequestLatency(int index);
+    void ResetRequests();
+    void QueueTab(int index);
+    // Tabs that matter most for the user (priced, currently viewed) are fetched first
+    int TabPriority(int index);
+    // Concatenates tab_items_ into items_ and computes delta_ against the previous items_
+    void RebuildItems();
+    void StartHotUpdateTimer();
+    // Settings are read right away, the snapshot is decoded in parse_pool_
     void LoadSavedData();
+    // Emits the first ItemsRefreshed once tab_items_ holds the saved items
+    void OnSavedItemsLoaded();
+    // Starts the refresh that was postponed by Update
+    void StartPendingUpdate();
+    void LoadLegacyData(const std::string &items);
+    void SaveData();
+    std::string SnapshotPath();
+    uint64_t SnapshotGeneration();
     QNetworkRequest MakeRequest(int tab_index, bool tabs);
+    // Makes the request conditional if the server sent validators for a tab that is still the same
+    void AddValidators(int index, QNetworkRequest *request);
+    std::string SourceMetadataString(int index);
+    QNetworkRequest MakeCharactersRequest();
 
-    MainWindow *app_;
+    Application *app_;
     std::vector<std::string> tabs_;
-    std::queue<int> tabs_queue_;
+    std::vector<std::string> characters_;
+    // entries of get-characters in this league, with the name also under "n" like in tabs_as_json_
+    Json::Value characters_as_json_;
+    QNetworkReply *characters_reply_;
+    std::priority_queue<TabRequest> tabs_queue_;
     std::map<int, QNetworkReply*> replies_;
+    // PerfStats::Now() when the request for a tab was sent
+    std::map<int, qint64> request_started_;
     Items items_;
+    // rebuilt together with items_
+    std::shared_ptr<const ItemsIndex> items_index_;
+    // what changed in the last RebuildItems
+    ItemsDelta delta_;
+    // items_ is built by concatenating these in tab order
+    std::map<int, Items> tab_items_;
+    // tabs that were parsed since the last save
+    std::set<int> dirty_tabs_;
+    // hash of the raw tab response plus tab metadata, used to skip parsing unchanged tabs
+    std::map<int, std::string> tab_fingerprints_;
+    // kept for the whole session, fingerprints still catch servers that ignore validators
+    std::map<int, TabValidator> validators_;
     int tabs_received_, tabs_needed_;
-    int requests_completed_, requests_needed_;
+    // responses listing tabs or characters that haven't been processed yet
+    int lists_pending_;
+    // queued or in-flight tabs with priority > 0, partial results are emitted once all of them arrive
+    std::set<int> priority_tabs_pending_;
+    int in_flight_, max_in_flight_;
+    RateLimiter *rate_limiter_;
+    // network, or a recording of it, see StashTransport::Create
+    StashTransport *transport_;
     QSignalMapper *signal_mapper_;
-    Json::Value items_as_json_;
+    ItemsStore *items_store_;
     Json::Value tabs_as_json_;
     // should items be automatically refreshed
     bool auto_update_;
     // items will be automatically updated every X minutes
     int auto_update_interval_;
     QTimer *auto_update_timer_;
+    // captions of tabs that are refreshed every hot_update_interval_ minutes
+    std::set<std::string> hot_tabs_;
+    int hot_update_interval_;
+    QTimer *hot_update_timer_;
     // set to true if updating right now
     bool updating_;
+    bool online_;
+    // saved items were shown, refreshes can replace them from now on
+    bool saved_data_loaded_;
+    // Update was called before the items manager was online and had its saved items
+    bool update_pending_;
+    // time since the current refresh started, logged when it's done
+    QElapsedTimer refresh_clock_;
+    // incremented every time pending requests are dropped
+    int generation_;
+    QThreadPool *parse_pool_;
 };
@@ -0,0 +1,356 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemssnapshot.h"
+
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <QFile>
+#include <QSaveFile>
+#include "QsLog.h"
+
+// "ACQS"
+const uint32_t SNAPSHOT_MAGIC = 0x53514341;
+// bump this every time the layout changes
+const uint32_t SNAPSHOT_VERSION = 3;
+
+namespace {
+
+class SnapshotWriter {
+public:
+    template<typename T>
+    void Put(T value) {
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void PutString(const std::string &value) {
+        Put(Intern(value));
+    }
+    template<typename T>
+    void PatchAt(size_t offset, T value) {
+        memcpy(&data_[offset], &value, sizeof(value));
+    }
+    size_t size() const { return data_.size(); }
+    void PutStringTable() {
+        Put(static_cast<uint32_t>(strings_.size()));
+        uint32_t offset = 0;
+        for (auto &s : strings_) {
+            Put(offset);
+            offset += s.size();
+        }
+        Put(offset);
+        for (auto &s : strings_)
+            data_ += s;
+    }
+    const std::string &data() const { return data_; }
+private:
+    uint32_t Intern(const std::string &value) {
+        auto it = ids_.find(value);
+        if (it != ids_.end())
+            return it->second;
+        uint32_t id = strings_.size();
+        ids_[value] = id;
+        strings_.push_back(value);
+        return id;
+    }
+    std::string data_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::string> strings_;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const uchar *data, size_t size):
+        data_(data),
+        size_(size),
+        pos_(0),
+        ok_(true)
+    {}
+    template<typename T>
+    T Get() {
+        T value = T();
+        if (pos_ + sizeof(T) > size_) {
+            ok_ = false;
+            return value;
+        }
+        memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+    bool ReadStringTable(size_t offset) {
+        size_t saved = pos_;
+        pos_ = offset;
+        uint32_t count = Get<uint32_t>();
+        if (!ok_ || count > size_)
+            return false;
+        offsets_.resize(count + 1);
+        for (auto &offset : offsets_)
+            offset = Get<uint32_t>();
+        blob_ = pos_;
+        if (!ok_ || blob_ + offsets_.back() > size_)
+            return false;
+        pos_ = saved;
+        return true;
+    }
+    std::string GetString() {
+        uint32_t id = Get<uint32_t>();
+        if (id + 1 >= offsets_.size()) {
+            ok_ = false;
+            return "";
+        }
+        return String(id);
+    }
+    // interns every string of the table at most once
+    IString GetIString() {
+        uint32_t id = Get<uint32_t>();
+        if (id + 1 >= offsets_.size()) {
+            ok_ = false;
+            return IString();
+        }
+        if (interned_.size() < offsets_.size())
+            interned_.resize(offsets_.size());
+        if (!interned_[id])
+            interned_[id].reset(new IString(String(id)));
+        return *interned_[id];
+    }
+    bool ok() const { return ok_; }
+private:
+    std::string String(uint32_t id) {
+        return std::string(reinterpret_cast<const char*>(data_ + blob_ + offsets_[id]), offsets_[id + 1] - offsets_[id]);
+    }
+    const uchar *data_;
+    size_t size_, pos_;
+    bool ok_;
+    std::vector<uint32_t> offsets_;
+    size_t blob_;
+    std::vector<std::unique_ptr<IString>> interned_;
+};
+
+}
+
+bool ItemsSnapshot::Save(const std::string &path, uint64_t generation, const Json::Value &tabs,
+                         const std::map<int, std::string> &fingerprints, const std::map<int, Items> &tab_items) {
+    std::vector<Item*> items;
+    for (auto &tab : tab_items)
+        for (auto &item : tab.second)
+            items.push_back(item.get());
+
+    SnapshotWriter writer;
+    writer.Put(SNAPSHOT_MAGIC);
+    writer.Put(SNAPSHOT_VERSION);
+    writer.Put(generation);
+    size_t string_table_offset = writer.size();
+    writer.Put(static_cast<uint64_t>(0));
+    writer.Put(static_cast<uint32_t>(tabs.size()));
+    writer.Put(static_cast<uint32_t>(items.size()));
+
+    Json::FastWriter json_writer;
+    for (Json::ArrayIndex i = 0; i < tabs.size(); ++i) {
+        writer.PutString(json_writer.write(tabs[i]));
+        auto it = fingerprints.find(i);
+        writer.PutString(it == fingerprints.end() ? "" : it->second);
+    }
+
+    for (auto item : items) writer.PutString(item->name_);
+    for (auto item : items) writer.PutString(item->typeLine_);
+    for (auto item : items) writer.PutString(item->icon_);
+    for (auto item : items) writer.PutString(item->hash_);
+    for (auto item : items) writer.PutString(item->tab_caption_);
+    for (auto item : items) writer.Put(static_cast<int32_t>(item->tab_));
+    for (auto item : items) writer.Put(static_cast<int64_t>(item->json_id_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->frameType_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->corrupted_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->x_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->y_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->w_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->h_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->sockets_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->links_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->sockets_r_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->sockets_g_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->sockets_b_));
+    for (auto item : items) writer.Put(static_cast<uint8_t>(item->sockets_w_));
+
+    // variable-length fields: per-item counts followed by the flattened values
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->explicitMods_.size()));
+    for (auto item : items)
+        for (auto &mod : item->explicitMods_)
+            writer.PutString(mod);
+
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->implicitMods_.size()));
+    for (auto item : items)
+        for (auto &mod : item->implicitMods_)
+            writer.PutString(mod);
+
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->text_sockets_.size()));
+    for (auto item : items)
+        for (auto &socket : item->text_sockets_) {
+            writer.Put(static_cast<uint8_t>(socket.group));
+            writer.Put(socket.attr);
+        }
+
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->properties_.size()));
+    for (auto item : items)
+        for (auto &property : item->properties_) {
+            writer.PutString(property.first);
+            writer.PutString(property.second);
+        }
+
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->requirements_.size()));
+    for (auto item : items)
+        for (auto &requirement : item->requirements_) {
+            writer.PutString(requirement.first);
+            writer.Put(static_cast<int32_t>(requirement.second));
+        }
+
+    for (auto item : items) writer.Put(static_cast<uint32_t>(item->elemental_damage_.size()));
+    for (auto item : items)
+        for (auto &damage : item->elemental_damage_) {
+            writer.PutString(damage.first);
+            writer.Put(static_cast<int32_t>(damage.second));
+        }
+
+    writer.PatchAt(string_table_offset, static_cast<uint64_t>(writer.size()));
+    writer.PutStringTable();
+
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly)) {
+        QLOG_WARN() << "Failed to open" << path.c_str() << "for writing the items snapshot.";
+        return false;
+    }
+    file.write(writer.data().c_str(), writer.data().size());
+    return file.commit();
+}
+
+bool ItemsSnapshot::Load(const std::string &path, uint64_t generation, ItemJsonSource *json_source, Json::Value *tabs,
+                         std::map<int, std::string> *fingerprints, std::map<int, Items> *tab_items) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return false;
+
+    SnapshotReader reader(data, file.size());
+    if (reader.Get<uint32_t>() != SNAPSHOT_MAGIC || reader.Get<uint32_t>() != SNAPSHOT_VERSION) {
+        QLOG_INFO() << "Items snapshot has an unknown format, ignoring it.";
+        return false;
+    }
+    if (reader.Get<uint64_t>() != generation) {
+        QLOG_INFO() << "Items snapshot is older than saved data, ignoring it.";
+        return false;
+    }
+    if (!reader.ReadStringTable(reader.Get<uint64_t>()))
+        return false;
+    uint32_t tabs_count = reader.Get<uint32_t>();
+    uint32_t count = reader.Get<uint32_t>();
+    if (!reader.ok() || count > file.size() || tabs_count > file.size())
+        return false;
+
+    Json::Value loaded_tabs(Json::arrayValue);
+    std::map<int, std::string> loaded_fingerprints;
+    for (uint32_t i = 0; i < tabs_count; ++i) {
+        Json::Value tab;
+        Json::Reader json_reader;
+        json_reader.parse(reader.GetString(), tab);
+        loaded_tabs.append(tab);
+        loaded_fingerprints[i] = reader.GetString();
+    }
+
+    std::vector<std::shared_ptr<Item>> items(count);
+    for (auto &item : items) {
+        item.reset(new Item);
+        item->json_source_ = json_source;
+    }
+    for (auto &item : items) item->name_ = reader.GetIString();
+    for (auto &item : items) item->typeLine_ = reader.GetIString();
+    for (auto &item : items) item->icon_ = reader.GetIString();
+    for (auto &item : items) item->SetHash(reader.GetString());
+    for (auto &item : items) item->tab_caption_ = reader.GetIString();
+    for (auto &item : items) item->tab_ = reader.Get<int32_t>();
+    for (auto &item : items) item->json_id_ = reader.Get<int64_t>();
+    for (auto &item : items) item->frameType_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->corrupted_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->x_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->y_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->w_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->h_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->sockets_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->links_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->sockets_r_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->sockets_g_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->sockets_b_ = reader.Get<uint8_t>();
+    for (auto &item : items) item->sockets_w_ = reader.Get<uint8_t>();
+
+    std::vector<uint32_t> counts(count);
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j)
+            items[i]->explicitMods_.push_back(reader.GetIString());
+
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j)
+            items[i]->implicitMods_.push_back(reader.GetIString());
+
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j) {
+            int group = reader.Get<uint8_t>();
+            items[i]->text_sockets_.push_back({ group, reader.Get<char>() });
+        }
+
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j) {
+            IString name = reader.GetIString();
+            items[i]->properties_.push_back(std::make_pair(name, reader.GetIString()));
+        }
+
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j) {
+            IString name = reader.GetIString();
+            items[i]->requirements_.push_back(std::make_pair(name, reader.Get<int32_t>()));
+        }
+
+    for (auto &c : counts) c = reader.Get<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i)
+        for (uint32_t j = 0; j < counts[i] && reader.ok(); ++j) {
+            IString value = reader.GetIString();
+            items[i]->elemental_damage_.push_back(std::make_pair(value, reader.Get<int32_t>()));
+        }
+
+    if (!reader.ok()) {
+        QLOG_WARN() << "Items snapshot is truncated, ignoring it.";
+        return false;
+    }
+
+    *tabs = loaded_tabs;
+    *fingerprints = loaded_fingerprints;
+    tab_items->clear();
+    for (auto &item : items) {
+        item->ComputeNumericAttributes();
+        item->ComputeLinkGroups();
+        (*tab_items)[item->tab_].push_back(item);
+    }
+    QLOG_INFO() << "Loaded" << count << "items from the snapshot.";
+    return true;
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "jsoncpp/json.h"
+
+#include "item.h"
+
+/*
+ * Binary snapshot of already derived Item fields, used to show saved items at
+ * startup without touching the database.
+ *
+ * All strings are stored once in a string table and referenced by index,
+ * numeric fields are stored as packed arrays (one array per field).
+ * The file is memory-mapped when loading.
+ * Raw item JSON is not part of the snapshot, it's fetched from json_source
+ * when needed.
+ *
+ * generation must match the value saved alongside the database, otherwise the
+ * snapshot is considered stale and ignored.
+ */
+class ItemsSnapshot {
+public:
+    static bool Save(const std::string &path, uint64_t generation, const Json::Value &tabs,
+                     const std::map<int, std::string> &fingerprints, const std::map<int, Items> &tab_items);
+    static bool Load(const std::string &path, uint64_t generation, ItemJsonSource *json_source, Json::Value *tabs,
+                     std::map<int, std::string> *fingerprints, std::map<int, Items> *tab_items);
+};
@@ -0,0 +1,422 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "itemsstore.h"
+
+#include <stdexcept>
+#include <unordered_map>
+#include "QsLog.h"
+
+#include "datamanager.h"
+
+// bumped whenever Item::ComputeHash changes, stored hashes are recomputed then
+const char *ITEM_HASH_VERSION = "2";
+
+enum {
+    MOD_EXPLICIT,
+    MOD_IMPLICIT
+};
+
+enum {
+    PROPERTY_PROPERTY,
+    PROPERTY_REQUIREMENT,
+    PROPERTY_ELEMENTAL_DAMAGE
+};
+
+static std::string ColumnText(sqlite3_stmt *stmt, int column) {
+    const char *text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+    if (!text)
+        return "";
+    return std::string(text, sqlite3_column_bytes(stmt, column));
+}
+
+static void BindText(sqlite3_stmt *stmt, int column, const std::string &value) {
+    sqlite3_bind_text(stmt, column, value.c_str(), value.size(), SQLITE_TRANSIENT);
+}
+
+// runs a statement that returns no rows and resets it for the next use
+static bool Step(sqlite3_stmt *stmt) {
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
+    return ok;
+}
+
+ItemsStore::ItemsStore(DataManager *data_manager):
+    data_manager_(data_manager),
+    db_(data_manager->db())
+{
+    data_manager_->BeginBatch();
+    bool ok = Exec("SAVEPOINT create_items");
+    ok = ok && Exec("CREATE TABLE IF NOT EXISTS tabs(tab INTEGER PRIMARY KEY, caption TEXT, fingerprint TEXT, json BLOB)");
+    // ids must never be reused: Items of a rewritten tab can still load their JSON by the old id
+    bool migrate = ok && ItemsTableNeedsAutoincrement();
+    if (migrate)
+        ok = Exec("ALTER TABLE items RENAME TO items_old");
+    ok = ok && Exec("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY AUTOINCREMENT, hash TEXT, tab INTEGER, "
+         "name TEXT, type_line TEXT, frame_type INTEGER, corrupted INTEGER, "
+         "x INTEGER, y INTEGER, w INTEGER, h INTEGER, icon TEXT, "
+         "sockets INTEGER, links INTEGER, sockets_r INTEGER, sockets_g INTEGER, sockets_b INTEGER, sockets_w INTEGER, "
+         "json BLOB)");
+    // same columns, drops the old indexes along with the table
+    if (migrate)
+        ok = ok && Exec("INSERT INTO items SELECT * FROM items_old") && Exec("DROP TABLE items_old");
+    for (auto query : {
+            "CREATE INDEX IF NOT EXISTS items_hash ON items(hash)",
+            "CREATE INDEX IF NOT EXISTS items_tab ON items(tab)",
+            "CREATE TABLE IF NOT EXISTS sockets(item INTEGER, tab INTEGER, position INTEGER, socket_group INTEGER, attr TEXT)",
+            "CREATE INDEX IF NOT EXISTS sockets_tab ON sockets(tab)",
+            "CREATE TABLE IF NOT EXISTS mods(item INTEGER, tab INTEGER, kind INTEGER, position INTEGER, text TEXT)",
+            "CREATE INDEX IF NOT EXISTS mods_tab ON mods(tab)",
+            "CREATE TABLE IF NOT EXISTS properties(item INTEGER, tab INTEGER, kind INTEGER, name TEXT, value TEXT, type INTEGER)",
+            "CREATE INDEX IF NOT EXISTS properties_tab ON properties(tab)" })
+        ok = ok && Exec(query);
+    ok = EndSavepoint("create_items", ok);
+    ok = data_manager_->Commit() && ok;
+    if (!ok)
+        throw std::runtime_error("Failed to create the items tables.");
+    if (migrate)
+        QLOG_INFO() << "Moved stored items to a table that doesn't reuse ids.";
+
+    insert_tab_ = Prepare("INSERT OR REPLACE INTO tabs (tab, caption, fingerprint, json) VALUES (?, ?, ?, ?)");
+    insert_item_ = Prepare("INSERT INTO items (hash, tab, name, type_line, frame_type, corrupted, x, y, w, h, icon, "
+        "sockets, links, sockets_r, sockets_g, sockets_b, sockets_w, json) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    insert_socket_ = Prepare("INSERT INTO sockets (item, tab, position, socket_group, attr) VALUES (?, ?, ?, ?, ?)");
+    insert_mod_ = Prepare("INSERT INTO mods (item, tab, kind, position, text) VALUES (?, ?, ?, ?, ?)");
+    insert_property_ = Prepare("INSERT INTO properties (item, tab, kind, name, value, type) VALUES (?, ?, ?, ?, ?, ?)");
+    select_json_ = Prepare("SELECT json FROM items WHERE id = ?");
+
+    if (data_manager_->Get("items_hash_version") != ITEM_HASH_VERSION)
+        RehashItems();
+}
+
+bool ItemsStore::ItemsTableNeedsAutoincrement() {
+    sqlite3_stmt *stmt = Prepare("SELECT sql FROM sqlite_master WHERE type = 'table' AND name = 'items'");
+    std::string sql;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        sql = ColumnText(stmt, 0);
+    sqlite3_finalize(stmt);
+    return !sql.empty() && sql.find("AUTOINCREMENT") == std::string::npos;
+}
+
+void ItemsStore::RehashItems() {
+    data_manager_->BeginBatch();
+    if (!Exec("SAVEPOINT rehash_items")) {
+        data_manager_->Commit();
+        return;
+    }
+    sqlite3_stmt *select = Prepare("SELECT id, json FROM items");
+    sqlite3_stmt *update = Prepare("UPDATE items SET hash = ? WHERE id = ?");
+    int count = 0;
+    bool ok = true;
+    while (ok && sqlite3_step(select) == SQLITE_ROW) {
+        Json::Value json;
+        Json::Reader reader;
+        if (!reader.parse(ColumnText(select, 1), json))
+            continue;
+        BindText(update, 1, Item::ComputeHash(json));
+        sqlite3_bind_int64(update, 2, sqlite3_column_int64(select, 0));
+        ok = Step(update);
+        ++count;
+    }
+    sqlite3_finalize(select);
+    sqlite3_finalize(update);
+    if (ok)
+        data_manager_->Set("items_hash_version", ITEM_HASH_VERSION);
+    else
+        QLOG_ERROR() << "Failed to update hashes of stored items:" << sqlite3_errmsg(db_);
+    // on failure the old hashes stay, this is retried on the next start
+    ok = EndSavepoint("rehash_items", ok);
+    ok = data_manager_->Commit() && ok;
+    if (ok && count > 0)
+        QLOG_INFO() << "Updated hashes of" << count << "stored items.";
+}
+
+ItemsStore::~ItemsStore() {
+    for (auto stmt : { insert_tab_, insert_item_, insert_socket_, insert_mod_, insert_property_, select_json_ })
+        sqlite3_finalize(stmt);
+}
+
+bool ItemsStore::Exec(const std::string &query) {
+    if (sqlite3_exec(db_, query.c_str(), 0, 0, 0) != SQLITE_OK) {
+        QLOG_ERROR() << "Failed to execute" << query.c_str() << ":" << sqlite3_errmsg(db_);
+        return false;
+    }
+    return true;
+}
+
+bool ItemsStore::EndSavepoint(const std::string &name, bool ok) {
+    if (ok)
+        ok = Exec("RELEASE " + name);
+    if (!ok) {
+        Exec("ROLLBACK TO " + name);
+        Exec("RELEASE " + name);
+    }
+    return ok;
+}
+
+sqlite3_stmt *ItemsStore::Prepare(const std::string &query) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db_, query.c_str(), -1, &stmt, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to prepare '" + query + "': " + sqlite3_errmsg(db_));
+    return stmt;
+}
+
+bool ItemsStore::InsertItem(int tab, const Item &item, const std::string &json, long long *id_out) {
+    sqlite3_stmt *stmt = insert_item_;
+    BindText(stmt, 1, item.hash());
+    sqlite3_bind_int(stmt, 2, tab);
+    BindText(stmt, 3, item.name());
+    BindText(stmt, 4, item.typeLine());
+    sqlite3_bind_int(stmt, 5, item.frameType());
+    sqlite3_bind_int(stmt, 6, item.corrupted());
+    sqlite3_bind_int(stmt, 7, item.x());
+    sqlite3_bind_int(stmt, 8, item.y());
+    sqlite3_bind_int(stmt, 9, item.w());
+    sqlite3_bind_int(stmt, 10, item.h());
+    BindText(stmt, 11, item.icon());
+    sqlite3_bind_int(stmt, 12, item.sockets());
+    sqlite3_bind_int(stmt, 13, item.links());
+    sqlite3_bind_int(stmt, 14, item.sockets_r());
+    sqlite3_bind_int(stmt, 15, item.sockets_g());
+    sqlite3_bind_int(stmt, 16, item.sockets_b());
+    sqlite3_bind_int(stmt, 17, item.sockets_w());
+    sqlite3_bind_blob(stmt, 18, json.c_str(), json.size(), SQLITE_TRANSIENT);
+    if (!Step(stmt))
+        return false;
+    long long id = sqlite3_last_insert_rowid(db_);
+
+    bool ok = true;
+    int position = 0;
+    for (auto &socket : item.text_sockets()) {
+        sqlite3_bind_int64(insert_socket_, 1, id);
+        sqlite3_bind_int(insert_socket_, 2, tab);
+        sqlite3_bind_int(insert_socket_, 3, position++);
+        sqlite3_bind_int(insert_socket_, 4, socket.group);
+        BindText(insert_socket_, 5, std::string(1, socket.attr));
+        ok = Step(insert_socket_) && ok;
+    }
+
+    auto insert_mod = [&](int kind, int position, const std::string &text) {
+        sqlite3_bind_int64(insert_mod_, 1, id);
+        sqlite3_bind_int(insert_mod_, 2, tab);
+        sqlite3_bind_int(insert_mod_, 3, kind);
+        sqlite3_bind_int(insert_mod_, 4, position);
+        BindText(insert_mod_, 5, text);
+        ok = Step(insert_mod_) && ok;
+    };
+    position = 0;
+    for (auto &mod : item.explicitMods())
+        insert_mod(MOD_EXPLICIT, position++, mod);
+    position = 0;
+    for (auto &mod : item.implicitMods())
+        insert_mod(MOD_IMPLICIT, position++, mod);
+
+    auto insert_property = [&](int kind, const std::string &name, const std::string &value, int type) {
+        sqlite3_bind_int64(insert_property_, 1, id);
+        sqlite3_bind_int(insert_property_, 2, tab);
+        sqlite3_bind_int(insert_property_, 3, kind);
+        BindText(insert_property_, 4, name);
+        BindText(insert_property_, 5, value);
+        sqlite3_bind_int(insert_property_, 6, type);
+        ok = Step(insert_property_) && ok;
+    };
+    for (auto &property : item.properties())
+        insert_property(PROPERTY_PROPERTY, property.first, property.second, 0);
+    for (auto &requirement : item.requirements())
+        insert_property(PROPERTY_REQUIREMENT, requirement.first, std::to_string(requirement.second), 0);
+    for (auto &damage : item.elemental_damage())
+        insert_property(PROPERTY_ELEMENTAL_DAMAGE, "", damage.first, damage.second);
+
+    *id_out = id;
+    return ok;
+}
+
+bool ItemsStore::SaveTab(int tab, const Json::Value &metadata, const std::string &fingerprint, const Items &items,
+        std::vector<long long> *ids) {
+    Json::FastWriter writer;
+    // grab raw JSON first, items restored from this tab would otherwise read rows that are about to be deleted
+    std::vector<std::string> payloads;
+    for (auto &item : items)
+        payloads.push_back(item->raw_json());
+
+    data_manager_->BeginBatch();
+    // usually nested in a bigger batch, a failure only undoes this tab
+    if (!Exec("SAVEPOINT save_tab")) {
+        data_manager_->Commit();
+        return false;
+    }
+    bool ok = true;
+    for (auto table : { "items", "sockets", "mods", "properties" })
+        ok = ok && Exec(std::string("DELETE FROM ") + table + " WHERE tab = " + std::to_string(tab));
+
+    if (ok) {
+        sqlite3_bind_int(insert_tab_, 1, tab);
+        BindText(insert_tab_, 2, metadata["n"].asString());
+        BindText(insert_tab_, 3, fingerprint);
+        std::string json = writer.write(metadata);
+        sqlite3_bind_blob(insert_tab_, 4, json.c_str(), json.size(), SQLITE_TRANSIENT);
+        ok = Step(insert_tab_);
+    }
+
+    ids->resize(items.size());
+    for (size_t i = 0; ok && i < items.size(); ++i)
+        ok = InsertItem(tab, *items[i], payloads[i], &(*ids)[i]);
+    if (!ok)
+        QLOG_ERROR() << "Failed to save tab" << tab << ":" << sqlite3_errmsg(db_);
+    ok = EndSavepoint("save_tab", ok);
+    ok = data_manager_->Commit() && ok;
+    return ok;
+}
+
+void ItemsStore::Attach(const Items &items, const std::vector<long long> &ids) {
+    for (size_t i = 0; i < items.size(); ++i)
+        items[i]->SetJsonSource(this, ids[i]);
+}
+
+bool ItemsStore::DeleteTabs(int first_tab, int end_tab) {
+    data_manager_->BeginBatch();
+    bool ok = Exec("SAVEPOINT delete_tabs");
+    if (ok) {
+        for (auto table : { "tabs", "items", "sockets", "mods", "properties" })
+            ok = ok && Exec(std::string("DELETE FROM ") + table + " WHERE tab >= " + std::to_string(first_tab)
+                 + " AND tab < " + std::to_string(end_tab));
+        ok = EndSavepoint("delete_tabs", ok);
+    }
+    ok = data_manager_->Commit() && ok;
+    return ok;
+}
+
+bool ItemsStore::empty() {
+    sqlite3_stmt *stmt = Prepare("SELECT COUNT(*) FROM tabs");
+    bool result = sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_int(stmt, 0) == 0;
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+void ItemsStore::Load(std::map<int, Items> *tab_items, Json::Value *tabs, std::map<int, std::string> *fingerprints) {
+    tab_items->clear();
+    fingerprints->clear();
+    *tabs = Json::Value(Json::arrayValue);
+
+    std::map<int, IString> captions;
+    sqlite3_stmt *stmt = Prepare("SELECT tab, caption, fingerprint, json FROM tabs ORDER BY tab");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int tab = sqlite3_column_int(stmt, 0);
+        Json::Value metadata;
+        Json::Reader reader;
+        reader.parse(ColumnText(stmt, 3), metadata);
+        // characters are listed separately, see ItemsManager
+        if (tab < CHARACTER_TAB_BASE)
+            tabs->append(metadata);
+        captions[tab] = IString(ColumnText(stmt, 1));
+        (*fingerprints)[tab] = ColumnText(stmt, 2);
+    }
+    sqlite3_finalize(stmt);
+
+    std::unordered_map<long long, Item*> by_id;
+    stmt = Prepare("SELECT id, hash, tab, name, type_line, frame_type, corrupted, x, y, w, h, icon, "
+        "sockets, links, sockets_r, sockets_g, sockets_b, sockets_w FROM items ORDER BY id");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        // Item() is private so make_shared can't be used here
+        std::shared_ptr<Item> item(new Item);
+        item->json_source_ = this;
+        item->json_id_ = sqlite3_column_int64(stmt, 0);
+        item->SetHash(ColumnText(stmt, 1));
+        item->tab_ = sqlite3_column_int(stmt, 2);
+        item->tab_caption_ = captions[item->tab_];
+        item->name_ = IString(ColumnText(stmt, 3));
+        item->typeLine_ = IString(ColumnText(stmt, 4));
+        item->frameType_ = sqlite3_column_int(stmt, 5);
+        item->corrupted_ = sqlite3_column_int(stmt, 6);
+        item->x_ = sqlite3_column_int(stmt, 7);
+        item->y_ = sqlite3_column_int(stmt, 8);
+        item->w_ = sqlite3_column_int(stmt, 9);
+        item->h_ = sqlite3_column_int(stmt, 10);
+        item->icon_ = IString(ColumnText(stmt, 11));
+        item->sockets_ = sqlite3_column_int(stmt, 12);
+        item->links_ = sqlite3_column_int(stmt, 13);
+        item->sockets_r_ = sqlite3_column_int(stmt, 14);
+        item->sockets_g_ = sqlite3_column_int(stmt, 15);
+        item->sockets_b_ = sqlite3_column_int(stmt, 16);
+        item->sockets_w_ = sqlite3_column_int(stmt, 17);
+        by_id[item->json_id_] = item.get();
+        (*tab_items)[item->tab_].push_back(item);
+    }
+    sqlite3_finalize(stmt);
+
+    stmt = Prepare("SELECT item, kind, text FROM mods ORDER BY item, kind, position");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto it = by_id.find(sqlite3_column_int64(stmt, 0));
+        if (it == by_id.end())
+            continue;
+        if (sqlite3_column_int(stmt, 1) == MOD_EXPLICIT)
+            it->second->explicitMods_.push_back(IString(ColumnText(stmt, 2)));
+        else
+            it->second->implicitMods_.push_back(IString(ColumnText(stmt, 2)));
+    }
+    sqlite3_finalize(stmt);
+
+    stmt = Prepare("SELECT item, socket_group, attr FROM sockets ORDER BY item, position");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto it = by_id.find(sqlite3_column_int64(stmt, 0));
+        std::string attr = ColumnText(stmt, 2);
+        if (it != by_id.end() && !attr.empty())
+            it->second->text_sockets_.push_back({ sqlite3_column_int(stmt, 1), attr[0] });
+    }
+    sqlite3_finalize(stmt);
+
+    stmt = Prepare("SELECT item, kind, name, value, type FROM properties ORDER BY rowid");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        auto it = by_id.find(sqlite3_column_int64(stmt, 0));
+        if (it == by_id.end())
+            continue;
+        Item *item = it->second;
+        IString name(ColumnText(stmt, 2));
+        std::string value = ColumnText(stmt, 3);
+        switch (sqlite3_column_int(stmt, 1)) {
+        case PROPERTY_PROPERTY:
+            item->properties_.push_back(std::make_pair(name, IString(value)));
+            break;
+        case PROPERTY_REQUIREMENT:
+            item->requirements_.push_back(std::make_pair(name, std::stoi(value)));
+            break;
+        case PROPERTY_ELEMENTAL_DAMAGE:
+            item->elemental_damage_.push_back(std::make_pair(IString(value), sqlite3_column_int(stmt, 4)));
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    for (auto &item : by_id) {
+        item.second->ComputeNumericAttributes();
+        item.second->ComputeLinkGroups();
+    }
+
+    QLOG_INFO() << "Loaded" << by_id.size() << "items from" << captions.size() << "tabs.";
+}
+
+std::string ItemsStore::LoadItemJson(long long id) {
+    std::string result;
+    sqlite3_bind_int64(select_json_, 1, id);
+    if (sqlite3_step(select_json_) == SQLITE_ROW && sqlite3_column_bytes(select_json_, 0) > 0)
+        result = std::string(static_cast<const char*>(sqlite3_column_blob(select_json_, 0)), sqlite3_column_bytes(select_json_, 0));
+    sqlite3_reset(select_json_);
+    return result;
+}
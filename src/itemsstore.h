@@ -0,0 +1,74 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include "jsoncpp/json.h"
+#include "sqlite/sqlite3.h"
+
+#include "item.h"
+
+class DataManager;
+
+/*
+ * Stores items in normalized tables (tabs, items, sockets, mods, properties)
+ * of the DataManager database. Everything is written per tab, so a refresh
+ * only has to rewrite tabs that actually changed.
+ * Items are restored from the derived columns, raw item JSON is only
+ * read from the database when Item::json() is called.
+ */
+class ItemsStore : public ItemJsonSource {
+public:
+    explicit ItemsStore(DataManager *data_manager);
+    ~ItemsStore();
+    ItemsStore(const ItemsStore&) = delete;
+    ItemsStore& operator=(const ItemsStore&) = delete;
+    // Replaces all items and metadata of a tab, ids are the new rows of items. Once the batch this
+    // ran in is committed pass them to Attach.
+    // Returns false and leaves the stored tab as it was if writing failed.
+    bool SaveTab(int tab, const Json::Value &metadata, const std::string &fingerprint, const Items &items,
+        std::vector<long long> *ids);
+    // items will load their JSON from the rows ids from now on
+    void Attach(const Items &items, const std::vector<long long> &ids);
+    // Removes tabs with first_tab <= index < end_tab (i.e. tabs or characters that were deleted in game),
+    // false and nothing removed if writing failed
+    bool DeleteTabs(int first_tab, int end_tab);
+    void Load(std::map<int, Items> *tab_items, Json::Value *tabs, std::map<int, std::string> *fingerprints);
+    bool empty();
+    std::string LoadItemJson(long long id);
+private:
+    // errors are logged, writes happen in the middle of a refresh and must not throw
+    bool Exec(const std::string &query);
+    // releases a savepoint if ok, rolls back to it otherwise, false if anything was rolled back
+    bool EndSavepoint(const std::string &name, bool ok);
+    sqlite3_stmt *Prepare(const std::string &query);
+    // false if any of the rows couldn't be written, id is set once the item row is in
+    bool InsertItem(int tab, const Item &item, const std::string &json, long long *id);
+    // databases made before items had AUTOINCREMENT
+    bool ItemsTableNeedsAutoincrement();
+    // Recomputes the hash column after Item::ComputeHash changed
+    void RehashItems();
+
+    DataManager *data_manager_;
+    sqlite3 *db_;
+    sqlite3_stmt *insert_tab_, *insert_item_, *insert_socket_, *insert_mod_, *insert_property_;
+    sqlite3_stmt *select_json_;
+};
@@ -34,20 +34,22 @@
 #include "jsoncpp/json.h"
 #include "QsLog.h"
 
-#include "mainwindow.h"
+#include "sessionmanager.h"
 #include "version.h"
 
 const char* POE_LEAGUE_LIST_URL = "http://api.pathofexile.com/leagues";
 const char* POE_LOGIN_URL = "https://www.pathofexile.com/login";
+const char* LOGIN_SETTINGS_FILE = "./settings.ini";
 
-LoginDialog::LoginDialog(QWidget *parent) :
+LoginDialog::LoginDialog(SessionManager *sessions, QWidget *parent) :
     QDialog(parent),
+    sessions_(sessions),
     ui(new Ui::LoginDialog)
 {
     ui->setupUi(this);
     setWindowTitle(QString("Login [") + VERSION_NAME + "]");
 
-    settingsFile_ = "./settings.ini";
+    settingsFile_ = LOGIN_SETTINGS_FILE;
     LoadSettings();
 
     login_manager_ = new QNetworkAccessManager;
@@ -93,14 +95,35 @@ void LoginDialog::OnLeaguesRequestFinished() {
         leagues_.push_back(name);
         ui->leagueComboBox->addItem(name.c_str());
     }
-    ui->leagueComboBox->setEnabled(true);
+    int saved_league = ui->leagueComboBox->findText(saved_league_);
+    if (saved_league >= 0)
+        ui->leagueComboBox->setCurrentIndex(saved_league);
+    // a login that is already running keeps the inputs locked
+    ui->leagueComboBox->setEnabled(ui->loginButton->isEnabled());
+}
+
+void LoginDialog::SetInputsEnabled(bool enabled) {
+    ui->leagueComboBox->setEnabled(enabled);
+    ui->emailLineEdit->setEnabled(enabled);
+    ui->passwordLineEdit->setEnabled(enabled);
+    ui->sessionIDLineEdit->setEnabled(enabled);
+    ui->sessIDCheckBox->setEnabled(enabled);
 }
 
 void LoginDialog::OnLoginButtonClicked() {
     ui->loginButton->setEnabled(false);
     ui->loginButton->setText("Logging in...");
+    // the session may be prepared for League() and Account() below, they can't change until it's opened
+    SetInputsEnabled(false);
     QNetworkReply *login_page = login_manager_->get(QNetworkRequest(QUrl(POE_LOGIN_URL)));
     connect(login_page, SIGNAL(finished()), this, SLOT(OnLoginPageFinished()));
+
+    // league and account are known, saved items are loaded while the login requests are running
+    if (!League().empty() && !Account().empty()) {
+        sessions_->Prepare(login_manager_, League(), Account());
+        raise();
+        activateWindow();
+    }
 }
 
 void LoginDialog::OnLoginPageFinished() {
@@ -139,20 +162,28 @@ void LoginDialog::OnLoginPageFinished() {
 void LoginDialog::OnLoggedIn() {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
     QByteArray bytes = reply->readAll();
-    std::string league(ui->leagueComboBox->currentText().toUtf8().constData());
-//    std::string email(ui->emailLineEdit->text().toUtf8().constData());
-    std::string user = ui->sessIDCheckBox ? ui->sessionIDLineEdit->text().toStdString() : ui->emailLineEdit->text().toStdString();
-    MainWindow *w = new MainWindow(0, login_manager_, league, user);
-    w->show();
+    sessions_->Open(login_manager_, League(), Account());
     close();
 }
 
+std::string LoginDialog::League() {
+    return ui->leagueComboBox->currentText().toUtf8().constData();
+}
+
+std::string LoginDialog::Account() {
+    // sessions, their network managers and data files are keyed by what the user logs in with
+    if (ui->sessIDCheckBox->isChecked())
+        return ui->sessionIDLineEdit->text().toUtf8().constData();
+    return ui->emailLineEdit->text().toUtf8().constData();
+}
+
 void LoginDialog::LoadSettings() {
     QSettings settings(settingsFile_, QSettings::NativeFormat);
     ui->emailLineEdit->setText(settings.value("email", "").toString());
     ui->sessionIDLineEdit->setText(settings.value("sessionID", "").toString());
     ui->sessIDCheckBox->setChecked(settings.value("sessIDBox").toBool());
     ui->rembmeCheckBox->setChecked(settings.value("emailBox").toBool());
+    saved_league_ = settings.value("league", "").toString();
     ui->sessionIDLineEdit->setVisible(ui->sessIDCheckBox->isChecked());
     ui->sessIDLabel->setVisible(ui->sessIDCheckBox->isChecked());
 }
@@ -168,6 +199,8 @@ void LoginDialog::SaveSettings() {
     }
     settings.setValue("sessIDBox", ui->sessIDCheckBox->isChecked());
     settings.setValue("emailBox", ui->rembmeCheckBox->isChecked());
+    if (!League().empty())
+        settings.setValue("league", ui->leagueComboBox->currentText());
 }
 
 LoginDialog::~LoginDialog() {
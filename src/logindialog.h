@@ -25,6 +25,11 @@
 
 class QNetworkAccessManager;
 class QNetworkReply;
+class SessionManager;
+
+// HeadlessSession logs in with the session id saved here as well
+extern const char *POE_LOGIN_URL;
+extern const char *LOGIN_SETTINGS_FILE;
 
 namespace Ui {
 class LoginDialog;
@@ -34,7 +39,7 @@ class LoginDialog : public QDialog {
     Q_OBJECT
 
 public:
-    explicit LoginDialog(QWidget *parent = 0);
+    explicit LoginDialog(SessionManager *sessions, QWidget *parent = 0);
     ~LoginDialog();
 public slots:
     void OnLeaguesRequestFinished();
@@ -46,8 +51,16 @@ public slots:
 private:
     void SaveSettings();
     void LoadSettings();
+    // league and account inputs, locked while logging in
+    void SetInputsEnabled(bool enabled);
+    std::string League();
+    // also names the session's data file
+    std::string Account();
+    SessionManager *sessions_;
     Ui::LoginDialog *ui;
     QString settingsFile_;
     QNetworkAccessManager *login_manager_;
     std::vector<std::string> leagues_;
+    // league of the last login, selected once the list of leagues arrives
+    QString saved_league_;
 };
@@ -17,25 +17,37 @@
     along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "asynclogdestination.h"
+#include "headlesssession.h"
 #include "logindialog.h"
+#include "sessionmanager.h"
+#include "rangekernels.h"
 
 #include <QApplication>
 #include <QDir>
 #include <QLocale>
+#include <cstring>
+#include <memory>
 #include "QsLog.h"
 #include "QsLogDest.h"
 
 int main(int argc, char *argv[])
 {
     QLocale::setDefault(QLocale::C);
-    QApplication a(argc, argv);
+    // --headless serves items to local tools without opening any windows, see HeadlessSession
+    bool headless = false;
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+    std::unique_ptr<QCoreApplication> a(headless ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
 
     QsLogging::Logger& logger = QsLogging::Logger::instance();
     logger.setLoggingLevel(QsLogging::InfoLevel);
-    const QString sLogPath(QDir(a.applicationDirPath()).filePath("log.txt"));
+    const QString sLogPath(QDir(a->applicationDirPath()).filePath("log.txt"));
 
-    QsLogging::DestinationPtr fileDestination(
-        QsLogging::DestinationFactory::MakeFileDestination(sLogPath, false, 512, 2) );
+    // the file is written from a background thread so that logging never waits for the disk
+    QSharedPointer<AsyncLogDestination> fileDestination(new AsyncLogDestination(
+        QsLogging::DestinationFactory::MakeFileDestination(sLogPath, false, 512, 2)));
     QsLogging::DestinationPtr debugDestination(
         QsLogging::DestinationFactory::MakeDebugOutputDestination() );
     logger.addDestination(debugDestination);
@@ -43,9 +55,24 @@ int main(int argc, char *argv[])
 
     QLOG_INFO() << "--------------------------------------------------------------------------------";
     QLOG_INFO() << "Built with Qt" << QT_VERSION_STR << "running on" << qVersion();
+    QLOG_INFO() << "Using" << RangeKernelName() << "filter kernels";
 
-    LoginDialog login;
-    login.show();
-
-    return a.exec();
+    std::string root_dir = a->applicationDirPath().toUtf8().constData();
+    int result = 1;
+    if (headless) {
+        HeadlessOptions options;
+        if (HeadlessSession::ParseOptions(a->arguments(), &options)) {
+            HeadlessSession session(root_dir, options);
+            if (session.Start())
+                result = a->exec();
+        }
+    } else {
+        // all windows opened in this process share icons and logins
+        SessionManager sessions(root_dir);
+        LoginDialog login(&sessions);
+        login.show();
+        result = a->exec();
+    }
+    fileDestination->Stop();
+    return result;
 }
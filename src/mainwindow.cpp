@@ -23,72 +23,110 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <QDialog>
 #include <QEvent>
-#include <QImageReader>
+#include <QFormLayout>
 #include <QInputDialog>
+#include <QLabel>
+#include <QLineEdit>
+#include <QMessageBox>
 #include <QMouseEvent>
 #include <QNetworkAccessManager>
-#include <QNetworkRequest>
-#include <QNetworkReply>
 #include <QPainter>
 #include <QPushButton>
+#include <QScrollBar>
 #include <QStringList>
 #include <QTabBar>
+#include <QTimer>
+#include <unordered_set>
 #include "jsoncpp/json.h"
 #include "QsLog.h"
 
 #include "item.h"
 #include "column.h"
+#include "columnwidths.h"
 #include "flowlayout.h"
 #include "filters.h"
+#include "icondelegate.h"
+#include "itemicons.h"
+#include "itemsindex.h"
 #include "itemsmanager.h"
+#include "perfpanel.h"
+#include "searchrunner.h"
 #include "datamanager.h"
 #include "buyoutmanager.h"
+#include "sessionmanager.h"
 #include "shop.h"
+#include "stashgrid.h"
 #include "tabbuyoutsdialog.h"
 #include "util.h"
 
-const int LINKH_HEIGHT = 16;
-const int LINKH_WIDTH = 38;
-const int LINKV_HEIGHT = LINKH_WIDTH;
-const int LINKV_WIDTH = LINKH_HEIGHT;
+const int PIXELS_PER_MINIMAP_SLOT = 16;
+// pause in buyout edits after which prices are applied to the searches
+const int PRICES_DEBOUNCE_MS = 700;
+// rows prefetched when the height of the view isn't known yet
+const int ICON_PREFETCH_MARGIN = 64;
 
-MainWindow::MainWindow(QWidget *parent, QNetworkAccessManager *login_manager,
+MainWindow::MainWindow(QWidget *parent, SessionManager *sessions, QNetworkAccessManager *login_manager,
                        const std::string &league, const std::string &email) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
+    items_index_(std::make_shared<ItemsIndex>()),
     current_search_(nullptr),
+    search_runner_(new SearchRunner(this)),
+    column_widths_(nullptr),
     search_count_(0),
+    sessions_(sessions),
+    image_cache_(sessions->image_cache()),
+    item_icons_(sessions->item_icons()),
     league_(league),
     email_(email),
     logged_in_nm_(login_manager),
-    tab_buyouts_dialog_(new TabBuyoutsDialog(0, this))
+    tab_buyouts_dialog_(new TabBuyoutsDialog(0, this)),
+    prices_timer_(new QTimer(this)),
+    all_prices_changed_(false)
 {
-    std::string root_dir(qApp->applicationDirPath().toUtf8().constData());
-    data_manager_ = new DataManager(this, root_dir + "/data");
-    image_cache_ = new ImageCache(this, root_dir + "/cache");
+    data_manager_ = new DataManager(this, sessions_->root_dir() + "/data");
+    warm_image_cache_ = data_manager_->Get("warm_image_cache") == "1";
+    stash_grid_ = new StashGrid(PIXELS_PER_MINIMAP_SLOT);
+    stash_grid_->SetIndex(items_index_);
+    connect(image_cache_, SIGNAL(ImageReady(QString)), this, SLOT(OnImageReady(QString)));
     buyout_manager_ = new BuyoutManager(this);
     shop_ = new Shop(this);
+    connect(search_runner_, SIGNAL(Finished(Search*)), this, SLOT(OnSearchFinished(Search*)));
+    prices_timer_->setSingleShot(true);
+    prices_timer_->setInterval(PRICES_DEBOUNCE_MS);
+    connect(prices_timer_, SIGNAL(timeout()), this, SLOT(ApplyPriceChanges()));
 
     InitializeUi();
     InitializeSearchForm();
     NewSearch();
 
-    image_network_manager_ = new QNetworkAccessManager;
-    connect(image_network_manager_, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(OnImageFetched(QNetworkReply*)));
-
     items_manager_ = new ItemsManager(this);
-    connect(items_manager_, SIGNAL(ItemsRefreshed(Items,std::vector<std::string>)),
-            this, SLOT(OnItemsRefreshed(Items,std::vector<std::string>)));
+    connect(items_manager_, SIGNAL(ItemsRefreshed(Items,std::vector<std::string>,ItemsDelta)),
+            this, SLOT(OnItemsRefreshed(Items,std::vector<std::string>,ItemsDelta)));
     connect(items_manager_, SIGNAL(StatusUpdate(int, int, bool)),
             this, SLOT(OnItemsManagerStatusUpdate(int, int, bool)));
     items_manager_->Init();
+    // postponed by the items manager until SetLoggedIn
     items_manager_->Update();
+    status_bar_label_->setText("Logging in, showing saved items");
+}
+
+void MainWindow::SetLoggedIn() {
+    if (items_manager_->online())
+        return;
+    status_bar_label_->setText("Ready");
+    items_manager_->SetOnline();
 }
 
 void MainWindow::InitializeUi() {
     ui->setupUi(this);
+    column_widths_ = new ColumnWidths(ui->treeView);
+    icon_delegate_ = new IconDelegate(image_cache_, item_icons_, ui->treeView);
+    // results are a flat list and every row is as tall as a thumbnail
+    ui->treeView->setRootIsDecorated(false);
+    ui->treeView->setUniformRowHeights(true);
     status_bar_label_ = new QLabel("Ready");
     statusBar()->addWidget(status_bar_label_);
     ui->itemLayout->setAlignment(Qt::AlignTop);
@@ -98,6 +136,18 @@ void MainWindow::InitializeUi() {
     ui->itemLayout->setAlignment(ui->imageLabel, Qt::AlignHCenter);
     ui->itemLayout->setAlignment(ui->locationLabel, Qt::AlignHCenter);
 
+    // ItemsModel sorts by numeric keys where the column has them
+    ui->treeView->setSortingEnabled(true);
+    ui->treeView->sortByColumn(-1, Qt::AscendingOrder);
+    ui->actionDownload_all_icons->setChecked(warm_image_cache_);
+    setWindowTitle(QString("Acquisition - ") + league_.c_str());
+    connect(ui->treeView->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(PrefetchVisibleIcons()));
+
+    perf_panel_ = new PerfPanel(this);
+    addDockWidget(Qt::BottomDockWidgetArea, perf_panel_);
+    perf_panel_->hide();
+    connect(perf_panel_, SIGNAL(Closed()), this, SLOT(OnPerfPanelClosed()));
+
     tab_bar_ = new QTabBar;
     tab_bar_->installEventFilter(this);
     tab_bar_->setExpanding(false);
@@ -113,12 +163,21 @@ void MainWindow::InitializeUi() {
     connect(ui->buyoutValueLineEdit, SIGNAL(textChanged(QString)), this, SLOT(OnBuyoutChange()));
 }
 
-void MainWindow::OnBuyoutChange() {
-    shop_->ExpireShopData();
+Buyout MainWindow::BuyoutFromForm() {
     Buyout bo;
     bo.type = static_cast<BuyoutType>(ui->buyoutTypeComboBox->currentIndex());
     bo.currency = static_cast<Currency>(ui->buyoutCurrencyComboBox->currentIndex());
     bo.value = ui->buyoutValueLineEdit->text().toDouble();
+    return bo;
+}
+
+void MainWindow::OnBuyoutChange() {
+    Buyout bo = BuyoutFromForm();
+    // e.g. "5" typed over "5.0", there's nothing to save or to show again
+    bool exists = buyout_manager_->Exists(*current_item_);
+    if (bo.type == BUYOUT_TYPE_NONE ? !exists : exists && buyout_manager_->Get(*current_item_) == bo)
+        return;
+    shop_->ExpireShopData();
     if (bo.type == BUYOUT_TYPE_NONE) {
         buyout_manager_->Delete(*current_item_);
         ui->buyoutCurrencyComboBox->setEnabled(false);
@@ -128,12 +187,36 @@ void MainWindow::OnBuyoutChange() {
         ui->buyoutCurrencyComboBox->setEnabled(true);
         ui->buyoutValueLineEdit->setEnabled(true);
     }
+    priced_items_.push_back(current_item_);
+    prices_timer_->start();
+}
+
+void MainWindow::OnPricesChanged() {
+    all_prices_changed_ = true;
+    ApplyPriceChanges();
+}
+
+void MainWindow::ApplyPriceChanges() {
+    prices_timer_->stop();
+    std::unordered_set<const Item*> changed;
+    for (auto &item : priced_items_)
+        changed.insert(item.get());
+    for (auto search : searches_) {
+        // price filters take the new prices, their results are filtered again on the next pass
+        search->Refresh();
+        auto &columns = search->columns();
+        for (size_t i = 0; i < columns.size(); ++i)
+            if (dynamic_cast<PriceColumn*>(columns[i]))
+                search->model()->InvalidateColumn(i, all_prices_changed_ ? nullptr : &changed);
+    }
+    priced_items_.clear();
+    all_prices_changed_ = false;
 }
 
 void MainWindow::OnItemsManagerStatusUpdate(int fetched, int total, bool throttled) {
     QString status = QString("Receiving stash tabs, %1/%2").arg(fetched).arg(total);
     if (throttled)
-        status += " (throttled, sleeping 60 seconds)";
+        status += " (throttled, waiting)";
     if (fetched == total)
         status = "Received all tabs";
     status_bar_label_->setText(status);
@@ -148,6 +231,7 @@ bool MainWindow::eventFilter(QObject *o, QEvent *e) {
             // remove tab and Search if it's not "+"
             if (index < tab_bar_->count() - 1) {
                 tab_bar_->removeTab(index);
+                search_runner_->Forget(searches_[index]);
                 delete searches_[index];
                 searches_.erase(searches_.begin() + index);
                 if (tab_bar_->currentIndex() == searches_.size())
@@ -160,34 +244,78 @@ bool MainWindow::eventFilter(QObject *o, QEvent *e) {
     return QMainWindow::eventFilter(o, e);
 }
 
-void MainWindow::OnImageFetched(QNetworkReply *reply) {
-    std::string url = reply->url().toString().toUtf8().constData();
-    if (reply->error())
-        return;
-    QImageReader image_reader(reply);
-    QImage image = image_reader.read();
+void MainWindow::OnImageReady(const QString &url) {
+    QPixmap icon;
+    if (current_item_ && url == current_item_->icon().c_str()
+            && image_cache_->Get(current_item_->icon(), &icon))
+        UpdateCurrentItemIcon(icon);
+}
 
-    image_cache_->Set(url, image);
+void MainWindow::WarmImageCache() {
+    std::vector<std::string> icons;
+    for (auto &item : items_)
+        icons.push_back(item->icon());
+    image_cache_->Warm(icons);
+}
 
-    if (url == current_item_->icon())
-        UpdateCurrentItemIcon(image);
+void MainWindow::WarmImageCache(const ItemsDelta &delta) {
+    std::vector<std::string> icons;
+    delta.dirty.ForEach([&](size_t row) { icons.push_back(items_[row]->icon()); });
+    image_cache_->Warm(icons);
+}
+
+void MainWindow::PrefetchVisibleIcons() {
+    ItemsModel *model = current_search_->model();
+    int rows = model->rowCount();
+    if (rows == 0)
+        return;
+    QModelIndex top = ui->treeView->indexAt(QPoint(0, 0));
+    QModelIndex bottom = ui->treeView->indexAt(QPoint(0, ui->treeView->viewport()->height() - 1));
+    int first = top.isValid() ? top.row() : 0;
+    int last = bottom.isValid() ? bottom.row() : std::min(rows - 1, first + ICON_PREFETCH_MARGIN);
+    // a screen worth of rows below and above as well, in the order they're likely to be needed
+    int page = last - first + 1;
+    std::vector<std::string> urls;
+    for (int row = first; row <= std::min(rows - 1, last + page); ++row)
+        urls.push_back(model->item(row)->icon());
+    for (int row = first - 1; row >= std::max(0, first - page); --row)
+        urls.push_back(model->item(row)->icon());
+    image_cache_->Prefetch(urls);
 }
 
 void MainWindow::OnSearchFormChange() {
-    buyout_manager_->Save();
-    Search *search = current_search_;
-    search->FromForm();
-    search->FilterItems(items_);
-    ui->treeView->setModel(current_search_->model());
-    connect(ui->treeView->selectionModel(), SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)),
-            this, SLOT(OnTreeChange(const QModelIndex&, const QModelIndex&)));
-    ui->treeView->reset();
-    for (int i = 0; i < ui->treeView->header()->count(); ++i)
-        ui->treeView->resizeColumnToContents(i);
+    current_search_->FromForm();
+    search_runner_->Schedule(current_search_, items_index_);
+}
+
+void MainWindow::ShowCurrentSearch() {
+    // previous results of the search are shown until its pass is done
+    if (ui->treeView->model() != current_search_->model()) {
+        ui->treeView->setModel(current_search_->model());
+        int icon_column = current_search_->model()->icon_column();
+        if (icon_column >= 0) {
+            ui->treeView->setItemDelegateForColumn(icon_column, icon_delegate_);
+            column_widths_->SetMinimumWidth(icon_column, icon_delegate_->sizeHint(QStyleOptionViewItem(), QModelIndex()).width());
+        }
+        connect(ui->treeView->selectionModel(), SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)),
+                this, SLOT(OnTreeChange(const QModelIndex&, const QModelIndex&)));
+    }
+    current_search_->FromForm();
+    search_runner_->RunNow(current_search_, items_index_);
+}
+
+void MainWindow::OnSearchFinished(Search *search) {
+    if (search != current_search_)
+        return;
+    column_widths_->Update();
+    PrefetchVisibleIcons();
+    // matches in the shown tab changed
+    if (current_item_)
+        UpdateCurrentItemMinimap();
 }
 
 void MainWindow::OnTreeChange(const QModelIndex &current, const QModelIndex & /* previous */) {
-    current_item_ = current_search_->items()[current.row()];
+    current_item_ = current_search_->model()->item(current.row());
     UpdateCurrentItem();
 }
 
@@ -198,8 +326,8 @@ void MainWindow::OnTabChange(int index) {
     } else {
         current_search_ = searches_[index];
         current_search_->ToForm();
+        ShowCurrentSearch();
     }
-    OnSearchFormChange();
 }
 
 void MainWindow::AddSearchGroup(FlowLayout *layout, std::string name) {
@@ -211,26 +339,30 @@ void MainWindow::AddSearchGroup(FlowLayout *layout, std::string name) {
 
 void MainWindow::InitializeSearchForm() {
     NameSearchFilter *name_search = new NameSearchFilter(ui->searchFormLayout);
+    NameSearchFilter *mods_search = new NameSearchFilter(ui->searchFormLayout, TEXT_MODS, "Mods");
     FlowLayout *offense_layout = new FlowLayout;
     FlowLayout *defense_layout = new FlowLayout;
     FlowLayout *sockets_layout = new FlowLayout;
     FlowLayout *requirements_layout = new FlowLayout;
     FlowLayout *misc_layout = new FlowLayout;
+    FlowLayout *mods_layout = new FlowLayout;
 
     AddSearchGroup(offense_layout, "Offense");
     AddSearchGroup(defense_layout, "Defense");
     AddSearchGroup(sockets_layout, "Sockets");
     AddSearchGroup(requirements_layout, "Reqs.");
     AddSearchGroup(misc_layout, "Misc");
+    AddSearchGroup(mods_layout, "Mods");
 
     filters_ = {
         name_search,
+        mods_search,
         // Offense
         // new DamageFilter(offense_layout, "Damage"),
         new SimplePropertyFilter(offense_layout, "Critical Strike Chance", "Crit."),
-        new ItemMethodFilter(offense_layout, &Item::DPS, "DPS"),
-        new ItemMethodFilter(offense_layout, &Item::pDPS, "pDPS"),
-        new ItemMethodFilter(offense_layout, &Item::eDPS, "eDPS"),
+        new NumericAttributeFilter(offense_layout, ATTRIBUTE_DPS, "DPS"),
+        new NumericAttributeFilter(offense_layout, ATTRIBUTE_PDPS, "pDPS"),
+        new NumericAttributeFilter(offense_layout, ATTRIBUTE_EDPS, "eDPS"),
         new SimplePropertyFilter(offense_layout, "Attacks per Second", "APS"),
         // Defense
         new SimplePropertyFilter(defense_layout, "Armour"),
@@ -250,6 +382,11 @@ void MainWindow::InitializeSearchForm() {
         // Misc
         new SimplePropertyFilter(misc_layout, "Quality"),
         new SimplePropertyFilter(misc_layout, "Level"),
+        new PriceFilter(misc_layout, this),
+        // Mods
+        new ModFilter(mods_layout),
+        new ModFilter(mods_layout),
+        new ModFilter(mods_layout),
     };
 }
 
@@ -257,15 +394,15 @@ void MainWindow::NewSearch() {
     tab_bar_->setTabText(tab_bar_->count() - 1, QString("Search %1").arg(++search_count_));
     tab_bar_->addTab("+");
     current_search_ = new Search("Search 1", filters_);
+    current_search_->AddColumn(new PriceColumn(buyout_manager_));
     // this can't be done in ctor because it'll call OnSearchFormChange slot
     // and remove all previous search data
     current_search_->ResetForm();
     searches_.push_back(current_search_);
-    OnSearchFormChange();
+    ShowCurrentSearch();
 }
 
 void MainWindow::UpdateCurrentItem() {
-    buyout_manager_->Save();
     ui->typeLineLabel->setText(current_item_->typeLine().c_str());
     if (current_item_->name().empty())
         ui->nameLabel->hide();
@@ -280,19 +417,23 @@ void MainWindow::UpdateCurrentItem() {
     UpdateCurrentItemProperties();
     UpdateCurrentItemMinimap();
 
-    if (!image_cache_->Exists(current_item_->icon())) {
-        image_network_manager_->get(QNetworkRequest(QUrl(current_item_->icon().c_str())));
-    } else {
-        UpdateCurrentItemIcon(image_cache_->Get(current_item_->icon()));
-    }
+    QPixmap icon;
+    if (image_cache_->Get(current_item_->icon(), &icon))
+        UpdateCurrentItemIcon(icon);
+    else
+        image_cache_->Fetch(current_item_->icon());
 
-    ui->locationLabel->setText(QString("#%1, \"%2\"").arg(current_item_->tab() + 1).arg(current_item_->tab_caption().c_str()));
+    if (current_item_->in_character())
+        ui->locationLabel->setText(QString("Character \"%1\"").arg(current_item_->tab_caption().c_str()));
+    else
+        ui->locationLabel->setText(QString("#%1, \"%2\"").arg(current_item_->tab() + 1).arg(current_item_->tab_caption().c_str()));
 
     UpdateCurrentItemBuyout();
 }
 
 void MainWindow::UpdateCurrentItemProperties() {
-    const auto &json = current_item_->json();
+    std::shared_ptr<const Json::Value> item_json = current_item_->json();
+    const Json::Value &json = *item_json;
     std::vector<std::string> sections;
 
     std::string properties_text;
@@ -329,7 +470,7 @@ void MainWindow::UpdateCurrentItemProperties() {
 
     std::string requirements_text;
     bool first_req = true;
-    for (auto &requirement : current_item_->json()["requirements"]) {
+    for (auto &requirement : json["requirements"]) {
         if (!first_req)
             requirements_text += ", ";
         first_req = false;
@@ -338,21 +479,21 @@ void MainWindow::UpdateCurrentItemProperties() {
     if (requirements_text.size() > 0)
         sections.push_back("Requires " + requirements_text);
 
-    if (json["implicitMods"].size() > 0) {
+    if (current_item_->implicitMods().size() > 0) {
         std::string implicit;
         bool first_impl = true;
-        for (auto &mod : json["implicitMods"]) {
+        for (auto &mod : current_item_->implicitMods()) {
             if (!first_impl)
                 implicit += "<br>";
             first_impl = false;
-            implicit += mod.asString();
+            implicit += mod.str();
         }
         sections.push_back(implicit);
     }
 
     std::string explicit_text;
     for (auto mod : current_item_->explicitMods())
-        explicit_text += mod + "<br>";
+        explicit_text += mod.str() + "<br>";
     if (explicit_text.size() > 0)
         sections.push_back(explicit_text);
 
@@ -367,78 +508,26 @@ void MainWindow::UpdateCurrentItemProperties() {
     ui->propertiesLabel->setText(text.c_str());
 }
 
-void MainWindow::UpdateCurrentItemIcon(const QImage &image) {
-    QPixmap pixmap = QPixmap::fromImage(image);
-    QPainter painter(&pixmap);
-
-    QImage link_h(":/sockets/linkH.png");
-    QImage link_v(":/sockets/linkV.png");
-
-    auto &json = current_item_->json();
-    for (int i = 0; i < json["sockets"].size(); ++i) {
-        auto &socket = json["sockets"][i];
-        bool link = (i > 0) && (socket["group"].asInt() == json["sockets"][i - 1]["group"].asInt());
-        QImage socket_image(":/sockets/" + QString(socket["attr"].asString().c_str()) + ".png");
-        if (current_item_->w() == 1) {
-            painter.drawImage(0, PIXELS_PER_SLOT * i, socket_image);
-            if (link)
-                painter.drawImage(16, PIXELS_PER_SLOT * i - 19, link_v);
-        } else /* w == 2 */ {
-            int row = i / 2;
-            int column = i % 2;
-            if (row % 2 == 1)
-                column = 1 - column;
-            painter.drawImage(PIXELS_PER_SLOT * column, PIXELS_PER_SLOT * row, socket_image);
-            if (link) {
-                if (i == 1 || i == 3 || i == 5) {
-                    // horizontal link
-                    painter.drawImage(
-                        PIXELS_PER_SLOT - LINKH_WIDTH / 2,
-                        row * PIXELS_PER_SLOT + PIXELS_PER_SLOT / 2 - LINKH_HEIGHT / 2,
-                        link_h
-                    );
-                } else if (i == 2) {
-                    painter.drawImage(
-                        PIXELS_PER_SLOT * 1.5 - LINKV_WIDTH / 2,
-                        row * PIXELS_PER_SLOT - LINKV_HEIGHT / 2,
-                        link_v
-                    );
-                } else if (i == 4) {
-                    painter.drawImage(
-                        PIXELS_PER_SLOT / 2 - LINKV_WIDTH / 2,
-                        row * PIXELS_PER_SLOT - LINKV_HEIGHT / 2,
-                        link_v
-                    );
-                } else {
-                    QLOG_ERROR() << "No idea how to draw link for" << current_item_->PrettyName().c_str();
-                }
-            }
-        }
-    }
-
+void MainWindow::UpdateCurrentItemIcon(const QPixmap &icon) {
+    QPixmap pixmap = item_icons_->Composite(*current_item_, icon);
     ui->imageLabel->setPixmap(pixmap);
 }
 
 void MainWindow::UpdateCurrentItemMinimap() {
-    const int PIXELS_PER_MINIMAP_SLOT = 10;
-
-    QPixmap pixmap(INVENTORY_SLOTS * PIXELS_PER_MINIMAP_SLOT, INVENTORY_SLOTS * PIXELS_PER_MINIMAP_SLOT);
-    pixmap.fill(QColor("transparent"));
-
-    QPainter painter(&pixmap);
-    painter.setBrush(QBrush(QColor(0x0c, 0x0b, 0x0b)));
-    painter.drawRect(0, 0, INVENTORY_SLOTS * PIXELS_PER_MINIMAP_SLOT, INVENTORY_SLOTS * PIXELS_PER_MINIMAP_SLOT);
-    painter.setBrush(QBrush(Qt::red));
-    int x = current_item_->x();
-    int y = current_item_->y();
-    int w = current_item_->w();
-    int h = current_item_->h();
-    painter.drawRect(x * PIXELS_PER_MINIMAP_SLOT, y * PIXELS_PER_MINIMAP_SLOT,
-                     w * PIXELS_PER_MINIMAP_SLOT, h * PIXELS_PER_MINIMAP_SLOT);
-    ui->minimapLabel->setPixmap(pixmap);
+    // inventory and equipment slots don't map onto a stash grid
+    if (current_item_->in_character()) {
+        ui->minimapLabel->clear();
+        return;
+    }
+    ui->minimapLabel->setPixmap(stash_grid_->Render(current_item_->tab(), current_search_->selection(),
+                                                    current_search_->selection_index_id(), current_item_.get()));
 }
 
 void MainWindow::UpdateCurrentItemBuyout() {
+    // loading the form isn't an edit, OnBuyoutChange only runs for the user's changes
+    ui->buyoutTypeComboBox->blockSignals(true);
+    ui->buyoutCurrencyComboBox->blockSignals(true);
+    ui->buyoutValueLineEdit->blockSignals(true);
     if (!buyout_manager_->Exists(*current_item_)) {
         ui->buyoutTypeComboBox->setCurrentIndex(0);
         ui->buyoutCurrencyComboBox->setEnabled(false);
@@ -452,28 +541,66 @@ void MainWindow::UpdateCurrentItemBuyout() {
         ui->buyoutCurrencyComboBox->setCurrentIndex(buyout.currency);
         ui->buyoutValueLineEdit->setText(QString::number(buyout.value));
     }
+    ui->buyoutTypeComboBox->blockSignals(false);
+    ui->buyoutCurrencyComboBox->blockSignals(false);
+    ui->buyoutValueLineEdit->blockSignals(false);
 }
 
-void MainWindow::OnItemsRefreshed(const Items &items, const std::vector<std::string> &tabs) {
-    items_ = items;
+void MainWindow::OnItemsRefreshed(const Items &items, const std::vector<std::string> &tabs,
+                                  const ItemsDelta &delta) {
     tabs_ = tabs;
+    if (items_index_ && delta.index_id == items_index_->id())
+        return;
+    items_ = items;
+    items_index_ = items_manager_->items_index();
+    stash_grid_->SetIndex(items_index_);
+
+    Items changed;
+    delta.dirty.ForEach([&](size_t row) { changed.push_back(items_[row]); });
+    buyout_manager_->MigrateItemHashes(changed);
+    buyout_manager_->Reconcile(*items_index_, delta);
+    // price filters move to the prices of the new index
     for (auto search : searches_)
-        search->FilterItems(items_);
-    OnSearchFormChange();
-    shop_->Update();
+        search->Refresh();
+
+    // searches whose results could be moved over only filter the dirty rows
+    std::vector<Search*> refilter;
+    for (auto search : searches_) {
+        if (!search->ApplyDelta(*items_index_, delta))
+            refilter.push_back(search);
+        // a pass that is still running would bring back results for the old items
+        search_runner_->Forget(search);
+    }
+    if (!refilter.empty())
+        Search::FilterMany(*items_index_, refilter);
+    QLOG_DEBUG() << "Items refreshed," << searches_.size() - refilter.size() << "of" << searches_.size()
+                 << "searches updated incrementally.";
+    OnSearchFinished(current_search_);
+    if (!delta.empty())
+        shop_->Update(true);
+    if (warm_image_cache_)
+        WarmImageCache(delta);
 }
 
 MainWindow::~MainWindow() {
+    // waits for any search pass in flight
+    delete search_runner_;
+    delete column_widths_;
+    delete stash_grid_;
     buyout_manager_->Save();
     delete ui;
-    delete data_manager_;
+    // their statements have to be finalized before the database is closed
     delete items_manager_;
     delete buyout_manager_;
+    delete data_manager_;
 }
 
 void MainWindow::on_actionForum_shop_thread_triggered() {
-    QString thread = QInputDialog::getText(this, "[NOT IMPLEMENTED] Shop thread", "Enter thread number");
-    shop_->SetThread(thread.toUtf8().constData());
+    bool ok;
+    QString thread = QInputDialog::getText(this, "Shop thread", "Enter thread number",
+        QLineEdit::Normal, shop_->thread().c_str(), &ok);
+    if (ok)
+        shop_->SetThread(thread.trimmed().toUtf8().constData());
 }
 
 void MainWindow::on_actionCopy_shop_data_to_clipboard_triggered() {
@@ -496,6 +623,115 @@ void MainWindow::on_actionRefresh_triggered() {
     items_manager_->Update();
 }
 
+void MainWindow::on_actionDownload_all_icons_triggered() {
+    warm_image_cache_ = ui->actionDownload_all_icons->isChecked();
+    data_manager_->Set("warm_image_cache", warm_image_cache_ ? "1" : "0");
+    if (warm_image_cache_)
+        WarmImageCache();
+}
+
+void MainWindow::on_actionNew_session_triggered() {
+    sessions_->ShowLogin();
+}
+
+void MainWindow::on_actionPerformance_stats_triggered() {
+    perf_panel_->setVisible(ui->actionPerformance_stats->isChecked());
+}
+
+void MainWindow::OnPerfPanelClosed() {
+    ui->actionPerformance_stats->setChecked(false);
+}
+
 void MainWindow::on_actionAutomatically_refresh_items_triggered() {
     items_manager_->SetAutoUpdate(ui->actionAutomatically_refresh_items->isChecked());
 }
+
+void MainWindow::on_actionHot_tabs_triggered() {
+    QStringList current;
+    for (auto &tab : items_manager_->hot_tabs())
+        current.append(tab.c_str());
+    bool ok;
+    QString text = QInputDialog::getMultiLineText(this, "Hot tabs",
+        "Captions of tabs to refresh more often, one per line", current.join("\n"), &ok);
+    if (!ok)
+        return;
+    std::set<std::string> hot_tabs;
+    for (auto &line : text.split("\n", QString::SkipEmptyParts))
+        hot_tabs.insert(line.trimmed().toUtf8().constData());
+    items_manager_->SetHotTabs(hot_tabs);
+}
+
+void MainWindow::on_actionHot_tabs_refresh_interval_triggered() {
+    int interval = QInputDialog::getText(this, "Auto refresh hot tabs", "Refresh hot tabs every X minutes",
+        QLineEdit::Normal, QString::number(items_manager_->hot_update_interval())).toInt();
+    if (interval > 0)
+        items_manager_->SetHotUpdateInterval(interval);
+}
+
+void MainWindow::on_actionPrice_search_results_triggered() {
+    const Items &items = current_search_->items();
+    if (items.empty())
+        return;
+    Buyout bo = BuyoutFromForm();
+    QString question;
+    if (bo.type == BUYOUT_TYPE_NONE)
+        question = QString("Remove buyouts of all %1 items of \"%2\"?");
+    else
+        question = QString("Set ") + BuyoutTypeAsTag[bo.type].c_str() + " " + QString::number(bo.value) + " "
+            + CurrencyAsTag[bo.currency].c_str() + " on all %1 items of \"%2\"?";
+    question = question.arg(static_cast<qint64>(items.size())).arg(current_search_->caption().c_str());
+    if (QMessageBox::question(this, "Price search results", question) != QMessageBox::Yes)
+        return;
+    buyout_manager_->SetMany(items, bo);
+    shop_->ExpireShopData();
+    if (current_item_)
+        UpdateCurrentItemBuyout();
+    OnPricesChanged();
+    search_runner_->Schedule(current_search_, items_index_);
+}
+
+void MainWindow::on_actionBuyout_grace_period_triggered() {
+    bool ok;
+    int days = QInputDialog::getText(this, "Buyouts of missing items",
+        "Keep buyouts of items that can't be found anymore for X days",
+        QLineEdit::Normal, QString::number(buyout_manager_->grace_period()), &ok).toInt();
+    if (ok && days > 0)
+        buyout_manager_->SetGracePeriod(days);
+}
+
+void MainWindow::on_actionExchange_rates_triggered() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Exchange rates");
+    QFormLayout *layout = new QFormLayout;
+    layout->addRow(new QLabel("Chaos orbs per one of each currency, prices in currencies\n"
+                              "without a rate are left out of the price filter and column."));
+    std::vector<QLineEdit*> rates(CurrencyAsString.size(), nullptr);
+    for (size_t currency = CURRENCY_NONE + 1; currency < CurrencyAsString.size(); ++currency) {
+        rates[currency] = new QLineEdit;
+        rates[currency]->setPlaceholderText("not set");
+        double rate = buyout_manager_->rate(static_cast<Currency>(currency));
+        if (rate > 0)
+            rates[currency]->setText(QString::number(rate));
+        layout->addRow(CurrencyAsString[currency].c_str(), rates[currency]);
+    }
+    QPushButton *ok = new QPushButton("OK");
+    connect(ok, SIGNAL(clicked()), &dialog, SLOT(accept()));
+    layout->addRow(ok);
+    dialog.setLayout(layout);
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    std::vector<double> values(CurrencyAsString.size(), 0.0);
+    for (size_t currency = CURRENCY_NONE + 1; currency < rates.size(); ++currency)
+        values[currency] = rates[currency]->text().toDouble();
+    buyout_manager_->SetRates(values);
+    OnPricesChanged();
+    search_runner_->Schedule(current_search_, items_index_);
+}
+
+void MainWindow::on_actionConcurrent_requests_triggered() {
+    int max_in_flight = QInputDialog::getText(this, "Concurrent requests", "Maximum number of stash tab requests in flight",
+        QLineEdit::Normal, QString::number(items_manager_->max_in_flight())).toInt();
+    if (max_in_flight > 0)
+        items_manager_->SetMaxInFlight(max_in_flight);
+}
@@ -22,20 +22,32 @@
 #include <memory>
 #include <QMainWindow>
 
+#include "application.h"
 #include "column.h"
 #include "items_model.h"
 #include "search.h"
 #include "imagecache.h"
+#include "itemsdelta.h"
 
 class QLabel;
+class QTimer;
 class QNetworkAccessManager;
 class QNetworkReply;
 
+class ColumnWidths;
 class DataManager;
 class Filter;
+class ItemsIndex;
 class ItemsManager;
 class BuyoutManager;
+struct Buyout;
+class SearchRunner;
+class IconDelegate;
+class ItemIcons;
+class SessionManager;
 class Shop;
+class PerfPanel;
+class StashGrid;
 class FlowLayout;
 class TabBuyoutsDialog;
 
@@ -43,62 +55,107 @@ namespace Ui {
 class MainWindow;
 }
 
-class MainWindow : public QMainWindow
+class MainWindow : public QMainWindow, public Application
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent, QNetworkAccessManager *login_manager,
+    MainWindow(QWidget *parent, SessionManager *sessions, QNetworkAccessManager *login_manager,
                const std::string &league, const std::string &email);
     ~MainWindow();
+    // Windows open before the login completes and show saved items, refreshing starts from here
+    void SetLoggedIn();
+    // Price filters and columns of every search pick up changed tab buyouts or exchange rates
+    void OnPricesChanged();
     std::vector<Column*> columns;
     const std::string &league() const { return league_; }
     const std::string &email() const { return email_; }
     const Items &items() const { return items_; }
+    const std::shared_ptr<const ItemsIndex> &items_index() const { return items_index_; }
     DataManager *data_manager() const { return data_manager_; }
     BuyoutManager *buyout_manager() const { return buyout_manager_; }
     QNetworkAccessManager *logged_in_nm() const { return logged_in_nm_; }
     const std::vector<std::string> &tabs() const { return tabs_; }
+    const std::shared_ptr<Item> &current_item() const { return current_item_; }
 public slots:
     void OnTreeChange(const QModelIndex &index, const QModelIndex &prev);
     void OnSearchFormChange();
     void OnTabChange(int index);
-    void OnImageFetched(QNetworkReply *reply);
-    void OnItemsRefreshed(const Items &items, const std::vector<std::string> &tabs);
+    void OnImageReady(const QString &url);
+    // Loads icons of the rows around the viewport into image_cache_
+    void PrefetchVisibleIcons();
+    void OnItemsRefreshed(const Items &items, const std::vector<std::string> &tabs, const ItemsDelta &delta);
     void OnItemsManagerStatusUpdate(int fetched, int total, bool throttled);
     void OnBuyoutChange();
+    void OnSearchFinished(Search *search);
 private slots:
     void on_actionForum_shop_thread_triggered();
     void on_actionCopy_shop_data_to_clipboard_triggered();
     void on_actionTab_buyouts_triggered();
+    void on_actionPrice_search_results_triggered();
+    void on_actionBuyout_grace_period_triggered();
+    void on_actionExchange_rates_triggered();
     void on_actionItems_refresh_interval_triggered();
 
     void on_actionRefresh_triggered();
 
     void on_actionAutomatically_refresh_items_triggered();
 
+    void on_actionHot_tabs_triggered();
+
+    void on_actionHot_tabs_refresh_interval_triggered();
+
+    void on_actionConcurrent_requests_triggered();
+
+    void on_actionDownload_all_icons_triggered();
+
+    void on_actionNew_session_triggered();
+
+    void on_actionPerformance_stats_triggered();
+    void OnPerfPanelClosed();
+    // called by prices_timer_ once buyout edits settle, and by OnPricesChanged
+    void ApplyPriceChanges();
+
 private:
     void UpdateCurrentItem();
     void UpdateCurrentItemMinimap();
-    void UpdateCurrentItemIcon(const QImage &image);
+    void UpdateCurrentItemIcon(const QPixmap &icon);
     void UpdateCurrentItemProperties();
     void UpdateCurrentItemBuyout();
+    // what the buyout widgets are set to
+    Buyout BuyoutFromForm();
+    // Downloads icons of all items that aren't in image_cache_ yet
+    void WarmImageCache();
+    // only icons of the added and modified items
+    void WarmImageCache(const ItemsDelta &delta);
     void NewSearch();
+    // Puts current_search_ into the view and filters it with its form data
+    void ShowCurrentSearch();
     void InitializeSearchForm();
     void InitializeUi();
     void AddSearchGroup(FlowLayout *layout, std::string name);
     bool eventFilter(QObject *o, QEvent *e);
     Ui::MainWindow *ui;
     Items items_;
+    std::shared_ptr<const ItemsIndex> items_index_;
     std::vector<std::string> tabs_;
     std::shared_ptr<Item> current_item_;
     std::vector<Search*> searches_;
     Search *current_search_;
+    SearchRunner *search_runner_;
+    ColumnWidths *column_widths_;
     QTabBar *tab_bar_;
     std::vector<Filter*> filters_;
     int search_count_;
-    QNetworkAccessManager *image_network_manager_;
+    SessionManager *sessions_;
+    // both shared with the other sessions
     ImageCache *image_cache_;
+    ItemIcons *item_icons_;
+    // download icons of all items after every refresh
+    bool warm_image_cache_;
+    // owned by ui->treeView
+    IconDelegate *icon_delegate_;
+    StashGrid *stash_grid_;
     ItemsManager *items_manager_;
     QLabel *status_bar_label_;
     DataManager *data_manager_;
@@ -108,4 +165,11 @@ private:
     Shop *shop_;
     QNetworkAccessManager *logged_in_nm_;
     TabBuyoutsDialog *tab_buyouts_dialog_;
+    PerfPanel *perf_panel_;
+    // buyouts typed in are applied to the searches after a pause, not on every key
+    QTimer *prices_timer_;
+    // items with buyouts edited since the last ApplyPriceChanges
+    Items priced_items_;
+    // e.g. rates or tab buyouts, every row has to be updated
+    bool all_prices_changed_;
 };
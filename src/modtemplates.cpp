@@ -0,0 +1,105 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modtemplates.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace {
+
+QMutex parsed_mutex;
+
+// Keyed by the pooled string, which never goes away
+std::unordered_map<IString, ParsedMod> &parsed_mods() {
+    static std::unordered_map<IString, ParsedMod> mods;
+    return mods;
+}
+
+ParsedMod ParseMod(const std::string &mod) {
+    std::string text;
+    double sum = 0;
+    int count = 0;
+    const char *s = mod.c_str();
+    while (*s) {
+        if (isdigit(static_cast<unsigned char>(*s))) {
+            char *end;
+            sum += strtod(s, &end);
+            ++count;
+            text += '#';
+            s = end;
+        } else {
+            text += *s++;
+        }
+    }
+    return { IString(text), count ? static_cast<float>(sum / count) : 0.0f };
+}
+
+}
+
+const ParsedMod &ModTemplates::Parse(const IString &mod) {
+    QMutexLocker locker(&parsed_mutex);
+    auto &mods = parsed_mods();
+    auto it = mods.find(mod);
+    if (it == mods.end())
+        it = mods.insert(std::make_pair(mod, ParseMod(mod))).first;
+    return it->second;
+}
+
+void ModsIndex::Build(const Items &items) {
+    std::unordered_map<IString, uint32_t> ids;
+    auto add = [&](uint32_t row, const IString &mod) {
+        const ParsedMod &parsed = ModTemplates::Parse(mod);
+        auto it = ids.find(parsed.mod_template);
+        if (it == ids.end()) {
+            it = ids.insert(std::make_pair(parsed.mod_template, static_cast<uint32_t>(templates_.size()))).first;
+            std::string text = parsed.mod_template;
+            std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+            templates_.push_back(text);
+            postings_.push_back(Postings());
+        }
+        Postings &postings = postings_[it->second];
+        // rows are added in order, so a repeated template can only be the last entry
+        if (!postings.rows.empty() && postings.rows.back() == row) {
+            postings.values.back() += parsed.value;
+            return;
+        }
+        postings.rows.push_back(row);
+        postings.values.push_back(parsed.value);
+    };
+    for (size_t i = 0; i < items.size(); ++i) {
+        for (auto &mod : items[i]->explicitMods())
+            add(i, mod);
+        for (auto &mod : items[i]->implicitMods())
+            add(i, mod);
+    }
+}
+
+std::vector<uint32_t> ModsIndex::MatchTemplates(const std::string &pattern) const {
+    std::string query = pattern;
+    std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+    std::vector<uint32_t> result;
+    for (size_t id = 0; id < templates_.size(); ++id)
+        if (templates_[id].find(query) != std::string::npos)
+            result.push_back(id);
+    return result;
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "item.h"
+#include "stringpool.h"
+
+/*
+ * Mods are split into a template with every number replaced by '#' and
+ * the numbers themselves, e.g. "Adds 5-10 Fire Damage" becomes
+ * "Adds #-# Fire Damage" with values 5 and 10.
+ */
+struct ParsedMod {
+    IString mod_template;
+    // average of all numbers in the mod, 0 if there are none
+    float value;
+};
+
+namespace ModTemplates {
+
+// Parsed once per distinct mod string, later calls are a hash lookup
+const ParsedMod &Parse(const IString &mod);
+
+}
+
+/*
+ * Columnar store of ParsedMod for all items of an ItemsIndex. For every
+ * template there's a sorted list of rows that have it and a parallel list
+ * of values, so a mod constraint is a few posting list scans and no mod
+ * text is looked at during a search.
+ */
+class ModsIndex {
+public:
+    struct Postings {
+        std::vector<uint32_t> rows;
+        // value of the mod for each row, summed if an item has the template twice
+        std::vector<float> values;
+    };
+    void Build(const Items &items);
+    // Case-insensitive substring match of pattern against every template
+    std::vector<uint32_t> MatchTemplates(const std::string &pattern) const;
+    const Postings &postings(uint32_t id) const { return postings_[id]; }
+    size_t template_count() const { return templates_.size(); }
+private:
+    // lower-cased template text
+    std::vector<std::string> templates_;
+    std::vector<Postings> postings_;
+};
@@ -0,0 +1,147 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perfpanel.h"
+
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QTableWidgetItem>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <string>
+
+#include "perfstats.h"
+
+const int PERF_PANEL_REFRESH_INTERVAL = 1000;
+const char *PERF_PANEL_COLUMNS[] = { "Name", "Count", "Total ms", "Mean ms", "Min ms", "p50 ms", "p90 ms", "p99 ms", "Max ms" };
+const int PERF_PANEL_COLUMN_COUNT = sizeof(PERF_PANEL_COLUMNS) / sizeof(PERF_PANEL_COLUMNS[0]);
+
+static QString Milliseconds(double microseconds) {
+    return QString::number(microseconds / 1000, 'f', 2);
+}
+
+PerfPanel::PerfPanel(QWidget *parent):
+    QDockWidget("Performance", parent),
+    table_(new QTableWidget(0, PERF_PANEL_COLUMN_COUNT)),
+    refresh_timer_(new QTimer(this))
+{
+    setObjectName("PerfPanel");
+    QStringList labels;
+    for (auto column : PERF_PANEL_COLUMNS)
+        labels << column;
+    table_->setHorizontalHeaderLabels(labels);
+    table_->verticalHeader()->hide();
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QPushButton *reset = new QPushButton("Reset");
+    QPushButton *export_trace = new QPushButton("Export trace...");
+    connect(reset, SIGNAL(clicked()), this, SLOT(OnReset()));
+    connect(export_trace, SIGNAL(clicked()), this, SLOT(OnExportTrace()));
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addStretch();
+    buttons->addWidget(reset);
+    buttons->addWidget(export_trace);
+
+    QWidget *contents = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(contents);
+    layout->addWidget(table_);
+    layout->addLayout(buttons);
+    setWidget(contents);
+
+    refresh_timer_->setInterval(PERF_PANEL_REFRESH_INTERVAL);
+    connect(refresh_timer_, SIGNAL(timeout()), this, SLOT(Refresh()));
+}
+
+void PerfPanel::closeEvent(QCloseEvent *event) {
+    QDockWidget::closeEvent(event);
+    emit Closed();
+}
+
+void PerfPanel::showEvent(QShowEvent *event) {
+    QDockWidget::showEvent(event);
+    PerfStats::SetEnabled(true);
+    Refresh();
+    refresh_timer_->start();
+}
+
+void PerfPanel::hideEvent(QHideEvent *event) {
+    QDockWidget::hideEvent(event);
+    refresh_timer_->stop();
+    PerfStats::SetEnabled(false);
+}
+
+void PerfPanel::Refresh() {
+    auto histograms = PerfStats::Instance().histograms();
+    auto counters = PerfStats::Instance().counters();
+    // "x hit" and "x miss" counters also get a "x hit rate" row
+    std::map<std::string, double> rates;
+    for (auto &counter : counters) {
+        const std::string &name = counter.first;
+        const std::string suffix = " hit";
+        if (name.size() <= suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        auto miss = counters.find(name.substr(0, name.size() - suffix.size()) + " miss");
+        qint64 total = counter.second + (miss == counters.end() ? 0 : miss->second);
+        if (total > 0)
+            rates[name + " rate"] = 100.0 * counter.second / total;
+    }
+
+    table_->setRowCount(histograms.size() + counters.size() + rates.size());
+    int row = 0;
+    auto set = [this, &row](int column, const QString &text) {
+        table_->setItem(row, column, new QTableWidgetItem(text));
+    };
+    for (auto &histogram : histograms) {
+        const PerfStats::Histogram &h = histogram.second;
+        set(0, histogram.first.c_str());
+        set(1, QString::number(h.count));
+        set(2, Milliseconds(h.total));
+        set(3, Milliseconds(h.count ? static_cast<double>(h.total) / h.count : 0));
+        set(4, Milliseconds(h.min));
+        set(5, Milliseconds(h.Percentile(0.5)));
+        set(6, Milliseconds(h.Percentile(0.9)));
+        set(7, Milliseconds(h.Percentile(0.99)));
+        set(8, Milliseconds(h.max));
+        ++row;
+    }
+    for (auto &counter : counters) {
+        set(0, counter.first.c_str());
+        set(1, QString::number(counter.second));
+        ++row;
+    }
+    for (auto &rate : rates) {
+        set(0, rate.first.c_str());
+        set(1, QString::number(rate.second, 'f', 1) + "%");
+        ++row;
+    }
+}
+
+void PerfPanel::OnReset() {
+    PerfStats::Instance().Reset();
+    Refresh();
+}
+
+void PerfPanel::OnExportTrace() {
+    QString path = QFileDialog::getSaveFileName(this, "Export trace", "acquisition-trace.json", "Chrome trace (*.json)");
+    if (!path.isEmpty())
+        PerfStats::Instance().ExportTrace(path);
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QDockWidget>
+
+class QCloseEvent;
+class QHideEvent;
+class QShowEvent;
+class QTableWidget;
+class QTimer;
+
+/*
+ * Dockable view of PerfStats, refreshed while visible. Collecting stats is
+ * tied to the panel being open.
+ */
+class PerfPanel : public QDockWidget {
+    Q_OBJECT
+public:
+    explicit PerfPanel(QWidget *parent);
+signals:
+    void Closed();
+protected:
+    void closeEvent(QCloseEvent *event);
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+private slots:
+    void Refresh();
+    void OnReset();
+    void OnExportTrace();
+private:
+    QTableWidget *table_;
+    QTimer *refresh_timer_;
+};
@@ -0,0 +1,183 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perfstats.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+#include "jsoncpp/json.h"
+#include "QsLog.h"
+
+std::atomic<bool> PerfStats::enabled_(false);
+
+static QElapsedTimer StartedTimer() {
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+static QElapsedTimer &Clock() {
+    static QElapsedTimer clock = StartedTimer();
+    return clock;
+}
+
+PerfStats::Histogram::Histogram():
+    count(0),
+    total(0),
+    min(0),
+    max(0),
+    buckets()
+{}
+
+void PerfStats::Histogram::Add(qint64 duration) {
+    if (count == 0 || duration < min)
+        min = duration;
+    if (duration > max)
+        max = duration;
+    ++count;
+    total += duration;
+    int bucket = 0;
+    while (bucket < PERF_BUCKETS - 1 && (1LL << bucket) <= duration)
+        ++bucket;
+    ++buckets[bucket];
+}
+
+qint64 PerfStats::Histogram::Percentile(double p) const {
+    qint64 seen = 0;
+    qint64 needed = static_cast<qint64>(p * count);
+    for (int i = 0; i < PERF_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > needed)
+            return std::min(max, 1LL << i);
+    }
+    return max;
+}
+
+PerfStats::PerfStats() {
+    Clock();
+}
+
+PerfStats &PerfStats::Instance() {
+    static PerfStats instance;
+    return instance;
+}
+
+void PerfStats::SetEnabled(bool enabled) {
+    if (enabled != PerfStats::enabled())
+        QLOG_INFO() << (enabled ? "Enabled" : "Disabled") << "performance stats";
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 PerfStats::Now() {
+    return Clock().nsecsElapsed() / 1000;
+}
+
+void PerfStats::Record(const char *name, qint64 start, qint64 duration) {
+    if (enabled())
+        Instance().Add(name, start, duration);
+}
+
+void PerfStats::Count(const char *name, qint64 n) {
+    if (enabled())
+        Instance().Increment(name, n);
+}
+
+void PerfStats::Add(const char *name, qint64 start, qint64 duration) {
+    TraceEvent event;
+    event.name = name;
+    event.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    event.start = start;
+    event.duration = duration;
+
+    QMutexLocker locker(&mutex_);
+    histograms_[name].Add(duration);
+    trace_.push_back(event);
+    if (trace_.size() > PERF_MAX_TRACE_EVENTS)
+        trace_.pop_front();
+}
+
+void PerfStats::Increment(const char *name, qint64 n) {
+    QMutexLocker locker(&mutex_);
+    counters_[name] += n;
+}
+
+std::map<std::string, PerfStats::Histogram> PerfStats::histograms() const {
+    QMutexLocker locker(&mutex_);
+    return histograms_;
+}
+
+std::map<std::string, qint64> PerfStats::counters() const {
+    QMutexLocker locker(&mutex_);
+    return counters_;
+}
+
+void PerfStats::Reset() {
+    QMutexLocker locker(&mutex_);
+    histograms_.clear();
+    counters_.clear();
+    trace_.clear();
+}
+
+bool PerfStats::ExportTrace(const QString &path) const {
+    Json::Value events(Json::arrayValue);
+    {
+        QMutexLocker locker(&mutex_);
+        // small thread ids are easier to read in the trace viewer
+        std::map<quintptr, int> threads;
+        for (auto &event : trace_) {
+            auto it = threads.find(event.thread);
+            if (it == threads.end())
+                it = threads.insert(std::make_pair(event.thread, static_cast<int>(threads.size()) + 1)).first;
+            Json::Value json;
+            json["name"] = event.name;
+            json["ph"] = "X";
+            json["pid"] = 1;
+            json["tid"] = it->second;
+            json["ts"] = static_cast<Json::Int64>(event.start);
+            json["dur"] = static_cast<Json::Int64>(event.duration);
+            events.append(json);
+        }
+        // counters only have their final value
+        qint64 now = Now();
+        for (auto &counter : counters_) {
+            Json::Value json;
+            json["name"] = counter.first;
+            json["ph"] = "C";
+            json["pid"] = 1;
+            json["ts"] = static_cast<Json::Int64>(now);
+            json["args"]["value"] = static_cast<Json::Int64>(counter.second);
+            events.append(json);
+        }
+    }
+    Json::Value trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+    std::string json = Json::FastWriter().write(trace);
+
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly) || out.write(json.c_str(), json.size()) < 0 || !out.commit()) {
+        QLOG_ERROR() << "Failed to write performance trace to" << path;
+        return false;
+    }
+    QLOG_INFO() << "Wrote" << events.size() << "trace events to" << path;
+    return true;
+}
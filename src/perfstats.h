@@ -0,0 +1,98 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <string>
+
+// histogram buckets are powers of two microseconds, the last one catches the rest
+const int PERF_BUCKETS = 32;
+// oldest trace events are dropped past this
+const size_t PERF_MAX_TRACE_EVENTS = 200000;
+
+/*
+ * Process wide timers and counters for the hot paths, shown in PerfPanel and
+ * exportable as a Chrome trace (chrome://tracing, Perfetto). Collection is
+ * off by default, in which case PerfTimer and Count cost a relaxed load.
+ * Can be used from any thread.
+ */
+class PerfStats {
+public:
+    struct Histogram {
+        Histogram();
+        void Add(qint64 duration);
+        // approximate, based on bucket boundaries; p is in [0, 1]
+        qint64 Percentile(double p) const;
+        qint64 count, total, min, max;
+        qint64 buckets[PERF_BUCKETS];
+    };
+
+    static PerfStats &Instance();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool enabled);
+    // microseconds since the first use
+    static qint64 Now();
+    // both in microseconds, name must outlive PerfStats (a literal)
+    static void Record(const char *name, qint64 start, qint64 duration);
+    static void Count(const char *name, qint64 n = 1);
+
+    std::map<std::string, Histogram> histograms() const;
+    std::map<std::string, qint64> counters() const;
+    void Reset();
+    bool ExportTrace(const QString &path) const;
+private:
+    struct TraceEvent {
+        const char *name;
+        quintptr thread;
+        qint64 start, duration;
+    };
+    PerfStats();
+    void Add(const char *name, qint64 start, qint64 duration);
+    void Increment(const char *name, qint64 n);
+
+    static std::atomic<bool> enabled_;
+    mutable QMutex mutex_;
+    std::map<std::string, Histogram> histograms_;
+    std::map<std::string, qint64> counters_;
+    std::deque<TraceEvent> trace_;
+};
+
+// Records the lifetime of the scope under name
+class PerfTimer {
+public:
+    explicit PerfTimer(const char *name):
+        name_(PerfStats::enabled() ? name : nullptr),
+        start_(name_ ? PerfStats::Now() : 0)
+    {}
+    ~PerfTimer() {
+        if (name_)
+            PerfStats::Record(name_, start_, PerfStats::Now() - start_);
+    }
+    PerfTimer(const PerfTimer&) = delete;
+    PerfTimer& operator=(const PerfTimer&) = delete;
+private:
+    const char *name_;
+    qint64 start_;
+};
@@ -0,0 +1,55 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pixmaplru.h"
+
+PixmapLru::PixmapLru(size_t budget):
+    budget_(budget),
+    bytes_(0)
+{}
+
+bool PixmapLru::Get(const std::string &key, QPixmap *pixmap) {
+    auto it = index_.find(key);
+    if (it == index_.end())
+        return false;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    *pixmap = it->second->second;
+    return true;
+}
+
+void PixmapLru::Put(const std::string &key, const QPixmap &pixmap) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        bytes_ -= PixmapBytes(it->second->second);
+        lru_.erase(it->second);
+    }
+    lru_.emplace_front(key, pixmap);
+    index_[key] = lru_.begin();
+    bytes_ += PixmapBytes(pixmap);
+    // the newest pixmap stays even if it's over the budget all by itself
+    while (bytes_ > budget_ && lru_.size() > 1) {
+        bytes_ -= PixmapBytes(lru_.back().second);
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+size_t PixmapLru::PixmapBytes(const QPixmap &pixmap) {
+    return static_cast<size_t>(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
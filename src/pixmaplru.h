@@ -0,0 +1,46 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QPixmap>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/*
+ * LRU of pixmaps limited by the memory their pixels take.
+ * GUI thread only, like QPixmap itself.
+ */
+class PixmapLru {
+public:
+    explicit PixmapLru(size_t budget);
+    bool Contains(const std::string &key) const { return index_.count(key) > 0; }
+    // Marks the pixmap as recently used, false if it's not there
+    bool Get(const std::string &key, QPixmap *pixmap);
+    void Put(const std::string &key, const QPixmap &pixmap);
+    size_t bytes() const { return bytes_; }
+private:
+    typedef std::list<std::pair<std::string, QPixmap>> List;
+    static size_t PixmapBytes(const QPixmap &pixmap);
+    size_t budget_, bytes_;
+    List lru_;
+    std::unordered_map<std::string, List::iterator> index_;
+};
@@ -0,0 +1,398 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "queryserver.h"
+
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "jsoncpp/json.h"
+#include "QsLog.h"
+
+#include "application.h"
+#include "buyoutmanager.h"
+#include "column.h"
+#include "filters.h"
+#include "itemsindex.h"
+#include "perfstats.h"
+#include "search.h"
+
+// request line and headers, anything longer is refused
+const int MAX_QUERY_REQUEST_SIZE = 8192;
+const int DEFAULT_QUERY_PAGE_SIZE = 100;
+const int MAX_QUERY_PAGE_SIZE = 1000;
+// connections that don't send a complete request by then are dropped
+const int QUERY_REQUEST_TIMEOUT_MS = 5000;
+
+static bool ParseNumber(const QString &text, double *value, bool *filled) {
+    bool ok;
+    *value = text.toDouble(&ok);
+    *filled = ok;
+    return ok;
+}
+
+static bool ParseCount(const QString &text, int *value, bool *filled) {
+    bool ok;
+    *value = text.toInt(&ok);
+    *filled = ok;
+    return ok && *value >= 0;
+}
+
+static std::string CsvField(const std::string &text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos)
+        return text;
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"')
+            result += '"';
+        result += c;
+    }
+    return result + "\"";
+}
+
+QueryServer::QueryServer(Application *app, const std::vector<QueryFilter> &filters):
+    app_(app),
+    filters_(filters),
+    server_(new QTcpServer(this)),
+    port_(0)
+{
+    std::vector<Filter*> search_filters;
+    for (auto &filter : filters_)
+        search_filters.push_back(filter.filter);
+    search_ = new Search("Query", search_filters);
+    search_->AddColumn(new PriceColumn(app_->buyout_manager()));
+    connect(server_, SIGNAL(newConnection()), this, SLOT(OnNewConnection()));
+}
+
+QueryServer::~QueryServer() {
+    delete search_;
+}
+
+bool QueryServer::Listen(int port) {
+    if (!server_->listen(QHostAddress::LocalHost, port)) {
+        QLOG_ERROR() << "Query server can't listen on port" << port << ":" << server_->errorString();
+        return false;
+    }
+    port_ = port;
+    QLOG_INFO() << "Query server listening on 127.0.0.1 port" << port;
+    return true;
+}
+
+void QueryServer::OnNewConnection() {
+    while (QTcpSocket *socket = server_->nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        // goes away with the socket
+        QTimer *timeout = new QTimer(socket);
+        timeout->setSingleShot(true);
+        connect(timeout, SIGNAL(timeout()), this, SLOT(OnRequestTimeout()));
+        timeout->start(QUERY_REQUEST_TIMEOUT_MS);
+    }
+}
+
+void QueryServer::OnRequestTimeout() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(QObject::sender()->parent());
+    QLOG_WARN() << "Query server dropped a connection that didn't send a request in time";
+    socket->abort();
+}
+
+void QueryServer::OnReadyRead() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(QObject::sender());
+    // the socket keeps what was received so far until the headers are complete
+    QByteArray request = socket->peek(socket->bytesAvailable());
+    int end = request.indexOf("\r\n\r\n");
+    if (end < 0 && request.size() <= MAX_QUERY_REQUEST_SIZE)
+        return;
+    socket->readAll();
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+    socket->findChild<QTimer*>()->stop();
+    if (end < 0)
+        WriteError(socket, 431, "Request Header Fields Too Large", "request is too large");
+    else
+        Answer(socket, request.left(end));
+    socket->disconnectFromHost();
+}
+
+bool QueryServer::HostAllowed(const QByteArray &request) {
+    QList<QByteArray> lines = request.split('\n');
+    for (int i = 1; i < lines.size(); ++i) {
+        QByteArray line = lines[i].trimmed();
+        int colon = line.indexOf(':');
+        if (colon < 0 || line.left(colon).trimmed().toLower() != "host")
+            continue;
+        QByteArray host = line.mid(colon + 1).trimmed().toLower();
+        QByteArray port = QByteArray::number(port_);
+        return host == "127.0.0.1:" + port || host == "localhost:" + port;
+    }
+    return false;
+}
+
+void QueryServer::Answer(QTcpSocket *socket, const QByteArray &request) {
+    if (!HostAllowed(request)) {
+        WriteError(socket, 403, "Forbidden", "the Host header has to be 127.0.0.1 or localhost with the port");
+        return;
+    }
+    QList<QByteArray> parts = request.left(request.indexOf("\r\n")).split(' ');
+    if (parts.size() != 3) {
+        WriteError(socket, 400, "Bad Request", "malformed request line");
+        return;
+    }
+    if (parts[0] != "GET") {
+        WriteError(socket, 405, "Method Not Allowed", "only GET is supported");
+        return;
+    }
+    QUrl url(QString::fromUtf8(parts[1]));
+    if (url.path() == "/status")
+        AnswerStatus(socket);
+    else if (url.path() == "/items")
+        AnswerItems(socket, QUrlQuery(url));
+    else
+        WriteError(socket, 404, "Not Found", "unknown path, try /status or /items");
+}
+
+void QueryServer::AnswerStatus(QTcpSocket *socket) {
+    const std::shared_ptr<const ItemsIndex> &index = app_->items_index();
+    Json::Value root;
+    root["league"] = app_->league();
+    root["items"] = static_cast<Json::UInt64>(index ? index->size() : 0);
+    root["index"] = static_cast<Json::UInt64>(index ? index->id() : 0);
+    Json::Value parameters(Json::arrayValue);
+    for (auto &filter : filters_) {
+        if (filter.kind == QUERY_TEXT || filter.kind == QUERY_TEXT_RANGE)
+            parameters.append(filter.key);
+        if (filter.kind == QUERY_RANGE || filter.kind == QUERY_TEXT_RANGE) {
+            parameters.append(filter.key + "_min");
+            parameters.append(filter.key + "_max");
+        }
+        if (filter.kind == QUERY_COLORS) {
+            parameters.append(filter.key + "_r");
+            parameters.append(filter.key + "_g");
+            parameters.append(filter.key + "_b");
+        }
+    }
+    root["parameters"] = parameters;
+    Json::Value columns(Json::arrayValue);
+    for (auto column : search_->columns())
+        if (!column->icon())
+            columns.append(column->name());
+    root["columns"] = columns;
+    WriteHeader(socket, 200, "OK", "application/json");
+    std::string body = Json::FastWriter().write(root);
+    socket->write(body.c_str(), body.size());
+}
+
+void QueryServer::AnswerItems(QTcpSocket *socket, const QUrlQuery &query) {
+    PerfTimer timer("QueryServer::AnswerItems");
+    // held so that a refresh finishing meanwhile doesn't pull the items away
+    std::shared_ptr<const ItemsIndex> index = app_->items_index();
+    std::vector<FilterData> data = search_->data();
+    Options options;
+    options.per_page = DEFAULT_QUERY_PAGE_SIZE;
+    std::string error;
+    if (!Parse(query, &data, &options, &error)) {
+        WriteError(socket, 400, "Bad Request", error);
+        return;
+    }
+    // price filters take the prices of the current index
+    for (auto &filter : data)
+        filter.Refresh();
+
+    Items items;
+    if (index) {
+        std::atomic<bool> cancel(false);
+        SearchResult result;
+        search_->Run(*index, data, cancel, &result);
+        items = std::move(result.items);
+    }
+    Sort(options, &items);
+    size_t total = items.size();
+    size_t begin = std::min(total, static_cast<size_t>(options.page) * options.per_page);
+    size_t end = std::min(total, begin + options.per_page);
+    Items page(items.begin() + begin, items.begin() + end);
+    if (options.csv)
+        WriteCsv(socket, page, total);
+    else
+        WriteJson(socket, page, total, options);
+}
+
+bool QueryServer::Parse(const QUrlQuery &query, std::vector<FilterData> *data, Options *options,
+                        std::string *error) {
+    for (auto &item : query.queryItems(QUrl::FullyDecoded)) {
+        std::string key = item.first.toUtf8().constData();
+        const QString &value = item.second;
+        bool ok = true, filled;
+        if (key == "page") {
+            ok = ParseCount(value, &options->page, &filled);
+        } else if (key == "per_page") {
+            ok = ParseCount(value, &options->per_page, &filled)
+                && options->per_page > 0 && options->per_page <= MAX_QUERY_PAGE_SIZE;
+        } else if (key == "format") {
+            ok = value == "json" || value == "csv";
+            options->csv = value == "csv";
+        } else if (key == "order") {
+            ok = value == "asc" || value == "desc";
+            options->descending = value == "desc";
+        } else if (key == "sort") {
+            options->sort = nullptr;
+            for (auto column : search_->columns())
+                if (!column->icon() && value == column->name().c_str())
+                    options->sort = column;
+            ok = options->sort != nullptr;
+        } else if (!ParseFilterParameter(key, value, data, error)) {
+            return false;
+        }
+        if (!ok) {
+            *error = "bad value of " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QueryServer::ParseFilterParameter(const std::string &key, const QString &value,
+                                       std::vector<FilterData> *data, std::string *error) {
+    for (size_t i = 0; i < filters_.size(); ++i) {
+        const QueryFilter &filter = filters_[i];
+        FilterData &filter_data = (*data)[i];
+        bool text = filter.kind == QUERY_TEXT || filter.kind == QUERY_TEXT_RANGE;
+        bool range = filter.kind == QUERY_RANGE || filter.kind == QUERY_TEXT_RANGE;
+        bool ok;
+        if (text && key == filter.key) {
+            filter_data.text_query = value.toUtf8().constData();
+            return true;
+        } else if (range && key == filter.key + "_min") {
+            ok = ParseNumber(value, &filter_data.min, &filter_data.min_filled);
+        } else if (range && key == filter.key + "_max") {
+            ok = ParseNumber(value, &filter_data.max, &filter_data.max_filled);
+        } else if (filter.kind == QUERY_COLORS && key == filter.key + "_r") {
+            ok = ParseCount(value, &filter_data.r, &filter_data.r_filled);
+        } else if (filter.kind == QUERY_COLORS && key == filter.key + "_g") {
+            ok = ParseCount(value, &filter_data.g, &filter_data.g_filled);
+        } else if (filter.kind == QUERY_COLORS && key == filter.key + "_b") {
+            ok = ParseCount(value, &filter_data.b, &filter_data.b_filled);
+        } else {
+            continue;
+        }
+        if (!ok)
+            *error = "bad value of " + key;
+        return ok;
+    }
+    *error = "unknown parameter " + key + ", see /status";
+    return false;
+}
+
+void QueryServer::Sort(const Options &options, Items *items) {
+    Column *column = options.sort;
+    if (!column)
+        return;
+    // same keys as ItemsModel::sort, computed once per item
+    std::vector<std::pair<double, std::string>> keys(items->size());
+    std::vector<size_t> order(items->size());
+    for (size_t i = 0; i < items->size(); ++i) {
+        if (column->numeric())
+            keys[i].first = column->sort_value(*(*items)[i]);
+        else
+            keys[i].second = column->value(*(*items)[i]);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return options.descending ? keys[b] < keys[a] : keys[a] < keys[b];
+    });
+    Items sorted;
+    sorted.reserve(items->size());
+    for (size_t i : order)
+        sorted.push_back((*items)[i]);
+    *items = std::move(sorted);
+}
+
+void QueryServer::WriteJson(QTcpSocket *socket, const Items &items, size_t total, const Options &options) {
+    WriteHeader(socket, 200, "OK", "application/json", "X-Total-Count: " + std::to_string(total) + "\r\n");
+    std::string head = "{\"total\":" + std::to_string(total) + ",\"page\":" + std::to_string(options.page)
+        + ",\"per_page\":" + std::to_string(options.per_page) + ",\"items\":[\n";
+    socket->write(head.c_str(), head.size());
+    Json::FastWriter writer;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const Item &item = *items[i];
+        Json::Value row;
+        row["hash"] = item.hash();
+        row["tab"] = item.tab_caption();
+        row["character"] = item.in_character();
+        row["x"] = item.x();
+        row["y"] = item.y();
+        row["icon"] = item.icon();
+        for (auto column : search_->columns()) {
+            if (column->icon())
+                continue;
+            if (!column->numeric()) {
+                row[column->name()] = column->value(item);
+                continue;
+            }
+            double value = column->sort_value(item);
+            row[column->name()] = std::isfinite(value) ? Json::Value(value) : Json::Value();
+        }
+        // FastWriter ends every value with a newline
+        std::string line = writer.write(row);
+        if (i + 1 < items.size())
+            line.insert(line.size() - 1, ",");
+        socket->write(line.c_str(), line.size());
+    }
+    socket->write("]}\n", 3);
+}
+
+void QueryServer::WriteCsv(QTcpSocket *socket, const Items &items, size_t total) {
+    WriteHeader(socket, 200, "OK", "text/csv; charset=utf-8", "X-Total-Count: " + std::to_string(total) + "\r\n");
+    std::string line = "hash,tab,character,x,y,icon";
+    for (auto column : search_->columns())
+        if (!column->icon())
+            line += "," + CsvField(column->name());
+    line += "\r\n";
+    socket->write(line.c_str(), line.size());
+    for (auto &item : items) {
+        line = item->hash() + "," + CsvField(item->tab_caption()) + "," + (item->in_character() ? "1" : "0")
+            + "," + std::to_string(item->x()) + "," + std::to_string(item->y()) + "," + CsvField(item->icon());
+        for (auto column : search_->columns())
+            if (!column->icon())
+                line += "," + CsvField(column->value(*item));
+        line += "\r\n";
+        socket->write(line.c_str(), line.size());
+    }
+}
+
+void QueryServer::WriteHeader(QTcpSocket *socket, int status, const std::string &reason,
+                              const std::string &content_type, const std::string &extra) {
+    std::string header = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+        + "Content-Type: " + content_type + "\r\n"
+        + "Connection: close\r\n"
+        + extra + "\r\n";
+    socket->write(header.c_str(), header.size());
+}
+
+void QueryServer::WriteError(QTcpSocket *socket, int status, const std::string &reason, const std::string &message) {
+    WriteHeader(socket, status, reason, "application/json");
+    Json::Value root;
+    root["error"] = message;
+    std::string body = Json::FastWriter().write(root);
+    socket->write(body.c_str(), body.size());
+}
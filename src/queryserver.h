@@ -0,0 +1,114 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QObject>
+#include <string>
+#include <vector>
+
+#include "item.h"
+
+class QTcpServer;
+class QTcpSocket;
+class QUrlQuery;
+class Application;
+class Column;
+class Filter;
+class FilterData;
+class Search;
+
+// How request parameters named after QueryFilter::key fill in FilterData
+enum QueryFilterKind {
+    // key=text
+    QUERY_TEXT,
+    // key_min=number, key_max=number
+    QUERY_RANGE,
+    // both of the above
+    QUERY_TEXT_RANGE,
+    // key_r, key_g, key_b
+    QUERY_COLORS,
+};
+
+struct QueryFilter {
+    std::string key;
+    Filter *filter;
+    QueryFilterKind kind;
+};
+
+/*
+ * Answers HTTP GET requests from tools on this machine with items of the
+ * current index of app, filtered by the same Search code as the GUI:
+ *
+ *   /status  league, number of items and id of the index, accepted parameters
+ *   /items   filter parameters (see QueryFilter) plus
+ *            sort=<column name>, order=asc|desc,
+ *            page (from 0), per_page (up to MAX_QUERY_PAGE_SIZE), format=json|csv
+ *
+ * One request per connection, it has to arrive within QUERY_REQUEST_TIMEOUT_MS.
+ * Rows are written out as they're formatted and the response ends when the
+ * connection is closed. Requests with a Host other than 127.0.0.1 or localhost
+ * with our port are refused, so web pages can't read them through DNS rebinding.
+ */
+class QueryServer : public QObject {
+    Q_OBJECT
+public:
+    // filters have to outlive the server and must not have widgets
+    QueryServer(Application *app, const std::vector<QueryFilter> &filters);
+    ~QueryServer();
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+    // Only listens on the loopback interface, there's no authentication
+    bool Listen(int port);
+public slots:
+    void OnNewConnection();
+    void OnReadyRead();
+    // the request of a connection didn't arrive in time
+    void OnRequestTimeout();
+private:
+    struct Options {
+        Column *sort = nullptr;
+        bool descending = false;
+        int page = 0;
+        int per_page;
+        bool csv = false;
+    };
+    // request is the request line and the headers
+    void Answer(QTcpSocket *socket, const QByteArray &request);
+    bool HostAllowed(const QByteArray &request);
+    void AnswerStatus(QTcpSocket *socket);
+    void AnswerItems(QTcpSocket *socket, const QUrlQuery &query);
+    // false and error set if a parameter is unknown or malformed
+    bool Parse(const QUrlQuery &query, std::vector<FilterData> *data, Options *options, std::string *error);
+    bool ParseFilterParameter(const std::string &key, const QString &value, std::vector<FilterData> *data,
+                              std::string *error);
+    void Sort(const Options &options, Items *items);
+    void WriteJson(QTcpSocket *socket, const Items &items, size_t total, const Options &options);
+    void WriteCsv(QTcpSocket *socket, const Items &items, size_t total);
+    void WriteHeader(QTcpSocket *socket, int status, const std::string &reason,
+                     const std::string &content_type, const std::string &extra = "");
+    void WriteError(QTcpSocket *socket, int status, const std::string &reason, const std::string &message);
+
+    Application *app_;
+    std::vector<QueryFilter> filters_;
+    // made with filters_ in the same order, its data() is the starting point of every query
+    Search *search_;
+    QTcpServer *server_;
+    int port_;
+};
@@ -0,0 +1,164 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rangekernels.h"
+
+#include <cstdint>
+#include "bitmap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RANGE_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RANGE_KERNELS_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define RANGE_KERNELS_AVX2
+#define AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace {
+
+const size_t BLOCK = 64;
+
+// Each kernel returns a bit per value of a full 64-value block
+typedef uint64_t (*BlockKernel)(const float *values, float min, float max);
+
+#ifndef RANGE_KERNELS_SSE2
+uint64_t ScalarBlock(const float *values, float min, float max) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < BLOCK; ++i)
+        mask |= static_cast<uint64_t>(values[i] >= min && values[i] <= max) << i;
+    return mask;
+}
+#endif
+
+#ifdef RANGE_KERNELS_SSE2
+uint64_t Sse2Block(const float *values, float min, float max) {
+    __m128 lo = _mm_set1_ps(min);
+    __m128 hi = _mm_set1_ps(max);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < BLOCK; i += 4) {
+        __m128 v = _mm_loadu_ps(values + i);
+        __m128 in = _mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmple_ps(v, hi));
+        mask |= static_cast<uint64_t>(_mm_movemask_ps(in)) << i;
+    }
+    return mask;
+}
+#endif
+
+#ifdef RANGE_KERNELS_AVX2
+AVX2_TARGET uint64_t Avx2Block(const float *values, float min, float max) {
+    __m256 lo = _mm256_set1_ps(min);
+    __m256 hi = _mm256_set1_ps(max);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < BLOCK; i += 8) {
+        __m256 v = _mm256_loadu_ps(values + i);
+        __m256 in = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ), _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+        mask |= static_cast<uint64_t>(_mm256_movemask_ps(in)) << i;
+    }
+    return mask;
+}
+
+bool HasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // OSXSAVE and AVX, and the OS saves ymm registers
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct Kernel {
+    BlockKernel block;
+    const char *name;
+};
+
+Kernel PickKernel() {
+#ifdef RANGE_KERNELS_AVX2
+    if (HasAvx2())
+        return { &Avx2Block, "AVX2" };
+#endif
+#ifdef RANGE_KERNELS_SSE2
+    return { &Sse2Block, "SSE2" };
+#else
+    return { &ScalarBlock, "scalar" };
+#endif
+}
+
+const Kernel &kernel() {
+    static Kernel kernel = PickKernel();
+    return kernel;
+}
+
+}
+
+void EvaluateRanges(const std::vector<RangeQuery> &queries, size_t size, Bitmap *result) {
+    EvaluateRanges(queries, 0, size, result);
+}
+
+void EvaluateRanges(const std::vector<RangeQuery> &queries, size_t begin, size_t end, Bitmap *result) {
+    BlockKernel block = kernel().block;
+    uint64_t *words = result->words();
+    size_t full = end / BLOCK;
+    for (size_t w = begin / BLOCK; w < full; ++w) {
+        uint64_t word = ~0ULL;
+        for (auto &query : queries) {
+            word &= block(query.values + w * BLOCK, query.min, query.max);
+            if (query.present)
+                word &= query.present->words()[w];
+            // nothing left in this block, skip the remaining filters
+            if (!word)
+                break;
+        }
+        words[w] = word;
+    }
+    if (end % BLOCK) {
+        uint64_t word = (1ULL << (end % BLOCK)) - 1;
+        for (auto &query : queries) {
+            const float *values = query.values + full * BLOCK;
+            uint64_t mask = 0;
+            for (size_t i = 0; i < end % BLOCK; ++i)
+                mask |= static_cast<uint64_t>(values[i] >= query.min && values[i] <= query.max) << i;
+            word &= mask;
+            if (query.present)
+                word &= query.present->words()[full];
+        }
+        words[full] = word;
+    }
+}
+
+const char *RangeKernelName() {
+    return kernel().name;
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class Bitmap;
+
+// min <= values[i] <= max, rows not in present (if set) never match
+struct RangeQuery {
+    const float *values;
+    float min, max;
+    const Bitmap *present;
+    // IndexColumn values come from, for ItemsIndex::Selectivity; -1 if they aren't a column
+    int column;
+};
+
+/*
+ * Evaluates all queries over rows [0, size) and writes rows matching every
+ * one of them to result. Uses AVX2 or SSE2 when the CPU has them and
+ * falls back to plain loops otherwise.
+ */
+void EvaluateRanges(const std::vector<RangeQuery> &queries, size_t size, Bitmap *result);
+// Same for rows [begin, end) only, begin must be a multiple of 64. Other words
+// of result aren't touched, so disjoint ranges can be evaluated concurrently.
+void EvaluateRanges(const std::vector<RangeQuery> &queries, size_t begin, size_t end, Bitmap *result);
+
+// Name of the kernel picked for this CPU, for logging
+const char *RangeKernelName();
@@ -0,0 +1,125 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ratelimiter.h"
+
+#include <algorithm>
+#include <QTimer>
+#include "QsLog.h"
+
+// backoff after the first throttled response, in milliseconds
+const int INITIAL_BACKOFF = 2000;
+const int MAX_BACKOFF = 120 * 1000;
+// rate grows by this fraction after this many successful requests in a row
+const double RATE_INCREASE = 0.05;
+const int SUCCESSES_BEFORE_INCREASE = 10;
+
+RateLimiter::RateLimiter(double requests_per_second, int burst):
+    timer_(new QTimer),
+    rate_(requests_per_second),
+    min_rate_(requests_per_second / 8),
+    max_rate_(requests_per_second * 2),
+    ceiling_(requests_per_second * 2),
+    tokens_(burst),
+    burst_(burst),
+    paused_until_(0),
+    backoff_(INITIAL_BACKOFF),
+    successes_(0),
+    running_(false)
+{
+    clock_.start();
+    last_refill_ = clock_.elapsed();
+    timer_->setSingleShot(true);
+    connect(timer_, SIGNAL(timeout()), this, SLOT(OnTimer()));
+}
+
+RateLimiter::~RateLimiter() {
+    delete timer_;
+}
+
+void RateLimiter::Start() {
+    if (running_)
+        return;
+    running_ = true;
+    ScheduleNext();
+}
+
+void RateLimiter::Stop() {
+    running_ = false;
+    timer_->stop();
+}
+
+void RateLimiter::Refill() {
+    qint64 now = clock_.elapsed();
+    tokens_ = std::min(static_cast<double>(burst_), tokens_ + (now - last_refill_) * rate_ / 1000);
+    last_refill_ = now;
+}
+
+void RateLimiter::ScheduleNext() {
+    if (!running_)
+        return;
+    Refill();
+    qint64 now = clock_.elapsed();
+    qint64 delay = 0;
+    if (paused_until_ > now)
+        delay = paused_until_ - now;
+    else if (tokens_ < 1)
+        delay = static_cast<qint64>((1 - tokens_) * 1000 / rate_) + 1;
+    timer_->start(delay);
+}
+
+void RateLimiter::OnTimer() {
+    Refill();
+    if (paused_until_ <= clock_.elapsed() && tokens_ >= 1) {
+        tokens_ -= 1;
+        // the receiver may call Stop() from here
+        emit Ready();
+    }
+    ScheduleNext();
+}
+
+void RateLimiter::OnSuccess() {
+    backoff_ = INITIAL_BACKOFF;
+    if (++successes_ < SUCCESSES_BEFORE_INCREASE)
+        return;
+    successes_ = 0;
+    rate_ = std::min(std::min(max_rate_, ceiling_), rate_ * (1 + RATE_INCREASE));
+}
+
+void RateLimiter::OnThrottled() {
+    successes_ = 0;
+    // don't grow past 90% of the rate that got us throttled
+    ceiling_ = std::max(min_rate_, rate_ * 0.9);
+    rate_ = std::max(min_rate_, rate_ / 2);
+    // drop the tokens saved up at the old rate
+    tokens_ = 0;
+    last_refill_ = clock_.elapsed();
+    paused_until_ = last_refill_ + backoff_;
+    QLOG_WARN() << "Throttled, pausing requests for" << backoff_ / 1000.0 << "seconds, rate is now"
+        << rate_ << "requests per second.";
+    backoff_ = std::min(MAX_BACKOFF, backoff_ * 2);
+    if (running_) {
+        timer_->stop();
+        ScheduleNext();
+    }
+}
+
+bool RateLimiter::backing_off() const {
+    return paused_until_ > clock_.elapsed();
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+
+class QTimer;
+
+/*
+ * Token bucket that paces requests to a throttled endpoint.
+ * While started, Ready() is emitted every time a request may be sent.
+ * The rate is adjusted during the session: it slowly grows while requests
+ * succeed and is halved (with an exponentially growing pause) when the
+ * server tells us we're going too fast. The rate at which we got throttled
+ * becomes a ceiling so we don't keep running into the limit.
+ */
+class RateLimiter : public QObject {
+    Q_OBJECT
+public:
+    RateLimiter(double requests_per_second, int burst);
+    ~RateLimiter();
+    void Start();
+    void Stop();
+    void OnSuccess();
+    void OnThrottled();
+    bool backing_off() const;
+    double rate() const { return rate_; }
+signals:
+    void Ready();
+private slots:
+    void OnTimer();
+private:
+    void Refill();
+    void ScheduleNext();
+
+    QTimer *timer_;
+    QElapsedTimer clock_;
+    // requests per second
+    double rate_, min_rate_, max_rate_, ceiling_;
+    double tokens_;
+    int burst_;
+    qint64 last_refill_;
+    // no requests are sent until this time (in clock_ milliseconds)
+    qint64 paused_until_;
+    int backoff_;
+    int successes_;
+    bool running_;
+};
@@ -20,14 +20,43 @@
 #include "filters.h"
 #include "search.h"
 #include "column.h"
+#include "itemsdelta.h"
+#include "itemsindex.h"
+#include "perfstats.h"
+#include "rangekernels.h"
 
+#include <algorithm>
 #include <iostream>
+#include <QFuture>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
+// rows per task of FilterMany, a multiple of the 64 rows in a bitmap word
+const size_t FILTER_CHUNK_ROWS = 64 * 256;
+// FilterAll only checks the rows still selected once at most 1/PLAN_SUBSET_SHARE are left
+const size_t PLAN_SUBSET_SHARE = 2;
+// ApplyDelta gives up once more than 1/DELTA_MAX_DIRTY_SHARE of the rows are dirty
+const size_t DELTA_MAX_DIRTY_SHARE = 4;
+
+// Moves bits of a bitmap over the previous index to the rows they have now
+static Bitmap RemapRows(const Bitmap &previous, const ItemsDelta &delta) {
+    Bitmap result(delta.previous_rows.size());
+    for (size_t row = 0; row < delta.previous_rows.size(); ++row) {
+        int from = delta.previous_rows[row];
+        if (from >= 0 && previous.Test(from))
+            result.Set(row);
+    }
+    return result;
+}
 
 Search::Search(std::string caption, std::vector<Filter*> filters):
     caption_(caption),
+    selection_index_id_(0),
     model_(new ItemsModel(0, this))
 {
     columns_ = {
+        new IconColumn,
         new NameColumn,
         new PropertyColumn("Q", "Quality"),
         new PropertyColumn("Stack", "Stack Size"),
@@ -64,6 +93,15 @@ void Search::FromForm() {
         filter->FromForm();
 }
 
+void Search::Refresh() {
+    for (auto filter : filters_)
+        filter->Refresh();
+}
+
+void Search::AddColumn(Column *column) {
+    columns_.push_back(column);
+}
+
 void Search::ToForm() {
     for (auto filter : filters_)
         filter->ToForm();
@@ -74,16 +112,271 @@ void Search::ResetForm() {
         filter->filter()->ResetForm();
 }
 
-void Search::FilterItems(const Items &items) {
-    items_.clear();
-    for (auto item : items) {
-        bool matches = true;
-        for (auto filter : filters_)
-            if (!filter->Matches(item)) {
-                matches = false;
-                break;
+void Search::FilterItems(const ItemsIndex &index) {
+    PerfTimer timer("Search::FilterItems");
+    std::atomic<bool> cancel(false);
+    SearchResult result;
+    Run(index, data(), cancel, &result);
+    SetItems(std::move(result));
+}
+
+std::vector<FilterData> Search::data() const {
+    std::vector<FilterData> result;
+    for (auto filter : filters_)
+        result.push_back(*filter);
+    return result;
+}
+
+void Search::SetItems(SearchResult result) {
+    PerfTimer timer("Search::SetItems");
+    items_ = std::move(result.items);
+    selection_ = std::move(result.selection);
+    selection_index_id_ = result.index_id;
+    model_->SetItems(items_);
+}
+
+bool Search::Run(const ItemsIndex &index, const std::vector<FilterData> &snapshot,
+                 const std::atomic<bool> &cancel, SearchResult *result) {
+    QMutexLocker locker(&run_mutex_);
+    PerfTimer timer("Search::Run");
+    // works on copies so that a cancelled pass doesn't leave half-updated caches
+    std::vector<FilterData> data = snapshot;
+    Cache cache = cache_;
+    if (index.id() != cache.index_id || cache.last_data.size() != data.size()) {
+        if (!FilterAll(index, data, cancel, &cache))
+            return false;
+    } else {
+        std::vector<size_t> changed;
+        for (size_t i = 0; i < data.size(); ++i)
+            if (!data[i].SameAs(cache.last_data[i]))
+                changed.push_back(i);
+
+        bool narrowing = true;
+        for (auto i : changed)
+            narrowing = narrowing && data[i].Narrows(cache.last_data[i]);
+
+        if (changed.empty()) {
+            // nothing to do
+        } else if (narrowing) {
+            // e.g. a larger min or a longer name: only previous results can still match
+            for (auto i : changed) {
+                if (cancel)
+                    return false;
+                Bitmap matches(index.size());
+                data[i].EvaluateSubset(index, cache.selection, &matches);
+                cache.selection = matches;
+                cache.exact[i] = false;
+            }
+        } else {
+            for (auto i : changed) {
+                cache.matches[i] = Bitmap();
+                cache.exact[i] = false;
+            }
+            cache.selection = Bitmap(index.size(), true);
+            for (size_t i = 0; i < data.size(); ++i) {
+                if (!data[i].IsActive())
+                    continue;
+                if (cancel)
+                    return false;
+                RefineMatches(index, data[i], i, &cache);
+                cache.selection.And(cache.matches[i]);
             }
-        if (matches)
-            items_.push_back(item);
+        }
+        for (auto i : changed)
+            cache.last_data[i] = data[i];
     }
+    if (cancel)
+        return false;
+    result->items = index.Select(cache.selection);
+    result->selection = cache.selection;
+    result->index_id = index.id();
+    cache_ = std::move(cache);
+    return true;
+}
+
+void Search::PrepareAll(const ItemsIndex &index, std::vector<FilterData> &data, Cache *cache,
+                        std::vector<RangeQuery> *queries, std::vector<size_t> *others) {
+    cache->index_id = index.id();
+    cache->last_data = data;
+    cache->matches.assign(data.size(), Bitmap());
+    cache->exact.assign(data.size(), false);
+    cache->selection = Bitmap(index.size(), true);
+
+    // range filters go through the vectorized kernel in one pass, the rest one by one
+    std::vector<std::pair<double, RangeQuery>> ranges;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (!data[i].IsActive())
+            continue;
+        RangeQuery query;
+        if (!data[i].ToRangeQuery(index, &query)) {
+            others->push_back(i);
+            continue;
+        }
+        if (query.column < 0) {
+            // values from outside of the index have no histogram, they're checked last
+            ranges.push_back(std::make_pair(1.0, query));
+            continue;
+        }
+        // e.g. a min below every item's value
+        if (index.MatchesAll(query.column, query.min, query.max))
+            continue;
+        ranges.push_back(std::make_pair(index.Selectivity(query.column, query.min, query.max), query));
+    }
+    // the kernel stops on a block once it's empty, so the query most likely to empty it goes first
+    std::stable_sort(ranges.begin(), ranges.end(),
+        [](const std::pair<double, RangeQuery> &a, const std::pair<double, RangeQuery> &b) {
+            return a.first < b.first;
+        });
+    for (auto &range : ranges)
+        queries->push_back(range.second);
+    std::stable_partition(others->begin(), others->end(), [&data](size_t i) { return data[i].IndexDriven(); });
+}
+
+bool Search::FilterAll(const ItemsIndex &index, std::vector<FilterData> &data,
+                       const std::atomic<bool> &cancel, Cache *cache) {
+    std::vector<RangeQuery> queries;
+    std::vector<size_t> others;
+    PrepareAll(index, data, cache, &queries, &others);
+    if (!queries.empty())
+        EvaluateRanges(queries, index.size(), &cache->selection);
+    for (auto i : others) {
+        if (cancel)
+            return false;
+        cache->matches[i] = Bitmap(index.size());
+        if (!data[i].IndexDriven() && cache->selection.Count() * PLAN_SUBSET_SHARE <= index.size()) {
+            // only rows that passed everything so far are checked, the rest is
+            // kept as possible matches so that matches[i] stays a superset
+            data[i].EvaluateSubset(index, cache->selection, &cache->matches[i]);
+            Bitmap unchecked = cache->selection;
+            unchecked.Invert();
+            cache->matches[i].Or(unchecked);
+            cache->exact[i] = false;
+        } else {
+            // these are the expensive ones, keep their results around
+            data[i].Evaluate(index, &cache->matches[i]);
+            cache->exact[i] = true;
+        }
+        cache->selection.And(cache->matches[i]);
+    }
+    return true;
+}
+
+void Search::FilterMany(const ItemsIndex &index, const std::vector<Search*> &searches) {
+    struct Job {
+        std::vector<FilterData> data;
+        Cache cache;
+        std::vector<RangeQuery> queries;
+        std::vector<size_t> others;
+    };
+    std::vector<std::unique_ptr<QMutexLocker>> locks;
+    std::vector<Job> jobs(searches.size());
+    // (job, filter) pairs for filters that aren't range checks
+    std::vector<std::pair<size_t, size_t>> filter_tasks;
+    for (size_t j = 0; j < searches.size(); ++j) {
+        locks.emplace_back(new QMutexLocker(&searches[j]->run_mutex_));
+        Job &job = jobs[j];
+        job.data = searches[j]->data();
+        PrepareAll(index, job.data, &job.cache, &job.queries, &job.others);
+        for (auto i : job.others) {
+            job.cache.matches[i] = Bitmap(index.size());
+            filter_tasks.push_back(std::make_pair(j, i));
+        }
+    }
+
+    // Tasks are claimed from a shared counter so a thread that's done early
+    // keeps taking work. Whole-index filters go first as they're the longest.
+    size_t chunks = (index.size() + FILTER_CHUNK_ROWS - 1) / FILTER_CHUNK_ROWS;
+    size_t total = filter_tasks.size() + chunks;
+    std::atomic<size_t> next_task(0);
+    auto work = [&]() {
+        for (size_t task; (task = next_task++) < total;) {
+            if (task < filter_tasks.size()) {
+                Job &job = jobs[filter_tasks[task].first];
+                size_t i = filter_tasks[task].second;
+                job.data[i].Evaluate(index, &job.cache.matches[i]);
+                continue;
+            }
+            size_t begin = (task - filter_tasks.size()) * FILTER_CHUNK_ROWS;
+            size_t end = std::min(begin + FILTER_CHUNK_ROWS, index.size());
+            for (auto &job : jobs)
+                if (!job.queries.empty())
+                    EvaluateRanges(job.queries, begin, end, &job.cache.selection);
+        }
+    };
+    int threads = std::min<size_t>(std::max(QThread::idealThreadCount(), 1), total);
+    std::vector<QFuture<void>> helpers;
+    for (int t = 1; t < threads; ++t)
+        helpers.push_back(QtConcurrent::run(work));
+    work();
+    for (auto &helper : helpers)
+        helper.waitForFinished();
+
+    for (size_t j = 0; j < searches.size(); ++j) {
+        Job &job = jobs[j];
+        for (auto i : job.others) {
+            job.cache.exact[i] = true;
+            job.cache.selection.And(job.cache.matches[i]);
+        }
+        SearchResult result;
+        result.items = index.Select(job.cache.selection);
+        result.selection = job.cache.selection;
+        result.index_id = index.id();
+        searches[j]->cache_ = std::move(job.cache);
+        searches[j]->SetItems(std::move(result));
+    }
+}
+
+bool Search::ApplyDelta(const ItemsIndex &index, const ItemsDelta &delta) {
+    QMutexLocker locker(&run_mutex_);
+    if (cache_.index_id != delta.previous_index_id || index.id() != delta.index_id
+            || cache_.last_data.size() != filters_.size()
+            || delta.dirty.Count() * DELTA_MAX_DIRTY_SHARE > index.size())
+        return false;
+    // the form was edited after the last pass, that needs a pass of its own
+    for (size_t i = 0; i < filters_.size(); ++i)
+        if (!filters_[i]->SameAs(cache_.last_data[i]))
+            return false;
+    PerfTimer timer("Search::ApplyDelta");
+
+    Cache cache;
+    cache.index_id = index.id();
+    cache.last_data = cache_.last_data;
+    cache.exact = cache_.exact;
+    cache.matches.resize(cache.last_data.size());
+    // dirty rows that passed every active filter so far
+    Bitmap fresh = delta.dirty;
+    for (size_t i = 0; i < cache.last_data.size(); ++i) {
+        FilterData &data = cache.last_data[i];
+        if (!data.IsActive())
+            continue;
+        Bitmap matches(index.size());
+        data.EvaluateSubset(index, delta.dirty, &matches);
+        if (cache_.matches[i].size() != 0) {
+            cache.matches[i] = RemapRows(cache_.matches[i], delta);
+            cache.matches[i].Or(matches);
+        }
+        fresh.And(matches);
+    }
+    cache.selection = RemapRows(cache_.selection, delta);
+    cache.selection.Or(fresh);
+
+    SearchResult result;
+    result.items = index.Select(cache.selection);
+    result.selection = cache.selection;
+    result.index_id = index.id();
+    cache_ = std::move(cache);
+    SetItems(std::move(result));
+    return true;
+}
+
+void Search::RefineMatches(const ItemsIndex &index, FilterData &data, size_t i, Cache *cache) {
+    if (cache->exact[i])
+        return;
+    Bitmap matches(index.size());
+    if (cache->matches[i].size() == index.size())
+        data.EvaluateSubset(index, cache->matches[i], &matches);
+    else
+        data.Evaluate(index, &matches);
+    cache->matches[i] = matches;
+    cache->exact[i] = true;
 }
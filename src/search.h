@@ -19,31 +19,96 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <vector>
+#include <QMutex>
 
+#include "bitmap.h"
 #include "item.h"
 
 class Filter;
 class FilterData;
+class ItemsIndex;
 class ItemsModel;
+struct ItemsDelta;
+struct RangeQuery;
+
+// Outcome of a filtering pass, handed from Run to SetItems
+struct SearchResult {
+    Items items;
+    // the same items as a bit per row of the index they came from
+    Bitmap selection;
+    unsigned long long index_id = 0;
+};
 
 class Search {
 public:
     explicit Search(std::string caption, std::vector<Filter*> filters);
     ~Search();
-    void FilterItems(const Items &items);
+    // Filters with the current form data and shows the result right away
+    void FilterItems(const ItemsIndex &index);
+    // Copy of the data last read with FromForm, for Run
+    std::vector<FilterData> data() const;
+    // Thread-safe part of FilterItems, can run on a worker thread while the
+    // GUI keeps editing the form. Returns false if cancel got set, the
+    // incremental caches are left as they were then.
+    bool Run(const ItemsIndex &index, const std::vector<FilterData> &data,
+             const std::atomic<bool> &cancel, SearchResult *result);
+    // GUI thread only, model() merges the change into its rows
+    void SetItems(SearchResult result);
+    // FilterItems for many searches over a new index at once. Rows are split
+    // in chunks that pool threads pick up one by one, and each chunk is range
+    // checked for all searches while it's hot in cache.
+    static void FilterMany(const ItemsIndex &index, const std::vector<Search*> &searches);
+    // Moves the last results over to index, which is the previous index
+    // changed by delta, and filters only the dirty rows. GUI thread only;
+    // returns false if the caches don't fit, FilterItems is needed then.
+    bool ApplyDelta(const ItemsIndex &index, const ItemsDelta &delta);
     void FromForm();
     void ToForm();
     void ResetForm();
+    // Filter::Refresh for every filter, GUI thread only
+    void Refresh();
+    // Takes ownership, for columns that need more than the item (e.g. buyouts)
+    void AddColumn(Column *column);
     const std::string &caption() const { return caption_; }
     const Items &items() const { return items_; }
+    // items() as rows of the index with selection_index_id(), GUI thread only
+    const Bitmap &selection() const { return selection_; }
+    unsigned long long selection_index_id() const { return selection_index_id_; }
     const std::vector<Column*> &columns() const { return columns_; }
     ItemsModel *model() const { return model_; }
 private:
+    // Per filter caches to re-filter incrementally when the form changes.
+    // matches[i] is a superset of what filter i matches, exactly that set
+    // if exact[i]; an empty bitmap stands for all items.
+    struct Cache {
+        unsigned long long index_id = 0;
+        std::vector<FilterData> last_data;
+        std::vector<Bitmap> matches;
+        std::vector<bool> exact;
+        // bit per item of the last filtered index
+        Bitmap selection;
+    };
+    static bool FilterAll(const ItemsIndex &index, std::vector<FilterData> &data,
+                          const std::atomic<bool> &cancel, Cache *cache);
+    // Resets cache for index and plans the active filters: range queries that
+    // leave something out, most selective first, then the rest with filters
+    // that go through an index ahead of the ones that look at every row
+    static void PrepareAll(const ItemsIndex &index, std::vector<FilterData> &data, Cache *cache,
+                           std::vector<RangeQuery> *queries, std::vector<size_t> *others);
+    // Makes cache->matches[i] exact for data[i]
+    static void RefineMatches(const ItemsIndex &index, FilterData &data, size_t i, Cache *cache);
+
     std::vector<FilterData*> filters_;
     std::vector<Column*> columns_;
     std::string caption_;
     Items items_;
+    Bitmap selection_;
+    unsigned long long selection_index_id_;
+    // held for the duration of Run, passes of one search don't overlap
+    QMutex run_mutex_;
+    Cache cache_;
     ItemsModel *model_;
 };
@@ -0,0 +1,127 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchrunner.h"
+
+#include <QtConcurrent/QtConcurrentRun>
+#include "QsLog.h"
+
+#include "itemsindex.h"
+#include "search.h"
+
+// quiet period after the last keystroke before a pass starts
+const int SEARCH_DEBOUNCE_MS = 150;
+
+SearchRunner::SearchRunner(QObject *parent):
+    QObject(parent),
+    cancel_(false),
+    pending_search_(nullptr),
+    running_search_(nullptr)
+{
+    timer_.setSingleShot(true);
+    timer_.setInterval(SEARCH_DEBOUNCE_MS);
+    connect(&timer_, SIGNAL(timeout()), this, SLOT(OnTimer()));
+    connect(&watcher_, SIGNAL(finished()), this, SLOT(OnPassFinished()));
+}
+
+SearchRunner::~SearchRunner() {
+    cancel_ = true;
+    watcher_.waitForFinished();
+}
+
+void SearchRunner::Queue(Search *search, const std::shared_ptr<const ItemsIndex> &index) {
+    pending_search_ = search;
+    pending_index_ = index;
+    pending_data_ = search->data();
+    // whatever is running now is already stale
+    if (running_search_)
+        cancel_ = true;
+}
+
+void SearchRunner::Schedule(Search *search, const std::shared_ptr<const ItemsIndex> &index) {
+    Queue(search, index);
+    timer_.start();
+}
+
+void SearchRunner::RunNow(Search *search, const std::shared_ptr<const ItemsIndex> &index) {
+    Queue(search, index);
+    timer_.stop();
+    OnTimer();
+}
+
+void SearchRunner::Forget(Search *search) {
+    if (pending_search_ == search) {
+        pending_search_ = nullptr;
+        pending_index_.reset();
+        pending_data_.clear();
+    }
+    if (running_search_ == search) {
+        cancel_ = true;
+        watcher_.waitForFinished();
+        // OnPassFinished may still arrive, it'll see there's nothing to deliver
+        running_search_ = nullptr;
+        running_index_.reset();
+        running_result_ = SearchResult();
+    }
+}
+
+void SearchRunner::OnTimer() {
+    // otherwise OnPassFinished starts the pending pass
+    if (!running_search_)
+        Start();
+}
+
+void SearchRunner::Start() {
+    if (!pending_search_)
+        return;
+    running_search_ = pending_search_;
+    running_index_ = pending_index_;
+    std::vector<FilterData> data;
+    data.swap(pending_data_);
+    pending_search_ = nullptr;
+    pending_index_.reset();
+    cancel_ = false;
+
+    Search *search = running_search_;
+    const ItemsIndex *index = running_index_.get();
+    SearchResult *result = &running_result_;
+    std::atomic<bool> *cancel = &cancel_;
+    watcher_.setFuture(QtConcurrent::run([=]() {
+        return search->Run(*index, data, *cancel, result);
+    }));
+}
+
+void SearchRunner::OnPassFinished() {
+    // a late signal of a future that was replaced since
+    if (!watcher_.isFinished())
+        return;
+    Search *search = running_search_;
+    running_search_ = nullptr;
+    running_index_.reset();
+    SearchResult result = std::move(running_result_);
+    running_result_ = SearchResult();
+    if (search && watcher_.result()) {
+        search->SetItems(std::move(result));
+        emit Finished(search);
+    } else if (search) {
+        QLOG_DEBUG() << "Search pass cancelled";
+    }
+    if (pending_search_ && !timer_.isActive())
+        Start();
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QTimer>
+
+#include "filters.h"
+#include "item.h"
+#include "search.h"
+
+class ItemsIndex;
+
+/*
+ * Runs Search passes on a worker thread. Form edits are debounced, a newer
+ * edit cancels the pass that is in flight and at most one more pass is kept
+ * waiting, so fast typing never piles up stale work. Results are swapped into
+ * the search's model on the GUI thread once a pass completes.
+ */
+class SearchRunner : public QObject {
+    Q_OBJECT
+public:
+    explicit SearchRunner(QObject *parent = 0);
+    ~SearchRunner();
+    // Filters search with its current form data after a short quiet period
+    void Schedule(Search *search, const std::shared_ptr<const ItemsIndex> &index);
+    // Same but without the delay, e.g. for tab switches and item refreshes
+    void RunNow(Search *search, const std::shared_ptr<const ItemsIndex> &index);
+    // Drops queued work for search and waits for its pass, call before deleting it
+    void Forget(Search *search);
+signals:
+    void Finished(Search *search);
+private slots:
+    void OnTimer();
+    void OnPassFinished();
+private:
+    void Queue(Search *search, const std::shared_ptr<const ItemsIndex> &index);
+    void Start();
+
+    QTimer timer_;
+    QFutureWatcher<bool> watcher_;
+    std::atomic<bool> cancel_;
+    Search *pending_search_;
+    std::shared_ptr<const ItemsIndex> pending_index_;
+    std::vector<FilterData> pending_data_;
+    // the index is kept alive until the pass is done with it
+    Search *running_search_;
+    std::shared_ptr<const ItemsIndex> running_index_;
+    SearchResult running_result_;
+};
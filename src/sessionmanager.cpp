@@ -0,0 +1,104 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sessionmanager.h"
+
+#include <QNetworkAccessManager>
+#include "QsLog.h"
+
+#include "imagecache.h"
+#include "itemicons.h"
+#include "logindialog.h"
+#include "mainwindow.h"
+
+SessionManager::SessionManager(const std::string &root_dir):
+    root_dir_(root_dir),
+    image_cache_(new ImageCache(root_dir + "/cache")),
+    item_icons_(new ItemIcons)
+{}
+
+SessionManager::~SessionManager() {
+    // windows closed right before quitting may not have been deleted yet
+    auto sessions = sessions_;
+    sessions_.clear();
+    for (auto &session : sessions) {
+        disconnect(session.second, SIGNAL(destroyed(QObject*)), this, SLOT(OnSessionDestroyed(QObject*)));
+        delete session.second;
+    }
+    for (auto &network_manager : network_managers_)
+        delete network_manager.second;
+    delete item_icons_;
+    delete image_cache_;
+}
+
+MainWindow *SessionManager::Open(QNetworkAccessManager *network_manager, const std::string &league,
+                                 const std::string &email) {
+    MainWindow *window = Show(network_manager, league, email, false);
+    window->SetLoggedIn();
+    return window;
+}
+
+MainWindow *SessionManager::Prepare(QNetworkAccessManager *network_manager, const std::string &league,
+                                    const std::string &email) {
+    return Show(network_manager, league, email, true);
+}
+
+MainWindow *SessionManager::Show(QNetworkAccessManager *network_manager, const std::string &league,
+                                 const std::string &email, bool logging_in) {
+    auto account = network_managers_.find(email);
+    if (account == network_managers_.end()) {
+        account = network_managers_.insert(std::make_pair(email, network_manager)).first;
+    } else if (account->second != network_manager && !logging_in) {
+        // the reply that finished the login still belongs to it
+        network_manager->deleteLater();
+    }
+
+    std::string key = email + "|" + league;
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) {
+        QLOG_INFO() << "Session for" << league.c_str() << "is already open";
+        it->second->show();
+        it->second->raise();
+        it->second->activateWindow();
+        return it->second;
+    }
+
+    QLOG_INFO() << "Opening session for" << league.c_str() << "," << sessions_.size() << "already open";
+    MainWindow *window = new MainWindow(0, this, account->second, league, email);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    connect(window, SIGNAL(destroyed(QObject*)), this, SLOT(OnSessionDestroyed(QObject*)));
+    sessions_[key] = window;
+    window->show();
+    return window;
+}
+
+void SessionManager::ShowLogin() {
+    LoginDialog *login = new LoginDialog(this);
+    login->setAttribute(Qt::WA_DeleteOnClose);
+    login->show();
+}
+
+void SessionManager::OnSessionDestroyed(QObject *window) {
+    for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+        if (it->second == window) {
+            sessions_.erase(it);
+            return;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QObject>
+#include <map>
+#include <string>
+
+class ImageCache;
+class ItemIcons;
+class MainWindow;
+class QNetworkAccessManager;
+
+/*
+ * Hosts every session (a MainWindow with its own DataManager and
+ * ItemsManager for one account and league) running in this process and owns
+ * what they share: the icon cache with its downloads, composited icons and
+ * the logged in network manager of each account. Item strings are interned
+ * process-wide by stringpool. Every ItemsManager keeps its own rate limiter.
+ */
+class SessionManager : public QObject {
+    Q_OBJECT
+public:
+    explicit SessionManager(const std::string &root_dir);
+    ~SessionManager();
+    SessionManager(const SessionManager&) = delete;
+    SessionManager& operator=(const SessionManager&) = delete;
+    // Opens a session or brings up the window if it's already open.
+    // Takes ownership of network_manager, accounts that are already logged in keep their old one.
+    MainWindow *Open(QNetworkAccessManager *network_manager, const std::string &league, const std::string &email);
+    // Opens the session while network_manager is still logging in, the window shows saved items
+    // until Open is called with the same arguments. Ownership is taken the same way as in Open.
+    MainWindow *Prepare(QNetworkAccessManager *network_manager, const std::string &league, const std::string &email);
+    // Shows a login dialog for one more session
+    void ShowLogin();
+    ImageCache *image_cache() const { return image_cache_; }
+    ItemIcons *item_icons() const { return item_icons_; }
+    const std::string &root_dir() const { return root_dir_; }
+private slots:
+    void OnSessionDestroyed(QObject *window);
+private:
+    // Finds or creates the window of the session, it's not logged in if it was just created.
+    // network_manager is only released once logging_in is over, the login dialog still uses it.
+    MainWindow *Show(QNetworkAccessManager *network_manager, const std::string &league, const std::string &email,
+                     bool logging_in);
+    std::string root_dir_;
+    ImageCache *image_cache_;
+    ItemIcons *item_icons_;
+    // email -> network manager that has the login cookies
+    std::map<std::string, QNetworkAccessManager*> network_managers_;
+    // "email|league" -> window
+    std::map<std::string, MainWindow*> sessions_;
+};
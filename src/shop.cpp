@@ -19,52 +19,177 @@
 
 #include "shop.h"
 
-#include "mainwindow.h"
+#include "application.h"
 #include "datamanager.h"
 #include "buyoutmanager.h"
 
 #include <QApplication>
 #include <QClipboard>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QUrl>
+#include <algorithm>
+#include <utility>
+#include "QsLog.h"
 
-Shop::Shop(MainWindow *app):
+#include "hash128.h"
+#include "itemsindex.h"
+
+const char *POE_EDIT_THREAD = "https://www.pathofexile.com/forum/edit-thread/";
+
+// forum posts can't be longer than this
+const size_t SHOP_POST_MAX_SIZE = 50000;
+// buyout edits that come within this many milliseconds of each other are submitted together
+const int SHOP_SUBMIT_DELAY = 30 * 1000;
+// but a stream of edits doesn't hold the submission back for longer than this
+const int SHOP_SUBMIT_MAX_DELAY = 3 * 60 * 1000;
+// minimum time between two submissions of the thread
+const int SHOP_SUBMIT_INTERVAL = 2 * 60 * 1000;
+
+namespace {
+
+// Value of the input with the given name attribute, "" if the page doesn't have it
+std::string FormValue(const std::string &page, const std::string &name) {
+    std::string needle = "name=\"" + name + "\"";
+    size_t pos = page.find(needle);
+    if (pos == std::string::npos)
+        return "";
+    size_t tag_end = page.find('>', pos);
+    std::string value = "value=\"";
+    pos = page.find(value, pos);
+    if (pos == std::string::npos || pos > tag_end)
+        return "";
+    pos += value.size();
+    size_t end = page.find('"', pos);
+    if (end == std::string::npos)
+        return "";
+    return page.substr(pos, end - pos);
+}
+
+// attribute values on the page are HTML-escaped
+std::string Unescape(std::string s) {
+    const std::pair<std::string, std::string> entities[] = {
+        { "&quot;", "\"" }, { "&#039;", "'" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&amp;", "&" }
+    };
+    for (auto &entity : entities) {
+        size_t pos = 0;
+        while ((pos = s.find(entity.first, pos)) != std::string::npos) {
+            s.replace(pos, entity.first.size(), entity.second);
+            pos += entity.second.size();
+        }
+    }
+    return s;
+}
+
+QByteArray FormField(const std::string &name, const std::string &value) {
+    return QByteArray(name.c_str()) + "=" + QUrl::toPercentEncoding(QString::fromUtf8(value.c_str()));
+}
+
+}
+
+Shop::Shop(Application *app):
     app_(app),
-    shop_data_outdated_(true)
+    shop_data_outdated_(true),
+    submitting_(false),
+    resubmit_(false)
 {
     thread_ = app_->data_manager()->Get("shop");
+    submitted_hash_ = app_->data_manager()->Get("shop_hash");
+    submit_timer_.setSingleShot(true);
+    connect(&submit_timer_, SIGNAL(timeout()), this, SLOT(OnSubmitTimer()));
 }
 
 void Shop::SetThread(const std::string &thread) {
+    if (thread == thread_)
+        return;
     thread_ = thread;
     app_->data_manager()->Set("shop", thread);
+    // the new thread has to get the shop even if it didn't change
+    submitted_hash_.clear();
+    app_->data_manager()->Set("shop_hash", "");
+    SubmitShopToForum();
+}
+
+HashKey Shop::FragmentKey(const Item &item) {
+    Hasher128 hasher;
+    hasher.AddInt(item.hash_key().hi);
+    hasher.AddInt(item.hash_key().lo);
+    hasher.AddInt(item.tab());
+    hasher.AddInt(item.x());
+    hasher.AddInt(item.y());
+    return hasher.Digest();
+}
+
+std::string Shop::RenderFragment(const Item &item, const Buyout &bo, const std::string &league) {
+    std::string data = "[linkItem location=\"Stash" + std::to_string(item.tab() + 1)
+          + "\" league=\"" + league + "\" x=\""
+          + std::to_string(item.x()) + "\" y=\"" + std::to_string(item.y()) + "\"]";
+
+    if (bo.type == BUYOUT_TYPE_BUYOUT)
+        data += " ~b/o ";
+    else if (bo.type == BUYOUT_TYPE_FIXED)
+        data += " ~price ";
+    data += QString::number(bo.value).toUtf8().constData();
+    data += " " + CurrencyAsTag[bo.currency];
+    return data;
 }
 
 void Shop::Update(bool submit) {
+    // no items until the first ItemsRefreshed, e.g. while the snapshot is still being decoded
+    if (!app_->items_index()) {
+        shop_data_outdated_ = true;
+        return;
+    }
     shop_data_outdated_ = false;
 
-    std::string data;
-    for (auto &item : app_->items()) {
-        Buyout bo;
-        bo.type = BUYOUT_TYPE_NONE;
-        if (app_->buyout_manager()->ExistsTab(item->tab_caption()))
-            bo = app_->buyout_manager()->GetTab(item->tab_caption());
-        if (app_->buyout_manager()->Exists(*item))
-            bo = app_->buyout_manager()->Get(*item);
+    const ItemsIndex &index = *app_->items_index();
+    const std::vector<Buyout> &buyouts = app_->buyout_manager()->ResolveAll(index);
+    HashKeyMap<Fragment> fragments;
+    // listed items in index order, text is looked up once the map stops growing
+    std::vector<HashKey> keys;
+    size_t size = 0;
+    int rendered = 0;
+    for (size_t i = 0; i < index.size(); ++i) {
+        const Buyout &bo = buyouts[i];
         if (bo.type == BUYOUT_TYPE_NONE)
             continue;
-
-        data += "[linkItem location=\"Stash" + std::to_string(item->tab() + 1)
-              + "\" league=\"" + app_->league() + "\" x=\""
-              + std::to_string(item->x()) + "\" y=\"" + std::to_string(item->y()) + "\"]";
-
-        if (bo.type == BUYOUT_TYPE_BUYOUT)
-            data += " ~b/o ";
-        else if (bo.type == BUYOUT_TYPE_FIXED)
-            data += " ~price ";
-        data += QString::number(bo.value).toUtf8().constData();
-        data += " " + CurrencyAsTag[bo.currency];
+        const Item &item = *index.item(i);
+        // forum shops can only link items in the stash
+        if (item.in_character())
+            continue;
+        HashKey key = FragmentKey(item);
+        // the same item can't be listed twice
+        if (fragments.Contains(key))
+            continue;
+        const Fragment *cached = fragments_.Find(key);
+        if (cached && cached->buyout.type == bo.type && cached->buyout.currency == bo.currency
+                && cached->buyout.value == bo.value) {
+            fragments.Set(key, *cached);
+            size += cached->text.size();
+        } else {
+            Fragment fragment = { bo, RenderFragment(item, bo, app_->league()) };
+            size += fragment.text.size();
+            fragments.Set(key, fragment);
+            ++rendered;
+        }
+        keys.push_back(key);
     }
+    // fragments of items that are gone or repriced are dropped here
+    fragments_ = std::move(fragments);
 
-    shop_data_ = data;
+    shop_data_.clear();
+    shop_data_.reserve(size);
+    posts_.clear();
+    posts_.push_back(std::string());
+    for (auto &key : keys) {
+        const std::string &text = fragments_.Find(key)->text;
+        shop_data_ += text;
+        if (!posts_.back().empty() && posts_.back().size() + text.size() > SHOP_POST_MAX_SIZE)
+            posts_.push_back(std::string());
+        posts_.back() += text;
+    }
+    QLOG_DEBUG() << "Shop updated," << rendered << "of" << keys.size() << "items rendered," << posts_.size() << "posts.";
 
     if (submit)
         SubmitShopToForum();
@@ -72,18 +197,117 @@ void Shop::Update(bool submit) {
 
 void Shop::ExpireShopData() {
     shop_data_outdated_ = true;
+    SubmitShopToForum();
 }
 
 void Shop::SubmitShopToForum() {
-    if (thread_.size() == 0)
+    if (thread_.empty())
+        return;
+    if (submitting_) {
+        resubmit_ = true;
+        return;
+    }
+
+    if (!submit_timer_.isActive())
+        pending_since_.start();
+    int delay = SHOP_SUBMIT_DELAY;
+    if (pending_since_.elapsed() + delay > SHOP_SUBMIT_MAX_DELAY)
+        delay = std::max<qint64>(0, SHOP_SUBMIT_MAX_DELAY - pending_since_.elapsed());
+    if (last_submit_.isValid())
+        delay = std::max<qint64>(delay, SHOP_SUBMIT_INTERVAL - last_submit_.elapsed());
+    submit_timer_.start(delay);
+}
+
+void Shop::OnSubmitTimer() {
+    if (thread_.empty() || submitting_)
+        return;
+    if (shop_data_outdated_)
+        Update();
+    // an empty shop would replace the thread, ItemsRefreshed submits it once there are items
+    if (shop_data_outdated_)
+        return;
+
+    // the thread only has the first post, the rest doesn't fit
+    std::string data = posts_.empty() ? "" : posts_.front();
+    if (posts_.size() > 1)
+        QLOG_WARN() << "Shop data doesn't fit in a single post, only" << data.size() << "of" << shop_data_.size() << "characters are submitted.";
+    Hasher128 hasher;
+    hasher.AddString(thread_);
+    hasher.AddString(data);
+    std::string hash = hasher.HexDigest();
+    if (hash == submitted_hash_) {
+        QLOG_DEBUG() << "Shop didn't change since the last submission, not submitting.";
+        return;
+    }
+
+    submitting_ = true;
+    resubmit_ = false;
+    submitting_hash_ = hash;
+    submitting_data_ = data;
+    QNetworkReply *edit_page = app_->logged_in_nm()->get(QNetworkRequest(QUrl((POE_EDIT_THREAD + thread_).c_str())));
+    connect(edit_page, SIGNAL(finished()), this, SLOT(OnEditPageFinished()));
+}
+
+void Shop::OnEditPageFinished() {
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
+    reply->deleteLater();
+    if (reply->error()) {
+        QLOG_ERROR() << "Failed to fetch the shop thread edit page:" << reply->errorString();
+        SubmitFinished();
+        return;
+    }
+    QByteArray bytes = reply->readAll();
+    std::string page(bytes.constData(), bytes.size());
+    std::string hash = FormValue(page, "hash");
+    if (hash.empty()) {
+        QLOG_ERROR() << "Can't submit the shop: no edit form in thread" << thread_.c_str() << "- is it yours?";
+        SubmitFinished();
+        return;
+    }
+
+    QByteArray data = FormField("title", Unescape(FormValue(page, "title")))
+        + "&" + FormField("content", submitting_data_)
+        + "&" + FormField("hash", hash)
+        + "&" + FormField("submit", "Submit");
+    QNetworkRequest request(QUrl((POE_EDIT_THREAD + thread_).c_str()));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    QNetworkReply *submitted = app_->logged_in_nm()->post(request, data);
+    connect(submitted, SIGNAL(finished()), this, SLOT(OnShopSubmitted()));
+}
+
+void Shop::OnShopSubmitted() {
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(QObject::sender());
+    reply->deleteLater();
+    QByteArray bytes = reply->readAll();
+    // on success the forum redirects to the thread, otherwise it shows the form again with errors
+    if (reply->error() || bytes.contains("class=\"errors\"")) {
+        QLOG_ERROR() << "Failed to submit the shop:" << reply->errorString();
+        SubmitFinished();
         return;
+    }
+    QLOG_INFO() << "Shop submitted to thread" << thread_.c_str();
+    submitted_hash_ = submitting_hash_;
+    app_->data_manager()->Set("shop_hash", submitted_hash_);
+    SubmitFinished();
+}
 
-    // TODO
+void Shop::SubmitFinished() {
+    submitting_ = false;
+    std::string().swap(submitting_data_);
+    // failed attempts count too, so that an error doesn't turn into a request storm
+    last_submit_.start();
+    // a failed submission is retried with the next change
+    if (resubmit_) {
+        resubmit_ = false;
+        SubmitShopToForum();
+    }
 }
 
 void Shop::CopyToClipboard() {
     if (shop_data_outdated_)
         Update();
+    if (shop_data_outdated_)
+        return;
 
     QClipboard *clipboard = QApplication::clipboard();
     clipboard->setText(QString(shop_data_.c_str()));
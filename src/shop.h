@@ -19,21 +19,68 @@
 
 #pragma once
 
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
 #include <string>
+#include <vector>
 
-class MainWindow;
+#include "buyoutmanager.h"
+#include "hashkeymap.h"
 
-class Shop {
+class Application;
+class Item;
+
+/*
+ * Builds the shop thread text from the priced items and keeps the forum
+ * thread up to date. Submissions are coalesced: every change restarts
+ * submit_timer_, and nothing is posted when the content is the same as
+ * in the last successful submission.
+ */
+class Shop : public QObject {
+    Q_OBJECT
 public:
-    explicit Shop(MainWindow *app);
+    explicit Shop(Application *app);
     void SetThread(const std::string &thread);
+    const std::string &thread() const { return thread_; }
     void Update(bool submit=false);
     void CopyToClipboard();
+    // Called when buyouts change, the thread is submitted once the edits settle
     void ExpireShopData();
+    // Shop data split so that every post fits in SHOP_POST_MAX_SIZE
+    const std::vector<std::string> &posts() const { return posts_; }
 private:
+    // Rendered [linkItem] of an item together with the buyout it was rendered for
+    struct Fragment {
+        Buyout buyout;
+        std::string text;
+    };
+    // item hash mixed with the item's location, which is part of the text
+    static HashKey FragmentKey(const Item &item);
+    static std::string RenderFragment(const Item &item, const Buyout &bo, const std::string &league);
     void SubmitShopToForum();
-    MainWindow *app_;
+    void SubmitFinished();
+    Application *app_;
     std::string thread_;
     std::string shop_data_;
+    std::vector<std::string> posts_;
+    // fragments of the last Update, only items whose key or buyout changed are rendered again
+    HashKeyMap<Fragment> fragments_;
     bool shop_data_outdated_;
+    QTimer submit_timer_;
+    // time since the first change that is still waiting for submit_timer_
+    QElapsedTimer pending_since_;
+    // time since the last successful submission
+    QElapsedTimer last_submit_;
+    // content hash of the last successfully submitted post
+    std::string submitted_hash_;
+    // hash and text of the submission in flight
+    std::string submitting_hash_, submitting_data_;
+    bool submitting_;
+    // something changed while a submission was in flight
+    bool resubmit_;
+private slots:
+    void OnSubmitTimer();
+    void OnEditPageFinished();
+    void OnShopSubmitted();
 };
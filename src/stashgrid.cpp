@@ -0,0 +1,115 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stashgrid.h"
+
+#include <QImage>
+#include <QPainter>
+#include <algorithm>
+
+#include "bitmap.h"
+#include "item.h"
+#include "itemsindex.h"
+
+const QColor STASH_BACKGROUND(0x0c, 0x0b, 0x0b);
+const QColor STASH_GRID(0x1e, 0x1c, 0x1a);
+const QColor STASH_ITEM(0x3a, 0x36, 0x30);
+const QColor STASH_ITEM_BORDER(0x6e, 0x64, 0x52);
+// premultiplied ARGB of the highlight over matched items
+const QRgb STASH_MATCH = qRgba(0x60, 0x58, 0x10, 0x80);
+const QColor STASH_SELECTED(Qt::red);
+
+StashGrid::StashGrid(int slot_size):
+    slot_size_(slot_size)
+{
+    empty_.cells.assign(INVENTORY_SLOTS * INVENTORY_SLOTS, -1);
+}
+
+void StashGrid::SetIndex(const std::shared_ptr<const ItemsIndex> &index) {
+    index_ = index;
+    tabs_.clear();
+    empty_.background = QPixmap();
+    for (size_t row = 0; row < index_->size(); ++row) {
+        const Item &item = *index_->item(row);
+        if (item.in_character())
+            continue;
+        TabLayout &layout = tabs_[item.tab()];
+        if (layout.cells.empty())
+            layout.cells.assign(INVENTORY_SLOTS * INVENTORY_SLOTS, -1);
+        layout.rows.push_back(row);
+        for (int y = std::max(item.y(), 0); y < std::min(item.y() + item.h(), INVENTORY_SLOTS); ++y)
+            for (int x = std::max(item.x(), 0); x < std::min(item.x() + item.w(), INVENTORY_SLOTS); ++x)
+                layout.cells[y * INVENTORY_SLOTS + x] = row;
+    }
+}
+
+int StashGrid::ItemAt(int tab, int x, int y) const {
+    if (x < 0 || y < 0 || x >= INVENTORY_SLOTS || y >= INVENTORY_SLOTS)
+        return -1;
+    auto it = tabs_.find(tab);
+    return it == tabs_.end() ? -1 : it->second.cells[y * INVENTORY_SLOTS + x];
+}
+
+void StashGrid::RenderBackground(TabLayout *layout) {
+    int size = INVENTORY_SLOTS * slot_size_;
+    layout->background = QPixmap(size, size);
+    layout->background.fill(STASH_BACKGROUND);
+    QPainter painter(&layout->background);
+    painter.setPen(STASH_GRID);
+    for (int i = 1; i < INVENTORY_SLOTS; ++i) {
+        painter.drawLine(i * slot_size_, 0, i * slot_size_, size);
+        painter.drawLine(0, i * slot_size_, size, i * slot_size_);
+    }
+    painter.setPen(STASH_ITEM_BORDER);
+    painter.setBrush(QBrush(STASH_ITEM));
+    for (auto row : layout->rows) {
+        const Item &item = *index_->item(row);
+        painter.drawRect(item.x() * slot_size_, item.y() * slot_size_,
+                         item.w() * slot_size_ - 1, item.h() * slot_size_ - 1);
+    }
+}
+
+QPixmap StashGrid::Render(int tab, const Bitmap &matches, unsigned long long matches_index_id, const Item *selected) {
+    auto it = tabs_.find(tab);
+    TabLayout &layout = it == tabs_.end() ? empty_ : it->second;
+    if (layout.background.isNull())
+        RenderBackground(&layout);
+
+    QPixmap pixmap = layout.background;
+    QPainter painter(&pixmap);
+    if (index_ && matches_index_id == index_->id() && matches.size() == index_->size()) {
+        // one pixel per slot, scaled up in a single blend
+        QImage mask(INVENTORY_SLOTS, INVENTORY_SLOTS, QImage::Format_ARGB32_Premultiplied);
+        for (int y = 0; y < INVENTORY_SLOTS; ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(mask.scanLine(y));
+            for (int x = 0; x < INVENTORY_SLOTS; ++x) {
+                int row = layout.cells[y * INVENTORY_SLOTS + x];
+                line[x] = (row >= 0 && matches.Test(row)) ? STASH_MATCH : 0;
+            }
+        }
+        painter.drawImage(pixmap.rect(), mask);
+    }
+    if (selected && selected->tab() == tab) {
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QBrush(STASH_SELECTED));
+        painter.drawRect(selected->x() * slot_size_, selected->y() * slot_size_,
+                         selected->w() * slot_size_, selected->h() * slot_size_);
+    }
+    return pixmap;
+}
@@ -0,0 +1,60 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QPixmap>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class Bitmap;
+class Item;
+class ItemsIndex;
+
+/*
+ * Renders a whole stash tab with all of its items. Which item covers which
+ * slot is worked out for every tab once per ItemsIndex, and the background
+ * with the item outlines is rendered once per tab. Search matches are
+ * blended over it as a single slot-sized mask, the selected item on top.
+ */
+class StashGrid {
+public:
+    explicit StashGrid(int slot_size);
+    void SetIndex(const std::shared_ptr<const ItemsIndex> &index);
+    // matches has a bit per row of the index with id matches_index_id, it's ignored for other indexes
+    QPixmap Render(int tab, const Bitmap &matches, unsigned long long matches_index_id, const Item *selected);
+    // Index row of the item that covers slot (x, y) of the tab, -1 if it's empty
+    int ItemAt(int tab, int x, int y) const;
+private:
+    struct TabLayout {
+        // index row covering each slot, INVENTORY_SLOTS * INVENTORY_SLOTS of them
+        std::vector<int> cells;
+        // items of the tab
+        std::vector<int> rows;
+        // null until the tab is rendered for the first time
+        QPixmap background;
+    };
+    void RenderBackground(TabLayout *layout);
+    std::shared_ptr<const ItemsIndex> index_;
+    std::unordered_map<int, TabLayout> tabs_;
+    // shown for tabs without items
+    TabLayout empty_;
+    int slot_size_;
+};
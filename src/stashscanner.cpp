@@ -0,0 +1,139 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stashscanner.h"
+
+StashScanner::StashScanner(const char *data, size_t size):
+    p_(data),
+    end_(data + size),
+    has_error_(false)
+{}
+
+void StashScanner::SkipSpace() {
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+        ++p_;
+}
+
+bool StashScanner::Consume(char c) {
+    SkipSpace();
+    if (p_ == end_ || *p_ != c)
+        return false;
+    ++p_;
+    return true;
+}
+
+bool StashScanner::ReadString(std::string *value) {
+    const char *begin = p_ + 1;
+    if (!SkipString())
+        return false;
+    value->assign(begin, p_ - 1);
+    return true;
+}
+
+bool StashScanner::SkipString() {
+    if (p_ == end_ || *p_ != '"')
+        return false;
+    for (++p_; p_ < end_; ++p_) {
+        if (*p_ == '\\')
+            ++p_;
+        else if (*p_ == '"') {
+            ++p_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool StashScanner::SkipValue() {
+    SkipSpace();
+    if (p_ == end_)
+        return false;
+    if (*p_ == '"')
+        return SkipString();
+    if (*p_ != '{' && *p_ != '[') {
+        // number, true, false or null
+        const char *begin = p_;
+        while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']'
+               && *p_ != ' ' && *p_ != '\t' && *p_ != '\n' && *p_ != '\r')
+            ++p_;
+        return p_ != begin;
+    }
+    // brackets are only counted, the decoder of the slice checks that they match
+    int depth = 0;
+    while (p_ < end_) {
+        char c = *p_;
+        if (c == '"') {
+            if (!SkipString())
+                return false;
+            continue;
+        }
+        ++p_;
+        if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool StashScanner::ScanItems(const ItemCallback &on_item) {
+    if (!Consume('['))
+        return false;
+    if (Consume(']'))
+        return true;
+    do {
+        SkipSpace();
+        const char *begin = p_;
+        if (!SkipValue())
+            return false;
+        on_item(begin, p_ - begin);
+    } while (Consume(','));
+    return Consume(']');
+}
+
+bool StashScanner::Scan(const ItemCallback &on_item) {
+    if (!Consume('{'))
+        return false;
+    if (Consume('}'))
+        return true;
+    do {
+        SkipSpace();
+        std::string key;
+        if (!ReadString(&key) || !Consume(':'))
+            return false;
+        if (key == "error") {
+            has_error_ = true;
+            return false;
+        }
+        if (key == "items") {
+            if (!ScanItems(on_item))
+                return false;
+            continue;
+        }
+        SkipSpace();
+        const char *begin = p_;
+        if (!SkipValue())
+            return false;
+        if (key == "tabs" && !Json::Reader().parse(begin, p_, tabs_, false))
+            return false;
+    } while (Consume(','));
+    return Consume('}');
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "jsoncpp/json.h"
+
+/*
+ * Walks a stash tab response in place without building a DOM for it.
+ * Every element of the top level "items" array is handed out as a slice
+ * of the buffer, so items can be decoded one at a time and the slice kept
+ * as their raw JSON. Only "tabs" is decoded as a whole.
+ */
+class StashScanner {
+public:
+    typedef std::function<void(const char *begin, size_t size)> ItemCallback;
+    StashScanner(const char *data, size_t size);
+    // false if the response is malformed or has an "error"
+    bool Scan(const ItemCallback &on_item);
+    bool has_error() const { return has_error_; }
+    // null unless the response had "tabs"
+    const Json::Value &tabs() const { return tabs_; }
+private:
+    void SkipSpace();
+    bool Consume(char c);
+    // Reads a string without decoding escapes, good enough to compare keys
+    bool ReadString(std::string *value);
+    bool SkipString();
+    bool SkipValue();
+    bool ScanItems(const ItemCallback &on_item);
+
+    const char *p_, *end_;
+    bool has_error_;
+    Json::Value tabs_;
+};
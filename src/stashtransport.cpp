@@ -0,0 +1,291 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stashtransport.h"
+
+#include <QDir>
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QSaveFile>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "QsLog.h"
+
+const char *STASH_MANIFEST = "manifest.json";
+// what the server answers when we're going too fast
+const char *THROTTLED_RESPONSE = "{\"error\":{\"message\":\"You are requesting stashes frequently. Please try again later.\"}}";
+// tabs that are missing from the recording are replayed as empty
+const char *EMPTY_RESPONSE = "{\"numTabs\":0,\"items\":[]}";
+// used when the recording has no latency for a response
+const int DEFAULT_REPLAY_LATENCY = 100;
+
+// identifies the tab, character or list that was requested
+static std::string RequestKey(const QNetworkRequest &request) {
+    return request.url().toString().toStdString();
+}
+
+// recordings made before the switch to https still match
+static std::string ReplayKey(const QUrl &url) {
+    return url.toString(QUrl::RemoveScheme).toStdString();
+}
+
+// value is only set if all of text is a number
+template<typename T>
+static bool ParseValue(const std::string &text, T *value) {
+    std::istringstream in(text);
+    T result;
+    if (!(in >> result) || !in.eof())
+        return false;
+    *value = result;
+    return true;
+}
+
+StashTransport *StashTransport::Create(QNetworkAccessManager *network_manager) {
+    QString replay = qgetenv("ACQUISITION_REPLAY_STASH");
+    if (!replay.isEmpty()) {
+        ReplayOptions options = ReplayOptions::Parse(qgetenv("ACQUISITION_REPLAY_OPTIONS").constData());
+        ReplayTransport *transport = new ReplayTransport(options);
+        if (transport->Load(replay)) {
+            QLOG_INFO() << "Replaying stash responses from" << replay;
+            return transport;
+        }
+        delete transport;
+        QLOG_ERROR() << "Failed to read the stash recording in" << replay << "- fetching from the network instead";
+    }
+    StashTransport *network = new NetworkTransport(network_manager);
+    QString record = qgetenv("ACQUISITION_RECORD_STASH");
+    if (!record.isEmpty()) {
+        QLOG_INFO() << "Recording stash responses to" << record;
+        return new RecordingTransport(network, record);
+    }
+    return network;
+}
+
+NetworkTransport::NetworkTransport(QNetworkAccessManager *network_manager):
+    network_manager_(network_manager)
+{}
+
+QNetworkReply *NetworkTransport::Fetch(const QNetworkRequest &request) {
+    return network_manager_->get(request);
+}
+
+RecordingTransport::RecordingTransport(StashTransport *inner, const QString &directory):
+    inner_(inner),
+    directory_(directory),
+    manifest_(Json::arrayValue)
+{
+    QDir dir(directory_);
+    if (!dir.exists() && !dir.mkpath("."))
+        QLOG_ERROR() << "Failed to create" << directory_;
+    clock_.start();
+}
+
+RecordingTransport::~RecordingTransport() {
+    delete inner_;
+}
+
+QNetworkReply *RecordingTransport::Fetch(const QNetworkRequest &request) {
+    QNetworkReply *reply = inner_->Fetch(request);
+    started_[reply] = clock_.elapsed();
+    // connected before the caller's slot, so the body can still be peeked
+    connect(reply, SIGNAL(finished()), this, SLOT(OnReplyFinished()));
+    connect(reply, SIGNAL(destroyed(QObject*)), this, SLOT(OnReplyDestroyed(QObject*)));
+    return reply;
+}
+
+void RecordingTransport::OnReplyFinished() {
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(QObject::sender());
+    auto it = started_.find(reply);
+    if (it == started_.end())
+        return;
+    qint64 started = it->second;
+    started_.erase(it);
+
+    QString file = QString("%1.json").arg(manifest_.size(), 5, 10, QChar('0'));
+    QSaveFile out(QDir(directory_).filePath(file));
+    if (!out.open(QIODevice::WriteOnly) || out.write(reply->peek(reply->bytesAvailable())) < 0 || !out.commit()) {
+        QLOG_ERROR() << "Failed to record" << reply->url().toString() << "into" << out.fileName();
+        return;
+    }
+
+    Json::Value entry;
+    entry["file"] = file.toStdString();
+    entry["url"] = RequestKey(reply->request());
+    entry["started"] = static_cast<Json::Int64>(started);
+    entry["latency"] = static_cast<Json::Int64>(clock_.elapsed() - started);
+    manifest_.append(entry);
+    SaveManifest();
+}
+
+void RecordingTransport::OnReplyDestroyed(QObject *reply) {
+    // aborted before finishing, nothing to record
+    started_.erase(static_cast<QNetworkReply*>(reply));
+}
+
+void RecordingTransport::SaveManifest() {
+    QSaveFile out(QDir(directory_).filePath(STASH_MANIFEST));
+    std::string json = Json::StyledWriter().write(manifest_);
+    if (!out.open(QIODevice::WriteOnly) || out.write(json.c_str(), json.size()) < 0 || !out.commit())
+        QLOG_ERROR() << "Failed to write" << out.fileName();
+}
+
+ReplayOptions::ReplayOptions():
+    latency(-1),
+    jitter(0),
+    limit(0),
+    window(60),
+    error_rate(0),
+    seed(0)
+{}
+
+ReplayOptions ReplayOptions::Parse(const std::string &spec) {
+    ReplayOptions options;
+    std::stringstream ss(spec);
+    std::string option;
+    while (std::getline(ss, option, ',')) {
+        size_t eq = option.find('=');
+        if (eq == std::string::npos) {
+            QLOG_WARN() << "Ignoring replay option" << option.c_str();
+            continue;
+        }
+        std::string key = option.substr(0, eq);
+        std::string value = option.substr(eq + 1);
+        bool ok = true;
+        if (key == "latency") {
+            ok = ParseValue(value, &options.latency);
+        } else if (key == "jitter") {
+            ok = ParseValue(value, &options.jitter);
+        } else if (key == "limit") {
+            size_t slash = value.find('/');
+            int limit, window = options.window;
+            ok = ParseValue(value.substr(0, slash), &limit)
+                && (slash == std::string::npos || ParseValue(value.substr(slash + 1), &window));
+            if (ok) {
+                options.limit = limit;
+                options.window = window;
+            }
+        } else if (key == "errors") {
+            ok = ParseValue(value, &options.error_rate);
+        } else if (key == "seed") {
+            ok = ParseValue(value, &options.seed);
+        } else {
+            QLOG_WARN() << "Unknown replay option" << key.c_str();
+        }
+        if (!ok)
+            QLOG_WARN() << "Ignoring malformed replay option" << option.c_str();
+    }
+    return options;
+}
+
+ReplayTransport::ReplayTransport(const ReplayOptions &options):
+    options_(options),
+    random_(options.seed)
+{
+    clock_.start();
+}
+
+bool ReplayTransport::Load(const QString &directory) {
+    QDir dir(directory);
+    QFile manifest_file(dir.filePath(STASH_MANIFEST));
+    Json::Value manifest;
+    if (!manifest_file.open(QIODevice::ReadOnly) || !Json::Reader().parse(manifest_file.readAll().constData(), manifest)
+            || !manifest.isArray())
+        return false;
+    for (auto &entry : manifest) {
+        QFile file(dir.filePath(entry["file"].asCString()));
+        if (!file.open(QIODevice::ReadOnly)) {
+            QLOG_WARN() << "Recorded response" << file.fileName() << "is missing";
+            continue;
+        }
+        Response response;
+        response.body = file.readAll();
+        response.latency = entry.isMember("latency") ? entry["latency"].asInt() : DEFAULT_REPLAY_LATENCY;
+        responses_[ReplayKey(QUrl(entry["url"].asCString()))].push_back(response);
+    }
+    QLOG_INFO() << "Loaded" << manifest.size() << "recorded responses for" << responses_.size() << "requests";
+    return true;
+}
+
+bool ReplayTransport::Throttled() {
+    if (options_.limit <= 0)
+        return false;
+    qint64 now = clock_.elapsed();
+    while (!requests_.empty() && requests_.front() <= now - options_.window * 1000)
+        requests_.pop_front();
+    requests_.push_back(now);
+    return requests_.size() > static_cast<size_t>(options_.limit);
+}
+
+QNetworkReply *ReplayTransport::Fetch(const QNetworkRequest &request) {
+    std::string key = ReplayKey(request.url());
+
+    QByteArray body;
+    int latency = options_.latency >= 0 ? options_.latency : DEFAULT_REPLAY_LATENCY;
+    auto it = responses_.find(key);
+    if (it != responses_.end()) {
+        size_t &next = next_[key];
+        const Response &response = it->second[next];
+        next = (next + 1) % it->second.size();
+        body = response.body;
+        if (options_.latency < 0)
+            latency = response.latency;
+    } else {
+        QLOG_WARN() << key.c_str() << "is not in the recording, replaying it as empty";
+        body = EMPTY_RESPONSE;
+    }
+    if (options_.jitter > 0)
+        latency += std::uniform_int_distribution<int>(0, options_.jitter)(random_);
+    bool error = options_.error_rate > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < options_.error_rate;
+    if (Throttled() || error)
+        body = THROTTLED_RESPONSE;
+    return new CannedReply(request, body, latency);
+}
+
+CannedReply::CannedReply(const QNetworkRequest &request, const QByteArray &body, int delay):
+    body_(body),
+    offset_(0)
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    QTimer::singleShot(std::max(delay, 0), this, SLOT(Finish()));
+}
+
+qint64 CannedReply::bytesAvailable() const {
+    return body_.size() - offset_ + QIODevice::bytesAvailable();
+}
+
+qint64 CannedReply::readData(char *data, qint64 max_size) {
+    qint64 size = std::min(max_size, body_.size() - offset_);
+    if (size <= 0)
+        return -1;
+    memcpy(data, body_.constData() + offset_, size);
+    offset_ += size;
+    return size;
+}
+
+void CannedReply::Finish() {
+    emit readyRead();
+    setFinished(true);
+    emit finished();
+}
@@ -0,0 +1,150 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QString>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "jsoncpp/json.h"
+
+class QNetworkAccessManager;
+
+/*
+ * Where ItemsManager gets stash tabs and character inventories from. The default is
+ * the network; for offline benchmarking and testing the responses can be
+ * recorded to a directory and replayed later, see Create.
+ */
+class StashTransport : public QObject {
+    Q_OBJECT
+public:
+    virtual ~StashTransport() {}
+    // The caller owns the reply, it emits finished() like any QNetworkReply
+    virtual QNetworkReply *Fetch(const QNetworkRequest &request) = 0;
+    /*
+     * Picks the transport based on the environment:
+     *   ACQUISITION_RECORD_STASH=dir   fetch from the network and record into dir
+     *   ACQUISITION_REPLAY_STASH=dir   replay a recording from dir
+     *   ACQUISITION_REPLAY_OPTIONS     see ReplayOptions::Parse
+     * Otherwise requests simply go through network_manager.
+     */
+    static StashTransport *Create(QNetworkAccessManager *network_manager);
+};
+
+class NetworkTransport : public StashTransport {
+    Q_OBJECT
+public:
+    explicit NetworkTransport(QNetworkAccessManager *network_manager);
+    QNetworkReply *Fetch(const QNetworkRequest &request);
+private:
+    QNetworkAccessManager *network_manager_;
+};
+
+/*
+ * Writes every response into directory as NNNNN.json together with
+ * manifest.json listing the requested url, when the request was sent and how
+ * long it took to complete.
+ */
+class RecordingTransport : public StashTransport {
+    Q_OBJECT
+public:
+    RecordingTransport(StashTransport *inner, const QString &directory);
+    ~RecordingTransport();
+    QNetworkReply *Fetch(const QNetworkRequest &request);
+private slots:
+    void OnReplyFinished();
+    void OnReplyDestroyed(QObject *reply);
+private:
+    void SaveManifest();
+
+    StashTransport *inner_;
+    QString directory_;
+    QElapsedTimer clock_;
+    // reply -> when it was sent
+    std::map<QNetworkReply*, qint64> started_;
+    Json::Value manifest_;
+};
+
+struct ReplayOptions {
+    ReplayOptions();
+    // "latency=200,jitter=50,limit=45/60,errors=0.05,seed=1", all optional
+    static ReplayOptions Parse(const std::string &spec);
+    // milliseconds, -1 replays the recorded latencies
+    int latency;
+    // up to this many milliseconds are randomly added to every reply
+    int jitter;
+    // more than limit requests within window seconds get the "too many requests" error, 0 disables
+    int limit;
+    int window;
+    // probability of replacing a response with the error
+    double error_rate;
+    unsigned seed;
+};
+
+/*
+ * Replays a directory written by RecordingTransport. Requests that were recorded
+ * several times (e.g. a few refreshes) cycle through their responses.
+ */
+class ReplayTransport : public StashTransport {
+    Q_OBJECT
+public:
+    explicit ReplayTransport(const ReplayOptions &options);
+    // reads the recording in directory, false if there's no readable manifest
+    bool Load(const QString &directory);
+    QNetworkReply *Fetch(const QNetworkRequest &request);
+private:
+    struct Response {
+        QByteArray body;
+        int latency;
+    };
+    bool Throttled();
+
+    ReplayOptions options_;
+    // by request url
+    std::map<std::string, std::vector<Response>> responses_;
+    std::map<std::string, size_t> next_;
+    std::mt19937 random_;
+    QElapsedTimer clock_;
+    std::deque<qint64> requests_;
+};
+
+// QNetworkReply with a fixed body, finishes after delay milliseconds
+class CannedReply : public QNetworkReply {
+    Q_OBJECT
+public:
+    CannedReply(const QNetworkRequest &request, const QByteArray &body, int delay);
+    void abort() {}
+    qint64 bytesAvailable() const;
+    bool isSequential() const { return true; }
+protected:
+    qint64 readData(char *data, qint64 max_size);
+private slots:
+    void Finish();
+private:
+    QByteArray body_;
+    qint64 offset_;
+};
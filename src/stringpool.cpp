@@ -0,0 +1,62 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stringpool.h"
+
+#include <unordered_set>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace {
+
+// Elements of unordered_set are never moved, so handles stay valid forever.
+class StringPool {
+public:
+    StringPool() {
+        empty_ = Intern("");
+    }
+    const std::string *Intern(const std::string &value) {
+        QMutexLocker locker(&mutex_);
+        return &*strings_.insert(value).first;
+    }
+    const std::string *empty() const { return empty_; }
+private:
+    QMutex mutex_;
+    std::unordered_set<std::string> strings_;
+    const std::string *empty_;
+};
+
+StringPool &pool() {
+    static StringPool pool;
+    return pool;
+}
+
+}
+
+IString::IString():
+    value_(pool().empty())
+{}
+
+IString::IString(const std::string &value):
+    value_(pool().Intern(value))
+{}
+
+IString::IString(const char *value):
+    value_(pool().Intern(value))
+{}
@@ -0,0 +1,55 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+/*
+ * Handle to a string stored in a global, never shrinking pool.
+ * Equal strings always share one handle, so copying and comparing
+ * handles is just a pointer operation. Used for item data that repeats
+ * a lot across items: names, type lines, mods, property names and values.
+ * Interning is thread-safe, reading through a handle needs no locking.
+ */
+class IString {
+public:
+    IString();
+    explicit IString(const std::string &value);
+    explicit IString(const char *value);
+    const std::string &str() const { return *value_; }
+    const char *c_str() const { return value_->c_str(); }
+    bool empty() const { return value_->empty(); }
+    operator const std::string&() const { return *value_; }
+    bool operator==(const IString &other) const { return value_ == other.value_; }
+    bool operator!=(const IString &other) const { return value_ != other.value_; }
+    // orders by identity, not alphabetically
+    bool operator<(const IString &other) const { return value_ < other.value_; }
+    size_t hash() const { return std::hash<const std::string*>()(value_); }
+private:
+    const std::string *value_;
+};
+
+namespace std {
+template<>
+struct hash<IString> {
+    size_t operator()(const IString &value) const { return value.hash(); }
+};
+}
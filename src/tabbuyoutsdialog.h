@@ -28,7 +28,7 @@ class TabBuyoutsDialog;
 }
 
 class MainWindow;
-class QSignalMapper;
+class TabBuyoutsModel;
 
 class TabBuyoutsDialog : public QDialog
 {
@@ -41,11 +41,9 @@ public:
 
 private slots:
     void on_pushButton_clicked();
-    void OnBuyoutChanged(int row);
 
 private:
     MainWindow *app_;
     Ui::TabBuyoutsDialog *ui;
-    std::vector<std::string> tab_titles_;
-    QSignalMapper *signal_mapper_;
+    TabBuyoutsModel *model_;
 };
@@ -0,0 +1,161 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tabbuyoutsmodel.h"
+
+#include <QComboBox>
+#include <QLineEdit>
+#include <unordered_set>
+
+#include "buyoutmanager.h"
+#include "mainwindow.h"
+#include "util.h"
+
+TabBuyoutsModel::TabBuyoutsModel(QObject *parent, MainWindow *app):
+    QAbstractTableModel(parent),
+    app_(app)
+{}
+
+// the dialog is created before MainWindow has its BuyoutManager
+BuyoutManager *TabBuyoutsModel::buyout_manager() const {
+    return app_->buyout_manager();
+}
+
+void TabBuyoutsModel::SetTabs(const std::vector<std::string> &tabs) {
+    beginResetModel();
+    tabs_.clear();
+    std::unordered_set<std::string> seen;
+    for (auto &tab : tabs)
+        if (seen.insert(tab).second)
+            tabs_.push_back(tab);
+    endResetModel();
+}
+
+int TabBuyoutsModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(tabs_.size());
+}
+
+int TabBuyoutsModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : TAB_COLUMN_COUNT;
+}
+
+QVariant TabBuyoutsModel::data(const QModelIndex &index, int role) const {
+    if (role != Qt::DisplayRole && role != Qt::EditRole)
+        return QVariant();
+    const std::string &tab = tabs_[index.row()];
+    if (index.column() == TAB_CAPTION)
+        return QString(tab.c_str());
+    if (!buyout_manager()->ExistsTab(tab)) {
+        if (index.column() == TAB_BUYOUT_TYPE)
+            return role == Qt::EditRole ? QVariant(static_cast<int>(BUYOUT_TYPE_NONE)) : QVariant(BuyoutTypeAsString[BUYOUT_TYPE_NONE].c_str());
+        return QVariant();
+    }
+    Buyout bo = buyout_manager()->GetTab(tab);
+    switch (index.column()) {
+    case TAB_BUYOUT_TYPE:
+        return role == Qt::EditRole ? QVariant(static_cast<int>(bo.type)) : QVariant(BuyoutTypeAsString[bo.type].c_str());
+    case TAB_BUYOUT_CURRENCY:
+        return role == Qt::EditRole ? QVariant(static_cast<int>(bo.currency)) : QVariant(CurrencyAsString[bo.currency].c_str());
+    case TAB_BUYOUT_VALUE:
+        return QString::number(bo.value);
+    }
+    return QVariant();
+}
+
+bool TabBuyoutsModel::setData(const QModelIndex &index, const QVariant &value, int role) {
+    if (role != Qt::EditRole || index.column() == TAB_CAPTION)
+        return false;
+    const std::string &tab = tabs_[index.row()];
+    Buyout bo = { 0, BUYOUT_TYPE_NONE, CURRENCY_NONE };
+    if (buyout_manager()->ExistsTab(tab))
+        bo = buyout_manager()->GetTab(tab);
+    switch (index.column()) {
+    case TAB_BUYOUT_TYPE:
+        bo.type = static_cast<BuyoutType>(value.toInt());
+        break;
+    case TAB_BUYOUT_CURRENCY:
+        bo.currency = static_cast<Currency>(value.toInt());
+        break;
+    case TAB_BUYOUT_VALUE:
+        bo.value = value.toDouble();
+        break;
+    }
+    if (bo.type == BUYOUT_TYPE_NONE)
+        buyout_manager()->DeleteTab(tab);
+    else
+        buyout_manager()->SetTab(tab, bo);
+    app_->OnPricesChanged();
+    // the type decides whether the other cells are shown and editable
+    emit dataChanged(this->index(index.row(), TAB_BUYOUT_TYPE), this->index(index.row(), TAB_BUYOUT_VALUE));
+    return true;
+}
+
+Qt::ItemFlags TabBuyoutsModel::flags(const QModelIndex &index) const {
+    Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+    if (index.column() == TAB_BUYOUT_TYPE
+            || (index.column() != TAB_CAPTION && buyout_manager()->ExistsTab(tabs_[index.row()])))
+        flags |= Qt::ItemIsEditable;
+    return flags;
+}
+
+TabBuyoutsDelegate::TabBuyoutsDelegate(QObject *parent):
+    QStyledItemDelegate(parent)
+{}
+
+QWidget *TabBuyoutsDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &option,
+                                          const QModelIndex &index) const {
+    QComboBox *combobox;
+    switch (index.column()) {
+    case TAB_BUYOUT_TYPE:
+        combobox = new QComboBox(parent);
+        Util::PopulateBuyoutTypeComboBox(combobox);
+        break;
+    case TAB_BUYOUT_CURRENCY:
+        combobox = new QComboBox(parent);
+        Util::PopulateBuyoutCurrencyComboBox(combobox);
+        break;
+    case TAB_BUYOUT_VALUE:
+        return new QLineEdit(parent);
+    default:
+        return QStyledItemDelegate::createEditor(parent, option, index);
+    }
+    connect(combobox, SIGNAL(activated(int)), this, SLOT(OnEditorChanged()));
+    return combobox;
+}
+
+void TabBuyoutsDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const {
+    QVariant value = index.data(Qt::EditRole);
+    if (QComboBox *combobox = qobject_cast<QComboBox*>(editor))
+        combobox->setCurrentIndex(value.toInt());
+    else if (QLineEdit *line_edit = qobject_cast<QLineEdit*>(editor))
+        line_edit->setText(value.toString());
+}
+
+void TabBuyoutsDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const {
+    if (QComboBox *combobox = qobject_cast<QComboBox*>(editor))
+        model->setData(index, combobox->currentIndex());
+    else if (QLineEdit *line_edit = qobject_cast<QLineEdit*>(editor))
+        model->setData(index, line_edit->text().toDouble());
+}
+
+void TabBuyoutsDelegate::OnEditorChanged() {
+    QWidget *editor = qobject_cast<QWidget*>(sender());
+    emit commitData(editor);
+    emit closeEditor(editor);
+}
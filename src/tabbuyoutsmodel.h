@@ -0,0 +1,70 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QStyledItemDelegate>
+#include <string>
+#include <vector>
+
+class BuyoutManager;
+class MainWindow;
+
+enum TabBuyoutsColumn {
+    TAB_CAPTION,
+    TAB_BUYOUT_TYPE,
+    TAB_BUYOUT_CURRENCY,
+    TAB_BUYOUT_VALUE,
+    TAB_COLUMN_COUNT
+};
+
+/*
+ * Buyouts of tabs, one row per distinct caption. Cells are read from and
+ * written to the BuyoutManager directly, the model only keeps the captions.
+ */
+class TabBuyoutsModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    TabBuyoutsModel(QObject *parent, MainWindow *app);
+    // captions in tab order, tabs with the same caption share a row
+    void SetTabs(const std::vector<std::string> &tabs);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+private:
+    BuyoutManager *buyout_manager() const;
+    MainWindow *app_;
+    std::vector<std::string> tabs_;
+};
+
+// Editors for TabBuyoutsModel cells, only the cell being edited has one
+class TabBuyoutsDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    explicit TabBuyoutsDelegate(QObject *parent);
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
+private slots:
+    // combo boxes commit as soon as something is picked
+    void OnEditorChanged();
+};
@@ -0,0 +1,76 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trigramindex.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "bitmap.h"
+
+uint32_t TrigramIndex::Key(const char *s) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(s[0])) << 16)
+        | (static_cast<uint32_t>(static_cast<unsigned char>(s[1])) << 8)
+        | static_cast<unsigned char>(s[2]);
+}
+
+void TrigramIndex::Build(const std::vector<std::string> &documents) {
+    postings_.clear();
+    std::vector<uint32_t> keys;
+    for (size_t row = 0; row < documents.size(); ++row) {
+        const std::string &document = documents[row];
+        keys.clear();
+        for (size_t i = 0; i + 3 <= document.size(); ++i)
+            keys.push_back(Key(&document[i]));
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        // rows are visited in order so every posting list stays sorted
+        for (auto key : keys)
+            postings_[key].push_back(row);
+    }
+}
+
+bool TrigramIndex::Candidates(const std::string &query, Bitmap *result) const {
+    if (query.size() < 3)
+        return false;
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (size_t i = 0; i + 3 <= query.size(); ++i) {
+        auto it = postings_.find(Key(&query[i]));
+        // some trigram is nowhere, nothing can match
+        if (it == postings_.end())
+            return true;
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+        return a->size() != b->size() ? a->size() < b->size() : a < b;
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    // intersect starting from the rarest trigram
+    std::vector<uint32_t> rows = *lists[0], next;
+    for (size_t i = 1; i < lists.size() && !rows.empty(); ++i) {
+        next.clear();
+        std::set_intersection(rows.begin(), rows.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(next));
+        rows.swap(next);
+    }
+    for (auto row : rows)
+        result->Set(row);
+    return true;
+}
@@ -0,0 +1,44 @@
+/*
+    Copyright 2014 Ilya Zhuravlev
+
+    This file is part of Acquisition.
+
+    Acquisition is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Acquisition is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Acquisition.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Bitmap;
+
+/*
+ * Inverted index from every 3-byte substring to the documents (rows)
+ * containing it. A substring query can only match rows that contain all
+ * of its trigrams, which is usually a handful, so only those need to be
+ * verified with a real substring search.
+ */
+class TrigramIndex {
+public:
+    void Build(const std::vector<std::string> &documents);
+    // Sets rows that may contain query. Returns false if query is shorter
+    // than a trigram, then every row is a candidate and result is untouched.
+    bool Candidates(const std::string &query, Bitmap *result) const;
+private:
+    static uint32_t Key(const char *s);
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings_;
+};
@@ -39,7 +39,8 @@ double Util::AverageDamage(const std::string &s) {
 }
 
 void Util::PopulateBuyoutTypeComboBox(QComboBox *combobox) {
-    combobox->addItems(QStringList({"No price", "Buyout", "Fixed price"}));
+    for (auto &type : BuyoutTypeAsString)
+        combobox->addItem(QString(type.c_str()));
 }
 
 void Util::PopulateBuyoutCurrencyComboBox(QComboBox *combobox) {